@@ -0,0 +1,126 @@
+#include "parallel_decompress.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+#include <bzlib.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+// ~60 MB of XML, large enough for dozens of bzip2 blocks
+const std::string &SyntheticXml() {
+    static const std::string xml = MakeSyntheticOsmXml(MakeSyntheticRoutes(20000, 32, SyntheticBounds()));
+    return xml;
+}
+
+std::string CompressBzip2(const std::string &data) {
+    std::string out(data.size() + data.size() / 100 + 600, '\0');
+    auto size = static_cast<unsigned>(out.size());
+    if (BZ2_bzBuffToBuffCompress(out.data(), &size, const_cast<char *>(data.data()),
+                                 static_cast<unsigned>(data.size()), 9, 0, 0) != BZ_OK) {
+        throw std::runtime_error("bzip2 compression failed");
+    }
+    out.resize(size);
+    return out;
+}
+
+// `memberSize` 0 writes a single member (gzip); otherwise one member per
+// `memberSize` input bytes (bgzip / pigz --independent style)
+std::string CompressGzip(const std::string &data, size_t memberSize) {
+    if (memberSize == 0) {
+        memberSize = data.size();
+    }
+    std::string out;
+    for (size_t offset = 0; offset < data.size(); offset += memberSize) {
+        const size_t count = std::min(memberSize, data.size() - offset);
+        z_stream zs{};
+        deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8, Z_DEFAULT_STRATEGY);
+        std::string member(deflateBound(&zs, static_cast<uLong>(count)) + 32, '\0');
+        zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data() + offset));
+        zs.avail_in = static_cast<uInt>(count);
+        zs.next_out = reinterpret_cast<Bytef *>(member.data());
+        zs.avail_out = static_cast<uInt>(member.size());
+        deflate(&zs, Z_FINISH);
+        member.resize(zs.total_out);
+        deflateEnd(&zs);
+        out += member;
+    }
+    return out;
+}
+
+DecompressInputSource MemorySource(const std::string &data) {
+    return [&data, offset = size_t{0}](char *buffer, size_t size) mutable {
+        size = std::min(size, data.size() - offset);
+        std::memcpy(buffer, data.data() + offset, size);
+        offset += size;
+        return size;
+    };
+}
+
+template <typename ReaderT> void RunReader(benchmark::State &state, const std::string &compressed) {
+    const auto threads = static_cast<size_t>(state.range(0));
+    for (auto _ : state) {
+        ReaderT reader(MemorySource(compressed), threads);
+        size_t total = 0;
+        for (auto piece = reader.Read(); !piece.empty(); piece = reader.Read()) {
+            total += piece.size();
+        }
+        if (total != SyntheticXml().size()) {
+            state.SkipWithError("decompressed size mismatch");
+            break;
+        }
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * SyntheticXml().size()));
+    state.counters["threads"] = static_cast<double>(threads);
+}
+
+} // namespace
+
+// Single-threaded libbz2 streaming decode, what osmium does for .osm.bz2
+static void BM_Bzip2Reference(benchmark::State &state) {
+    static const std::string compressed = CompressBzip2(SyntheticXml());
+    std::string output(1024 * 1024, '\0');
+    for (auto _ : state) {
+        bz_stream bz{};
+        BZ2_bzDecompressInit(&bz, 0, 0);
+        bz.next_in = const_cast<char *>(compressed.data());
+        bz.avail_in = static_cast<unsigned>(compressed.size());
+        int result = BZ_OK;
+        while (result == BZ_OK) {
+            bz.next_out = output.data();
+            bz.avail_out = static_cast<unsigned>(output.size());
+            result = BZ2_bzDecompress(&bz);
+            benchmark::DoNotOptimize(output.data());
+        }
+        BZ2_bzDecompressEnd(&bz);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * SyntheticXml().size()));
+}
+BENCHMARK(BM_Bzip2Reference)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Args: {threads}
+static void BM_ParallelBzip2(benchmark::State &state) {
+    static const std::string compressed = CompressBzip2(SyntheticXml());
+    RunReader<ParallelBzip2Reader>(state, compressed);
+}
+BENCHMARK(BM_ParallelBzip2)->ArgsProduct({{1, 2, 4, 8}})->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Single-member gzip: nothing to split, measures the streaming fallback
+static void BM_ParallelGzipSingleMember(benchmark::State &state) {
+    static const std::string compressed = CompressGzip(SyntheticXml(), 0);
+    RunReader<ParallelGzipReader>(state, compressed);
+}
+BENCHMARK(BM_ParallelGzipSingleMember)->ArgsProduct({{1, 4}})->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// 1 MB members, as written by bgzip or pigz --independent
+static void BM_ParallelGzipMultiMember(benchmark::State &state) {
+    static const std::string compressed = CompressGzip(SyntheticXml(), 1024 * 1024);
+    RunReader<ParallelGzipReader>(state, compressed);
+}
+BENCHMARK(BM_ParallelGzipMultiMember)->ArgsProduct({{1, 2, 4, 8}})->UseRealTime()->Unit(benchmark::kMillisecond);
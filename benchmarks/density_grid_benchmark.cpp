@@ -0,0 +1,28 @@
+#include "map_style.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+// Args: {routes, threads}. Load-time density pyramid of streets of 20 nodes
+// crossing the synthetic bounds, from a 1024-cell grid down to one cell. Each
+// segment crosses about 50 cells of the finest grid. Items are segments.
+static void BM_BuildDensityPyramid(benchmark::State &state) {
+    const auto bounds = SyntheticBounds();
+    OSMLoader::OSMData data;
+    data.first = MakeSyntheticRoutes(static_cast<size_t>(state.range(0)), 20, bounds);
+    size_t segments = 0;
+    for (const auto &route : data.first) {
+        segments += route.second.nodes.size() - 1;
+    }
+
+    const auto threads = static_cast<size_t>(state.range(1));
+    for (auto _ : state) {
+        auto pyramid = BuildDensityPyramid(data, bounds, Projection::WebMercator, threads);
+        benchmark::DoNotOptimize(pyramid.levels.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * segments));
+}
+BENCHMARK(BM_BuildDensityPyramid)
+    ->ArgsProduct({{10000, 100000}, {1, 2, 4, 8}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,124 @@
+#include "feature_index.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <random>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+// Search radius of an 8 pixel pick on a 1000 pixel wide view of the data
+constexpr double PICK_FRACTION = 8.0 / 1000.0;
+constexpr size_t QUERY_COUNT = 4096;
+
+const OSMLoader::OSMData &SyntheticData(size_t routeCount) {
+    static std::unordered_map<size_t, OSMLoader::OSMData> cache;
+    auto &data = cache[routeCount];
+    if (data.first.empty()) {
+        data.first = MakeSyntheticRoutes(routeCount, 32, SyntheticBounds());
+    }
+    return data;
+}
+
+std::vector<osmium::Location> QueryPoints() {
+    const auto bounds = SyntheticBounds();
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<double> lon(bounds.left(), bounds.right());
+    std::uniform_real_distribution<double> lat(bounds.bottom(), bounds.top());
+    std::vector<osmium::Location> points;
+    for (size_t i = 0; i < QUERY_COUNT; ++i) {
+        points.emplace_back(lon(rng), lat(rng));
+    }
+    return points;
+}
+
+// Reference answer: scan every segment. Returns the id and the distance in
+// units of the radius, or id 0 if nothing is in range.
+std::pair<osmium::object_id_type, double> ScanNearest(const OSMLoader::Id2Route &routes,
+                                                      const osmium::Location &location, double radiusLon,
+                                                      double radiusLat) {
+    std::pair<osmium::object_id_type, double> best{0, std::numeric_limits<double>::max()};
+    for (const auto &[id, route] : routes) {
+        for (size_t i = 1; i < route.nodes.size(); ++i) {
+            const double ax = (route.nodes[i - 1].lon() - location.lon()) / radiusLon;
+            const double ay = (route.nodes[i - 1].lat() - location.lat()) / radiusLat;
+            const double dx = (route.nodes[i].lon() - location.lon()) / radiusLon - ax;
+            const double dy = (route.nodes[i].lat() - location.lat()) / radiusLat - ay;
+            const double lengthSq = dx * dx + dy * dy;
+            const double t = lengthSq > 0.0 ? std::clamp(-(ax * dx + ay * dy) / lengthSq, 0.0, 1.0) : 0.0;
+            const double distance = std::hypot(ax + t * dx, ay + t * dy);
+            if (distance <= 1.0 && distance < best.second) {
+                best = {id, distance};
+            }
+        }
+    }
+    return best;
+}
+
+} // namespace
+
+// Args: {routes}. Build time of the grid for 32-vertex routes.
+static void BM_FeatureIndexBuild(benchmark::State &state) {
+    const auto &data = SyntheticData(static_cast<size_t>(state.range(0)));
+    size_t segments = 0;
+    for (auto _ : state) {
+        FeatureIndex index{data};
+        segments = index.SegmentCount();
+        benchmark::DoNotOptimize(segments);
+    }
+    state.counters["segments"] = static_cast<double>(segments);
+}
+BENCHMARK(BM_FeatureIndexBuild)->Arg(2000)->Arg(20000)->Unit(benchmark::kMillisecond);
+
+// Args: {routes}. Latency of one pick. Fails if any answer differs from a
+// scan of every segment.
+static void BM_FeatureIndexNearest(benchmark::State &state) {
+    const auto &data = SyntheticData(static_cast<size_t>(state.range(0)));
+    const auto bounds = SyntheticBounds();
+    const double radiusLon = (bounds.right() - bounds.left()) * PICK_FRACTION;
+    const double radiusLat = (bounds.top() - bounds.bottom()) * PICK_FRACTION;
+    const FeatureIndex index{data};
+    const auto points = QueryPoints();
+
+    for (size_t i = 0; i < 256; ++i) {
+        const auto hit = index.Nearest(points[i], radiusLon, radiusLat);
+        const auto [id, distance] = ScanNearest(data.first, points[i], radiusLon, radiusLat);
+        // The index stores float offsets, so only near-ties may resolve differently
+        const bool matches = hit.feature
+                                 ? (id != 0 && (hit.feature->id == id || std::abs(hit.distance - distance) < 1e-3))
+                                 : (id == 0 || distance > 1.0 - 1e-3);
+        if (!matches) {
+            state.SkipWithError("feature index disagrees with a full scan");
+            return;
+        }
+    }
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(index.Nearest(points[i++ % QUERY_COUNT], radiusLon, radiusLat));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FeatureIndexNearest)->Arg(2000)->Arg(20000)->Unit(benchmark::kMicrosecond);
+
+// Args: {routes}. What a pick costs without the index.
+static void BM_FeatureScanNearest(benchmark::State &state) {
+    const auto &data = SyntheticData(static_cast<size_t>(state.range(0)));
+    const auto bounds = SyntheticBounds();
+    const double radiusLon = (bounds.right() - bounds.left()) * PICK_FRACTION;
+    const double radiusLat = (bounds.top() - bounds.bottom()) * PICK_FRACTION;
+    const auto points = QueryPoints();
+
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(ScanNearest(data.first, points[i++ % QUERY_COUNT], radiusLon, radiusLat));
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_FeatureScanNearest)->Arg(2000)->Arg(20000)->Unit(benchmark::kMicrosecond);
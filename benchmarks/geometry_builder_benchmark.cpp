@@ -0,0 +1,72 @@
+#include "geometry_builder.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+// Build time of the chunked render buffers against the number of worker
+// threads. Args: {routes, threads}
+static void BM_GeometryBuilderBuild(benchmark::State &state) {
+    const auto bounds = SyntheticBounds();
+    const auto routes = MakeSyntheticRoutes(static_cast<size_t>(state.range(0)), 64, bounds);
+
+    GeometryBuilder builder(bounds);
+    for (const auto &entry : routes) {
+        builder.AddLineStrip(entry.second.nodes, {1.0f, 1.0f, 1.0f});
+    }
+
+    const auto threads = static_cast<size_t>(state.range(1));
+    size_t vertices = 0;
+    for (auto _ : state) {
+        auto geometry = builder.Build(threads);
+        vertices = geometry.vertices.size() / FLOATS_PER_VERTEX;
+        benchmark::DoNotOptimize(geometry.indices.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * vertices));
+    state.counters["threads"] = static_cast<double>(threads);
+}
+BENCHMARK(BM_GeometryBuilderBuild)
+    ->ArgsProduct({{10000, 100000}, {1, 2, 4, 8, 16}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Build time and VBO size with and without shared vertices. The streets of
+// a grid are cut into ways of two blocks, as in OSM, so ways share their end
+// nodes and cross at shared intersections. Args: {share}
+static void BM_GeometryBuilderShareVertices(benchmark::State &state) {
+    constexpr size_t NODES_BETWEEN = 4;
+    constexpr size_t NODES_PER_WAY = 2 * (NODES_BETWEEN + 1) + 1;
+    const auto bounds = SyntheticBounds();
+    const auto streets = MakeSyntheticRoadGrid(300, NODES_BETWEEN, bounds);
+    std::vector<OSMLoader::Coordinates> ways;
+    for (const auto &entry : streets) {
+        const auto &nodes = entry.second.nodes;
+        for (size_t first = 0; first + 1 < nodes.size(); first += NODES_PER_WAY - 1) {
+            const size_t last = std::min(nodes.size(), first + NODES_PER_WAY);
+            ways.emplace_back(nodes.begin() + static_cast<ptrdiff_t>(first),
+                              nodes.begin() + static_cast<ptrdiff_t>(last));
+        }
+    }
+
+    GeometryBuilder builder(bounds);
+    builder.SetShareVertices(state.range(0) != 0);
+    for (const auto &way : ways) {
+        builder.AddLineStrip(way, {1.0f, 1.0f, 1.0f});
+    }
+
+    size_t stripVertices = 0;
+    size_t vboBytes = 0;
+    for (auto _ : state) {
+        auto geometry = builder.Build();
+        stripVertices = geometry.stripVertexCount;
+        vboBytes = geometry.vertices.size() * sizeof(float);
+        benchmark::DoNotOptimize(geometry.indices.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * stripVertices));
+    state.counters["vboMB"] = static_cast<double>(vboBytes) / (1024.0 * 1024.0);
+    state.counters["vertices"] = static_cast<double>(vboBytes / (FLOATS_PER_VERTEX * sizeof(float)));
+}
+BENCHMARK(BM_GeometryBuilderShareVertices)->Arg(0)->Arg(1)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,345 @@
+#include "external_way_join.h"
+#include "geometry_builder.h"
+#include "osm_loader_detail.h"
+#include "parallel.h"
+#include "render_layers.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+constexpr size_t NODES_PER_WAY = 32;
+// Every 4th node of a way is shared with the previous way, like an
+// intersection, so some nodes belong to several ways
+constexpr size_t SHARED_NODE_STRIDE = 4;
+
+// Node ids of each way; way i has id i + 1
+std::vector<std::vector<osmium::object_id_type>> MakeWayNodeIds(size_t wayCount) {
+    std::vector<std::vector<osmium::object_id_type>> ways(wayCount);
+    osmium::object_id_type nextNodeId = 1;
+    for (size_t way = 0; way < wayCount; ++way) {
+        ways[way].reserve(NODES_PER_WAY);
+        for (size_t i = 0; i < NODES_PER_WAY; ++i) {
+            const bool shared = way > 0 && i % SHARED_NODE_STRIDE == 0;
+            ways[way].push_back(shared ? ways[way - 1][i + 1] : nextNodeId++);
+        }
+    }
+    return ways;
+}
+
+// What WayHandler builds: node -> (way, index in way)
+detail::Id2IdIndexMap MakeNode2Ways(const std::vector<std::vector<osmium::object_id_type>> &ways) {
+    detail::Id2IdIndexMap node2Ways;
+    for (size_t way = 0; way < ways.size(); ++way) {
+        for (size_t i = 0; i < ways[way].size(); ++i) {
+            node2Ways[ways[way][i]].emplace(static_cast<osmium::object_id_type>(way + 1), static_cast<int64_t>(i));
+        }
+    }
+    return node2Ways;
+}
+
+// One node callback of the node pass: the node's location goes to every way
+// position that references it
+struct NodeVisit {
+    osmium::object_id_type wayId;
+    int64_t index;
+    osmium::Location location;
+};
+
+// Visits in node id order (how extracts are sorted) or shuffled
+std::vector<NodeVisit> MakeNodeVisits(size_t wayCount, bool shuffled) {
+    const auto ways = MakeWayNodeIds(wayCount);
+    const auto node2Ways = MakeNode2Ways(ways);
+    const auto bounds = SyntheticBounds();
+
+    std::vector<osmium::object_id_type> nodeIds;
+    nodeIds.reserve(node2Ways.size());
+    for (const auto &entry : node2Ways) {
+        nodeIds.push_back(entry.first);
+    }
+    std::sort(nodeIds.begin(), nodeIds.end());
+    if (shuffled) {
+        std::shuffle(nodeIds.begin(), nodeIds.end(), std::mt19937{3});
+    }
+
+    std::vector<NodeVisit> visits;
+    for (const auto nodeId : nodeIds) {
+        const double t = static_cast<double>(nodeId % 1000) / 1000.0;
+        const osmium::Location location{bounds.left() + t * (bounds.right() - bounds.left()),
+                                        bounds.bottom() + t * (bounds.top() - bounds.bottom())};
+        for (const auto &way : node2Ways.at(nodeId)) {
+            visits.push_back({way.pairID, way.pairIndex, location});
+        }
+    }
+    return visits;
+}
+
+} // namespace
+
+// Args: {pairs}. Cost of hashing (way, index) pairs, the key of node2Ways' sets.
+static void BM_IdIndexPairHash(benchmark::State &state) {
+    std::vector<detail::IdIndexPair> pairs;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        pairs.emplace_back(i / static_cast<int64_t>(NODES_PER_WAY) + 1, i % static_cast<int64_t>(NODES_PER_WAY));
+    }
+    const detail::IdIndexPairHash hash;
+    for (auto _ : state) {
+        size_t combined = 0;
+        for (const auto &pair : pairs) {
+            combined += hash(pair);
+        }
+        benchmark::DoNotOptimize(combined);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_IdIndexPairHash)->Arg(1 << 10)->Arg(1 << 16)->Arg(1 << 20);
+
+// Args: {ways}. Building node2Ways the way WayHandler does, one emplace per way node.
+static void BM_Node2WaysInsert(benchmark::State &state) {
+    const auto ways = MakeWayNodeIds(static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        auto node2Ways = MakeNode2Ways(ways);
+        benchmark::DoNotOptimize(node2Ways.size());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(NODES_PER_WAY));
+}
+BENCHMARK(BM_Node2WaysInsert)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// Args: {ways, threads}. The way pass on several threads: workers split the
+// node refs of 64-way "buffers" into shards, then each thread inserts whole
+// shards into node2Ways. Compare with BM_Node2WaysInsert.
+static void BM_Node2WaysShardedInsert(benchmark::State &state) {
+    constexpr size_t WAYS_PER_BUFFER = 64;
+    const auto ways = MakeWayNodeIds(static_cast<size_t>(state.range(0)));
+    const auto threads = static_cast<size_t>(state.range(1));
+    const size_t bufferCount = (ways.size() + WAYS_PER_BUFFER - 1) / WAYS_PER_BUFFER;
+    for (auto _ : state) {
+        std::vector<detail::ShardedWayNodeRefs> partials(bufferCount);
+        ParallelFor(bufferCount, threads, [&](size_t buffer) {
+            const size_t end = std::min(ways.size(), (buffer + 1) * WAYS_PER_BUFFER);
+            for (size_t way = buffer * WAYS_PER_BUFFER; way < end; ++way) {
+                for (size_t i = 0; i < ways[way].size(); ++i) {
+                    const auto nodeID = ways[way][i];
+                    partials[buffer][detail::shardOf(nodeID)].push_back(
+                        {nodeID, static_cast<osmium::object_id_type>(way + 1), static_cast<int64_t>(i)});
+                }
+            }
+        });
+        detail::MappedWayData wayData;
+        detail::mergeWayNodeRefs(partials, wayData, threads);
+        benchmark::DoNotOptimize(wayData.node2Ways.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(NODES_PER_WAY));
+}
+BENCHMARK(BM_Node2WaysShardedInsert)
+    ->ArgsProduct({{10000, 100000}, {1, 2, 4, 8}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Args: {ways}. The node pass lookup: every node id of the file, in order,
+// including the half that no way references.
+static void BM_Node2WaysLookup(benchmark::State &state) {
+    const auto ways = MakeWayNodeIds(static_cast<size_t>(state.range(0)));
+    const auto node2Ways = MakeNode2Ways(ways);
+    const auto maxNodeId = static_cast<osmium::object_id_type>(node2Ways.size() * 2);
+    for (auto _ : state) {
+        size_t found = 0;
+        for (osmium::object_id_type nodeId = 1; nodeId <= maxNodeId; ++nodeId) {
+            if (auto it = node2Ways.find(nodeId); it != node2Ways.end()) {
+                for (const auto &way : it->second) {
+                    found += static_cast<size_t>(way.pairIndex);
+                }
+            }
+        }
+        benchmark::DoNotOptimize(found);
+    }
+    state.SetItemsProcessed(state.iterations() * maxNodeId);
+}
+BENCHMARK(BM_Node2WaysLookup)->Arg(1000)->Arg(10000)->Arg(100000)->Unit(benchmark::kMillisecond);
+
+// Args: {join memory in MB}. The out-of-core join on 100k ways (3.2M way
+// nodes, ~75 MB of references): add the way nodes, stream every node in id
+// order, and assemble the ways. Small caps spill more, shorter runs.
+static void BM_ExternalWayJoin(benchmark::State &state) {
+    const auto ways = MakeWayNodeIds(100000);
+    osmium::object_id_type maxNodeId = 0;
+    for (const auto &way : ways) {
+        maxNodeId = std::max(maxNodeId, *std::max_element(way.begin(), way.end()));
+    }
+    const auto bounds = SyntheticBounds();
+
+    ExternalWayJoin::Stats stats;
+    for (auto _ : state) {
+        ExternalWayJoin join(static_cast<size_t>(state.range(0)) << 20);
+        for (size_t way = 0; way < ways.size(); ++way) {
+            for (size_t i = 0; i < ways[way].size(); ++i) {
+                join.AddWayNode(ways[way][i], static_cast<osmium::object_id_type>(way + 1), static_cast<int64_t>(i));
+            }
+        }
+        for (osmium::object_id_type nodeId = 1; nodeId <= maxNodeId; ++nodeId) {
+            const double t = static_cast<double>(nodeId % 1000) / 1000.0;
+            join.AddNode(nodeId, osmium::Location{bounds.left() + t * (bounds.right() - bounds.left()),
+                                                  bounds.bottom() + t * (bounds.top() - bounds.bottom())});
+        }
+        size_t assembled = 0;
+        join.AssembleWays([&assembled](osmium::object_id_type, OSMLoader::Coordinates &nodes) {
+            assembled += nodes.size();
+        });
+        benchmark::DoNotOptimize(assembled);
+        stats = join.GetStats();
+    }
+    state.counters["runs"] = static_cast<double>(stats.runs);
+    state.counters["spilledMB"] = static_cast<double>(stats.spilledBytes >> 20);
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(stats.wayNodes));
+}
+BENCHMARK(BM_ExternalWayJoin)->RangeMultiplier(4)->Range(1, 256)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Args: {ways, shuffled}. NodeHandler filling route coordinates through
+// populateWay, with the route map lookup it does per visit.
+static void BM_PopulateWay(benchmark::State &state) {
+    const auto visits = MakeNodeVisits(static_cast<size_t>(state.range(0)), state.range(1) != 0);
+    for (auto _ : state) {
+        OSMLoader::Id2Route routes;
+        for (const auto &visit : visits) {
+            detail::populateWay(visit.location, visit.index, routes[visit.wayId].nodes);
+        }
+        benchmark::DoNotOptimize(routes.size());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(visits.size()));
+}
+BENCHMARK(BM_PopulateWay)
+    ->ArgsProduct({{1000, 10000, 100000}, {0, 1}})
+    ->Unit(benchmark::kMillisecond);
+
+// Args: {ways, percent of nodes missing}. cleanupWay on routes with holes left
+// by nodes outside the bounds.
+static void BM_CleanupWay(benchmark::State &state) {
+    auto routes = MakeSyntheticRoutes(static_cast<size_t>(state.range(0)), NODES_PER_WAY, SyntheticBounds());
+    std::mt19937 rng{5};
+    std::uniform_int_distribution<int64_t> percent(0, 99);
+    std::vector<OSMLoader::Coordinates> original;
+    for (auto &entry : routes) {
+        for (auto &location : entry.second.nodes) {
+            if (percent(rng) < state.range(1)) {
+                location = osmium::Location{};
+            }
+        }
+        original.push_back(entry.second.nodes);
+    }
+
+    auto ways = original;
+    for (auto _ : state) {
+        state.PauseTiming();
+        for (size_t i = 0; i < ways.size(); ++i) {
+            ways[i].assign(original[i].begin(), original[i].end());
+        }
+        state.ResumeTiming();
+        size_t empty = 0;
+        for (auto &way : ways) {
+            empty += detail::cleanupWay(way) ? 1 : 0;
+        }
+        benchmark::DoNotOptimize(empty);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) * static_cast<int64_t>(NODES_PER_WAY));
+}
+BENCHMARK(BM_CleanupWay)->ArgsProduct({{1000, 100000}, {0, 10, 90}})->Unit(benchmark::kMillisecond);
+
+// Args: {files}. Merging 100k routes loaded from adjacent extracts: each file
+// holds its slice of every route (sharing the border node with the next
+// slice) and leaves the rest invalid, so every route is stitched from all the
+// files, the worst case of mergePartialData.
+static void BM_MergeExtracts(benchmark::State &state) {
+    const auto fileCount = static_cast<size_t>(state.range(0));
+    const auto routes = MakeSyntheticRoutes(100000, NODES_PER_WAY, SyntheticBounds());
+    std::vector<detail::PartialData> original(fileCount);
+    for (size_t file = 0; file < fileCount; ++file) {
+        const size_t first = file * NODES_PER_WAY / fileCount;
+        const size_t last = std::min(NODES_PER_WAY, (file + 1) * NODES_PER_WAY / fileCount + 1);
+        for (const auto &[id, route] : routes) {
+            auto &slice = original[file].data.first[id];
+            slice.id = id;
+            slice.tags = route.tags;
+            slice.nodes.resize(last);
+            std::copy(route.nodes.begin() + first, route.nodes.begin() + last, slice.nodes.begin() + first);
+        }
+    }
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        auto parts = original;
+        state.ResumeTiming();
+        const auto merged = detail::mergePartialData(parts);
+        benchmark::DoNotOptimize(merged.first.size());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(routes.size() * fileCount));
+}
+BENCHMARK(BM_MergeExtracts)->Arg(1)->Arg(2)->Arg(4)->Unit(benchmark::kMillisecond);
+
+// Args: {vertices per strip}. Writing strips into pre-sized buffers; 64k
+// vertices' worth of strips per iteration, one chunk's capacity.
+static void BM_AddLineStripAdjacency(benchmark::State &state) {
+    const auto count = static_cast<size_t>(state.range(0));
+    const auto routes = MakeSyntheticRoutes(1, count, SyntheticBounds());
+    const auto &coords = routes.begin()->second.nodes;
+    const size_t strips = (MAX_CHUNK_VERTICES - 1) / count;
+
+    std::vector<float> vertices(strips * count * FLOATS_PER_VERTEX);
+    std::vector<uint16_t> indices(strips * (count + EXTRA_INDICES_PER_STRIP));
+    const std::array<float, 3> color{1.0f, 0.5f, 0.25f};
+    for (auto _ : state) {
+        for (size_t strip = 0; strip < strips; ++strip) {
+            AddLineStripAdjacencyToBuffers(coords.data(), count, color,
+                                           vertices.data() + strip * count * FLOATS_PER_VERTEX,
+                                           indices.data() + strip * (count + EXTRA_INDICES_PER_STRIP), strip * count);
+        }
+        benchmark::DoNotOptimize(vertices.data());
+        benchmark::DoNotOptimize(indices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(strips * count));
+}
+BENCHMARK(BM_AddLineStripAdjacency)->Arg(2)->Arg(8)->Arg(64)->Arg(1024);
+
+// Args: {routes}. Everything UpdateBuffersFromRoutes does on the CPU: order
+// routes by id, look up colour and layer per route, and build the chunks.
+static void BM_BuildRenderBuffers(benchmark::State &state) {
+    const auto bounds = SyntheticBounds();
+    const auto routes = MakeSyntheticRoutes(static_cast<size_t>(state.range(0)), NODES_PER_WAY, bounds);
+    const auto layerTable = RenderLayerTable::Default();
+    const std::unordered_map<std::string, GeometryBuilder::Color_t> highway2Color = {
+        {"motorway", {1.0f, 0.35f, 0.35f}}, {"secondary", {1.0f, 0.75f, 0.4f}}, {"tertiary", {1.0f, 1.0f, 0.6f}},
+        {"residential", {1.0f, 1.0f, 1.0f}}, {"service", {0.8f, 0.8f, 0.8f}},   {"footway", {0.9f, 0.7f, 0.7f}}};
+    const GeometryBuilder::Color_t defaultColor{0.5f, 0.5f, 0.5f};
+
+    size_t vertexCount = 0;
+    for (auto _ : state) {
+        std::vector<const OSMLoader::Route_t *> sorted;
+        sorted.reserve(routes.size());
+        for (const auto &entry : routes) {
+            sorted.push_back(&entry.second);
+        }
+        std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) { return a->id < b->id; });
+
+        GeometryBuilder builder(bounds, 16, layerTable.LayerCount());
+        for (const auto *route : sorted) {
+            const auto highway = route->tags.find(HIGHWAY_TAG);
+            const auto color = highway == route->tags.end() ? highway2Color.end() : highway2Color.find(highway->second);
+            builder.AddLineStrip(route->nodes, color == highway2Color.end() ? defaultColor : color->second,
+                                 layerTable.RouteLayer(*route));
+        }
+        auto geometry = builder.Build();
+        vertexCount = geometry.vertices.size() / FLOATS_PER_VERTEX;
+        benchmark::DoNotOptimize(geometry.indices.data());
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(vertexCount));
+}
+BENCHMARK(BM_BuildRenderBuffers)->Arg(1000)->Arg(10000)->Arg(100000)->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -0,0 +1,90 @@
+#include "name_index.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <string>
+
+namespace {
+
+// `count` two-node routes named from random syllables ("Kalomer Street"),
+// scattered over the synthetic bounds so few pieces merge
+OSMLoader::OSMData MakeNamedRoutes(size_t count) {
+    static const char *SYLLABLES[] = {"ka", "lo", "mer", "shi", "tan", "bel", "ro", "vi", "dor", "na", "que", "zu"};
+    static const char *SUFFIXES[] = {" Street", " Avenue", " Road", " Lane", " Way", " Park"};
+    const auto bounds = SyntheticBounds();
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<size_t> syllable(0, std::size(SYLLABLES) - 1);
+    std::uniform_int_distribution<size_t> syllableCount(2, 5);
+    std::uniform_int_distribution<size_t> suffix(0, std::size(SUFFIXES) - 1);
+    std::uniform_real_distribution<double> lon(bounds.left(), bounds.right());
+    std::uniform_real_distribution<double> lat(bounds.bottom(), bounds.top());
+
+    OSMLoader::OSMData data;
+    data.first.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        std::string name;
+        for (size_t s = syllableCount(rng); s > 0; --s) {
+            name += SYLLABLES[syllable(rng)];
+        }
+        name[0] = static_cast<char>(name[0] - 'a' + 'A');
+        name += SUFFIXES[suffix(rng)];
+
+        OSMLoader::Route_t route;
+        route.id = static_cast<osmium::object_id_type>(i + 1);
+        route.tags[NAME_TAG] = std::move(name);
+        const double x = lon(rng);
+        const double y = lat(rng);
+        route.nodes = {osmium::Location(x, y), osmium::Location(x + 1e-4, y)};
+        data.first.emplace(route.id, std::move(route));
+    }
+    return data;
+}
+
+} // namespace
+
+// Args: {routes, threads}. Load-time build of the sorted string table.
+static void BM_BuildNameIndex(benchmark::State &state) {
+    const auto data = MakeNamedRoutes(static_cast<size_t>(state.range(0)));
+    const auto threads = static_cast<size_t>(state.range(1));
+    size_t memoryBytes = 0;
+    for (auto _ : state) {
+        NameIndex index(data, threads);
+        memoryBytes = index.MemoryBytes();
+        benchmark::DoNotOptimize(index.EntryCount());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+    state.counters["MB"] = static_cast<double>(memoryBytes) / (1024.0 * 1024.0);
+}
+BENCHMARK(BM_BuildNameIndex)
+    ->ArgsProduct({{100000, 1000000}, {1, 4}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Args: {routes, prefix length}. Queries for the first DEFAULT_NAME_MATCHES
+// names under prefixes cut from random indexed names; short prefixes match
+// many names, long ones few.
+static void BM_NameIndexPrefix(benchmark::State &state) {
+    const auto data = MakeNamedRoutes(static_cast<size_t>(state.range(0)));
+    const NameIndex index(data);
+    std::vector<std::string> prefixes;
+    for (const auto &[id, route] : data.first) {
+        prefixes.push_back(route.tags.at(NAME_TAG).substr(0, static_cast<size_t>(state.range(1))));
+        if (prefixes.size() == 1024) {
+            break;
+        }
+    }
+
+    size_t query = 0;
+    size_t matches = 0;
+    for (auto _ : state) {
+        const auto found = index.FindPrefix(prefixes[query++ % prefixes.size()]);
+        matches += found.size();
+        benchmark::DoNotOptimize(found.data());
+    }
+    state.counters["matches"] = static_cast<double>(matches) / static_cast<double>(state.iterations());
+}
+BENCHMARK(BM_NameIndexPrefix)
+    ->ArgsProduct({{100000, 1000000}, {1, 3, 8}})
+    ->Unit(benchmark::kMicrosecond);
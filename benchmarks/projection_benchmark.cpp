@@ -0,0 +1,59 @@
+#include "projection.h"
+
+#include <benchmark/benchmark.h>
+
+#include <random>
+#include <vector>
+
+namespace {
+
+std::vector<osmium::Location> MakeLocations(size_t count) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> lon(-180.0, 180.0);
+    std::uniform_real_distribution<double> lat(-85.0, 85.0);
+    std::vector<osmium::Location> locations;
+    locations.reserve(count);
+    for (size_t i = 0; i < count; ++i) {
+        locations.emplace_back(lon(rng), lat(rng));
+    }
+    return locations;
+}
+
+} // namespace
+
+// Batch projection straight into interleaved vertices, in coordinates per
+// second. Args: {projection (0 equirectangular, 1 Web Mercator), coordinates}
+static void BM_ProjectLocations(benchmark::State &state) {
+    const auto projection = state.range(0) == 0 ? Projection::Equirectangular : Projection::WebMercator;
+    const auto locations = MakeLocations(static_cast<size_t>(state.range(1)));
+    std::vector<float> vertices(locations.size() * 5);
+
+    for (auto _ : state) {
+        ProjectLocations(projection, locations.data(), locations.size(), vertices.data(), 5);
+        benchmark::DoNotOptimize(vertices.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * locations.size()));
+    state.SetLabel(ProjectionName(projection));
+}
+BENCHMARK(BM_ProjectLocations)->ArgsProduct({{0, 1}, {4096, 1 << 20}});
+
+// The same Web Mercator projection one location at a time through the libm
+// sin() and log() of ProjectLat, for comparison with the batch kernel
+static void BM_ProjectLatScalar(benchmark::State &state) {
+    const auto locations = MakeLocations(static_cast<size_t>(state.range(0)));
+    std::vector<float> vertices(locations.size() * 5);
+
+    for (auto _ : state) {
+        float *vertex = vertices.data();
+        for (const auto &location : locations) {
+            vertex[0] = static_cast<float>(location.lon());
+            vertex[1] = static_cast<float>(ProjectLat(Projection::WebMercator, location.lat()));
+            vertex += 5;
+        }
+        benchmark::DoNotOptimize(vertices.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * locations.size()));
+}
+BENCHMARK(BM_ProjectLatScalar)->Arg(4096)->Arg(1 << 20);
@@ -0,0 +1,63 @@
+#include "geometry_builder.h"
+#include "map_style.h"
+#include "png_writer.h"
+#include "render_layers.h"
+#include "software_rasterizer.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+namespace {
+
+ChunkedGeometry MakeMapGeometry(size_t routeCount, const RenderLayerTable &layerTable) {
+    const auto bounds = SyntheticBounds();
+    // Build() keeps pointers to the routes until it returns
+    OSMLoader::OSMData data;
+    data.first = MakeSyntheticRoutes(routeCount, 32, bounds);
+    GeometryBuilder builder(bounds, 16, layerTable.LayerCount());
+    AddMapFeatures(data, layerTable, builder);
+    return builder.Build();
+}
+
+} // namespace
+
+// Args: {routes, image side in pixels, threads}. Software rasterisation of
+// the synthetic street grid over the whole image; reports megapixels/s.
+static void BM_RasterizeMap(benchmark::State &state) {
+    const auto layerTable = RenderLayerTable::Default();
+    const auto geometry = MakeMapGeometry(static_cast<size_t>(state.range(0)), layerTable);
+    RasterOptions options;
+    options.width = options.height = static_cast<uint32_t>(state.range(1));
+    options.threadCount = static_cast<size_t>(state.range(2));
+
+    RasterStats stats;
+    for (auto _ : state) {
+        auto image = RasterizeGeometry(geometry, layerTable, SyntheticBounds(), options, &stats);
+        benchmark::DoNotOptimize(image.pixels.data());
+    }
+    const double megapixels = static_cast<double>(options.width) * options.height / 1e6;
+    state.counters["MP/s"] = benchmark::Counter(megapixels * static_cast<double>(state.iterations()),
+                                                benchmark::Counter::kIsRate);
+    state.counters["segments"] = static_cast<double>(stats.segments);
+}
+BENCHMARK(BM_RasterizeMap)
+    ->ArgsProduct({{1000, 10000}, {1024, 4096}, {1, 2, 4, 8}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
+
+// Args: {image side in pixels}. PNG encoding of a rendered map.
+static void BM_EncodePng(benchmark::State &state) {
+    const auto layerTable = RenderLayerTable::Default();
+    const auto geometry = MakeMapGeometry(1000, layerTable);
+    RasterOptions options;
+    options.width = options.height = static_cast<uint32_t>(state.range(0));
+    const auto image = RasterizeGeometry(geometry, layerTable, SyntheticBounds(), options);
+    for (auto _ : state) {
+        auto png = EncodePng(image.width, image.height, image.pixels.data());
+        benchmark::DoNotOptimize(png.data());
+    }
+    state.counters["MP/s"] = benchmark::Counter(
+        static_cast<double>(image.width) * image.height / 1e6 * static_cast<double>(state.iterations()),
+        benchmark::Counter::kIsRate);
+}
+BENCHMARK(BM_EncodePng)->Arg(1024)->Arg(4096)->UseRealTime()->Unit(benchmark::kMillisecond);
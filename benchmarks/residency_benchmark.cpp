@@ -0,0 +1,99 @@
+#include "geometry_builder.h"
+#include "gpu_residency.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+namespace {
+
+constexpr size_t ROUTE_COUNT = 4000;
+constexpr size_t NODES_PER_ROUTE = 256;
+// Synthetic streets cross the whole map; cut them into short ways so the
+// chunks spread over the grid cells like real data
+constexpr size_t NODES_PER_WAY = 16;
+constexpr size_t FRAMES_PER_ORBIT = 240;
+
+// Chunks of the synthetic map as the canvas builds them
+const ChunkedGeometry &SyntheticChunks() {
+    static const ChunkedGeometry geometry = [] {
+        const auto bounds = SyntheticBounds();
+        static std::vector<OSMLoader::Coordinates> ways;
+        for (const auto &entry : MakeSyntheticRoutes(ROUTE_COUNT, NODES_PER_ROUTE, bounds)) {
+            const auto &nodes = entry.second.nodes;
+            for (size_t first = 0; first + 1 < nodes.size(); first += NODES_PER_WAY - 1) {
+                const size_t last = std::min(first + NODES_PER_WAY, nodes.size());
+                ways.emplace_back(nodes.begin() + static_cast<std::ptrdiff_t>(first),
+                                  nodes.begin() + static_cast<std::ptrdiff_t>(last));
+            }
+        }
+        GeometryBuilder builder(bounds, 16);
+        for (const auto &way : ways) {
+            builder.AddLineStrip(way, {1.0f, 1.0f, 1.0f});
+        }
+        return builder.Build();
+    }();
+    return geometry;
+}
+
+size_t ChunkBytes(const GeometryChunk &chunk) {
+    return chunk.vertexCount * FLOATS_PER_VERTEX * sizeof(float) + chunk.indexCount * sizeof(uint16_t);
+}
+
+// A view a quarter of the map wide, circling the centre
+osmium::Box OrbitView(size_t frame) {
+    const auto bounds = SyntheticBounds();
+    const double lonRange = bounds.right() - bounds.left();
+    const double latRange = bounds.top() - bounds.bottom();
+    const double angle = 2.0 * 3.141592653589793 * static_cast<double>(frame % FRAMES_PER_ORBIT) / FRAMES_PER_ORBIT;
+    const double centerLon = bounds.left() + lonRange * (0.5 + 0.3 * std::cos(angle));
+    const double centerLat = bounds.bottom() + latRange * (0.5 + 0.3 * std::sin(angle));
+    return osmium::Box{centerLon - 0.125 * lonRange, centerLat - 0.125 * latRange, centerLon + 0.125 * lonRange,
+                       centerLat + 0.125 * latRange};
+}
+
+} // namespace
+
+// Args: {budget in percent of all geometry}. The per-frame residency work of
+// OnPaint while panning: cull, request every visible chunk, evict to fit.
+// Uploads are no-ops, so this is the bookkeeping cost; the counters show how
+// much a real frame would upload.
+static void BM_ResidencyPan(benchmark::State &state) {
+    const auto &geometry = SyntheticChunks();
+    std::vector<size_t> chunkBytes;
+    size_t totalBytes = 0;
+    for (const auto &chunk : geometry.chunks) {
+        chunkBytes.push_back(ChunkBytes(chunk));
+        totalBytes += chunkBytes.back();
+    }
+    GpuResidency residency(totalBytes * static_cast<size_t>(state.range(0)) / 100);
+    residency.Reset(chunkBytes);
+
+    auto upload = [](size_t) { return true; };
+    auto evict = [](size_t) {};
+    size_t frame = 0;
+    size_t drawn = 0;
+    for (auto _ : state) {
+        const auto view = OrbitView(frame++);
+        residency.BeginFrame();
+        for (size_t i = 0; i < geometry.chunks.size(); ++i) {
+            if (BoxesIntersect(geometry.chunks[i].bounds, view) && residency.Request(i, upload, evict)) {
+                ++drawn;
+            }
+        }
+    }
+    benchmark::DoNotOptimize(drawn);
+
+    const auto &stats = residency.GetStats();
+    const double frames = static_cast<double>(state.iterations());
+    state.counters["chunks"] = static_cast<double>(geometry.chunks.size());
+    state.counters["drawn/frame"] = static_cast<double>(drawn) / frames;
+    state.counters["uploadMB/frame"] = static_cast<double>(stats.uploadedBytes) / (1024.0 * 1024.0) / frames;
+    state.counters["evictions/frame"] = static_cast<double>(stats.evictions) / frames;
+    state.counters["deferred/frame"] = static_cast<double>(stats.deferred) / frames;
+}
+BENCHMARK(BM_ResidencyPan)->Arg(100)->Arg(50)->Arg(25)->Arg(10);
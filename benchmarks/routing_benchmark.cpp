@@ -0,0 +1,176 @@
+#include "contraction_hierarchy.h"
+#include "road_graph.h"
+#include "route_planner.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+#include <memory>
+#include <queue>
+#include <random>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr size_t NODES_BETWEEN_INTERSECTIONS = 3;
+constexpr size_t QUERY_COUNT = 1024;
+constexpr size_t CHECKED_QUERIES = 32;
+
+// Graph and hierarchy per grid size, built once
+struct RoutingData {
+    RoadGraph graph;
+    std::unique_ptr<ContractionHierarchy> hierarchy;
+    std::vector<std::pair<RoadGraph::Vertex, RoadGraph::Vertex>> queries;
+};
+
+const RoutingData &SyntheticRouting(size_t streets) {
+    static std::map<size_t, RoutingData> cache;
+    auto &data = cache[streets];
+    if (data.graph.VertexCount() == 0) {
+        data.graph = RoadGraph{MakeSyntheticRoadGrid(streets, NODES_BETWEEN_INTERSECTIONS, SyntheticBounds())};
+        data.hierarchy = std::make_unique<ContractionHierarchy>(data.graph);
+        std::mt19937 rng(11);
+        std::uniform_int_distribution<RoadGraph::Vertex> vertex(0, static_cast<RoadGraph::Vertex>(
+                                                                       data.graph.VertexCount() - 1));
+        for (size_t i = 0; i < QUERY_COUNT; ++i) {
+            data.queries.emplace_back(vertex(rng), vertex(rng));
+        }
+    }
+    return data;
+}
+
+// Reference travel time: plain Dijkstra over the whole graph
+uint64_t DijkstraTimeMs(const RoadGraph &graph, RoadGraph::Vertex from, RoadGraph::Vertex to) {
+    constexpr uint64_t UNREACHED = std::numeric_limits<uint64_t>::max();
+    std::vector<uint64_t> distance(graph.VertexCount(), UNREACHED);
+    using Entry = std::pair<uint64_t, RoadGraph::Vertex>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+    distance[from] = 0;
+    queue.push({0, from});
+    while (!queue.empty()) {
+        const auto [d, v] = queue.top();
+        queue.pop();
+        if (v == to) {
+            return d;
+        }
+        if (d > distance[v]) {
+            continue;
+        }
+        for (const auto &edge : graph.OutEdges(v)) {
+            if (d + edge.weight < distance[edge.target]) {
+                distance[edge.target] = d + edge.weight;
+                queue.push({d + edge.weight, edge.target});
+            }
+        }
+    }
+    return UNREACHED;
+}
+
+// Travel time along the returned vertices, to check the path and not just its cost
+uint64_t PathTimeMs(const RoadGraph &graph, const RoutePlanner::Path &path) {
+    uint64_t time = 0;
+    for (size_t i = 1; i < path.vertices.size(); ++i) {
+        uint64_t best = std::numeric_limits<uint64_t>::max();
+        for (const auto &edge : graph.OutEdges(path.vertices[i - 1])) {
+            if (edge.target == path.vertices[i]) {
+                best = std::min<uint64_t>(best, edge.weight);
+            }
+        }
+        time += best;
+    }
+    return time;
+}
+
+template <typename Query> bool MatchesDijkstra(const RoutingData &data, Query &&query) {
+    for (size_t i = 0; i < CHECKED_QUERIES; ++i) {
+        const auto [from, to] = data.queries[i];
+        const auto expected = DijkstraTimeMs(data.graph, from, to);
+        const auto path = query(from, to);
+        if (path.vertices.empty() ? expected != std::numeric_limits<uint64_t>::max()
+                                  : path.timeMs != expected || PathTimeMs(data.graph, path) != expected) {
+            return false;
+        }
+    }
+    return true;
+}
+
+} // namespace
+
+// Args: {streets}. Graph build from routes on a streets x streets grid.
+static void BM_RoadGraphBuild(benchmark::State &state) {
+    const auto routes =
+        MakeSyntheticRoadGrid(static_cast<size_t>(state.range(0)), NODES_BETWEEN_INTERSECTIONS, SyntheticBounds());
+    size_t vertices = 0;
+    for (auto _ : state) {
+        RoadGraph graph{routes};
+        vertices = graph.VertexCount();
+        benchmark::DoNotOptimize(vertices);
+    }
+    state.counters["vertices"] = static_cast<double>(vertices);
+}
+BENCHMARK(BM_RoadGraphBuild)->Arg(64)->Arg(256)->Unit(benchmark::kMillisecond);
+
+// Args: {streets}. Contraction hierarchy preprocessing.
+static void BM_ContractionHierarchyBuild(benchmark::State &state) {
+    const RoadGraph graph{
+        MakeSyntheticRoadGrid(static_cast<size_t>(state.range(0)), NODES_BETWEEN_INTERSECTIONS, SyntheticBounds())};
+    size_t shortcuts = 0;
+    for (auto _ : state) {
+        ContractionHierarchy hierarchy{graph};
+        shortcuts = hierarchy.ShortcutCount();
+        benchmark::DoNotOptimize(shortcuts);
+    }
+    state.counters["vertices"] = static_cast<double>(graph.VertexCount());
+    state.counters["shortcuts"] = static_cast<double>(shortcuts);
+}
+BENCHMARK(BM_ContractionHierarchyBuild)->Arg(64)->Arg(256)->Unit(benchmark::kMillisecond)->Iterations(1);
+
+// Args: {streets}. Random point-to-point queries with bidirectional A*.
+// Fails if a path differs from plain Dijkstra.
+static void BM_RouteAStar(benchmark::State &state) {
+    const auto &data = SyntheticRouting(static_cast<size_t>(state.range(0)));
+    RoutePlanner planner{data.graph};
+    if (!MatchesDijkstra(data, [&](auto from, auto to) { return planner.ShortestPathAStar(from, to); })) {
+        state.SkipWithError("A* path differs from Dijkstra");
+        return;
+    }
+
+    size_t i = 0;
+    size_t settled = 0;
+    for (auto _ : state) {
+        const auto [from, to] = data.queries[i++ % QUERY_COUNT];
+        const auto path = planner.ShortestPathAStar(from, to);
+        settled += path.settled;
+        benchmark::DoNotOptimize(path.timeMs);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["settled"] = benchmark::Counter(static_cast<double>(settled) / state.iterations());
+}
+BENCHMARK(BM_RouteAStar)->Arg(64)->Arg(256)->Unit(benchmark::kMicrosecond);
+
+// Args: {streets}. The same queries on the contraction hierarchy.
+static void BM_RouteContracted(benchmark::State &state) {
+    const auto &data = SyntheticRouting(static_cast<size_t>(state.range(0)));
+    RoutePlanner planner{data.graph, data.hierarchy.get()};
+    if (!MatchesDijkstra(data, [&](auto from, auto to) { return planner.ShortestPathContracted(from, to); })) {
+        state.SkipWithError("contraction hierarchy path differs from Dijkstra");
+        return;
+    }
+
+    size_t i = 0;
+    size_t settled = 0;
+    for (auto _ : state) {
+        const auto [from, to] = data.queries[i++ % QUERY_COUNT];
+        const auto path = planner.ShortestPathContracted(from, to);
+        settled += path.settled;
+        benchmark::DoNotOptimize(path.timeMs);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.counters["settled"] = benchmark::Counter(static_cast<double>(settled) / state.iterations());
+}
+BENCHMARK(BM_RouteContracted)->Arg(64)->Arg(256)->Unit(benchmark::kMicrosecond);
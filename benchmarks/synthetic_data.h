@@ -0,0 +1,142 @@
+#pragma once
+
+#include "osm_loader.h"
+
+#include <osmium/osm/box.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+// Deterministic synthetic road network used by the benchmarks so they run
+// without a display or an OSM extract. Produces a jittered grid of streets
+// (shared intersections) inside `bounds` with `nodesPerRoute` vertices each.
+inline OSMLoader::Id2Route MakeSyntheticRoutes(size_t routeCount, size_t nodesPerRoute, const osmium::Box &bounds,
+                                               uint32_t seed = 42) {
+    static const char *HIGHWAY_VALUES[] = {"motorway", "secondary", "tertiary", "residential", "service", "footway"};
+
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> jitter(-0.25, 0.25);
+    std::uniform_int_distribution<size_t> highway(0, std::size(HIGHWAY_VALUES) - 1);
+
+    const double lonRange = bounds.right() - bounds.left();
+    const double latRange = bounds.top() - bounds.bottom();
+
+    OSMLoader::Id2Route routes;
+    routes.reserve(routeCount);
+    for (size_t i = 0; i < routeCount; ++i) {
+        OSMLoader::Route_t route;
+        route.id = static_cast<osmium::object_id_type>(i + 1);
+        route.tags[HIGHWAY_TAG] = HIGHWAY_VALUES[highway(rng)];
+        route.tags[NAME_TAG] = "Street " + std::to_string(i);
+
+        // Alternate horizontal and vertical streets
+        const bool horizontal = (i % 2) == 0;
+        const double offset = (static_cast<double>(i / 2) + 0.5) / static_cast<double>((routeCount + 1) / 2);
+        route.nodes.reserve(nodesPerRoute);
+        for (size_t n = 0; n < nodesPerRoute; ++n) {
+            const double along = static_cast<double>(n) / static_cast<double>(nodesPerRoute - 1);
+            const double across = offset + jitter(rng) / static_cast<double>(routeCount);
+            const double u = horizontal ? along : across;
+            const double v = horizontal ? across : along;
+            route.nodes.emplace_back(bounds.left() + u * lonRange, bounds.bottom() + v * latRange);
+        }
+        routes.emplace(route.id, std::move(route));
+    }
+    return routes;
+}
+
+// Connected street grid for routing: `streets` horizontal and `streets`
+// vertical streets that share their (jittered) intersections, with
+// `nodesBetween` shape points between neighbouring intersections. Every 8th
+// street is primary, the rest residential, and every 5th residential street
+// is oneway (alternating direction).
+inline OSMLoader::Id2Route MakeSyntheticRoadGrid(size_t streets, size_t nodesBetween, const osmium::Box &bounds,
+                                                 uint32_t seed = 42) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> jitter(-0.25, 0.25);
+
+    const double lonStep = (bounds.right() - bounds.left()) / static_cast<double>(streets);
+    const double latStep = (bounds.top() - bounds.bottom()) / static_cast<double>(streets);
+    std::vector<osmium::Location> intersections;
+    intersections.reserve(streets * streets);
+    for (size_t row = 0; row < streets; ++row) {
+        for (size_t column = 0; column < streets; ++column) {
+            intersections.emplace_back(bounds.left() + (static_cast<double>(column) + 0.5 + jitter(rng)) * lonStep,
+                                       bounds.bottom() + (static_cast<double>(row) + 0.5 + jitter(rng)) * latStep);
+        }
+    }
+
+    OSMLoader::Id2Route routes;
+    routes.reserve(2 * streets);
+    for (size_t i = 0; i < 2 * streets; ++i) {
+        const bool horizontal = i < streets;
+        const size_t line = horizontal ? i : i - streets;
+        OSMLoader::Route_t route;
+        route.id = static_cast<osmium::object_id_type>(i + 1);
+        route.tags[NAME_TAG] = (horizontal ? "Row " : "Column ") + std::to_string(line);
+        route.tags[HIGHWAY_TAG] = line % 8 == 0 ? "primary" : "residential";
+        if (line % 8 != 0 && line % 5 == 0) {
+            route.tags[ONEWAY_TAG] = line % 10 == 0 ? "yes" : "-1";
+        }
+        for (size_t step = 0; step < streets; ++step) {
+            const auto &at = intersections[horizontal ? line * streets + step : step * streets + line];
+            route.nodes.push_back(at);
+            if (step + 1 == streets) {
+                break;
+            }
+            const auto &next = intersections[horizontal ? line * streets + step + 1 : (step + 1) * streets + line];
+            for (size_t n = 1; n <= nodesBetween; ++n) {
+                const double t = static_cast<double>(n) / static_cast<double>(nodesBetween + 1);
+                route.nodes.emplace_back(at.lon() + t * (next.lon() - at.lon()),
+                                         at.lat() + t * (next.lat() - at.lat()));
+            }
+        }
+        routes.emplace(route.id, std::move(route));
+    }
+    return routes;
+}
+
+inline osmium::Box SyntheticBounds() { return osmium::Box{-122.52, 37.70, -122.35, 37.83}; }
+
+// Serialise `routes` as an .osm XML document in the layout of a planet
+// extract: every route vertex as its own node, then the ways referencing them
+inline std::string MakeSyntheticOsmXml(const OSMLoader::Id2Route &routes) {
+    std::vector<const OSMLoader::Route_t *> ordered;
+    ordered.reserve(routes.size());
+    for (const auto &entry : routes) {
+        ordered.push_back(&entry.second);
+    }
+    std::sort(ordered.begin(), ordered.end(), [](const auto *a, const auto *b) { return a->id < b->id; });
+
+    std::string xml = "<?xml version='1.0' encoding='UTF-8'?>\n<osm version=\"0.6\" generator=\"synthetic\">\n";
+    char line[256];
+    int64_t nodeId = 1;
+    for (const auto *route : ordered) {
+        for (const auto &location : route->nodes) {
+            std::snprintf(line, sizeof(line),
+                          "  <node id=\"%lld\" version=\"1\" timestamp=\"2024-01-01T00:00:00Z\" lat=\"%.7f\" "
+                          "lon=\"%.7f\"/>\n",
+                          static_cast<long long>(nodeId++), location.lat(), location.lon());
+            xml += line;
+        }
+    }
+    nodeId = 1;
+    for (const auto *route : ordered) {
+        std::snprintf(line, sizeof(line), "  <way id=\"%lld\" version=\"1\">\n", static_cast<long long>(route->id));
+        xml += line;
+        for (size_t i = 0; i < route->nodes.size(); ++i) {
+            std::snprintf(line, sizeof(line), "    <nd ref=\"%lld\"/>\n", static_cast<long long>(nodeId++));
+            xml += line;
+        }
+        for (const auto &[key, value] : route->tags) {
+            xml += "    <tag k=\"" + key + "\" v=\"" + value + "\"/>\n";
+        }
+        xml += "  </way>\n";
+    }
+    xml += "</osm>\n";
+    return xml;
+}
@@ -0,0 +1,64 @@
+#include "synthetic_data.h"
+#include "tile_pyramid.h"
+
+#include <benchmark/benchmark.h>
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+namespace {
+
+constexpr size_t NODES_PER_ROUTE = 64;
+
+std::string PyramidPath(const std::string &name) {
+    return (std::filesystem::temp_directory_path() / (name + TILE_PYRAMID_EXTENSION)).string();
+}
+
+OSMLoader::OSMData SyntheticData(size_t routes) {
+    return OSMLoader::OSMData{MakeSyntheticRoutes(routes, NODES_PER_ROUTE, SyntheticBounds()), {}};
+}
+
+} // namespace
+
+// Args: {routes}. Cutting, simplifying, encoding and writing zoom 10-16.
+static void BM_TilePyramidWrite(benchmark::State &state) {
+    const auto data = SyntheticData(static_cast<size_t>(state.range(0)));
+    const auto path = PyramidPath("write_benchmark");
+    TilePyramidStats stats;
+    for (auto _ : state) {
+        stats = WriteTilePyramid(data, TilePyramidOptions{}, path);
+    }
+    std::filesystem::remove(path);
+    state.counters["tiles"] = static_cast<double>(stats.tiles);
+    state.counters["MB"] = static_cast<double>(stats.bytes) / (1024.0 * 1024.0);
+}
+BENCHMARK(BM_TilePyramidWrite)->Arg(1000)->Arg(10000)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Args: {routes, zoom}. What the viewer does when the view changes: decode
+// every tile covering the data at one zoom level.
+static void BM_TilePyramidReadView(benchmark::State &state) {
+    const auto path = PyramidPath("read_benchmark_" + std::to_string(state.range(0)));
+    WriteTilePyramid(SyntheticData(static_cast<size_t>(state.range(0))), TilePyramidOptions{}, path);
+    const TilePyramid pyramid{path};
+    const auto range = TilesCovering(pyramid.Bounds(), static_cast<uint32_t>(state.range(1)));
+
+    size_t vertices = 0;
+    for (auto _ : state) {
+        vertices = 0;
+        for (uint32_t y = range.minY; y <= range.maxY; ++y) {
+            for (uint32_t x = range.minX; x <= range.maxX; ++x) {
+                for (const auto &feature : pyramid.ReadTile({range.z, x, y})) {
+                    vertices += feature.nodes.size();
+                }
+            }
+        }
+        benchmark::DoNotOptimize(vertices);
+    }
+    std::filesystem::remove(path);
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(vertices));
+    state.counters["tiles"] = static_cast<double>(range.Count());
+}
+BENCHMARK(BM_TilePyramidReadView)
+    ->ArgsProduct({{1000, 10000}, {12, 14, 16}})
+    ->Unit(benchmark::kMillisecond);
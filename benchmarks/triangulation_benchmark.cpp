@@ -0,0 +1,83 @@
+#include "map_style.h"
+#include "polygon_triangulation.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <random>
+
+namespace {
+
+constexpr double TWO_PI = 6.283185307179586;
+
+// Star-shaped ring around (centerX, centerY) whose radius varies randomly by
+// up to `jitter` of `radius`; closed with a repeated first vertex as in OSM
+OSMLoader::Coordinates MakeRing(size_t vertices, double centerX, double centerY, double radius, double jitter,
+                                std::mt19937 &rng) {
+    std::uniform_real_distribution<double> scale(1.0 - jitter, 1.0);
+    OSMLoader::Coordinates ring;
+    ring.reserve(vertices + 1);
+    for (size_t i = 0; i < vertices; ++i) {
+        const double angle = TWO_PI * static_cast<double>(i) / static_cast<double>(vertices);
+        const double r = radius * scale(rng);
+        ring.emplace_back(centerX + r * std::cos(angle), centerY + r * std::sin(angle));
+    }
+    ring.push_back(ring.front());
+    return ring;
+}
+
+} // namespace
+
+// Args: {ring vertices}. One smooth outline, like a lake or coastline; rings
+// of more than 80 vertices use the z-order hashed ear test.
+static void BM_TriangulatePolygon(benchmark::State &state) {
+    std::mt19937 rng(42);
+    const auto ring = MakeRing(static_cast<size_t>(state.range(0)), 0.0, 0.0, 1.0, 0.05, rng);
+    std::vector<double> xy;
+    for (const auto &location : ring) {
+        xy.push_back(location.lon());
+        xy.push_back(location.lat());
+    }
+    std::vector<uint32_t> triangles;
+    for (auto _ : state) {
+        triangles.clear();
+        TriangulatePolygon(xy, {}, triangles);
+        benchmark::DoNotOptimize(triangles.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations()) * state.range(0));
+}
+BENCHMARK(BM_TriangulatePolygon)->Arg(16)->Arg(256)->Arg(4096)->Arg(65536)->Unit(benchmark::kMicrosecond);
+
+// Args: {areas, threads}. Load-time triangulation of building-sized areas of
+// 8 to 64 vertices spread over the synthetic bounds.
+static void BM_BuildAreaFills(benchmark::State &state) {
+    const auto bounds = SyntheticBounds();
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<double> lon(bounds.left(), bounds.right());
+    std::uniform_real_distribution<double> lat(bounds.bottom(), bounds.top());
+    std::uniform_int_distribution<size_t> vertices(8, 64);
+
+    OSMLoader::OSMData data;
+    const auto areaCount = static_cast<size_t>(state.range(0));
+    for (size_t i = 0; i < areaCount; ++i) {
+        OSMLoader::Area_t area;
+        area.id = static_cast<osmium::object_id_type>(i + 1);
+        area.outerRings.push_back(MakeRing(vertices(rng), lon(rng), lat(rng), 2e-4, 0.4, rng));
+        data.second.emplace(area.id, std::move(area));
+    }
+
+    const auto threads = static_cast<size_t>(state.range(1));
+    size_t triangles = 0;
+    for (auto _ : state) {
+        auto fills = BuildAreaFills(data, threads);
+        triangles = fills.indices.size() / 3;
+        benchmark::DoNotOptimize(fills.indices.data());
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * areaCount));
+    state.counters["triangles"] = static_cast<double>(triangles);
+}
+BENCHMARK(BM_BuildAreaFills)
+    ->ArgsProduct({{10000, 100000}, {1, 2, 4, 8}})
+    ->UseRealTime()
+    ->Unit(benchmark::kMillisecond);
@@ -0,0 +1,113 @@
+#include "fast_xml_reader.h"
+#include "synthetic_data.h"
+
+#include <benchmark/benchmark.h>
+
+#include <osmium/io/xml_input.hpp>
+#include <osmium/osm/node.hpp>
+#include <osmium/osm/relation.hpp>
+#include <osmium/osm/way.hpp>
+
+#include <string>
+#include <vector>
+
+namespace {
+
+const std::string &SyntheticXml() {
+    static const std::string xml = MakeSyntheticOsmXml(MakeSyntheticRoutes(20000, 32, SyntheticBounds()));
+    return xml;
+}
+
+// Everything the XML carries about an object, for comparing the two parsers
+std::string Describe(const osmium::OSMObject &object) {
+    std::string text = osmium::item_type_to_name(object.type());
+    text += ' ' + std::to_string(object.id()) + " v" + std::to_string(object.version()) + " c" +
+            std::to_string(object.changeset()) + " t" + object.timestamp().to_iso() + " u" +
+            std::to_string(object.uid()) + " " + object.user() + (object.visible() ? " visible" : " deleted");
+    if (object.type() == osmium::item_type::node) {
+        const auto location = static_cast<const osmium::Node &>(object).location();
+        text += " @" + std::to_string(location.x()) + "," + std::to_string(location.y());
+    } else if (object.type() == osmium::item_type::way) {
+        for (const auto &node : static_cast<const osmium::Way &>(object).nodes()) {
+            text += " n" + std::to_string(node.ref());
+        }
+    } else if (object.type() == osmium::item_type::relation) {
+        for (const auto &member : static_cast<const osmium::Relation &>(object).members()) {
+            text += std::string(" m") + osmium::item_type_to_char(member.type()) + std::to_string(member.ref()) + "/" +
+                    member.role();
+        }
+    }
+    for (const auto &tag : object.tags()) {
+        text += std::string(" ") + tag.key() + "=" + tag.value();
+    }
+    return text;
+}
+
+std::vector<std::string> DescribeBuffer(const osmium::memory::Buffer &buffer) {
+    std::vector<std::string> objects;
+    for (const auto &object : buffer.select<osmium::OSMObject>()) {
+        objects.push_back(Describe(object));
+    }
+    return objects;
+}
+
+std::vector<std::string> ParseWithExpat(const std::string &xml) {
+    std::vector<std::string> objects;
+    osmium::io::Reader reader{osmium::io::File{xml.data(), xml.size(), "osm"}};
+    while (auto buffer = reader.read()) {
+        auto described = DescribeBuffer(buffer);
+        objects.insert(objects.end(), described.begin(), described.end());
+    }
+    reader.close();
+    return objects;
+}
+
+std::vector<std::string> ParseWithFastReader(const std::string &xml, size_t threads) {
+    std::vector<std::string> objects;
+    ForEachOsmXmlBuffer(xml.data(), xml.size(), osmium::osm_entity_bits::all, threads,
+                        [&objects](osmium::memory::Buffer &buffer) {
+                            auto described = DescribeBuffer(buffer);
+                            objects.insert(objects.end(), described.begin(), described.end());
+                        });
+    return objects;
+}
+
+} // namespace
+
+// osmium's XML input (expat), what the loader uses by default
+static void BM_ExpatXmlParse(benchmark::State &state) {
+    const auto &xml = SyntheticXml();
+    for (auto _ : state) {
+        osmium::io::Reader reader{osmium::io::File{xml.data(), xml.size(), "osm"}};
+        size_t bytes = 0;
+        while (auto buffer = reader.read()) {
+            bytes += buffer.committed();
+        }
+        reader.close();
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * xml.size()));
+}
+BENCHMARK(BM_ExpatXmlParse)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+// Args: {threads}. Fails if the objects differ from the expat path.
+static void BM_FastXmlParse(benchmark::State &state) {
+    const auto &xml = SyntheticXml();
+    const auto threads = static_cast<size_t>(state.range(0));
+
+    static const auto expected = ParseWithExpat(xml);
+    if (ParseWithFastReader(xml, threads) != expected) {
+        state.SkipWithError("fast XML reader output differs from expat");
+        return;
+    }
+
+    for (auto _ : state) {
+        size_t bytes = 0;
+        ForEachOsmXmlBuffer(xml.data(), xml.size(), osmium::osm_entity_bits::all, threads,
+                            [&bytes](osmium::memory::Buffer &buffer) { bytes += buffer.committed(); });
+        benchmark::DoNotOptimize(bytes);
+    }
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * xml.size()));
+    state.counters["threads"] = static_cast<double>(threads);
+}
+BENCHMARK(BM_FastXmlParse)->ArgsProduct({{1, 2, 4, 8}})->UseRealTime()->Unit(benchmark::kMillisecond);
@@ -1,9 +1,14 @@
 # generate_config.cmake
 # This script is run at build time via add_custom_command
 # configure_file(${CMAKE_ARGC} ${CMAKE_ARGV})
-file(READ ${VS_FILE} VERTEX_SHADER)
-file(READ ${GS_FILE} GEOMETRY_SHADER)
-file(READ ${FS_FILE} FRAGMENT_SHADER)
+#
+# SHADER_NAMES is a comma separated list of variable names. For every name the
+# caller passes -D<NAME>_FILE=<path> and the file contents are read into <NAME>
+# so that @<NAME>@ can be expanded in IN_FILE.
+string(REPLACE "," ";" SHADER_NAME_LIST "${SHADER_NAMES}")
+foreach(SHADER_NAME IN LISTS SHADER_NAME_LIST)
+    file(READ ${${SHADER_NAME}_FILE} ${SHADER_NAME})
+endforeach()
 
 # # Run configure_file
 # # The @ONLY option ensures only @VAR@ syntax is expanded, not ${VAR}
@@ -11,4 +16,4 @@ configure_file(
     ${IN_FILE}
     ${OUT_FILE}
     @ONLY
-)
\ No newline at end of file
+)
@@ -0,0 +1,243 @@
+#include "contraction_hierarchy.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <limits>
+#include <queue>
+#include <utility>
+
+namespace {
+
+using Vertex = RoadGraph::Vertex;
+using Weight = RoadGraph::Weight;
+
+// Witness searches give up after this many vertices and add the shortcut;
+// an unnecessary shortcut only costs a little query time
+constexpr size_t WITNESS_SETTLE_LIMIT = 500;
+constexpr uint64_t UNREACHED = std::numeric_limits<uint64_t>::max();
+
+struct DynamicEdge {
+    Vertex other;
+    Weight weight;
+    Vertex middle;
+};
+
+// Keep one edge per neighbour, the shortest
+void AddOrShorten(std::vector<DynamicEdge> &edges, Vertex other, Weight weight, Vertex middle) {
+    for (auto &edge : edges) {
+        if (edge.other == other) {
+            if (weight < edge.weight) {
+                edge.weight = weight;
+                edge.middle = middle;
+            }
+            return;
+        }
+    }
+    edges.push_back({other, weight, middle});
+}
+
+void RemoveNeighbour(std::vector<DynamicEdge> &edges, Vertex other) {
+    edges.erase(std::remove_if(edges.begin(), edges.end(), [other](const auto &edge) { return edge.other == other; }),
+                edges.end());
+}
+
+// The shrinking graph of not yet contracted vertices
+class Contractor {
+  public:
+    explicit Contractor(const RoadGraph &graph)
+        : out_(graph.VertexCount()), in_(graph.VertexCount()), contractedNeighbours_(graph.VertexCount(), 0),
+          distance_(graph.VertexCount(), UNREACHED) {
+        for (Vertex v = 0; v < graph.VertexCount(); ++v) {
+            for (const auto &edge : graph.OutEdges(v)) {
+                AddOrShorten(out_[v], edge.target, edge.weight, RoadGraph::NO_VERTEX);
+                AddOrShorten(in_[edge.target], v, edge.weight, RoadGraph::NO_VERTEX);
+            }
+        }
+    }
+
+    // Lower is contracted earlier
+    int64_t Priority(Vertex v) {
+        const auto shortcuts = static_cast<int64_t>(Contract(v, false));
+        const auto removed = static_cast<int64_t>(out_[v].size() + in_[v].size());
+        return shortcuts - removed + contractedNeighbours_[v];
+    }
+
+    // Number of shortcuts contracting `v` needs; they are added if `apply`
+    size_t Contract(Vertex v, bool apply) {
+        struct Shortcut {
+            Vertex from;
+            Vertex to;
+            Weight weight;
+        };
+        std::vector<Shortcut> shortcuts;
+        size_t count = 0;
+        for (const auto &in : in_[v]) {
+            uint64_t maxVia = 0;
+            for (const auto &out : out_[v]) {
+                if (out.other != in.other) {
+                    maxVia = std::max<uint64_t>(maxVia, uint64_t{in.weight} + out.weight);
+                }
+            }
+            if (maxVia == 0) {
+                continue;
+            }
+            WitnessSearch(in.other, v, maxVia);
+            for (const auto &out : out_[v]) {
+                const uint64_t via = uint64_t{in.weight} + out.weight;
+                if (out.other == in.other || distance_[out.other] <= via) {
+                    continue;
+                }
+                ++count;
+                if (apply) {
+                    shortcuts.push_back({in.other, out.other, static_cast<Weight>(via)});
+                }
+            }
+            ResetWitnessSearch();
+        }
+        for (const auto &shortcut : shortcuts) {
+            AddOrShorten(out_[shortcut.from], shortcut.to, shortcut.weight, v);
+            AddOrShorten(in_[shortcut.to], shortcut.from, shortcut.weight, v);
+        }
+        return count;
+    }
+
+    // Take `v` out of the graph; its remaining edges all lead to vertices
+    // contracted later
+    void Remove(Vertex v, std::vector<ContractionHierarchy::Edge> &up,
+                std::vector<ContractionHierarchy::Edge> &down) {
+        for (const auto &out : out_[v]) {
+            up.push_back({out.other, out.weight, out.middle});
+            RemoveNeighbour(in_[out.other], v);
+            ++contractedNeighbours_[out.other];
+        }
+        for (const auto &in : in_[v]) {
+            down.push_back({in.other, in.weight, in.middle});
+            RemoveNeighbour(out_[in.other], v);
+            ++contractedNeighbours_[in.other];
+        }
+        out_[v] = {};
+        in_[v] = {};
+    }
+
+  private:
+    // Dijkstra from `source` that avoids `skipped` and stops past `limit`
+    void WitnessSearch(Vertex source, Vertex skipped, uint64_t limit) {
+        using Entry = std::pair<uint64_t, Vertex>;
+        std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+        distance_[source] = 0;
+        touched_.push_back(source);
+        queue.push({0, source});
+        size_t settled = 0;
+        while (!queue.empty() && settled < WITNESS_SETTLE_LIMIT) {
+            const auto [distance, v] = queue.top();
+            queue.pop();
+            if (distance > distance_[v]) {
+                continue;
+            }
+            if (distance > limit) {
+                break;
+            }
+            ++settled;
+            for (const auto &edge : out_[v]) {
+                if (edge.other == skipped) {
+                    continue;
+                }
+                const uint64_t candidate = distance + edge.weight;
+                if (candidate < distance_[edge.other]) {
+                    if (distance_[edge.other] == UNREACHED) {
+                        touched_.push_back(edge.other);
+                    }
+                    distance_[edge.other] = candidate;
+                    queue.push({candidate, edge.other});
+                }
+            }
+        }
+    }
+
+    void ResetWitnessSearch() {
+        for (const auto v : touched_) {
+            distance_[v] = UNREACHED;
+        }
+        touched_.clear();
+    }
+
+    std::vector<std::vector<DynamicEdge>> out_;
+    std::vector<std::vector<DynamicEdge>> in_;
+    std::vector<int64_t> contractedNeighbours_;
+    std::vector<uint64_t> distance_;
+    std::vector<Vertex> touched_;
+};
+
+void BuildCsr(std::vector<std::vector<ContractionHierarchy::Edge>> &lists, std::vector<uint32_t> &offsets,
+              std::vector<ContractionHierarchy::Edge> &edges) {
+    offsets.assign(lists.size() + 1, 0);
+    for (size_t v = 0; v < lists.size(); ++v) {
+        offsets[v + 1] = offsets[v] + static_cast<uint32_t>(lists[v].size());
+    }
+    edges.clear();
+    edges.reserve(offsets.back());
+    for (auto &list : lists) {
+        edges.insert(edges.end(), list.begin(), list.end());
+        list = {};
+    }
+}
+
+} // namespace
+
+ContractionHierarchy::ContractionHierarchy(const RoadGraph &graph) : rank_(graph.VertexCount(), 0) {
+    const size_t vertexCount = graph.VertexCount();
+    Contractor contractor{graph};
+
+    using Entry = std::pair<int64_t, Vertex>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<>> queue;
+    for (Vertex v = 0; v < vertexCount; ++v) {
+        queue.push({contractor.Priority(v), v});
+    }
+
+    std::vector<std::vector<Edge>> up(vertexCount);
+    std::vector<std::vector<Edge>> down(vertexCount);
+    uint32_t nextRank = 0;
+    while (!queue.empty()) {
+        const Vertex v = queue.top().second;
+        queue.pop();
+        // Lazy update: contracting neighbours changed the priority since it
+        // was queued; requeue unless it is still the least important vertex
+        const auto priority = contractor.Priority(v);
+        if (!queue.empty() && priority > queue.top().first) {
+            queue.push({priority, v});
+            continue;
+        }
+        shortcutCount_ += contractor.Contract(v, true);
+        contractor.Remove(v, up[v], down[v]);
+        rank_[v] = nextRank++;
+    }
+
+    BuildCsr(up, upOffsets_, upEdges_);
+    BuildCsr(down, downOffsets_, downEdges_);
+}
+
+void ContractionHierarchy::Unpack(Vertex from, Vertex to, std::vector<Vertex> &path) const {
+    // Explicit stack: chains of shortcuts over long roads nest deeply
+    std::vector<std::pair<Vertex, Vertex>> pending{{from, to}};
+    while (!pending.empty()) {
+        const auto [u, w] = pending.back();
+        pending.pop_back();
+
+        // The edge lives at its less important end
+        const Edge *edge = nullptr;
+        for (const auto &candidate : rank_[u] < rank_[w] ? UpEdges(u) : DownEdges(w)) {
+            if (candidate.target == (rank_[u] < rank_[w] ? w : u)) {
+                edge = &candidate;
+                break;
+            }
+        }
+        assert(edge != nullptr);
+        if (edge->middle == RoadGraph::NO_VERTEX) {
+            path.push_back(w);
+        } else {
+            pending.push_back({edge->middle, w});
+            pending.push_back({u, edge->middle});
+        }
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "road_graph.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Contraction hierarchy over a RoadGraph. Vertices are contracted one at a
+// time, least important first (edge difference plus contracted neighbours,
+// with lazy updates); a shortcut replaces every shortest path through the
+// contracted vertex that a bounded witness search can't beat. Queries then
+// only walk edges towards more important vertices, which settles a few
+// hundred vertices instead of a large part of the graph.
+class ContractionHierarchy {
+  public:
+    using Vertex = RoadGraph::Vertex;
+    using Weight = RoadGraph::Weight;
+
+    struct Edge {
+        Vertex target; // head of upward edges, tail of downward ones
+        Weight weight;
+        Vertex middle; // contracted vertex a shortcut skips, NO_VERTEX for road edges
+    };
+
+    struct EdgeRange {
+        const Edge *first;
+        const Edge *last;
+        const Edge *begin() const { return first; }
+        const Edge *end() const { return last; }
+    };
+
+    explicit ContractionHierarchy(const RoadGraph &graph);
+
+    size_t VertexCount() const { return rank_.size(); }
+    size_t ShortcutCount() const { return shortcutCount_; }
+    uint32_t Rank(Vertex v) const { return rank_[v]; }
+
+    // Edges v -> w with Rank(w) > Rank(v), for the forward search
+    EdgeRange UpEdges(Vertex v) const { return {upEdges_.data() + upOffsets_[v], upEdges_.data() + upOffsets_[v + 1]}; }
+    // Edges u -> v with Rank(u) > Rank(v), stored at v with target u, for the
+    // backward search
+    EdgeRange DownEdges(Vertex v) const {
+        return {downEdges_.data() + downOffsets_[v], downEdges_.data() + downOffsets_[v + 1]};
+    }
+
+    // Append the road vertices of the hierarchy edge `from` -> `to` to `path`,
+    // except `from` itself, expanding shortcuts recursively
+    void Unpack(Vertex from, Vertex to, std::vector<Vertex> &path) const;
+
+  private:
+    std::vector<uint32_t> rank_;
+    size_t shortcutCount_{0};
+    std::vector<uint32_t> upOffsets_;
+    std::vector<Edge> upEdges_;
+    std::vector<uint32_t> downOffsets_;
+    std::vector<Edge> downEdges_;
+};
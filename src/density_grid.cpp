@@ -0,0 +1,226 @@
+#include "density_grid.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+// Rows of level 0 per binning band; a segment is walked once per band it
+// crosses
+constexpr uint32_t BAND_ROWS = 16;
+
+// A segment in level-0 cell units
+struct Segment {
+    float x0, y0, x1, y1;
+    uint32_t densityClass;
+};
+
+// Largest power of two <= value, at least 1
+uint32_t FloorPowerOfTwo(double value) {
+    uint32_t size = 1;
+    while (static_cast<double>(size) * 2.0 <= value) {
+        size *= 2;
+    }
+    return size;
+}
+
+// Add the length of `s` inside every cell of rows [firstRow, endRow) to
+// `cells` (the band's rows, DENSITY_CLASS_COUNT floats per cell). `unitX` and
+// `unitY` are the cell width and height in units of the cell side.
+void AccumulateSegment(const Segment &s, uint32_t width, uint32_t firstRow, uint32_t endRow, double unitX,
+                       double unitY, float *cells) {
+    double x0 = s.x0, y0 = s.y0, x1 = s.x1, y1 = s.y1;
+    const double dx = x1 - x0;
+    const double dy = y1 - y0;
+
+    // Clip to the band's rows and the grid's columns
+    double tMin = 0.0, tMax = 1.0;
+    auto clip = [&tMin, &tMax](double start, double delta, double low, double high) {
+        if (delta == 0.0) {
+            return start >= low && start <= high;
+        }
+        double t0 = (low - start) / delta;
+        double t1 = (high - start) / delta;
+        if (t0 > t1) {
+            std::swap(t0, t1);
+        }
+        tMin = std::max(tMin, t0);
+        tMax = std::min(tMax, t1);
+        return tMin < tMax;
+    };
+    if (!clip(y0, dy, firstRow, endRow) || !clip(x0, dx, 0.0, width)) {
+        return;
+    }
+    const double length = std::hypot(dx * unitX, dy * unitY);
+    x0 = s.x0 + tMin * dx;
+    y0 = s.y0 + tMin * dy;
+
+    // Walk the cells along the segment (Amanatides & Woo), adding the length
+    // of the piece inside each
+    auto cellX = static_cast<int64_t>(std::floor(x0));
+    auto cellY = static_cast<int64_t>(std::floor(y0));
+    const int64_t stepX = dx > 0.0 ? 1 : -1;
+    const int64_t stepY = dy > 0.0 ? 1 : -1;
+    constexpr double NEVER = std::numeric_limits<double>::infinity();
+    const double tDeltaX = dx != 0.0 ? 1.0 / std::abs(dx) : NEVER;
+    const double tDeltaY = dy != 0.0 ? 1.0 / std::abs(dy) : NEVER;
+    double tNextX = dx > 0.0 ? tMin + (static_cast<double>(cellX + 1) - x0) / dx
+                    : dx < 0.0 ? tMin + (x0 - static_cast<double>(cellX)) / -dx
+                               : NEVER;
+    double tNextY = dy > 0.0 ? tMin + (static_cast<double>(cellY + 1) - y0) / dy
+                    : dy < 0.0 ? tMin + (y0 - static_cast<double>(cellY)) / -dy
+                               : NEVER;
+
+    double t = tMin;
+    while (t < tMax) {
+        const double tEnd = std::min({tNextX, tNextY, tMax});
+        if (cellX >= 0 && cellX < static_cast<int64_t>(width) && cellY >= firstRow && cellY < endRow) {
+            const size_t cell = static_cast<size_t>(cellY - firstRow) * width + static_cast<size_t>(cellX);
+            cells[cell * DENSITY_CLASS_COUNT + s.densityClass] += static_cast<float>((tEnd - t) * length);
+        }
+        t = tEnd;
+        if (tNextX < tNextY) {
+            cellX += stepX;
+            tNextX += tDeltaX;
+        } else {
+            cellY += stepY;
+            tNextY += tDeltaY;
+        }
+    }
+}
+
+// The next coarser level: the mean of the (up to) 2 x 2 cells of `fine` under
+// each cell, as glGenerateMipmap would compute it
+DensityLevel Reduce(const DensityLevel &fine, size_t threadCount) {
+    DensityLevel coarse;
+    coarse.width = std::max<uint32_t>(1, fine.width / 2);
+    coarse.height = std::max<uint32_t>(1, fine.height / 2);
+    coarse.cells.resize(static_cast<size_t>(coarse.width) * coarse.height * DENSITY_CLASS_COUNT);
+    const uint32_t spanX = fine.width / coarse.width;
+    const uint32_t spanY = fine.height / coarse.height;
+    const float scale = 1.0f / static_cast<float>(spanX * spanY);
+
+    ParallelFor(coarse.height, threadCount, [&](size_t row) {
+        for (uint32_t col = 0; col < coarse.width; ++col) {
+            float *out = &coarse.cells[(row * coarse.width + col) * DENSITY_CLASS_COUNT];
+            for (uint32_t y = 0; y < spanY; ++y) {
+                for (uint32_t x = 0; x < spanX; ++x) {
+                    const size_t fineCell = (row * spanY + y) * fine.width + col * spanX + x;
+                    for (size_t c = 0; c < DENSITY_CLASS_COUNT; ++c) {
+                        out[c] += fine.cells[fineCell * DENSITY_CLASS_COUNT + c];
+                    }
+                }
+            }
+            for (size_t c = 0; c < DENSITY_CLASS_COUNT; ++c) {
+                out[c] *= scale;
+            }
+        }
+    });
+    return coarse;
+}
+
+} // namespace
+
+DensityGridBuilder::DensityGridBuilder(const osmium::Box &bounds, Projection projection, uint32_t maxSize)
+    : projection_(projection), left_(bounds.left()), bottom_(ProjectLat(projection, bounds.bottom())),
+      right_(bounds.right()), top_(ProjectLat(projection, bounds.top())) {
+    maxSize = std::max<uint32_t>(1, maxSize);
+    const double spanX = std::max(right_ - left_, 1e-9);
+    const double spanY = std::max(top_ - bottom_, 1e-9);
+    // Cells stay within a factor of two of square
+    width_ = spanX >= spanY ? FloorPowerOfTwo(maxSize) : FloorPowerOfTwo(maxSize * spanX / spanY);
+    height_ = spanY > spanX ? FloorPowerOfTwo(maxSize) : FloorPowerOfTwo(maxSize * spanY / spanX);
+}
+
+void DensityGridBuilder::AddLineStrip(const OSMLoader::Coordinates &coords, size_t densityClass) {
+    if (coords.size() < 2) {
+        return;
+    }
+    strips_.push_back(Strip{&coords, std::min(densityClass, DENSITY_CLASS_COUNT - 1)});
+}
+
+DensityPyramid DensityGridBuilder::Build(size_t threadCount) const {
+    DensityPyramid pyramid;
+    pyramid.left = left_;
+    pyramid.bottom = bottom_;
+    pyramid.right = right_;
+    pyramid.top = top_;
+    if (strips_.empty() || right_ <= left_ || top_ <= bottom_) {
+        return pyramid;
+    }
+
+    const double cellWidth = (right_ - left_) / width_;
+    const double cellHeight = (top_ - bottom_) / height_;
+    const double cellSide = std::sqrt(cellWidth * cellHeight);
+
+    // 1) Project every strip into level-0 cell units, in parallel into
+    // pre-sized segment ranges
+    std::vector<size_t> firstSegment(strips_.size() + 1, 0);
+    for (size_t i = 0; i < strips_.size(); ++i) {
+        firstSegment[i + 1] = firstSegment[i] + strips_[i].coords->size() - 1;
+    }
+    std::vector<Segment> segments(firstSegment.back());
+    ParallelFor(strips_.size(), threadCount, [&](size_t i) {
+        const auto &strip = strips_[i];
+        const size_t count = strip.coords->size();
+        std::vector<float> projected(count * 2);
+        ProjectLocations(projection_, strip.coords->data(), count, projected.data(), 2);
+        for (size_t j = 0; j + 1 < count; ++j) {
+            auto &segment = segments[firstSegment[i] + j];
+            segment.x0 = static_cast<float>((projected[2 * j] - left_) / cellWidth);
+            segment.y0 = static_cast<float>((projected[2 * j + 1] - bottom_) / cellHeight);
+            segment.x1 = static_cast<float>((projected[2 * j + 2] - left_) / cellWidth);
+            segment.y1 = static_cast<float>((projected[2 * j + 3] - bottom_) / cellHeight);
+            segment.densityClass = static_cast<uint32_t>(strip.densityClass);
+        }
+    });
+
+    // 2) Bin segment indices into every band of rows they touch; bins keep
+    // segment order so the sums don't depend on the thread count
+    const uint32_t bandCount = (height_ + BAND_ROWS - 1) / BAND_ROWS;
+    std::vector<std::vector<uint32_t>> bins(bandCount);
+    for (size_t i = 0; i < segments.size(); ++i) {
+        const auto &s = segments[i];
+        const float minY = std::max(0.0f, std::min(s.y0, s.y1));
+        const float maxY = std::max(s.y0, s.y1);
+        if (maxY < 0.0f || minY >= static_cast<float>(height_)) {
+            continue;
+        }
+        const uint32_t first = std::min(bandCount - 1, static_cast<uint32_t>(minY) / BAND_ROWS);
+        const uint32_t last = std::min(bandCount - 1, static_cast<uint32_t>(maxY) / BAND_ROWS);
+        for (uint32_t band = first; band <= last; ++band) {
+            bins[band].push_back(static_cast<uint32_t>(i));
+        }
+    }
+
+    // 3) Walk each band's segments through its cells. Bands differ a lot in
+    // cost, so threads take the next one as they finish.
+    auto &finest = pyramid.levels.emplace_back();
+    finest.width = width_;
+    finest.height = height_;
+    finest.cells.resize(static_cast<size_t>(width_) * height_ * DENSITY_CLASS_COUNT);
+    const double unitX = cellWidth / cellSide;
+    const double unitY = cellHeight / cellSide;
+    std::atomic<size_t> nextBand{0};
+    const size_t workers = threadCount == 0 ? DefaultThreadCount() : threadCount;
+    ParallelFor(workers, workers, [&](size_t) {
+        for (size_t band = nextBand++; band < bandCount; band = nextBand++) {
+            const uint32_t firstRow = static_cast<uint32_t>(band) * BAND_ROWS;
+            const uint32_t endRow = std::min(height_, firstRow + BAND_ROWS);
+            float *cells = finest.cells.data() + static_cast<size_t>(firstRow) * width_ * DENSITY_CLASS_COUNT;
+            for (const uint32_t segment : bins[band]) {
+                AccumulateSegment(segments[segment], width_, firstRow, endRow, unitX, unitY, cells);
+            }
+        }
+    });
+
+    // 4) Coarser levels down to a single cell
+    while (pyramid.levels.back().width > 1 || pyramid.levels.back().height > 1) {
+        auto coarse = Reduce(pyramid.levels.back(), threadCount);
+        pyramid.levels.push_back(std::move(coarse));
+    }
+    return pyramid;
+}
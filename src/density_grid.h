@@ -0,0 +1,74 @@
+#pragma once
+
+#include "osm_loader.h"
+#include "projection.h"
+
+#include <osmium/osm/box.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Line classes the density grids count separately; one texture channel each
+constexpr size_t DENSITY_CLASS_COUNT = 4;
+// Cells on the longer side of the finest grid
+constexpr uint32_t DEFAULT_DENSITY_GRID_SIZE = 1024;
+
+// One resolution of a DensityPyramid: `width` x `height` cells, row-major from
+// the bottom row, DENSITY_CLASS_COUNT floats per cell
+struct DensityLevel {
+    uint32_t width{0};
+    uint32_t height{0};
+    std::vector<float> cells;
+};
+
+// Line length per cell and class at several resolutions. Level 0 is the
+// finest; every further level halves both sides (rounding down, never below
+// one cell) and holds the mean of the cells it covers, the same reduction as
+// a GL mipmap, so the levels upload as one texture's mip chain. Values are
+// line length in units of a level-0 cell side (the geometric mean of its
+// width and height), averaged per level-0 cell.
+struct DensityPyramid {
+    // Projected bounds the grids cover (x = lon, y = ProjectLat)
+    double left{0.0};
+    double bottom{0.0};
+    double right{0.0};
+    double top{0.0};
+    std::vector<DensityLevel> levels;
+
+    bool Empty() const { return levels.empty(); }
+};
+
+// Accumulates line strips into a DensityPyramid over `bounds`, in the same
+// projected space as the vertex buffers. The finest grid has `maxSize` cells
+// on the longer side of the projected bounds (both sides are powers of two).
+class DensityGridBuilder {
+  public:
+    DensityGridBuilder(const osmium::Box &bounds, Projection projection,
+                       uint32_t maxSize = DEFAULT_DENSITY_GRID_SIZE);
+
+    // `coords` must outlive the call to Build()
+    void AddLineStrip(const OSMLoader::Coordinates &coords, size_t densityClass);
+
+    // Projects the strips, bins their segments into bands of rows, and
+    // walks every segment through the cells of each band it crosses, one
+    // band per task on `threadCount` threads (0 uses every core); then
+    // reduces level by level, splitting rows across the threads. The result
+    // does not depend on the thread count.
+    DensityPyramid Build(size_t threadCount = 0) const;
+
+  private:
+    struct Strip {
+        const OSMLoader::Coordinates *coords{nullptr};
+        size_t densityClass{0};
+    };
+
+    Projection projection_;
+    double left_;
+    double bottom_;
+    double right_;
+    double top_;
+    uint32_t width_;
+    uint32_t height_;
+    std::vector<Strip> strips_;
+};
@@ -0,0 +1,171 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#if !defined(_WIN32)
+#include <sys/types.h>
+#endif
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Sorts more records than fit in memory. Records are buffered up to the
+// memory limit; a full buffer is sorted and written to a temporary file as a
+// run. Finish() then merges the runs (and whatever is still buffered) back in
+// order. The temporary file is deleted when the sorter is destroyed. Errors
+// writing or reading it throw std::runtime_error.
+template <typename T, typename Less = std::less<T>> class ExternalSorter {
+    static_assert(std::is_trivially_copyable_v<T>, "records are written to disk as raw bytes");
+
+  public:
+    explicit ExternalSorter(size_t memoryBytes, Less less = Less{})
+        : capacity_(std::max<size_t>(1, memoryBytes / sizeof(T))), less_(std::move(less)) {}
+    ExternalSorter(const ExternalSorter &) = delete;
+    ExternalSorter &operator=(const ExternalSorter &) = delete;
+
+    void Push(const T &record) {
+        if (buffer_.size() == capacity_) {
+            SpillBuffer();
+        }
+        buffer_.push_back(record);
+        ++size_;
+    }
+
+    // Stop pushing and start reading the records back in order
+    void Finish();
+    // The next record in order; false once all have been read
+    bool Next(T &record);
+
+    uint64_t Size() const { return size_; }
+    size_t RunCount() const { return runs_.size(); }
+    uint64_t SpilledBytes() const { return spilledBytes_; }
+
+  private:
+    struct Run {
+        uint64_t offset; // in records
+        uint64_t size;   // records not yet read into `buffer`
+        std::vector<T> buffer;
+        size_t position{0};
+    };
+
+    void SpillBuffer();
+    // Move the file position to `byteOffset`. std::fseek takes a long, which
+    // is 32 bits on Windows, and the file can be far larger than 2 GB.
+    bool Seek(uint64_t byteOffset) {
+#if defined(_WIN32)
+        return _fseeki64(file_.get(), static_cast<__int64>(byteOffset), SEEK_SET) == 0;
+#else
+        return fseeko(file_.get(), static_cast<off_t>(byteOffset), SEEK_SET) == 0;
+#endif
+    }
+    // Read the next slice of `run` into its buffer; false if it is exhausted
+    bool Refill(Run &run);
+    // Heap order of the runs by their current record, smallest on top
+    bool RunAfter(size_t a, size_t b) const {
+        return less_(runs_[b].buffer[runs_[b].position], runs_[a].buffer[runs_[a].position]);
+    }
+
+    struct FileCloser {
+        void operator()(std::FILE *file) const { std::fclose(file); }
+    };
+
+    size_t capacity_;
+    Less less_;
+    std::vector<T> buffer_;
+    uint64_t size_{0};
+
+    std::unique_ptr<std::FILE, FileCloser> file_;
+    uint64_t spilledBytes_{0};
+    std::vector<Run> runs_;
+
+    // Indices of the runs that still have records, as a heap ordered by RunAfter
+    std::vector<size_t> heap_;
+    size_t memoryPosition_{0}; // reading straight from buffer_ when nothing was spilled
+};
+
+template <typename T, typename Less> void ExternalSorter<T, Less>::SpillBuffer() {
+    if (!file_) {
+        // Unnamed file in the system's temporary directory, removed on close
+        file_.reset(std::tmpfile());
+        if (!file_) {
+            throw std::runtime_error("cannot create a temporary file for sorting");
+        }
+    }
+    std::sort(buffer_.begin(), buffer_.end(), less_);
+    if (std::fwrite(buffer_.data(), sizeof(T), buffer_.size(), file_.get()) != buffer_.size()) {
+        throw std::runtime_error("cannot write a sorted run to the temporary file");
+    }
+    runs_.push_back({spilledBytes_ / sizeof(T), buffer_.size(), {}});
+    spilledBytes_ += buffer_.size() * sizeof(T);
+    buffer_.clear();
+}
+
+template <typename T, typename Less> void ExternalSorter<T, Less>::Finish() {
+    if (runs_.empty()) {
+        // Everything fit in memory
+        std::sort(buffer_.begin(), buffer_.end(), less_);
+        return;
+    }
+    if (!buffer_.empty()) {
+        SpillBuffer();
+    }
+    std::vector<T>().swap(buffer_);
+    if (std::fflush(file_.get()) != 0) {
+        throw std::runtime_error("cannot write a sorted run to the temporary file");
+    }
+
+    // Split the memory between the runs' read buffers
+    const size_t slice = std::max<size_t>(1, capacity_ / runs_.size());
+    for (size_t i = 0; i < runs_.size(); ++i) {
+        runs_[i].buffer.reserve(static_cast<size_t>(std::min<uint64_t>(slice, runs_[i].size)));
+        if (Refill(runs_[i])) {
+            heap_.push_back(i);
+        }
+    }
+    std::make_heap(heap_.begin(), heap_.end(), [this](size_t a, size_t b) { return RunAfter(a, b); });
+}
+
+template <typename T, typename Less> bool ExternalSorter<T, Less>::Refill(Run &run) {
+    const auto count = static_cast<size_t>(std::min<uint64_t>(run.buffer.capacity(), run.size));
+    if (count == 0) {
+        return false;
+    }
+    run.buffer.resize(count);
+    run.position = 0;
+    if (!Seek(run.offset * sizeof(T)) ||
+        std::fread(run.buffer.data(), sizeof(T), count, file_.get()) != count) {
+        throw std::runtime_error("cannot read a sorted run back from the temporary file");
+    }
+    run.offset += count;
+    run.size -= count;
+    return true;
+}
+
+template <typename T, typename Less> bool ExternalSorter<T, Less>::Next(T &record) {
+    if (runs_.empty()) {
+        if (memoryPosition_ == buffer_.size()) {
+            return false;
+        }
+        record = buffer_[memoryPosition_++];
+        return true;
+    }
+
+    if (heap_.empty()) {
+        return false;
+    }
+    const auto runAfter = [this](size_t a, size_t b) { return RunAfter(a, b); };
+    std::pop_heap(heap_.begin(), heap_.end(), runAfter);
+    auto &run = runs_[heap_.back()];
+    record = run.buffer[run.position++];
+    if (run.position < run.buffer.size() || Refill(run)) {
+        std::push_heap(heap_.begin(), heap_.end(), runAfter);
+    } else {
+        heap_.pop_back();
+    }
+    return true;
+}
@@ -0,0 +1,63 @@
+#include "external_way_join.h"
+#include "osm_loader_detail.h"
+
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+ExternalWayJoin::ExternalWayJoin(size_t memoryBytes) : refs_(memoryBytes / 2), locations_(memoryBytes / 2) {}
+
+void ExternalWayJoin::AddWayNode(osmium::object_id_type nodeID, osmium::object_id_type wayID, int64_t index) {
+    if (joining_) {
+        throw std::logic_error("way nodes added after the node pass started");
+    }
+    refs_.Push({nodeID, wayID, index});
+}
+
+void ExternalWayJoin::AddNode(osmium::object_id_type nodeID, const osmium::Location &location) {
+    if (!joining_) {
+        refs_.Finish();
+        hasRef_ = refs_.Next(ref_);
+        lastNodeID_ = std::numeric_limits<osmium::object_id_type>::min();
+        joining_ = true;
+    }
+    if (nodeID < lastNodeID_) {
+        throw std::runtime_error("the external join needs nodes sorted by id, but node " + std::to_string(nodeID) +
+                                 " follows node " + std::to_string(lastNodeID_));
+    }
+    lastNodeID_ = nodeID;
+
+    while (hasRef_ && ref_.nodeID < nodeID) {
+        hasRef_ = refs_.Next(ref_);
+    }
+    while (hasRef_ && ref_.nodeID == nodeID) {
+        locations_.Push({ref_.wayID, ref_.index, location});
+        ++joined_;
+        hasRef_ = refs_.Next(ref_);
+    }
+}
+
+void ExternalWayJoin::AssembleWays(
+    const std::function<void(osmium::object_id_type, OSMLoader::Coordinates &)> &fn) {
+    locations_.Finish();
+
+    OSMLoader::Coordinates nodes;
+    osmium::object_id_type wayID = 0;
+    WayNodeLocation record;
+    while (locations_.Next(record)) {
+        if (!nodes.empty() && record.wayID != wayID) {
+            fn(wayID, nodes);
+            nodes.clear();
+        }
+        wayID = record.wayID;
+        detail::populateWay(record.location, record.index, nodes);
+    }
+    if (!nodes.empty()) {
+        fn(wayID, nodes);
+    }
+}
+
+ExternalWayJoin::Stats ExternalWayJoin::GetStats() const {
+    return {refs_.Size(), joined_, refs_.RunCount() + locations_.RunCount(),
+            refs_.SpilledBytes() + locations_.SpilledBytes()};
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include "external_sort.h"
+#include "osm_loader.h"
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+// Out-of-core join of ways with the locations of their nodes, for inputs whose
+// node -> way map does not fit in memory. The way pass writes one
+// (node, way, index) reference per way node; they are sorted into runs by
+// node id on disk. The node pass then streams the nodes in id order and
+// merge-joins them against the references, writing (way, index, location)
+// records that are sorted again by way. Reading those back in order yields
+// each way's locations one way at a time.
+//
+// Memory use is bounded by `memoryBytes` (split between the two sorters),
+// not by the size of the input.
+class ExternalWayJoin {
+  public:
+    struct Stats {
+        uint64_t wayNodes{0}; // references added
+        uint64_t joined{0};   // references that found their node
+        size_t runs{0};
+        uint64_t spilledBytes{0};
+    };
+
+    explicit ExternalWayJoin(size_t memoryBytes);
+
+    // Way pass: node `nodeID` is at `index` of way `wayID`
+    void AddWayNode(osmium::object_id_type nodeID, osmium::object_id_type wayID, int64_t index);
+
+    // Node pass: `location` of node `nodeID`. The first call ends the way
+    // pass. Nodes must come in increasing id order, as in sorted OSM files;
+    // throws std::runtime_error otherwise. Nodes no way references (or outside
+    // the area of interest) may be left out.
+    void AddNode(osmium::object_id_type nodeID, const osmium::Location &location);
+
+    // Call `fn(wayID, nodes)` for every way with at least one located node, in
+    // increasing way id order. Each node is at its index in the way; the ones
+    // that were never located are left invalid, like the gaps populateWay
+    // leaves. Ends the node pass.
+    void AssembleWays(const std::function<void(osmium::object_id_type, OSMLoader::Coordinates &)> &fn);
+
+    Stats GetStats() const;
+
+  private:
+    struct WayNodeRef {
+        osmium::object_id_type nodeID;
+        osmium::object_id_type wayID;
+        int64_t index;
+    };
+    struct ByNode {
+        bool operator()(const WayNodeRef &a, const WayNodeRef &b) const { return a.nodeID < b.nodeID; }
+    };
+
+    struct WayNodeLocation {
+        osmium::object_id_type wayID;
+        int64_t index;
+        osmium::Location location;
+    };
+    struct ByWay {
+        bool operator()(const WayNodeLocation &a, const WayNodeLocation &b) const {
+            return a.wayID < b.wayID || (a.wayID == b.wayID && a.index < b.index);
+        }
+    };
+
+    ExternalSorter<WayNodeRef, ByNode> refs_;
+    ExternalSorter<WayNodeLocation, ByWay> locations_;
+
+    bool joining_{false};
+    bool hasRef_{false};
+    WayNodeRef ref_{};
+    osmium::object_id_type lastNodeID_{0};
+    uint64_t joined_{0};
+};
@@ -0,0 +1,153 @@
+#include "fast_xml_reader.h"
+#include "parallel.h"
+
+#include <osmium/builder/osm_object_builder.hpp>
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types_from_string.hpp>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Large enough that chunks amortise the thread start, small enough that a
+// group of chunks in flight stays cheap
+constexpr size_t CHUNK_BYTES = 8 * 1024 * 1024;
+constexpr size_t INITIAL_BUFFER_BYTES = 1024 * 1024;
+
+// osmium's setters take NUL-terminated strings
+class CStrings {
+  public:
+    const char *operator()(std::string_view value, size_t slot = 0) {
+        auto &storage = storage_[slot];
+        storage.assign(value.data(), value.size());
+        return storage.c_str();
+    }
+
+  private:
+    std::string storage_[2];
+};
+
+// Mirrors osmium's XML parser: lon/lat build the location (returned for the
+// caller to set on nodes), user is set on the builder, everything else goes
+// through OSMObject::set_attribute() (which ignores attributes it doesn't know)
+template <typename TBuilder>
+osmium::Location SetAttributes(TBuilder &builder, const OsmXmlObject &object, CStrings &cstr) {
+    auto &osmObject = builder.object();
+    osmium::Location location;
+    std::string_view user;
+    for (const auto &[name, value] : object.attributes) {
+        if (name == "lon") {
+            location.set_lon(cstr(value));
+        } else if (name == "lat") {
+            location.set_lat(cstr(value));
+        } else if (name == "user") {
+            user = value;
+        } else {
+            osmObject.set_attribute(cstr(name, 0), cstr(value, 1));
+        }
+    }
+    builder.set_user(user.data(), static_cast<osmium::string_size_type>(user.size()));
+    return location;
+}
+
+template <typename TBuilder> void AddTags(TBuilder &builder, const OsmXmlObject &object) {
+    if (object.tags.empty()) {
+        return;
+    }
+    osmium::builder::TagListBuilder tags{builder};
+    for (const auto &[key, value] : object.tags) {
+        tags.add_tag(key.data(), key.size(), value.data(), value.size());
+    }
+}
+
+unsigned ScannerTypes(osmium::osm_entity_bits::type entities) {
+    unsigned types = 0;
+    if ((entities & osmium::osm_entity_bits::node) != osmium::osm_entity_bits::nothing) {
+        types |= OsmXmlScanner::NODES;
+    }
+    if ((entities & osmium::osm_entity_bits::way) != osmium::osm_entity_bits::nothing) {
+        types |= OsmXmlScanner::WAYS;
+    }
+    if ((entities & osmium::osm_entity_bits::relation) != osmium::osm_entity_bits::nothing) {
+        types |= OsmXmlScanner::RELATIONS;
+    }
+    return types;
+}
+
+} // namespace
+
+osmium::memory::Buffer ParseOsmXmlChunk(const char *begin, const char *end, osmium::osm_entity_bits::type entities) {
+    osmium::memory::Buffer buffer{INITIAL_BUFFER_BYTES, osmium::memory::Buffer::auto_grow::yes};
+    OsmXmlScanner scanner{begin, end, ScannerTypes(entities)};
+    OsmXmlObject object;
+    CStrings cstr;
+
+    while (scanner.Next(object)) {
+        switch (object.type) {
+        case OsmXmlObject::Type::Node: {
+            osmium::builder::NodeBuilder builder{buffer};
+            if (const auto location = SetAttributes(builder, object, cstr)) {
+                builder.object().set_location(location);
+            }
+            AddTags(builder, object);
+            break;
+        }
+        case OsmXmlObject::Type::Way: {
+            osmium::builder::WayBuilder builder{buffer};
+            SetAttributes(builder, object, cstr);
+            if (!object.nodeRefs.empty()) {
+                osmium::builder::WayNodeListBuilder nodes{builder};
+                for (const auto ref : object.nodeRefs) {
+                    nodes.add_node_ref(osmium::NodeRef{osmium::string_to_object_id(cstr(ref))});
+                }
+            }
+            AddTags(builder, object);
+            break;
+        }
+        case OsmXmlObject::Type::Relation: {
+            osmium::builder::RelationBuilder builder{buffer};
+            SetAttributes(builder, object, cstr);
+            if (!object.members.empty()) {
+                osmium::builder::RelationMemberListBuilder members{builder};
+                for (const auto &member : object.members) {
+                    const auto type = member.type.empty() ? osmium::item_type::undefined
+                                                          : osmium::char_to_item_type(member.type.front());
+                    if (type == osmium::item_type::undefined) {
+                        // Let the expat path report it
+                        throw FastXmlUnsupported("unknown relation member type");
+                    }
+                    members.add_member(type, osmium::string_to_object_id(cstr(member.ref)), member.role.data(),
+                                       member.role.size());
+                }
+            }
+            AddTags(builder, object);
+            break;
+        }
+        }
+        buffer.commit();
+    }
+    return buffer;
+}
+
+void ForEachOsmXmlBuffer(const char *data, size_t size, osmium::osm_entity_bits::type entities, size_t threadCount,
+                         const std::function<void(osmium::memory::Buffer &)> &fn) {
+    if (threadCount == 0) {
+        threadCount = DefaultThreadCount();
+    }
+    const auto chunks = SplitOsmXmlChunks(data, size, CHUNK_BYTES);
+
+    for (size_t first = 0; first < chunks.size(); first += threadCount) {
+        const size_t count = std::min(threadCount, chunks.size() - first);
+        std::vector<osmium::memory::Buffer> buffers(count);
+        ParallelFor(count, threadCount, [&](size_t i) {
+            const auto &[begin, end] = chunks[first + i];
+            buffers[i] = ParseOsmXmlChunk(data + begin, data + end, entities);
+        });
+        for (auto &buffer : buffers) {
+            fn(buffer);
+        }
+    }
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "osm_xml_scanner.h"
+
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/entity_bits.hpp>
+
+#include <cstddef>
+#include <functional>
+
+// Parallel OSM XML reader built on OsmXmlScanner. It produces the same
+// osmium objects as osmium's expat-based XML parser, so the loader's handlers
+// run unchanged on either. Throws FastXmlUnsupported for input outside the
+// scanner's subset.
+
+// Parse one chunk (see SplitOsmXmlChunks) into a buffer of the requested
+// entities
+osmium::memory::Buffer ParseOsmXmlChunk(const char *begin, const char *end, osmium::osm_entity_bits::type entities);
+
+// Parse [data, data + size) on `threadCount` workers (0 uses every core) and
+// call `fn` with each chunk's buffer in document order, on the calling
+// thread. Chunks are parsed one group of `threadCount` at a time so only that
+// many buffers are alive at once.
+void ForEachOsmXmlBuffer(const char *data, size_t size, osmium::osm_entity_bits::type entities, size_t threadCount,
+                         const std::function<void(osmium::memory::Buffer &)> &fn);
@@ -0,0 +1,201 @@
+#include "feature_index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
+
+namespace {
+
+// Caps the grid for data with many tiny segments; query cost grows with the
+// cells under the search box, build memory with the cell count
+constexpr size_t MAX_CELLS = size_t{1} << 22;
+// Degenerate (single point or axis-aligned) data still gets a non-zero extent
+constexpr double MIN_SPAN = 1e-7;
+
+std::string TagValue(const OSMLoader::Tags &tags, const char *key) {
+    const auto it = tags.find(key);
+    return it == tags.end() ? std::string{} : it->second;
+}
+
+template <typename Map> std::vector<const typename Map::mapped_type *> SortedById(const Map &map) {
+    std::vector<const typename Map::mapped_type *> sorted;
+    sorted.reserve(map.size());
+    for (const auto &entry : map) {
+        sorted.push_back(&entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) { return a->id < b->id; });
+    return sorted;
+}
+
+} // namespace
+
+FeatureIndex::FeatureIndex(const OSMLoader::OSMData &data, double segmentsPerCell) {
+    const auto &[routes, areas] = data;
+
+    // Bounds of everything indexed; segments are stored relative to them
+    double minLon = std::numeric_limits<double>::max();
+    double minLat = std::numeric_limits<double>::max();
+    double maxLon = std::numeric_limits<double>::lowest();
+    double maxLat = std::numeric_limits<double>::lowest();
+    auto extend = [&](const OSMLoader::Coordinates &coords) {
+        for (const auto &location : coords) {
+            if (location.valid()) {
+                minLon = std::min(minLon, location.lon());
+                minLat = std::min(minLat, location.lat());
+                maxLon = std::max(maxLon, location.lon());
+                maxLat = std::max(maxLat, location.lat());
+            }
+        }
+    };
+    for (const auto &[id, route] : routes) {
+        extend(route.nodes);
+    }
+    for (const auto &[id, area] : areas) {
+        for (const auto &ring : area.outerRings) {
+            extend(ring);
+        }
+    }
+    if (minLon > maxLon) {
+        return;
+    }
+    originLon_ = minLon;
+    originLat_ = minLat;
+
+    // Sorted by id so ties resolve the same way on every load
+    for (const auto *route : SortedById(routes)) {
+        features_.push_back({route->id, Kind::Route, TagValue(route->tags, NAME_TAG),
+                             TagValue(route->tags, HIGHWAY_TAG)});
+        AddCoordinates(route->nodes, static_cast<uint32_t>(features_.size() - 1));
+    }
+    for (const auto *area : SortedById(areas)) {
+        features_.push_back({area->id, Kind::Area, TagValue(area->tags, NAME_TAG), TagValue(area->tags, TYPE_TAG)});
+        for (const auto &ring : area->outerRings) {
+            AddCoordinates(ring, static_cast<uint32_t>(features_.size() - 1));
+        }
+    }
+    if (segments_.size() > std::numeric_limits<uint32_t>::max()) {
+        throw std::length_error("too many segments for the feature index");
+    }
+
+    // Grid with roughly square cells holding `segmentsPerCell` segments on average
+    const double spanLon = std::max(maxLon - minLon, MIN_SPAN);
+    const double spanLat = std::max(maxLat - minLat, MIN_SPAN);
+    const double wantedCells = std::max(1.0, static_cast<double>(segments_.size()) / std::max(segmentsPerCell, 1.0));
+    const size_t cells = static_cast<size_t>(std::min(wantedCells, static_cast<double>(MAX_CELLS)));
+    gridWidth_ = std::clamp<size_t>(
+        static_cast<size_t>(std::lround(std::sqrt(static_cast<double>(cells) * spanLon / spanLat))), 1, cells);
+    gridHeight_ = std::max<size_t>(1, (cells + gridWidth_ - 1) / gridWidth_);
+    cellWidth_ = spanLon / static_cast<double>(gridWidth_);
+    cellHeight_ = spanLat / static_cast<double>(gridHeight_);
+
+    // Count, prefix sum, fill
+    cellOffsets_.assign(gridWidth_ * gridHeight_ + 1, 0);
+    for (const auto &segment : segments_) {
+        ForEachCell(segment, [this](size_t cell) { ++cellOffsets_[cell + 1]; });
+    }
+    for (size_t cell = 1; cell < cellOffsets_.size(); ++cell) {
+        cellOffsets_[cell] += cellOffsets_[cell - 1];
+    }
+    cellSegments_.resize(cellOffsets_.back());
+    std::vector<uint32_t> cursor(cellOffsets_.begin(), cellOffsets_.end() - 1);
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        ForEachCell(segments_[i], [&](size_t cell) { cellSegments_[cursor[cell]++] = static_cast<uint32_t>(i); });
+    }
+}
+
+void FeatureIndex::AddCoordinates(const OSMLoader::Coordinates &coords, uint32_t feature) {
+    for (size_t i = 1; i < coords.size(); ++i) {
+        const auto &a = coords[i - 1];
+        const auto &b = coords[i];
+        if (!a.valid() || !b.valid()) {
+            continue;
+        }
+        segments_.push_back({static_cast<float>(a.lon() - originLon_), static_cast<float>(a.lat() - originLat_),
+                             static_cast<float>(b.lon() - originLon_), static_cast<float>(b.lat() - originLat_),
+                             feature});
+    }
+}
+
+size_t FeatureIndex::CellX(double x) const {
+    const double cell = std::floor(x / cellWidth_);
+    return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(gridWidth_ - 1)));
+}
+
+size_t FeatureIndex::CellY(double y) const {
+    const double cell = std::floor(y / cellHeight_);
+    return static_cast<size_t>(std::clamp(cell, 0.0, static_cast<double>(gridHeight_ - 1)));
+}
+
+template <typename Fn> void FeatureIndex::ForEachCell(const Segment &segment, Fn &&fn) const {
+    // Walk the rows the segment spans and, per row, the columns between
+    // where it enters and leaves the row. Long segments (boundaries, straight
+    // roads) only land in the cells they cross rather than their whole box.
+    const double minY = std::min(segment.y0, segment.y1);
+    const double maxY = std::max(segment.y0, segment.y1);
+    const double dy = static_cast<double>(segment.y1) - segment.y0;
+    const double slack = cellWidth_ * 1e-6;
+    for (size_t row = CellY(minY), lastRow = CellY(maxY); row <= lastRow; ++row) {
+        double xa = segment.x0;
+        double xb = segment.x1;
+        if (dy != 0.0) {
+            const double yLow = std::max(minY, static_cast<double>(row) * cellHeight_);
+            const double yHigh = std::min(maxY, static_cast<double>(row + 1) * cellHeight_);
+            const double dx = static_cast<double>(segment.x1) - segment.x0;
+            xa = segment.x0 + (yLow - segment.y0) / dy * dx;
+            xb = segment.x0 + (yHigh - segment.y0) / dy * dx;
+        }
+        const size_t firstColumn = CellX(std::min(xa, xb) - slack);
+        const size_t lastColumn = CellX(std::max(xa, xb) + slack);
+        for (size_t column = firstColumn; column <= lastColumn; ++column) {
+            fn(row * gridWidth_ + column);
+        }
+    }
+}
+
+FeatureIndex::Hit FeatureIndex::Nearest(const osmium::Location &location, double radiusLon,
+                                        double radiusLat) const {
+    if (segments_.empty() || !location.valid() || radiusLon <= 0.0 || radiusLat <= 0.0) {
+        return {};
+    }
+    const double x = location.lon() - originLon_;
+    const double y = location.lat() - originLat_;
+    if (x + radiusLon < 0.0 || y + radiusLat < 0.0 || x - radiusLon > cellWidth_ * gridWidth_ ||
+        y - radiusLat > cellHeight_ * gridHeight_) {
+        return {};
+    }
+
+    // Distances are measured with the search ellipse scaled to a unit circle
+    const double scaleX = 1.0 / radiusLon;
+    const double scaleY = 1.0 / radiusLat;
+    double bestDistanceSq = 1.0;
+    uint32_t bestFeature = std::numeric_limits<uint32_t>::max();
+
+    const size_t firstColumn = CellX(x - radiusLon);
+    const size_t lastColumn = CellX(x + radiusLon);
+    for (size_t row = CellY(y - radiusLat), lastRow = CellY(y + radiusLat); row <= lastRow; ++row) {
+        const size_t rowStart = row * gridWidth_;
+        for (uint32_t i = cellOffsets_[rowStart + firstColumn]; i < cellOffsets_[rowStart + lastColumn + 1]; ++i) {
+            const auto &segment = segments_[cellSegments_[i]];
+            // Closest point of the segment to the origin (the query point)
+            const double ax = (segment.x0 - x) * scaleX;
+            const double ay = (segment.y0 - y) * scaleY;
+            const double dx = (segment.x1 - x) * scaleX - ax;
+            const double dy = (segment.y1 - y) * scaleY - ay;
+            const double lengthSq = dx * dx + dy * dy;
+            const double t = lengthSq > 0.0 ? std::clamp(-(ax * dx + ay * dy) / lengthSq, 0.0, 1.0) : 0.0;
+            const double px = ax + t * dx;
+            const double py = ay + t * dy;
+            const double distanceSq = px * px + py * py;
+            if (distanceSq < bestDistanceSq || (distanceSq == bestDistanceSq && segment.feature < bestFeature)) {
+                bestDistanceSq = distanceSq;
+                bestFeature = segment.feature;
+            }
+        }
+    }
+
+    if (bestFeature == std::numeric_limits<uint32_t>::max()) {
+        return {};
+    }
+    return {&features_[bestFeature], std::sqrt(bestDistanceSq)};
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include "osm_loader.h"
+
+#include <osmium/osm/location.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Nearest-feature lookup for click-to-inspect. Every segment of every route
+// and area outer ring is bucketed at load time into a uniform grid over the
+// data bounds; cells store segment indices in one flat array (CSR style). A
+// query only tests the segments in the few cells under its search box, so it
+// doesn't depend on how much data is loaded.
+class FeatureIndex {
+  public:
+    enum class Kind { Route, Area };
+
+    // What is shown for a picked feature. Copied out of the snapshot so the
+    // index still works after the canvas releases its CPU geometry.
+    struct Feature {
+        osmium::object_id_type id{0};
+        Kind kind{Kind::Route};
+        std::string name;
+        std::string featureClass; // highway value for routes, type for areas
+    };
+
+    struct Hit {
+        const Feature *feature{nullptr}; // nullptr if nothing is in range
+        double distance{0.0};            // in units of the search radius
+    };
+
+    FeatureIndex() = default;
+    // `segmentsPerCell` is the average grid occupancy to size the grid for
+    explicit FeatureIndex(const OSMLoader::OSMData &data, double segmentsPerCell = 4.0);
+
+    // Nearest feature whose geometry passes within the ellipse around
+    // `location` with half axes `radiusLon` and `radiusLat` (degrees). The
+    // canvas maps lon and lat linearly to pixels, so a pixel radius converted
+    // per axis gives a circle on screen. Ties go to the lowest id, routes first.
+    Hit Nearest(const osmium::Location &location, double radiusLon, double radiusLat) const;
+
+    size_t FeatureCount() const { return features_.size(); }
+    size_t SegmentCount() const { return segments_.size(); }
+
+  private:
+    // Endpoints relative to the grid origin, where float keeps sub-metre
+    // precision for city-sized data
+    struct Segment {
+        float x0, y0, x1, y1;
+        uint32_t feature;
+    };
+
+    void AddCoordinates(const OSMLoader::Coordinates &coords, uint32_t feature);
+    // Call `fn(cell)` for every grid cell the segment passes through
+    template <typename Fn> void ForEachCell(const Segment &segment, Fn &&fn) const;
+    size_t CellX(double x) const;
+    size_t CellY(double y) const;
+
+    std::vector<Feature> features_;
+    std::vector<Segment> segments_;
+
+    double originLon_{0.0};
+    double originLat_{0.0};
+    double cellWidth_{1.0};
+    double cellHeight_{1.0};
+    size_t gridWidth_{0};
+    size_t gridHeight_{0};
+    // Segments of cell c are cellSegments_[cellOffsets_[c] .. cellOffsets_[c + 1])
+    std::vector<uint32_t> cellOffsets_;
+    std::vector<uint32_t> cellSegments_;
+};
@@ -0,0 +1,275 @@
+#include "geometry_builder.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <cassert>
+
+namespace {
+
+// Bits of a location's fixed-point x and y, as one key
+uint64_t LocationKey(const osmium::Location &location) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(location.x())) << 32) |
+           static_cast<uint32_t>(location.y());
+}
+
+} // namespace
+
+bool BoxesIntersect(const osmium::Box &a, const osmium::Box &b) {
+    return a.bottom_left().x() <= b.top_right().x() && b.bottom_left().x() <= a.top_right().x() &&
+           a.bottom_left().y() <= b.top_right().y() && b.bottom_left().y() <= a.top_right().y();
+}
+
+void AddLineStripAdjacencyToBuffers(const OSMLoader::Coordinate *coords, size_t count,
+                                    const std::array<float, 3> &color, float *vertices, uint16_t *indices,
+                                    size_t firstLocalVertex, Projection projection) {
+    assert(count >= 2);
+    assert(firstLocalVertex + count <= MAX_CHUNK_VERTICES);
+
+    // Add vertices for the current line strip: the projected position in one
+    // batch, then the colour; the shader maps positions to the view
+    ProjectLocations(projection, coords, count, vertices, FLOATS_PER_VERTEX);
+    for (size_t i = 0; i < count; ++i) {
+        assert(coords[i].valid());
+        float *vertex = vertices + i * FLOATS_PER_VERTEX;
+        vertex[2] = color[0];
+        vertex[3] = color[1];
+        vertex[4] = color[2];
+    }
+
+    // Indices for GL_LINE_STRIP_ADJACENCY: duplicate first and last
+    // This is required for the geometry shader to calculate normals for the end segments.
+    *indices++ = static_cast<uint16_t>(firstLocalVertex);
+    for (size_t i = 0; i < count; ++i) {
+        *indices++ = static_cast<uint16_t>(firstLocalVertex + i);
+    }
+    *indices++ = static_cast<uint16_t>(firstLocalVertex + count - 1);
+
+    // End the strip so the next one in the chunk starts a new primitive
+    *indices = PRIMITIVE_RESTART_INDEX;
+}
+
+GeometryBuilder::GeometryBuilder(const osmium::Box &bounds, size_t gridSize, size_t layerCount, Projection projection)
+    : bounds_(bounds), gridSize_(std::max<size_t>(gridSize, 1)), layerCount_(std::max<size_t>(layerCount, 1)),
+      projection_(projection) {}
+
+size_t GeometryBuilder::CellIndex(const osmium::Box &stripBounds) const {
+    // Bucket by the centre of the strip; the chunk bounds are grown to cover
+    // the whole strip so culling stays conservative.
+    const double lonRange = bounds_.right() - bounds_.left();
+    const double latRange = bounds_.top() - bounds_.bottom();
+    const double centerLon = 0.5 * (stripBounds.left() + stripBounds.right());
+    const double centerLat = 0.5 * (stripBounds.bottom() + stripBounds.top());
+
+    auto toCell = [this](double value, double minValue, double range) {
+        if (range <= 0.0) {
+            return size_t{0};
+        }
+        const double normalized = (value - minValue) / range;
+        const auto cell = static_cast<long long>(normalized * static_cast<double>(gridSize_));
+        return static_cast<size_t>(std::clamp<long long>(cell, 0, static_cast<long long>(gridSize_) - 1));
+    };
+
+    const size_t col = toCell(centerLon, bounds_.left(), lonRange);
+    const size_t row = toCell(centerLat, bounds_.bottom(), latRange);
+    return row * gridSize_ + col;
+}
+
+size_t GeometryBuilder::BuildSharedChunk(const std::vector<size_t> &order, size_t firstStrip, size_t lastStrip,
+                                         size_t maxVertices, float *vertices, uint16_t *indices) const {
+    // Open-addressing table of the chunk's vertices, keyed by location, at
+    // most half full. A slot holds the vertex index; vertices at the same
+    // location in another colour get slots of their own.
+    size_t capacityBits = 1;
+    while ((size_t{1} << capacityBits) < 2 * maxVertices) {
+        ++capacityBits;
+    }
+    const size_t mask = (size_t{1} << capacityBits) - 1;
+    std::vector<uint64_t> keys(mask + 1);
+    std::vector<uint16_t> slots(mask + 1, PRIMITIVE_RESTART_INDEX);
+
+    size_t vertexCount = 0;
+    std::vector<float> projected;
+    for (size_t k = firstStrip; k < lastStrip; ++k) {
+        const auto &strip = strips_[order[k]];
+        const auto *coords = strip.coords->data() + strip.first;
+        projected.resize(strip.count * 2);
+        ProjectLocations(projection_, coords, strip.count, projected.data(), 2);
+
+        // Same index layout as AddLineStripAdjacencyToBuffers, through the
+        // shared vertices
+        uint16_t *stripIndices = indices;
+        ++indices; // first vertex again as adjacency, written below
+        for (size_t i = 0; i < strip.count; ++i) {
+            assert(coords[i].valid());
+            const uint64_t key = LocationKey(coords[i]);
+            size_t slot = static_cast<size_t>((key * 0x9E3779B97F4A7C15ull) >> (64 - capacityBits));
+            while (true) {
+                const uint16_t index = slots[slot];
+                if (index == PRIMITIVE_RESTART_INDEX) {
+                    float *vertex = vertices + vertexCount * FLOATS_PER_VERTEX;
+                    vertex[0] = projected[2 * i];
+                    vertex[1] = projected[2 * i + 1];
+                    vertex[2] = strip.color[0];
+                    vertex[3] = strip.color[1];
+                    vertex[4] = strip.color[2];
+                    keys[slot] = key;
+                    slots[slot] = static_cast<uint16_t>(vertexCount++);
+                    *indices++ = slots[slot];
+                    break;
+                }
+                const float *vertex = vertices + index * FLOATS_PER_VERTEX;
+                if (keys[slot] == key && vertex[2] == strip.color[0] && vertex[3] == strip.color[1] &&
+                    vertex[4] == strip.color[2]) {
+                    *indices++ = index;
+                    break;
+                }
+                slot = (slot + 1) & mask;
+            }
+        }
+        stripIndices[0] = stripIndices[1];
+        *indices = *(indices - 1);
+        ++indices;
+        *indices++ = PRIMITIVE_RESTART_INDEX;
+    }
+    return vertexCount;
+}
+
+void GeometryBuilder::AddLineStrip(const OSMLoader::Coordinates &coords, const Color_t &color, size_t layer) {
+    if (coords.size() < 2) {
+        return;
+    }
+    layer = std::min(layer, layerCount_ - 1);
+
+    // Split ways that cannot fit into a single chunk. Consecutive pieces share
+    // their boundary vertex so the rendered line stays continuous.
+    const size_t maxPiece = MAX_CHUNK_VERTICES;
+    for (size_t first = 0; first + 1 < coords.size(); first += maxPiece - 1) {
+        strips_.push_back(Strip{&coords, first, std::min(maxPiece, coords.size() - first), color, layer});
+    }
+}
+
+ChunkedGeometry GeometryBuilder::Build(size_t threadCount) const {
+    ChunkedGeometry geometry;
+    const size_t stripCount = strips_.size();
+    const size_t cellCount = gridSize_ * gridSize_;
+    // Buckets are (layer, cell) pairs, layer-major, so each layer's chunks
+    // end up contiguous
+    const size_t bucketCount = layerCount_ * cellCount;
+
+    // 1) Counting pass: bounds and bucket of every strip
+    std::vector<osmium::Box> stripBounds(stripCount);
+    std::vector<size_t> stripCells(stripCount);
+    ParallelFor(stripCount, threadCount, [&](size_t i) {
+        const auto &strip = strips_[i];
+        auto &bounds = stripBounds[i];
+        for (size_t j = 0; j < strip.count; ++j) {
+            bounds.extend((*strip.coords)[strip.first + j]);
+        }
+        stripCells[i] = strip.layer * cellCount + CellIndex(bounds);
+    });
+
+    // Stable counting sort of the strips by bucket
+    std::vector<size_t> cellStart(bucketCount + 1, 0);
+    for (auto cell : stripCells) {
+        ++cellStart[cell + 1];
+    }
+    for (size_t cell = 0; cell < bucketCount; ++cell) {
+        cellStart[cell + 1] += cellStart[cell];
+    }
+    std::vector<size_t> order(stripCount);
+    {
+        auto next = cellStart;
+        for (size_t i = 0; i < stripCount; ++i) {
+            order[next[stripCells[i]]++] = i;
+        }
+    }
+
+    // 2) Prefix sum: give every strip its chunk and vertex/index offsets
+    struct Placement {
+        size_t vertexOffset;
+        size_t indexOffset;
+        size_t localVertex; // first vertex relative to the chunk base
+    };
+    std::vector<Placement> placements(stripCount);
+    size_t vertexTotal = 0;
+    size_t indexTotal = 0;
+    // Position in `order` of the first strip of every chunk
+    std::vector<size_t> chunkFirstStrip;
+    geometry.layers.resize(layerCount_);
+    for (size_t cell = 0; cell < bucketCount; ++cell) {
+        const size_t layer = cell / cellCount;
+        if (cell % cellCount == 0) {
+            geometry.layers[layer].firstChunk = geometry.chunks.size();
+        }
+        GeometryChunk *chunk = nullptr;
+        size_t chunkVertices = 0;
+
+        for (size_t k = cellStart[cell]; k < cellStart[cell + 1]; ++k) {
+            const auto stripIndex = order[k];
+            const auto &strip = strips_[stripIndex];
+            if (chunk == nullptr || chunkVertices + strip.count > MAX_CHUNK_VERTICES) {
+                auto &newChunk = geometry.chunks.emplace_back();
+                newChunk.layer = layer;
+                newChunk.baseVertex = static_cast<int32_t>(vertexTotal);
+                newChunk.firstIndex = indexTotal;
+                chunkFirstStrip.push_back(k);
+                chunk = &newChunk;
+                chunkVertices = 0;
+            }
+
+            const size_t stripIndices = strip.count + EXTRA_INDICES_PER_STRIP;
+            placements[stripIndex] = Placement{vertexTotal, indexTotal, chunkVertices};
+            chunk->bounds.extend(stripBounds[stripIndex]);
+            chunk->vertexCount += strip.count;
+            chunk->indexCount += stripIndices;
+            chunkVertices += strip.count;
+            vertexTotal += strip.count;
+            indexTotal += stripIndices;
+        }
+        geometry.layers[layer].chunkCount = geometry.chunks.size() - geometry.layers[layer].firstChunk;
+    }
+
+    geometry.stripVertexCount = vertexTotal;
+    geometry.indices.resize(indexTotal);
+    if (shareVertices_) {
+        // 3) Parallel fill of each chunk, sharing vertices within the chunk,
+        // into the space the unshared vertices would take. The indices are
+        // where the prefix sum put them; the chunks' vertices are then packed.
+        chunkFirstStrip.push_back(stripCount);
+        std::vector<float> unpacked(vertexTotal * FLOATS_PER_VERTEX);
+        std::vector<size_t> unpackedBase(geometry.chunks.size());
+        ParallelFor(geometry.chunks.size(), threadCount, [&](size_t c) {
+            auto &chunk = geometry.chunks[c];
+            unpackedBase[c] = static_cast<size_t>(chunk.baseVertex);
+            chunk.vertexCount = BuildSharedChunk(order, chunkFirstStrip[c], chunkFirstStrip[c + 1], chunk.vertexCount,
+                                                 unpacked.data() + unpackedBase[c] * FLOATS_PER_VERTEX,
+                                                 geometry.indices.data() + chunk.firstIndex);
+        });
+        size_t sharedTotal = 0;
+        for (auto &chunk : geometry.chunks) {
+            chunk.baseVertex = static_cast<int32_t>(sharedTotal);
+            sharedTotal += chunk.vertexCount;
+        }
+        geometry.vertices.resize(sharedTotal * FLOATS_PER_VERTEX);
+        ParallelFor(geometry.chunks.size(), threadCount, [&](size_t c) {
+            const auto &chunk = geometry.chunks[c];
+            const auto source = unpacked.begin() + static_cast<ptrdiff_t>(unpackedBase[c] * FLOATS_PER_VERTEX);
+            std::copy(source, source + static_cast<ptrdiff_t>(chunk.vertexCount * FLOATS_PER_VERTEX),
+                      geometry.vertices.begin() + static_cast<ptrdiff_t>(chunk.baseVertex) * FLOATS_PER_VERTEX);
+        });
+        return geometry;
+    }
+
+    // 3) Parallel fill straight into the pre-sized buffers
+    geometry.vertices.resize(vertexTotal * FLOATS_PER_VERTEX);
+    ParallelFor(stripCount, threadCount, [&](size_t i) {
+        const auto &strip = strips_[i];
+        const auto &placement = placements[i];
+        AddLineStripAdjacencyToBuffers(strip.coords->data() + strip.first, strip.count, strip.color,
+                                       geometry.vertices.data() + placement.vertexOffset * FLOATS_PER_VERTEX,
+                                       geometry.indices.data() + placement.indexOffset, placement.localVertex,
+                                       projection_);
+    });
+
+    return geometry;
+}
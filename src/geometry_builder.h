@@ -0,0 +1,114 @@
+#pragma once
+
+#include "osm_loader.h"
+#include "projection.h"
+
+#include <osmium/osm/box.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Vertex layout: x,y,r,g,b, with x,y the projected location (see projection.h)
+constexpr size_t FLOATS_PER_VERTEX = 5;
+
+// Chunks use 16-bit indices. 0xFFFF restarts the line strip so that a whole
+// chunk can be submitted with a single draw call, which leaves 0..0xFFFE for
+// vertices.
+constexpr uint16_t PRIMITIVE_RESTART_INDEX = 0xFFFF;
+constexpr size_t MAX_CHUNK_VERTICES = PRIMITIVE_RESTART_INDEX;
+
+// Indices emitted per strip on top of one per vertex: the duplicated first and
+// last vertex (adjacency) and the primitive restart
+constexpr size_t EXTRA_INDICES_PER_STRIP = 3;
+
+// A spatially coherent group of line strips sharing a 16-bit index range
+struct GeometryChunk {
+    osmium::Box bounds{};
+    size_t layer{0};
+    int32_t baseVertex{0}; // first vertex of the chunk in the shared VBO
+    size_t vertexCount{0};
+    size_t firstIndex{0};  // offset (in indices, not bytes) into the shared EBO
+    size_t indexCount{0};
+};
+
+// Chunks of one render layer; they are contiguous in `chunks` (and so in the
+// EBO) because chunks are ordered by layer first
+struct LayerRange {
+    size_t firstChunk{0};
+    size_t chunkCount{0};
+};
+
+struct ChunkedGeometry {
+    std::vector<float> vertices;
+    std::vector<uint16_t> indices;
+    std::vector<GeometryChunk> chunks;
+    std::vector<LayerRange> layers;
+    // Vertices of all strips before sharing; vertices.size() /
+    // FLOATS_PER_VERTEX when vertices are not shared
+    size_t stripVertexCount{0};
+};
+
+bool BoxesIntersect(const osmium::Box &a, const osmium::Box &b);
+
+// Write one GL_LINE_STRIP_ADJACENCY strip into pre-sized buffers: `count`
+// vertices starting at `coords` go to `vertices`, and count +
+// EXTRA_INDICES_PER_STRIP indices (relative to the chunk, starting at
+// `firstLocalVertex`) go to `indices`. The first and last vertex are
+// duplicated as adjacency and the strip ends with a primitive restart.
+void AddLineStripAdjacencyToBuffers(const OSMLoader::Coordinate *coords, size_t count,
+                                    const std::array<float, 3> &color, float *vertices, uint16_t *indices,
+                                    size_t firstLocalVertex, Projection projection = Projection::Equirectangular);
+
+// Buckets line strips by render layer and then into a uniform grid over the
+// data bounds, and packs each (layer, cell) into one or more chunks of at most
+// MAX_CHUNK_VERTICES vertices. Within a chunk strips keep insertion order.
+// Vertices are projected with `projection`; the grid and the chunk bounds
+// stay in lon/lat.
+class GeometryBuilder {
+  public:
+    using Color_t = std::array<float, 3>;
+
+    GeometryBuilder(const osmium::Box &bounds, size_t gridSize = 16, size_t layerCount = 1,
+                    Projection projection = Projection::Equirectangular);
+
+    // Emit one vertex per distinct (location, colour) within each chunk and
+    // let every strip through it index that vertex, instead of one vertex per
+    // strip coordinate. Intersections and ring closures then share a vertex,
+    // which shrinks the VBO; the index buffer is unchanged. Off by default.
+    void SetShareVertices(bool share) { shareVertices_ = share; }
+
+    // `coords` must outlive the call to Build()
+    void AddLineStrip(const OSMLoader::Coordinates &coords, const Color_t &color, size_t layer = 0);
+
+    // Builds the buffers in three passes: a parallel counting pass (strip
+    // bounds and grid cell), a prefix sum that assigns every strip its chunk
+    // and vertex/index offsets, and a parallel fill straight into the
+    // pre-sized output. `threadCount` 0 uses every core. The result does not
+    // depend on the thread count.
+    ChunkedGeometry Build(size_t threadCount = 0) const;
+
+  private:
+    struct Strip {
+        const OSMLoader::Coordinates *coords{nullptr};
+        size_t first{0}; // sub-range of coords, used to split very long ways
+        size_t count{0};
+        Color_t color{};
+        size_t layer{0};
+    };
+
+    size_t CellIndex(const osmium::Box &stripBounds) const;
+    // Fill pass of a chunk with shared vertices: its strips are
+    // order[firstStrip, lastStrip), with at most `maxVertices` vertices
+    // before sharing. Returns the number of vertices written.
+    size_t BuildSharedChunk(const std::vector<size_t> &order, size_t firstStrip, size_t lastStrip,
+                            size_t maxVertices, float *vertices, uint16_t *indices) const;
+
+    osmium::Box bounds_;
+    size_t gridSize_;
+    size_t layerCount_;
+    Projection projection_;
+    bool shareVertices_{false};
+    std::vector<Strip> strips_;
+};
@@ -0,0 +1,252 @@
+#include "gl_tile_renderer.h"
+#include "map_style.h"
+
+#include <shaders.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+GLuint CreateFramebuffer(GLuint &colorBuffer, uint32_t size, int samples) {
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    if (samples > 0) {
+        glRenderbufferStorageMultisample(GL_RENDERBUFFER, samples, GL_RGBA8, size, size);
+    } else {
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+    }
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    GLuint framebuffer = 0;
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    const GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("tile framebuffer is incomplete (status " + std::to_string(status) + ")");
+    }
+    return framebuffer;
+}
+
+} // namespace
+
+GLTileRenderer::GLTileRenderer(const ChunkedGeometry &geometry, const RenderLayerTable &layerTable,
+                               const GLTileRendererOptions &options)
+    : geometry_(geometry), layerTable_(layerTable), options_(options) {
+    if (options_.tileSize == 0) {
+        throw std::runtime_error("tile size must be positive");
+    }
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxSize);
+    if (options_.tileSize > static_cast<uint32_t>(maxSize)) {
+        throw std::runtime_error("tile size exceeds GL_MAX_RENDERBUFFER_SIZE (" + std::to_string(maxSize) + ")");
+    }
+    GLint maxSamples = 0;
+    glGetIntegerv(GL_MAX_SAMPLES, &maxSamples);
+    options_.samples = std::clamp(options_.samples, 0, static_cast<int>(maxSamples));
+    options_.readbackDepth = std::max<size_t>(1, options_.readbackDepth);
+
+    program_.vertexShaderSource_ = VertexShader;
+    program_.geometryShaderSource_ = GeometryShader;
+    program_.fragmentShaderSource_ = FragmentShader;
+    program_.Build();
+    if (!program_.IsReady()) {
+        throw std::runtime_error(program_.lastBuildLog_.str());
+    }
+    boundsLoc_ = glGetUniformLocation(program_.shaderProgram_.value(), "uBounds");
+    lineWidthLoc_ = glGetUniformLocation(program_.shaderProgram_.value(), "uLineWidth");
+    for (size_t layer = 0; layer < layerTable_.LayerCount(); ++layer) {
+        maxLineWidth_ = std::max(maxLineWidth_, layerTable_.GetLayer(layer).lineWidth);
+    }
+
+    // Same buffer layout as the canvas: one VBO and EBO, chunks drawn with a base vertex
+    glGenVertexArrays(1, &VAO_);
+    glBindVertexArray(VAO_);
+    glGenBuffers(1, &VBO_);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_);
+    glBufferData(GL_ARRAY_BUFFER, geometry_.vertices.size() * sizeof(float), geometry_.vertices.data(),
+                 GL_STATIC_DRAW);
+    glGenBuffers(1, &EBO_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry_.indices.size() * sizeof(uint16_t), geometry_.indices.data(),
+                 GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), reinterpret_cast<void *>(0));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float),
+                          reinterpret_cast<void *>(2 * sizeof(float)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    resolveFBO_ = CreateFramebuffer(resolveColor_, options_.tileSize, 0);
+    if (options_.samples > 0) {
+        drawFBO_ = CreateFramebuffer(drawColor_, options_.tileSize, options_.samples);
+    }
+
+    const GLsizeiptr imageBytes = GLsizeiptr{options_.tileSize} * options_.tileSize * 4;
+    readbacks_.resize(options_.readbackDepth);
+    for (auto &readback : readbacks_) {
+        glGenBuffers(1, &readback.pbo);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+        glBufferData(GL_PIXEL_PACK_BUFFER, imageBytes, nullptr, GL_STREAM_READ);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+}
+
+GLTileRenderer::~GLTileRenderer() {
+    for (auto &readback : readbacks_) {
+        if (readback.fence != nullptr) {
+            glDeleteSync(readback.fence);
+        }
+        glDeleteBuffers(1, &readback.pbo);
+    }
+    glDeleteFramebuffers(1, &resolveFBO_);
+    glDeleteRenderbuffers(1, &resolveColor_);
+    if (drawFBO_ != 0) {
+        glDeleteFramebuffers(1, &drawFBO_);
+        glDeleteRenderbuffers(1, &drawColor_);
+    }
+    glDeleteBuffers(1, &EBO_);
+    glDeleteBuffers(1, &VBO_);
+    glDeleteVertexArrays(1, &VAO_);
+    if (program_.shaderProgram_) {
+        glDeleteProgram(program_.shaderProgram_.value());
+    }
+}
+
+void GLTileRenderer::Render(const std::vector<TileId> &tiles, const std::function<void(TileImage &&)> &onTile) {
+    // readbacks_[next] always holds the oldest tile in flight
+    size_t next = 0;
+    for (const auto &tile : tiles) {
+        auto &readback = readbacks_[next];
+        if (readback.fence != nullptr) {
+            onTile(FinishReadback(readback));
+        }
+        Draw(tile);
+        StartReadback(readback, tile);
+        next = (next + 1) % readbacks_.size();
+    }
+    for (size_t i = 0; i < readbacks_.size(); ++i) {
+        auto &readback = readbacks_[(next + i) % readbacks_.size()];
+        if (readback.fence != nullptr) {
+            onTile(FinishReadback(readback));
+        }
+    }
+}
+
+void GLTileRenderer::Draw(const TileId &tile) {
+    const GLsizei size = static_cast<GLsizei>(options_.tileSize);
+    glBindFramebuffer(GL_FRAMEBUFFER, drawFBO_ != 0 ? drawFBO_ : resolveFBO_);
+    glViewport(0, 0, size, size);
+
+    // Tiles are opaque: clear alpha to 1 and keep it there while blending
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    glClearColor(MAP_CLEAR_COLOR, MAP_CLEAR_COLOR, MAP_CLEAR_COLOR, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_FALSE);
+
+    const osmium::Box bounds = TileBounds(tile);
+    const auto projection = options_.projection;
+    const double bottom = ProjectLat(projection, bounds.bottom());
+    const double top = ProjectLat(projection, bounds.top());
+    const double lonRange = bounds.right() - bounds.left();
+    glUseProgram(program_.shaderProgram_.value());
+    if (boundsLoc_ >= 0) {
+        glUniform4f(boundsLoc_, static_cast<float>(bounds.left()), static_cast<float>(bottom),
+                    static_cast<float>(lonRange), static_cast<float>(top - bottom));
+    }
+
+    // Lines just outside the tile still reach into it by up to a line width
+    const double lonMargin = maxLineWidth_ * 0.5 * lonRange;
+    const double yMargin = maxLineWidth_ * 0.5 * (top - bottom);
+    const osmium::Box visibleBounds{bounds.left() - lonMargin, UnprojectY(projection, bottom - yMargin),
+                                    bounds.right() + lonMargin, UnprojectY(projection, top + yMargin)};
+
+    glEnable(GL_PRIMITIVE_RESTART);
+    glPrimitiveRestartIndex(PRIMITIVE_RESTART_INDEX);
+    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    glBindVertexArray(VAO_);
+    for (size_t layer = 0; layer < geometry_.layers.size(); ++layer) {
+        const auto &style = layerTable_.GetLayer(layer);
+        if (style.blend) {
+            glEnable(GL_BLEND);
+        } else {
+            glDisable(GL_BLEND);
+        }
+        if (lineWidthLoc_ >= 0) {
+            glUniform1f(lineWidthLoc_, style.lineWidth);
+        }
+
+        const auto &range = geometry_.layers[layer];
+        for (size_t i = range.firstChunk; i < range.firstChunk + range.chunkCount; ++i) {
+            const auto &chunk = geometry_.chunks[i];
+            if (!BoxesIntersect(chunk.bounds, visibleBounds)) {
+                continue;
+            }
+            const void *offset = reinterpret_cast<const void *>(chunk.firstIndex * sizeof(uint16_t));
+            glDrawElementsBaseVertex(GL_LINE_STRIP_ADJACENCY, static_cast<GLsizei>(chunk.indexCount),
+                                     GL_UNSIGNED_SHORT, offset, chunk.baseVertex);
+        }
+    }
+    glBindVertexArray(0);
+
+    if (drawFBO_ != 0) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, drawFBO_);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, resolveFBO_);
+        glBlitFramebuffer(0, 0, size, size, 0, 0, size, size, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+    }
+}
+
+void GLTileRenderer::StartReadback(Readback &readback, const TileId &tile) {
+    const GLsizei size = static_cast<GLsizei>(options_.tileSize);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, resolveFBO_);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    // With a pack buffer bound this only queues the copy
+    glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    readback.tile = tile;
+    // Submit now so the GPU works on this tile while the CPU prepares the next
+    glFlush();
+}
+
+TileImage GLTileRenderer::FinishReadback(Readback &readback) {
+    constexpr GLuint64 WAIT_NANOSECONDS = 100'000'000;
+    GLenum result;
+    do {
+        result = glClientWaitSync(readback.fence, GL_SYNC_FLUSH_COMMANDS_BIT, WAIT_NANOSECONDS);
+    } while (result == GL_TIMEOUT_EXPIRED);
+    glDeleteSync(readback.fence);
+    readback.fence = nullptr;
+    if (result == GL_WAIT_FAILED) {
+        throw std::runtime_error("waiting for a tile readback failed");
+    }
+
+    TileImage image;
+    image.tile = readback.tile;
+    image.size = options_.tileSize;
+    const size_t rowBytes = size_t{image.size} * 4;
+    image.pixels.resize(rowBytes * image.size);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.pbo);
+    const auto *mapped = static_cast<const uint8_t *>(
+        glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, static_cast<GLsizeiptr>(image.pixels.size()), GL_MAP_READ_BIT));
+    if (mapped == nullptr) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+        throw std::runtime_error("mapping a tile readback buffer failed");
+    }
+    // GL rows run bottom to top
+    for (uint32_t row = 0; row < image.size; ++row) {
+        std::memcpy(image.pixels.data() + row * rowBytes, mapped + (image.size - 1 - row) * rowBytes, rowBytes);
+    }
+    glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    return image;
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "geometry_builder.h"
+#include "render_layers.h"
+#include "shaderprogram.h"
+#include "tile_pyramid.h"
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+// Renders z/x/y map tiles on the GPU with the viewer's shaders and buffer
+// layout, for batch export. Needs a current OpenGL 3.3 context (see
+// OffscreenContext). The geometry is uploaded once; each tile is then a
+// uBounds change, a draw of the chunks that overlap it into a framebuffer
+// object, and a glReadPixels into a pixel buffer object. Readbacks are
+// asynchronous: a ring of PBOs with fences lets the GPU draw the next tiles
+// while earlier ones are copied back, and a tile is only mapped once its
+// fence has been passed `readbackDepth` tiles later.
+//
+// Like the canvas, the vertex shader maps lon/lat linearly, so each tile is
+// its Mercator bounds stretched over the image; tile edges match exactly and
+// the error inside a tile is negligible beyond the lowest zooms.
+
+struct TileImage {
+    TileId tile;
+    uint32_t size{0};
+    std::vector<uint8_t> pixels; // RGBA, rows from top to bottom
+};
+
+struct GLTileRendererOptions {
+    uint32_t tileSize{256};
+    // MSAA samples of the draw framebuffer; 0 draws aliased lines like the viewer
+    int samples{4};
+    // Tiles in flight between drawing and mapping their pixels
+    size_t readbackDepth{3};
+    // Projection the geometry was built with. Tiles are Web Mercator, so
+    // only that draws them undistorted.
+    Projection projection{Projection::WebMercator};
+};
+
+class GLTileRenderer {
+  public:
+    // Throws std::runtime_error if the shaders or framebuffers can't be created
+    GLTileRenderer(const ChunkedGeometry &geometry, const RenderLayerTable &layerTable,
+                   const GLTileRendererOptions &options);
+    ~GLTileRenderer();
+
+    GLTileRenderer(const GLTileRenderer &) = delete;
+    GLTileRenderer &operator=(const GLTileRenderer &) = delete;
+
+    // Draw every tile and call `onTile` with its pixels as they arrive, in
+    // the order of `tiles`, on the calling thread
+    void Render(const std::vector<TileId> &tiles, const std::function<void(TileImage &&)> &onTile);
+
+  private:
+    struct Readback {
+        GLuint pbo{0};
+        GLsync fence{nullptr};
+        TileId tile;
+    };
+
+    void Draw(const TileId &tile);
+    void StartReadback(Readback &readback, const TileId &tile);
+    TileImage FinishReadback(Readback &readback);
+
+    const ChunkedGeometry &geometry_;
+    const RenderLayerTable &layerTable_;
+    GLTileRendererOptions options_;
+
+    ShaderProgram program_;
+    GLint boundsLoc_{-1};
+    GLint lineWidthLoc_{-1};
+    float maxLineWidth_{0.0f};
+
+    GLuint VAO_{0};
+    GLuint VBO_{0};
+    GLuint EBO_{0};
+
+    // The multisampled framebuffer is resolved into `resolveFBO_`, which is
+    // also the one drawn to without MSAA
+    GLuint drawFBO_{0};
+    GLuint drawColor_{0};
+    GLuint resolveFBO_{0};
+    GLuint resolveColor_{0};
+
+    std::vector<Readback> readbacks_;
+};
@@ -0,0 +1,78 @@
+#include "gpu_residency.h"
+
+#include <utility>
+
+GpuResidency::GpuResidency(size_t budgetBytes, size_t frameUploadBytes) : frameUploadBytes_(frameUploadBytes) {
+    stats_.budgetBytes = budgetBytes;
+}
+
+void GpuResidency::Reset(std::vector<size_t> batchBytes) {
+    bytes_ = std::move(batchBytes);
+    const size_t count = bytes_.size();
+    resident_.assign(count, false);
+    lastVisibleFrame_.assign(count, 0);
+    prev_.assign(count, NONE);
+    next_.assign(count, NONE);
+    head_ = NONE;
+    tail_ = NONE;
+
+    const size_t budget = stats_.budgetBytes;
+    stats_ = Stats{};
+    stats_.budgetBytes = budget;
+    stats_.totalBatches = count;
+    for (const auto bytes : bytes_) {
+        stats_.totalBytes += bytes;
+    }
+}
+
+void GpuResidency::BeginFrame() {
+    ++frame_;
+    frameUploaded_ = 0;
+}
+
+void GpuResidency::Unlink(size_t batch) {
+    const size_t prev = prev_[batch];
+    const size_t next = next_[batch];
+    (prev == NONE ? head_ : next_[prev]) = next;
+    (next == NONE ? tail_ : prev_[next]) = prev;
+    prev_[batch] = NONE;
+    next_[batch] = NONE;
+}
+
+void GpuResidency::PushFront(size_t batch) {
+    next_[batch] = head_;
+    prev_[batch] = NONE;
+    (head_ == NONE ? tail_ : prev_[head_]) = batch;
+    head_ = batch;
+}
+
+void GpuResidency::MarkResident(size_t batch) {
+    resident_[batch] = true;
+    PushFront(batch);
+    frameUploaded_ += bytes_[batch];
+    stats_.residentBytes += bytes_[batch];
+    ++stats_.residentBatches;
+    ++stats_.uploads;
+    stats_.uploadedBytes += bytes_[batch];
+}
+
+void GpuResidency::MarkEvicted(size_t batch) {
+    resident_[batch] = false;
+    Unlink(batch);
+    stats_.residentBytes -= bytes_[batch];
+    --stats_.residentBatches;
+    ++stats_.evictions;
+}
+
+size_t GpuResidency::EvictionCandidate() const {
+    // Visible batches are moved to the front as they are requested, so if
+    // the tail was seen in this frame every resident batch was
+    if (tail_ == NONE || lastVisibleFrame_[tail_] == frame_) {
+        return NONE;
+    }
+    return tail_;
+}
+
+bool GpuResidency::FitsFrameUploads(size_t bytes) const {
+    return frameUploadBytes_ == 0 || frameUploaded_ == 0 || frameUploaded_ + bytes <= frameUploadBytes_;
+}
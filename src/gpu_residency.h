@@ -0,0 +1,117 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Byte budget for geometry batches that live in GPU memory. Resident batches
+// are kept in least-recently-visible order; when a visible batch has to be
+// uploaded, the batches that have been out of view the longest are evicted
+// until it fits. This is only the bookkeeping: the caller owns the buffers
+// and uploads/frees them from the callbacks of Request, so the policy does
+// not depend on GL.
+class GpuResidency {
+  public:
+    struct Stats {
+        size_t budgetBytes{0}; // 0 means unlimited
+        size_t residentBytes{0};
+        size_t totalBytes{0};
+        size_t residentBatches{0};
+        size_t totalBatches{0};
+        uint64_t uploads{0};
+        uint64_t uploadedBytes{0};
+        uint64_t evictions{0};
+        uint64_t deferred{0}; // requests that could not be made resident
+    };
+
+    // `frameUploadBytes` caps how much is uploaded per frame (0 means no
+    // cap), so zooming out spreads the uploads over a few frames instead of
+    // stalling one. The first upload of a frame is always allowed.
+    explicit GpuResidency(size_t budgetBytes = 0, size_t frameUploadBytes = 0);
+
+    // Track `batchBytes.size()` batches, none resident. Any buffers of the
+    // previous batches must already have been freed by the caller.
+    void Reset(std::vector<size_t> batchBytes);
+
+    // Takes effect on the next upload; lowering it does not evict by itself
+    void SetBudget(size_t budgetBytes) { stats_.budgetBytes = budgetBytes; }
+
+    // Start a frame. Batches requested after this count as visible and are
+    // never evicted to make room for another batch of the same frame.
+    void BeginFrame();
+
+    // Mark `batch` visible in this frame and make sure it is resident.
+    // `upload(batch)` is called if it is not, and returns false if the GPU
+    // ran out of memory; the budget is then lowered to what is resident
+    // (unless nothing is). `evict(batch)` is called for every batch dropped
+    // to make room. Returns whether the batch is resident and can be drawn.
+    template <typename Upload, typename Evict> bool Request(size_t batch, Upload &&upload, Evict &&evict);
+
+    bool IsResident(size_t batch) const { return resident_[batch]; }
+    size_t BatchBytes(size_t batch) const { return bytes_[batch]; }
+    const Stats &GetStats() const { return stats_; }
+
+  private:
+    static constexpr size_t NONE = std::numeric_limits<size_t>::max();
+
+    // Intrusive list over the batch indices, most recently visible first
+    void Unlink(size_t batch);
+    void PushFront(size_t batch);
+
+    void MarkResident(size_t batch);
+    void MarkEvicted(size_t batch);
+    // The least recently visible batch if it was not visible in this frame
+    size_t EvictionCandidate() const;
+    bool FitsFrameUploads(size_t bytes) const;
+
+    size_t frameUploadBytes_;
+    uint64_t frame_{1}; // 0 marks batches that were never visible
+    size_t frameUploaded_{0};
+
+    std::vector<size_t> bytes_;
+    std::vector<bool> resident_;
+    std::vector<uint64_t> lastVisibleFrame_;
+    std::vector<size_t> prev_;
+    std::vector<size_t> next_;
+    size_t head_{NONE};
+    size_t tail_{NONE};
+
+    Stats stats_;
+};
+
+template <typename Upload, typename Evict> bool GpuResidency::Request(size_t batch, Upload &&upload, Evict &&evict) {
+    lastVisibleFrame_[batch] = frame_;
+    if (resident_[batch]) {
+        Unlink(batch);
+        PushFront(batch);
+        return true;
+    }
+
+    const size_t bytes = bytes_[batch];
+    const size_t budget = stats_.budgetBytes;
+    if (!FitsFrameUploads(bytes) || (budget != 0 && bytes > budget)) {
+        ++stats_.deferred;
+        return false;
+    }
+    while (budget != 0 && stats_.residentBytes + bytes > budget) {
+        const size_t victim = EvictionCandidate();
+        if (victim == NONE) {
+            // Everything resident is on screen
+            ++stats_.deferred;
+            return false;
+        }
+        MarkEvicted(victim);
+        evict(victim);
+    }
+
+    if (!upload(batch)) {
+        if (stats_.residentBytes > 0) {
+            stats_.budgetBytes = stats_.residentBytes;
+        }
+        ++stats_.deferred;
+        return false;
+    }
+    MarkResident(batch);
+    return true;
+}
@@ -1,6 +1,7 @@
 
 #include "openglcanvas.h"
 #include "osm_loader.h"
+#include "tile_pyramid.h"
 
 // TODO: move the wxWidgets functionality into a separate module
 #include <wx/cmdline.h>
@@ -9,15 +10,38 @@
 #include <wx/log.h>
 #include <wx/settings.h>
 #include <wx/splitter.h>
+#include <wx/srchctrl.h>
 #include <wx/stc/stc.h>
 #include <wx/wx.h>
 
+#include <iostream>
 #include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
 
 constexpr size_t IndentWidth = 4;
 
 class MyFrame;
 
+// Suggests indexed names as the search box is typed into
+class NameCompleter : public wxTextCompleterSimple {
+  public:
+    explicit NameCompleter(const OpenGLCanvas &canvas) : canvas_(canvas) {}
+
+    void GetCompletions(const wxString &prefix, wxArrayString &res) wxOVERRIDE {
+        for (const auto &match : canvas_.GetNameIndex().FindPrefix(prefix.utf8_string())) {
+            const auto name = wxString::FromUTF8(match.name.data(), match.name.size());
+            if (res.IsEmpty() || res.Last() != name) {
+                res.Add(name);
+            }
+        }
+    }
+
+  private:
+    const OpenGLCanvas &canvas_;
+};
+
 class MyApp : public wxApp {
   public:
     MyApp() {}
@@ -26,7 +50,17 @@ class MyApp : public wxApp {
     bool OnCmdLineParsed(wxCmdLineParser &parser) wxOVERRIDE;
 
   protected:
-    wxString osmDataFilePath_{};
+    // One or more OSM extracts, or a single .osmtiles pyramid
+    std::vector<std::string> osmDataFilePaths_{};
+    bool releaseCpuGeometry_{false};
+    bool routeCh_{false};
+    bool fastXml_{false};
+    bool shareVertices_{false};
+    wxString tagFilterPath_{};
+    long vramBudgetMb_{0};
+    long joinMemoryMb_{0};
+    double densityRasterThreshold_{1.0};
+    Projection projection_{Projection::WebMercator};
     MyFrame *frame_{nullptr};
     std::shared_ptr<OSMLoader> osmLoader_{nullptr};
 };
@@ -34,17 +68,33 @@ class MyApp : public wxApp {
 class MyFrame : public wxFrame {
   public:
     MyFrame(const wxString &title);
-    bool initialize(const std::shared_ptr<OSMLoader> &osmLoader);
+    bool initialize(const std::shared_ptr<OSMLoader> &osmLoader, bool releaseCpuGeometry, bool routeCh,
+                    size_t vramBudgetBytes, Projection projection, bool shareVertices, double densityRasterThreshold);
+    // Show a tile pyramid instead of loading OSM data; call before initialize
+    void setTilePyramid(std::shared_ptr<const TilePyramid> tilePyramid) { tilePyramid_ = std::move(tilePyramid); }
     bool BuildShaderProgram();
 
   protected:
     void OnOpenGLInitialized(wxCommandEvent &event);
     void StylizeTextCtrl();
     void OnSize(wxSizeEvent &event);
+    // Enter in the search box zooms to the first name starting with the
+    // text; pressing it again steps through the other matches
+    void OnSearch(wxCommandEvent &event);
 
     OpenGLCanvas *openGLCanvas{nullptr};
+    wxSearchCtrl *searchCtrl_{nullptr};
+    wxString lastSearch_{};
+    size_t searchResult_{0};
 
     std::shared_ptr<OSMLoader> osmLoader_{nullptr};
+    bool releaseCpuGeometry_{false};
+    bool routeCh_{false};
+    size_t vramBudgetBytes_{0};
+    Projection projection_{Projection::WebMercator};
+    bool shareVertices_{false};
+    double densityRasterThreshold_{1.0};
+    std::shared_ptr<const TilePyramid> tilePyramid_{nullptr};
 };
 
 wxIMPLEMENT_APP(MyApp);
@@ -54,10 +104,37 @@ bool MyApp::OnInit() {
         return false;
 
     osmLoader_ = std::make_shared<OSMLoader>();
-    osmLoader_->setFilepath(osmDataFilePath_.ToStdString());
+    osmLoader_->setFilepaths(osmDataFilePaths_);
+    osmLoader_->setFastXmlParser(fastXml_);
+    osmLoader_->setJoinMemoryLimit(static_cast<size_t>(joinMemoryMb_) << 20);
+    if (!tagFilterPath_.empty()) {
+        try {
+            osmLoader_->setTagFilter(TagFilter::FromFile(tagFilterPath_.ToStdString()));
+        } catch (const std::exception &e) {
+            std::cerr << e.what() << std::endl;
+            return false;
+        }
+    }
 
-    frame_ = new MyFrame("OpenStreetMap: " + osmDataFilePath_);
-    if (!frame_->initialize(osmLoader_)) {
+    wxString title = "OpenStreetMap:";
+    for (const auto &path : osmDataFilePaths_) {
+        title += " " + wxString(path);
+    }
+    frame_ = new MyFrame(title);
+    if (wxString(osmDataFilePaths_.front()).EndsWith(TILE_PYRAMID_EXTENSION)) {
+        if (osmDataFilePaths_.size() > 1) {
+            std::cerr << "A tile pyramid must be opened on its own" << std::endl;
+            return false;
+        }
+        try {
+            frame_->setTilePyramid(std::make_shared<const TilePyramid>(osmDataFilePaths_.front()));
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return false;
+        }
+    }
+    if (!frame_->initialize(osmLoader_, releaseCpuGeometry_, routeCh_, static_cast<size_t>(vramBudgetMb_) << 20,
+                            projection_, shareVertices_, densityRasterThreshold_)) {
         return false;
     }
     frame_->Show(true);
@@ -69,7 +146,25 @@ void MyApp::OnInitCmdLine(wxCmdLineParser &parser) {
     wxApp::OnInitCmdLine(parser);
 
     static const wxCmdLineEntryDesc cmdLineDesc[] = {
-        {wxCMD_LINE_PARAM, NULL, NULL, "Input OSM datafile", wxCMD_LINE_VAL_STRING}, {wxCMD_LINE_NONE}};
+        {wxCMD_LINE_SWITCH, NULL, "release-cpu-geometry", "Free the CPU copy of the map once it is on the GPU"},
+        {wxCMD_LINE_SWITCH, NULL, "route-ch", "Preprocess the road graph for fast routing (slower load)"},
+        {wxCMD_LINE_SWITCH, NULL, "fast-xml", "Parse .osm files with the parallel memory-mapped XML scanner"},
+        {wxCMD_LINE_SWITCH, NULL, "share-vertices", "Share one vertex between the ways through each map location"},
+        {wxCMD_LINE_OPTION, NULL, "tag-filter", "Tag filter file choosing which objects and tags are loaded",
+         wxCMD_LINE_VAL_STRING},
+        {wxCMD_LINE_OPTION, NULL, "vram-budget", "GPU memory for map geometry in MB; chunks out of view are evicted",
+         wxCMD_LINE_VAL_NUMBER},
+        {wxCMD_LINE_OPTION, NULL, "join-memory",
+         "Join ways with their nodes on disk using at most this many MB, for inputs larger than RAM",
+         wxCMD_LINE_VAL_NUMBER},
+        {wxCMD_LINE_OPTION, NULL, "density-raster",
+         "Draw line density instead of the map once a pixel spans this many grid cells (default 1, 0 = never)",
+         wxCMD_LINE_VAL_DOUBLE},
+        {wxCMD_LINE_OPTION, NULL, "projection", "Map projection: mercator (default) or equirectangular",
+         wxCMD_LINE_VAL_STRING},
+        {wxCMD_LINE_PARAM, NULL, NULL, "Input OSM datafiles (loaded together and merged) or .osmtiles pyramid",
+         wxCMD_LINE_VAL_STRING, wxCMD_LINE_PARAM_MULTIPLE},
+        {wxCMD_LINE_NONE}};
 
     parser.SetDesc(cmdLineDesc);
 }
@@ -78,19 +173,54 @@ bool MyApp::OnCmdLineParsed(wxCmdLineParser &parser) {
     if (!wxApp::OnCmdLineParsed(parser))
         return false;
 
-    if (parser.GetParamCount() > 0) {
-        osmDataFilePath_ = parser.GetParam(0);
-    } else {
+    if (parser.GetParamCount() == 0) {
         return false;
     }
+    for (size_t i = 0; i < parser.GetParamCount(); ++i) {
+        osmDataFilePaths_.push_back(parser.GetParam(i).ToStdString());
+    }
+
+    releaseCpuGeometry_ = parser.Found("release-cpu-geometry");
+    routeCh_ = parser.Found("route-ch");
+    fastXml_ = parser.Found("fast-xml");
+    shareVertices_ = parser.Found("share-vertices");
+    parser.Found("tag-filter", &tagFilterPath_);
+    if (parser.Found("vram-budget", &vramBudgetMb_) && vramBudgetMb_ < 0) {
+        std::cerr << "--vram-budget must not be negative" << std::endl;
+        return false;
+    }
+    if (parser.Found("join-memory", &joinMemoryMb_) && joinMemoryMb_ < 0) {
+        std::cerr << "--join-memory must not be negative" << std::endl;
+        return false;
+    }
+    if (parser.Found("density-raster", &densityRasterThreshold_) && densityRasterThreshold_ < 0.0) {
+        std::cerr << "--density-raster must not be negative" << std::endl;
+        return false;
+    }
+    if (wxString projection; parser.Found("projection", &projection)) {
+        try {
+            projection_ = ParseProjection(projection.ToStdString());
+        } catch (const std::runtime_error &e) {
+            std::cerr << e.what() << std::endl;
+            return false;
+        }
+    }
 
     return true;
 }
 
 MyFrame::MyFrame(const wxString &title) : wxFrame(nullptr, wxID_ANY, title) {}
 
-bool MyFrame::initialize(const std::shared_ptr<OSMLoader> &osmLoader) {
+bool MyFrame::initialize(const std::shared_ptr<OSMLoader> &osmLoader, bool releaseCpuGeometry, bool routeCh,
+                         size_t vramBudgetBytes, Projection projection, bool shareVertices,
+                         double densityRasterThreshold) {
     osmLoader_ = osmLoader;
+    releaseCpuGeometry_ = releaseCpuGeometry;
+    routeCh_ = routeCh;
+    vramBudgetBytes_ = vramBudgetBytes;
+    projection_ = projection;
+    shareVertices_ = shareVertices;
+    densityRasterThreshold_ = densityRasterThreshold;
 
     wxGLAttributes vAttrs;
     vAttrs.PlatformDefaults().Defaults().EndList();
@@ -100,7 +230,17 @@ bool MyFrame::initialize(const std::shared_ptr<OSMLoader> &osmLoader) {
         return false;
     }
 
+    searchCtrl_ = new wxSearchCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxDefaultSize,
+                                   wxTE_PROCESS_ENTER);
+    searchCtrl_->SetDescriptiveText("Search names");
     openGLCanvas = new OpenGLCanvas(this, vAttrs);
+    searchCtrl_->AutoComplete(new NameCompleter(*openGLCanvas));
+    searchCtrl_->Bind(wxEVT_SEARCH, &MyFrame::OnSearch, this);
+
+    auto *sizer = new wxBoxSizer(wxVERTICAL);
+    sizer->Add(searchCtrl_, wxSizerFlags().Expand().Border(wxALL, FromDIP(4)));
+    sizer->Add(openGLCanvas, wxSizerFlags(1).Expand());
+    SetSizer(sizer);
 
     this->Bind(wxEVT_OPENGL_INITIALIZED, &MyFrame::OnOpenGLInitialized, this);
 
@@ -109,6 +249,16 @@ bool MyFrame::initialize(const std::shared_ptr<OSMLoader> &osmLoader) {
 
     this->Bind(wxEVT_SIZE, &MyFrame::OnSize, this);
 
+    if (tilePyramid_) {
+        std::cout << "Opened tile pyramid with " << tilePyramid_->TileCount() << " tiles, zoom "
+                  << tilePyramid_->MinZoom() << "-" << tilePyramid_->MaxZoom() << std::endl;
+        openGLCanvas->SetReleaseCpuGeometry(releaseCpuGeometry_);
+        openGLCanvas->SetVramBudget(vramBudgetBytes_);
+        openGLCanvas->SetProjection(projection_);
+        openGLCanvas->SetTilePyramid(tilePyramid_);
+        return true;
+    }
+
     const auto bounds = osmium::Box({-122.50035, 37.84373}, {-122.46780, 37.85918});
 
     auto data = osmLoader_->getData(bounds);
@@ -134,9 +284,15 @@ bool MyFrame::initialize(const std::shared_ptr<OSMLoader> &osmLoader) {
     std::cout << "Total nodes in loaded areas: " << nodeCount << std::endl;
 
     // Upload ways into the OpenGL canvas so it can replace the
-    // VBO/EBO.
+    // VBO/EBO. The snapshot is moved so the canvas holds the only reference.
     if (openGLCanvas) {
-        openGLCanvas->SetData(*data, bounds);
+        openGLCanvas->SetReleaseCpuGeometry(releaseCpuGeometry_);
+        openGLCanvas->SetUseContractionHierarchy(routeCh_);
+        openGLCanvas->SetVramBudget(vramBudgetBytes_);
+        openGLCanvas->SetProjection(projection_);
+        openGLCanvas->SetShareVertices(shareVertices_);
+        openGLCanvas->SetDensityRasterThreshold(densityRasterThreshold_);
+        openGLCanvas->SetData(std::move(data), bounds);
     }
 
     return true;
@@ -144,6 +300,13 @@ bool MyFrame::initialize(const std::shared_ptr<OSMLoader> &osmLoader) {
 
 void MyFrame::OnOpenGLInitialized(wxCommandEvent &event) {}
 
+void MyFrame::OnSearch(wxCommandEvent &event) {
+    const wxString query = event.GetString();
+    searchResult_ = query == lastSearch_ ? searchResult_ + 1 : 0;
+    lastSearch_ = query;
+    openGLCanvas->SearchName(query.utf8_string(), searchResult_);
+}
+
 wxFont GetMonospacedFont(wxFontInfo &&fontInfo) {
     const wxString preferredFonts[] = {"Menlo", "Consolas", "Monaco", "DejaVu Sans Mono", "Courier New"};
 
@@ -0,0 +1,238 @@
+#include "map_style.h"
+#include "parallel.h"
+#include "polygon_triangulation.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using Color_t = GeometryBuilder::Color_t;
+
+const std::unordered_map<std::string, Color_t> HIGHWAY2COLOR = {
+    {"motorway", {1.0f, 0.35f, 0.35f}},   {"motorway_link", {1.0f, 0.6f, 0.6f}},
+    {"secondary", {1.0f, 0.75f, 0.4f}},   {"tertiary", {1.0f, 1.0f, 0.6f}},
+    {"residential", {1.0f, 1.0f, 1.0f}},  {"unclassified", {0.95f, 0.95f, 0.95f}},
+    {"service", {0.8f, 0.8f, 0.8f}},      {"track", {0.65f, 0.55f, 0.4f}},
+    {"pedestrian", {0.85f, 0.8f, 0.85f}}, {"footway", {0.9f, 0.7f, 0.7f}},
+    {"path", {0.6f, 0.7f, 0.6f}},         {"steps", {0.7f, 0.4f, 0.4f}},
+    {"platform", {0.6f, 0.6f, 0.8f}}};
+constexpr Color_t AREA_COLOR = {0.2f, 0.89f, 0.1f};
+
+const std::unordered_map<std::string, size_t> HIGHWAY2DENSITY_CLASS = {
+    {"motorway", DENSITY_MAJOR_ROADS},  {"motorway_link", DENSITY_MAJOR_ROADS}, {"trunk", DENSITY_MAJOR_ROADS},
+    {"trunk_link", DENSITY_MAJOR_ROADS}, {"primary", DENSITY_MAJOR_ROADS},      {"primary_link", DENSITY_MAJOR_ROADS},
+    {"secondary", DENSITY_MINOR_ROADS}, {"secondary_link", DENSITY_MINOR_ROADS}, {"tertiary", DENSITY_MINOR_ROADS},
+    {"tertiary_link", DENSITY_MINOR_ROADS}};
+// The motorway, secondary and residential colours, and AREA_COLOR
+constexpr std::array<Color_t, DENSITY_CLASS_COUNT> DENSITY_CLASS_COLORS = {
+    {{1.0f, 0.35f, 0.35f}, {1.0f, 0.75f, 0.4f}, {1.0f, 1.0f, 1.0f}, AREA_COLOR}};
+
+template <typename Map> std::vector<const typename Map::mapped_type *> SortedById(const Map &map) {
+    std::vector<const typename Map::mapped_type *> sorted;
+    sorted.reserve(map.size());
+    for (const auto &entry : map) {
+        sorted.push_back(&entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) { return a->id < b->id; });
+    return sorted;
+}
+
+// Each outer ring is a little darker than the one before
+void DarkenForNextRing(Color_t &color) {
+    for (auto &component : color) {
+        component *= 0.8f;
+    }
+}
+
+// A closed ring joined from the outer ways of an area, and the index of the
+// way it starts with
+struct JoinedRing {
+    OSMLoader::Coordinates nodes;
+    size_t firstWay;
+};
+
+uint64_t EndpointKey(const osmium::Location &location) {
+    return (static_cast<uint64_t>(static_cast<uint32_t>(location.x())) << 32) | static_cast<uint32_t>(location.y());
+}
+
+// Join the outer ways of an area end to end into closed rings. Each entry of
+// outerRings is one member way, so a boundary is usually a chain of open
+// ways; they are followed through shared end nodes in either direction.
+// Chains that never close (ways missing from the extract or cut by the
+// bounds) are dropped, since filling them would close them with a chord.
+std::vector<JoinedRing> JoinOuterRings(const std::vector<OSMLoader::Coordinates> &ways) {
+    // End nodes of the open ways, sorted by location
+    std::vector<std::pair<uint64_t, size_t>> ends;
+    for (size_t w = 0; w < ways.size(); ++w) {
+        if (ways[w].size() >= 2 && ways[w].front() != ways[w].back()) {
+            ends.emplace_back(EndpointKey(ways[w].front()), w);
+            ends.emplace_back(EndpointKey(ways[w].back()), w);
+        }
+    }
+    std::sort(ends.begin(), ends.end());
+
+    std::vector<JoinedRing> rings;
+    std::vector<bool> used(ways.size(), false);
+    for (size_t w = 0; w < ways.size(); ++w) {
+        if (used[w] || ways[w].size() < 2) {
+            continue;
+        }
+        used[w] = true;
+        JoinedRing ring{ways[w], w};
+        while (ring.nodes.front() != ring.nodes.back()) {
+            const uint64_t key = EndpointKey(ring.nodes.back());
+            auto it = std::lower_bound(ends.begin(), ends.end(), std::make_pair(key, size_t{0}));
+            while (it != ends.end() && it->first == key && used[it->second]) {
+                ++it;
+            }
+            if (it == ends.end() || it->first != key) {
+                break;
+            }
+            used[it->second] = true;
+            const auto &next = ways[it->second];
+            if (next.front() == ring.nodes.back()) {
+                ring.nodes.insert(ring.nodes.end(), next.begin() + 1, next.end());
+            } else {
+                ring.nodes.insert(ring.nodes.end(), next.rbegin() + 1, next.rend());
+            }
+        }
+        if (ring.nodes.size() >= 4 && ring.nodes.front() == ring.nodes.back()) {
+            rings.push_back(std::move(ring));
+        }
+    }
+    return rings;
+}
+
+} // namespace
+
+const Color_t &RouteColor(const OSMLoader::Route_t &route) {
+    const auto highway = route.tags.find(HIGHWAY_TAG);
+    if (highway == route.tags.end()) {
+        return DEFAULT_ROUTE_COLOR;
+    }
+    const auto color = HIGHWAY2COLOR.find(highway->second);
+    return color == HIGHWAY2COLOR.end() ? DEFAULT_ROUTE_COLOR : color->second;
+}
+
+size_t RouteDensityClass(const OSMLoader::Route_t &route) {
+    const auto highway = route.tags.find(HIGHWAY_TAG);
+    if (highway == route.tags.end()) {
+        return DENSITY_LOCAL_ROADS;
+    }
+    const auto densityClass = HIGHWAY2DENSITY_CLASS.find(highway->second);
+    return densityClass == HIGHWAY2DENSITY_CLASS.end() ? DENSITY_LOCAL_ROADS : densityClass->second;
+}
+
+const Color_t &DensityClassColor(size_t densityClass) {
+    return DENSITY_CLASS_COLORS[std::min(densityClass, DENSITY_CLASS_COUNT - 1)];
+}
+
+void AddMapFeatures(const OSMLoader::OSMData &data, const RenderLayerTable &layerTable, GeometryBuilder &builder) {
+    auto color = AREA_COLOR;
+    const size_t areaLayer = layerTable.AreaLayer();
+    for (const auto *area : SortedById(data.second)) {
+        for (const auto &outerRing : area->outerRings) {
+            builder.AddLineStrip(outerRing, color, areaLayer);
+            DarkenForNextRing(color);
+        }
+    }
+
+    for (const auto *route : SortedById(data.first)) {
+        if (route->nodes.size() < 2)
+            continue;
+        builder.AddLineStrip(route->nodes, RouteColor(*route), layerTable.RouteLayer(*route));
+    }
+}
+
+FillGeometry BuildAreaFills(const OSMLoader::OSMData &data, size_t threadCount, Projection projection) {
+    const auto areas = SortedById(data.second);
+
+    // Colour of every area's first ring, as AddMapFeatures assigns them
+    std::vector<Color_t> firstColors(areas.size());
+    auto color = AREA_COLOR;
+    for (size_t a = 0; a < areas.size(); ++a) {
+        firstColors[a] = color;
+        for (size_t ring = 0; ring < areas[a]->outerRings.size(); ++ring) {
+            DarkenForNextRing(color);
+        }
+    }
+
+    // Triangulate each area on its own, then concatenate them in order
+    std::vector<FillGeometry> parts(areas.size());
+    ParallelFor(areas.size(), threadCount, [&](size_t a) {
+        auto &part = parts[a];
+        const std::vector<uint32_t> noHoles;
+        std::vector<double> xy;
+        std::vector<uint32_t> triangles;
+        for (const auto &joined : JoinOuterRings(areas[a]->outerRings)) {
+            // The closing vertex repeats the first
+            const auto &ring = joined.nodes;
+            const size_t count = ring.size() - 1;
+
+            // Relative to the first vertex so the ear tests keep their precision
+            const double originLon = ring[0].lon();
+            const double originLat = ring[0].lat();
+            xy.clear();
+            for (size_t i = 0; i < count; ++i) {
+                xy.push_back(ring[i].lon() - originLon);
+                xy.push_back(ring[i].lat() - originLat);
+            }
+            triangles.clear();
+            TriangulatePolygon(xy, noHoles, triangles);
+
+            // In the colour of the outline of the ring's first way
+            auto ringColor = firstColors[a];
+            for (size_t w = 0; w < joined.firstWay; ++w) {
+                DarkenForNextRing(ringColor);
+            }
+            const auto firstVertex = static_cast<uint32_t>(part.vertices.size() / FLOATS_PER_VERTEX);
+            part.vertices.resize(part.vertices.size() + count * FLOATS_PER_VERTEX);
+            part.indices.reserve(part.indices.size() + triangles.size());
+            float *vertices = part.vertices.data() + firstVertex * FLOATS_PER_VERTEX;
+            ProjectLocations(projection, ring.data(), count, vertices, FLOATS_PER_VERTEX);
+            for (size_t i = 0; i < count; ++i) {
+                std::copy(ringColor.begin(), ringColor.end(), vertices + i * FLOATS_PER_VERTEX + 2);
+            }
+            for (const auto index : triangles) {
+                part.indices.push_back(firstVertex + index);
+            }
+        }
+    });
+
+    std::vector<size_t> vertexOffsets(parts.size() + 1, 0);
+    std::vector<size_t> indexOffsets(parts.size() + 1, 0);
+    for (size_t a = 0; a < parts.size(); ++a) {
+        vertexOffsets[a + 1] = vertexOffsets[a] + parts[a].vertices.size();
+        indexOffsets[a + 1] = indexOffsets[a] + parts[a].indices.size();
+    }
+    FillGeometry fills;
+    fills.vertices.resize(vertexOffsets.back());
+    fills.indices.resize(indexOffsets.back());
+    ParallelFor(parts.size(), threadCount, [&](size_t a) {
+        std::copy(parts[a].vertices.begin(), parts[a].vertices.end(), fills.vertices.begin() + vertexOffsets[a]);
+        const auto firstVertex = static_cast<uint32_t>(vertexOffsets[a] / FLOATS_PER_VERTEX);
+        std::transform(parts[a].indices.begin(), parts[a].indices.end(), fills.indices.begin() + indexOffsets[a],
+                       [firstVertex](uint32_t index) { return firstVertex + index; });
+    });
+    return fills;
+}
+
+DensityPyramid BuildDensityPyramid(const OSMLoader::OSMData &data, const osmium::Box &bounds, Projection projection,
+                                   size_t threadCount, uint32_t maxSize) {
+    DensityGridBuilder builder(bounds, projection, maxSize);
+    for (const auto *area : SortedById(data.second)) {
+        for (const auto &outerRing : area->outerRings) {
+            builder.AddLineStrip(outerRing, DENSITY_AREAS);
+        }
+    }
+    for (const auto *route : SortedById(data.first)) {
+        builder.AddLineStrip(route->nodes, RouteDensityClass(*route));
+    }
+    return builder.Build(threadCount);
+}
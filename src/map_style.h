@@ -0,0 +1,67 @@
+#pragma once
+
+#include "density_grid.h"
+#include "geometry_builder.h"
+#include "osm_loader.h"
+#include "render_layers.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Colours of the map, shared by the OpenGL canvas and the software
+// rasterizer so both draw the same picture. Area fills are drawn by the
+// canvas only; osm_render and osm_tile_render draw outlines.
+
+// Background grey
+constexpr float MAP_CLEAR_COLOR = 0.87f;
+// Opacity of blended layers; must match house_shader.fs
+constexpr float MAP_LINE_ALPHA = 0.5f;
+// Opacity of area fills in the canvas
+constexpr float AREA_FILL_ALPHA = 0.25f;
+constexpr GeometryBuilder::Color_t DEFAULT_ROUTE_COLOR = {0.5f, 0.5f, 0.5f};
+
+// Colour of a route, by its highway tag
+const GeometryBuilder::Color_t &RouteColor(const OSMLoader::Route_t &route);
+
+// Density grid classes: major roads (motorway, trunk, primary), minor roads
+// (secondary, tertiary), every other highway, and area outlines
+constexpr size_t DENSITY_MAJOR_ROADS = 0;
+constexpr size_t DENSITY_MINOR_ROADS = 1;
+constexpr size_t DENSITY_LOCAL_ROADS = 2;
+constexpr size_t DENSITY_AREAS = 3;
+
+// Density class of a route, by its highway tag
+size_t RouteDensityClass(const OSMLoader::Route_t &route);
+
+// Colour a density class is drawn in, taken from the vector style
+const GeometryBuilder::Color_t &DensityClassColor(size_t densityClass);
+
+// Add the area outlines and then the routes of `data` to `builder`, each in id
+// order so the output (and z-order within a layer) does not depend on
+// unordered_map iteration order
+void AddMapFeatures(const OSMLoader::OSMData &data, const RenderLayerTable &layerTable, GeometryBuilder &builder);
+
+// Triangulated area interiors. The vertex layout is the one ChunkedGeometry
+// uses; indices are 32-bit so every fill can be drawn in one call.
+struct FillGeometry {
+    std::vector<float> vertices;
+    std::vector<uint32_t> indices;
+};
+
+// Triangulate the outer rings of the areas in `data` on `threadCount`
+// threads (0 uses every core), each in the colour of the outline of its
+// first way. The outer ways of an area are joined end to end into rings
+// first, and rings that don't close (ways outside the extract or the
+// bounds) are not filled. The output is in area id order, like
+// AddMapFeatures. Rings are triangulated in lon/lat and their vertices
+// projected with `projection`.
+FillGeometry BuildAreaFills(const OSMLoader::OSMData &data, size_t threadCount = 0,
+                            Projection projection = Projection::Equirectangular);
+
+// Line density of the routes and area outlines of `data` over `bounds`, per
+// density class, built on `threadCount` threads (0 uses every core). See
+// DensityGridBuilder for the grid layout.
+DensityPyramid BuildDensityPyramid(const OSMLoader::OSMData &data, const osmium::Box &bounds,
+                                   Projection projection = Projection::Equirectangular, size_t threadCount = 0,
+                                   uint32_t maxSize = DEFAULT_DENSITY_GRID_SIZE);
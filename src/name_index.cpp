@@ -0,0 +1,338 @@
+#include "name_index.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <tuple>
+
+namespace {
+
+// Base letters of U+0100..U+017F (Latin Extended-A); the ligatures U+0132,
+// U+0133 (ij) and U+0152, U+0153 (oe) are expanded separately
+constexpr char LATIN_EXTENDED_A_BASE[] = "aaaaaaccccccccddddeeeeeeeeeegggggggghhhhiiiiiiiiii"
+                                         "iijjkkkllllllllllnnnnnnnnnoooooooorrrrrrssssssss"
+                                         "ttttttuuuuuuuuuuuuwwyyyzzzzzzs";
+static_assert(sizeof(LATIN_EXTENDED_A_BASE) == 0x80 + 1, "one letter per code point");
+
+// Folded letters of U+00C0..U+00FF (Latin-1); empty for the two operators,
+// which separate words
+constexpr const char *LATIN_1_FOLDED[] = {
+    "a", "a", "a",  "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",  // C0
+    "d", "n", "o",  "o", "o", "o", "o",  "",  "o", "u", "u", "u", "u", "y", "th", "ss", // D0
+    "a", "a", "a",  "a", "a", "a", "ae", "c", "e", "e", "e", "e", "i", "i", "i", "i",  // E0
+    "d", "n", "o",  "o", "o", "o", "o",  "",  "o", "u", "u", "u", "u", "y", "th", "y"}; // F0
+static_assert(std::size(LATIN_1_FOLDED) == 0x40, "one entry per code point");
+
+void AppendUtf8(uint32_t codePoint, std::string &out) {
+    if (codePoint < 0x80) {
+        out += static_cast<char>(codePoint);
+    } else {
+        // Only two-byte code points are ever re-encoded
+        out += static_cast<char>(0xC0 | (codePoint >> 6));
+        out += static_cast<char>(0x80 | (codePoint & 0x3F));
+    }
+}
+
+// Lower-case letters `codePoint` folds to, empty if it separates words;
+// nullopt if it is not a Latin letter
+std::optional<std::string_view> FoldLatin(uint32_t codePoint) {
+    if (codePoint >= 0xC0 && codePoint <= 0xFF) {
+        return LATIN_1_FOLDED[codePoint - 0xC0];
+    }
+    if (codePoint == 0x132 || codePoint == 0x133) {
+        return "ij";
+    }
+    if (codePoint == 0x152 || codePoint == 0x153) {
+        return "oe";
+    }
+    if (codePoint >= 0x100 && codePoint <= 0x17F) {
+        return std::string_view(&LATIN_EXTENDED_A_BASE[codePoint - 0x100], 1);
+    }
+    return std::nullopt;
+}
+
+// Greek and Cyrillic capitals to lower case; everything else is unchanged
+uint32_t LowerCase(uint32_t codePoint) {
+    if ((codePoint >= 0x391 && codePoint <= 0x3A9) || (codePoint >= 0x410 && codePoint <= 0x42F)) {
+        return codePoint + 0x20;
+    }
+    if (codePoint >= 0x400 && codePoint <= 0x40F) {
+        return codePoint + 0x50;
+    }
+    return codePoint;
+}
+
+bool TouchesOrOverlaps(const osmium::Box &a, const osmium::Box &b) {
+    return a.bottom_left().x() <= b.top_right().x() && b.bottom_left().x() <= a.top_right().x() &&
+           a.bottom_left().y() <= b.top_right().y() && b.bottom_left().y() <= a.top_right().y();
+}
+
+struct Named {
+    const std::string *name;
+    osmium::object_id_type id;
+    NameIndex::Kind kind;
+    const OSMLoader::Route_t *route; // one of route and area is set
+    const OSMLoader::Area_t *area;
+    std::string key;
+    osmium::Box bounds;
+};
+
+template <typename Map> std::vector<const typename Map::mapped_type *> SortedById(const Map &map) {
+    std::vector<const typename Map::mapped_type *> sorted;
+    sorted.reserve(map.size());
+    for (const auto &entry : map) {
+        sorted.push_back(&entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) { return a->id < b->id; });
+    return sorted;
+}
+
+// First eight bytes of `key`, big-endian and zero-padded, so comparing them
+// orders keys like comparing the strings does as far as they go
+uint64_t KeyPrefix(const std::string &key) {
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; ++i) {
+        prefix = (prefix << 8) | (i < key.size() ? static_cast<unsigned char>(key[i]) : 0u);
+    }
+    return prefix;
+}
+
+// Union-find root of `i`, halving the path on the way
+size_t Root(std::vector<size_t> &parents, size_t i) {
+    while (parents[i] != i) {
+        parents[i] = parents[parents[i]];
+        i = parents[i];
+    }
+    return i;
+}
+
+} // namespace
+
+std::string NormalizeName(std::string_view name) {
+    std::string key;
+    key.reserve(name.size());
+    bool pendingSpace = false;
+    auto append = [&key, &pendingSpace](std::string_view letters) {
+        if (pendingSpace && !key.empty()) {
+            key += ' ';
+        }
+        pendingSpace = false;
+        key += letters;
+    };
+
+    for (size_t i = 0; i < name.size();) {
+        const auto byte = static_cast<unsigned char>(name[i]);
+        if (byte < 0x80) {
+            ++i;
+            if ((byte >= '0' && byte <= '9') || (byte >= 'a' && byte <= 'z')) {
+                const char letter = static_cast<char>(byte);
+                append({&letter, 1});
+            } else if (byte >= 'A' && byte <= 'Z') {
+                const char letter = static_cast<char>(byte - 'A' + 'a');
+                append({&letter, 1});
+            } else if (byte != '\'') {
+                pendingSpace = true;
+            }
+            continue;
+        }
+
+        // Two-byte sequences cover the Latin, Greek and Cyrillic letters that
+        // are folded; anything longer (or malformed) is copied byte by byte
+        const auto next = i + 1 < name.size() ? static_cast<unsigned char>(name[i + 1]) : 0u;
+        if ((byte & 0xE0) == 0xC0 && (next & 0xC0) == 0x80) {
+            const uint32_t codePoint = ((byte & 0x1Fu) << 6) | (next & 0x3Fu);
+            i += 2;
+            if (const auto folded = FoldLatin(codePoint); !folded) {
+                std::string encoded;
+                AppendUtf8(LowerCase(codePoint), encoded);
+                append(encoded);
+            } else if (folded->empty()) {
+                pendingSpace = true;
+            } else {
+                append(*folded);
+            }
+            continue;
+        }
+        // General punctuation (U+2000..U+206F): typographic apostrophes are
+        // dropped like ASCII ones, dashes, quotes and spaces separate words
+        const auto third = i + 2 < name.size() ? static_cast<unsigned char>(name[i + 2]) : 0u;
+        if (byte == 0xE2 && (next == 0x80 || next == 0x81) && (third & 0xC0) == 0x80) {
+            const uint32_t codePoint = 0x2000 | ((next & 0x3Fu) << 6) | (third & 0x3Fu);
+            i += 3;
+            if (codePoint != 0x2018 && codePoint != 0x2019) {
+                pendingSpace = true;
+            }
+            continue;
+        }
+        append(name.substr(i, 1));
+        ++i;
+    }
+    return key;
+}
+
+NameIndex::NameIndex(const OSMLoader::OSMData &data, size_t threadCount) {
+    // Every named route and area, in id order so merged entries and ties come
+    // out the same on every load
+    std::vector<Named> named;
+    for (const auto *route : SortedById(data.first)) {
+        if (const auto name = route->tags.find(NAME_TAG); name != route->tags.end() && !name->second.empty()) {
+            named.push_back({&name->second, route->id, Kind::Route, route, nullptr, {}, {}});
+        }
+    }
+    for (const auto *area : SortedById(data.second)) {
+        if (const auto name = area->tags.find(NAME_TAG); name != area->tags.end() && !name->second.empty()) {
+            named.push_back({&name->second, area->id, Kind::Area, nullptr, area, {}, {}});
+        }
+    }
+
+    // Keys and bounds, one feature per task
+    ParallelFor(named.size(), threadCount, [&](size_t i) {
+        auto &feature = named[i];
+        feature.key = NormalizeName(*feature.name);
+        auto extend = [&feature](const OSMLoader::Coordinates &coords) {
+            for (const auto &location : coords) {
+                if (location.valid()) {
+                    feature.bounds.extend(location);
+                }
+            }
+        };
+        if (feature.route) {
+            extend(feature.route->nodes);
+        } else {
+            for (const auto &ring : feature.area->outerRings) {
+                extend(ring);
+            }
+        }
+    });
+
+    // Features without a single loaded node can't be shown
+    named.erase(
+        std::remove_if(named.begin(), named.end(), [](const Named &feature) { return !feature.bounds.valid(); }),
+        named.end());
+
+    // Within a key and kind, features stay in id order (tile pieces of one
+    // way share their id, so the position breaks those ties). Most keys
+    // differ in their first bytes, which are compared without touching the
+    // strings.
+    struct SortKey {
+        uint64_t prefix;
+        size_t feature;
+    };
+    std::vector<SortKey> sortKeys(named.size());
+    size_t keyBytes = 0;
+    size_t nameBytes = 0;
+    for (size_t i = 0; i < named.size(); ++i) {
+        sortKeys[i] = {KeyPrefix(named[i].key), i};
+        keyBytes += named[i].key.size();
+        nameBytes += named[i].name->size();
+    }
+    std::sort(sortKeys.begin(), sortKeys.end(), [&named](const SortKey &a, const SortKey &b) {
+        if (a.prefix != b.prefix) {
+            return a.prefix < b.prefix;
+        }
+        const auto &featureA = named[a.feature];
+        const auto &featureB = named[b.feature];
+        return std::tie(featureA.key, featureA.kind, a.feature) < std::tie(featureB.key, featureB.kind, b.feature);
+    });
+    std::vector<size_t> order(named.size());
+    std::transform(sortKeys.begin(), sortKeys.end(), order.begin(), [](const SortKey &key) { return key.feature; });
+    keys_.reserve(keyBytes);
+    names_.reserve(nameBytes);
+
+    // Runs of one key and kind; the features in a run whose bounds touch,
+    // directly or through others, become one entry
+    std::vector<size_t> parents(named.size());
+    std::iota(parents.begin(), parents.end(), 0);
+    std::vector<size_t> byLeft;
+    // Entry of each root feature
+    std::vector<size_t> entryOf(named.size());
+    for (size_t first = 0, last = 0; first < order.size(); first = last) {
+        const auto &head = named[order[first]];
+        last = first + 1;
+        while (last < order.size() && named[order[last]].key == head.key && named[order[last]].kind == head.kind) {
+            ++last;
+        }
+        if (head.key.empty()) {
+            continue;
+        }
+
+        // Sweep the run from west to east, testing each box against those
+        // that start before it ends
+        byLeft.assign(order.begin() + static_cast<std::ptrdiff_t>(first),
+                      order.begin() + static_cast<std::ptrdiff_t>(last));
+        std::sort(byLeft.begin(), byLeft.end(), [&named](size_t a, size_t b) {
+            return named[a].bounds.bottom_left().x() < named[b].bounds.bottom_left().x();
+        });
+        for (size_t i = 0; i < byLeft.size(); ++i) {
+            const auto &box = named[byLeft[i]].bounds;
+            for (size_t j = i + 1; j < byLeft.size(); ++j) {
+                const auto &other = named[byLeft[j]].bounds;
+                if (other.bottom_left().x() > box.top_right().x()) {
+                    break;
+                }
+                if (TouchesOrOverlaps(box, other)) {
+                    const size_t a = Root(parents, byLeft[i]);
+                    const size_t b = Root(parents, byLeft[j]);
+                    // The earliest feature of the run stays the root
+                    parents[std::max(a, b)] = std::min(a, b);
+                }
+            }
+        }
+
+        // Each entry's root is its first feature in the run, so the entries
+        // come out in id order
+        const auto keyOffset = keys_.size();
+        keys_ += head.key;
+        for (size_t i = first; i < last; ++i) {
+            const auto &feature = named[order[i]];
+            const size_t root = Root(parents, order[i]);
+            if (root == order[i]) {
+                entryOf[root] = entries_.size();
+                entries_.push_back(Entry{static_cast<uint32_t>(keyOffset), static_cast<uint32_t>(head.key.size()),
+                                         static_cast<uint32_t>(names_.size()),
+                                         static_cast<uint32_t>(feature.name->size()), feature.id, 1, feature.kind,
+                                         feature.bounds});
+                names_ += *feature.name;
+                continue;
+            }
+            auto &entry = entries_[entryOf[root]];
+            entry.bounds.extend(feature.bounds);
+            ++entry.featureCount;
+        }
+        if (keys_.size() > std::numeric_limits<uint32_t>::max() ||
+            names_.size() > std::numeric_limits<uint32_t>::max()) {
+            throw std::length_error("too many names for the name index");
+        }
+    }
+    keys_.shrink_to_fit();
+    names_.shrink_to_fit();
+    entries_.shrink_to_fit();
+}
+
+std::vector<NameIndex::Match> NameIndex::FindPrefix(std::string_view prefix, size_t limit) const {
+    std::vector<Match> matches;
+    const auto key = NormalizeName(prefix);
+    if (key.empty()) {
+        return matches;
+    }
+
+    auto entry = std::lower_bound(entries_.begin(), entries_.end(), key,
+                                  [this](const Entry &e, const std::string &k) { return Key(e) < k; });
+    for (; entry != entries_.end() && matches.size() < limit; ++entry) {
+        const auto entryKey = Key(*entry);
+        if (entryKey.compare(0, key.size(), key) != 0) {
+            break;
+        }
+        matches.push_back({std::string_view(names_.data() + entry->nameOffset, entry->nameLength), entry->id,
+                           entry->kind, entry->featureCount, entry->bounds});
+    }
+    return matches;
+}
+
+size_t NameIndex::MemoryBytes() const {
+    return keys_.capacity() + names_.capacity() + entries_.capacity() * sizeof(Entry);
+}
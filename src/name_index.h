@@ -0,0 +1,72 @@
+#pragma once
+
+#include "feature_index.h"
+#include "osm_loader.h"
+
+#include <osmium/osm/box.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Matches returned by NameIndex::FindPrefix unless asked for more
+constexpr size_t DEFAULT_NAME_MATCHES = 10;
+
+// Search key of a name: letters are lower-cased, Latin accents are dropped
+// (é -> e, ß -> ss), apostrophes are removed, and every other run of
+// punctuation and white space (ASCII and U+2000..U+206F) becomes one space,
+// trimmed at both ends. Greek and Cyrillic capitals are lower-cased; other
+// text is kept as is.
+std::string NormalizeName(std::string_view name);
+
+// Prefix search over the names of routes and areas, for the search box. The
+// keys (NormalizeName) live in one sorted string table: a single character
+// buffer and an array of entries sorted by key, so a query is a binary search
+// for the prefix and a scan of the entries after it, whatever the number of
+// names. The pieces of one street, ways of the same name whose bounding boxes
+// touch, are merged into a single entry covering all of them.
+class NameIndex {
+  public:
+    using Kind = FeatureIndex::Kind;
+
+    struct Match {
+        std::string_view name;        // as tagged on the lowest id; valid while the index lives
+        osmium::object_id_type id{0}; // lowest id of the merged features
+        Kind kind{Kind::Route};
+        size_t featureCount{1};
+        osmium::Box bounds{};
+    };
+
+    NameIndex() = default;
+    // Keys are built on `threadCount` threads (0 uses every core)
+    explicit NameIndex(const OSMLoader::OSMData &data, size_t threadCount = 0);
+
+    // Up to `limit` entries whose key starts with the key of `prefix`, in key
+    // order (an exact match comes first), then routes before areas and by id.
+    // An empty key matches nothing.
+    std::vector<Match> FindPrefix(std::string_view prefix, size_t limit = DEFAULT_NAME_MATCHES) const;
+
+    size_t EntryCount() const { return entries_.size(); }
+    // Heap memory held by the string table
+    size_t MemoryBytes() const;
+
+  private:
+    struct Entry {
+        uint32_t keyOffset;
+        uint32_t keyLength;
+        uint32_t nameOffset;
+        uint32_t nameLength;
+        osmium::object_id_type id;
+        uint32_t featureCount;
+        Kind kind;
+        osmium::Box bounds;
+    };
+
+    std::string_view Key(const Entry &entry) const { return {keys_.data() + entry.keyOffset, entry.keyLength}; }
+
+    std::string keys_;
+    std::string names_;
+    std::vector<Entry> entries_;
+};
@@ -0,0 +1,147 @@
+#include <GL/glew.h> // must be included before the EGL headers
+
+#include "offscreen_context.h"
+
+#include <EGL/eglext.h>
+
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+bool HasExtension(const char *extensions, const char *name) {
+    if (extensions == nullptr) {
+        return false;
+    }
+    const size_t length = std::strlen(name);
+    for (const char *p = std::strstr(extensions, name); p != nullptr; p = std::strstr(p + length, name)) {
+        const bool startsWord = p == extensions || p[-1] == ' ';
+        const bool endsWord = p[length] == ' ' || p[length] == '\0';
+        if (startsWord && endsWord) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::string EglError(const char *what) {
+    return std::string(what) + " failed (EGL error " + std::to_string(eglGetError()) + ")";
+}
+
+} // namespace
+
+OffscreenContext::OffscreenContext() {
+    // Client extensions are queried without a display
+    const char *clientExtensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (HasExtension(clientExtensions, "EGL_MESA_platform_surfaceless")) {
+        auto getPlatformDisplay =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (getPlatformDisplay != nullptr) {
+            display_ = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        }
+    }
+    if (display_ == EGL_NO_DISPLAY) {
+        display_ = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (display_ == EGL_NO_DISPLAY) {
+        throw std::runtime_error("no EGL display available");
+    }
+    EGLint major = 0, minor = 0;
+    if (!eglInitialize(display_, &major, &minor)) {
+        display_ = EGL_NO_DISPLAY;
+        throw std::runtime_error(EglError("eglInitialize"));
+    }
+
+    try {
+        const bool surfaceless =
+            HasExtension(eglQueryString(display_, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context");
+
+        // The surfaceless platform has no window configs, so don't ask for the
+        // default EGL_WINDOW_BIT
+        const EGLint configAttributes[] = {EGL_SURFACE_TYPE,
+                                           surfaceless ? 0 : EGL_PBUFFER_BIT,
+                                           EGL_RENDERABLE_TYPE,
+                                           EGL_OPENGL_BIT,
+                                           EGL_RED_SIZE,
+                                           8,
+                                           EGL_GREEN_SIZE,
+                                           8,
+                                           EGL_BLUE_SIZE,
+                                           8,
+                                           EGL_ALPHA_SIZE,
+                                           8,
+                                           EGL_NONE};
+        EGLConfig config = nullptr;
+        EGLint configCount = 0;
+        if (!eglChooseConfig(display_, configAttributes, &config, 1, &configCount) || configCount == 0) {
+            throw std::runtime_error("no EGL config supports desktop OpenGL");
+        }
+        if (!eglBindAPI(EGL_OPENGL_API)) {
+            throw std::runtime_error(EglError("eglBindAPI"));
+        }
+
+        // Same version and profile as the viewer's wxGLContext
+        const EGLint contextAttributes[] = {EGL_CONTEXT_MAJOR_VERSION_KHR,
+                                            3,
+                                            EGL_CONTEXT_MINOR_VERSION_KHR,
+                                            3,
+                                            EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR,
+                                            EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+                                            EGL_NONE};
+        context_ = eglCreateContext(display_, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context_ == EGL_NO_CONTEXT) {
+            throw std::runtime_error(EglError("eglCreateContext"));
+        }
+
+        if (!surfaceless) {
+            const EGLint pbufferAttributes[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+            surface_ = eglCreatePbufferSurface(display_, config, pbufferAttributes);
+            if (surface_ == EGL_NO_SURFACE) {
+                throw std::runtime_error(EglError("eglCreatePbufferSurface"));
+            }
+        }
+        if (!eglMakeCurrent(display_, surface_, surface_, context_)) {
+            throw std::runtime_error(EglError("eglMakeCurrent"));
+        }
+
+        // Core profiles need glewExperimental for GLEW to load everything
+        glewExperimental = GL_TRUE;
+        const GLenum err = glewInit();
+        if (err != GLEW_OK) {
+            throw std::runtime_error(std::string("OpenGL GLEW initialization failed: ") +
+                                     reinterpret_cast<const char *>(glewGetErrorString(err)));
+        }
+        // glewInit queries GL_EXTENSIONS the pre-core way, which leaves an error behind
+        while (glGetError() != GL_NO_ERROR) {
+        }
+    } catch (...) {
+        Release();
+        throw;
+    }
+}
+
+OffscreenContext::~OffscreenContext() { Release(); }
+
+void OffscreenContext::Release() {
+    if (display_ == EGL_NO_DISPLAY) {
+        return;
+    }
+    eglMakeCurrent(display_, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (surface_ != EGL_NO_SURFACE) {
+        eglDestroySurface(display_, surface_);
+    }
+    if (context_ != EGL_NO_CONTEXT) {
+        eglDestroyContext(display_, context_);
+    }
+    eglTerminate(display_);
+    display_ = EGL_NO_DISPLAY;
+}
+
+std::string OffscreenContext::Describe() const {
+    auto string = [](GLenum name) {
+        const auto *value = reinterpret_cast<const char *>(glGetString(name));
+        return std::string(value != nullptr ? value : "unknown");
+    };
+    return string(GL_RENDERER) + ", OpenGL " + string(GL_VERSION);
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <EGL/egl.h>
+
+#include <string>
+
+// Headless OpenGL 3.3 core context on EGL, for rendering without a window or
+// display server. Prefers Mesa's surfaceless platform and
+// EGL_KHR_surfaceless_context; otherwise falls back to the default display
+// with a 1x1 pbuffer. Either way, drawing is meant to go to framebuffer
+// objects. The constructor makes the context current on the calling thread
+// and initialises GLEW, and throws std::runtime_error if any step fails.
+class OffscreenContext {
+  public:
+    OffscreenContext();
+    ~OffscreenContext();
+
+    OffscreenContext(const OffscreenContext &) = delete;
+    OffscreenContext &operator=(const OffscreenContext &) = delete;
+
+    // GL_RENDERER and GL_VERSION, for logging
+    std::string Describe() const;
+
+  private:
+    void Release();
+
+    EGLDisplay display_{EGL_NO_DISPLAY};
+    EGLContext context_{EGL_NO_CONTEXT};
+    EGLSurface surface_{EGL_NO_SURFACE};
+};
@@ -1,11 +1,16 @@
 #include "openglcanvas.h"
+#include "map_style.h"
 
 #include <shaders.h>
 
 #include <algorithm>
+#include <array>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
 #include <functional>
 #include <iostream>
+#include <iterator>
 #include <limits>
 #include <sstream>
 #include <string>
@@ -13,6 +18,48 @@
 
 wxDEFINE_EVENT(wxEVT_OPENGL_INITIALIZED, wxCommandEvent);
 
+// Text sizes (line height) and margins in logical pixels
+constexpr float LABEL_FONT_SIZE = 13.0f;
+constexpr float HUD_FONT_SIZE = 16.0f;
+constexpr float HUD_MARGIN = 8.0f;
+// Clicks pick features within this many logical pixels; a press that moves
+// further than CLICK_SLOP before release is a drag, not a click
+constexpr double PICK_RADIUS = 8.0;
+constexpr int CLICK_SLOP = 3;
+// Route overlay style; drawn wider than every layer so it stays visible
+constexpr float PATH_LINE_WIDTH = 0.012f;
+const GeometryBuilder::Color_t PATH_COLOR = {0.15f, 0.35f, 1.0f};
+// With a VRAM budget, at most this much geometry is uploaded per frame (plus
+// one chunk) so zooming out doesn't stall a single frame
+constexpr size_t VRAM_UPLOAD_BYTES_PER_FRAME = 16 * 1024 * 1024;
+constexpr double BYTES_PER_MB = 1024.0 * 1024.0;
+// Tile pyramid mode: pick the zoom level whose tiles are closest to this many
+// physical pixels wide, but never load more than MAX_VISIBLE_TILES at once
+constexpr double TILE_DISPLAY_SIZE = 512.0;
+constexpr size_t MAX_VISIBLE_TILES = 64;
+// Decoded tiles kept around for panning back; the visible ones always stay
+constexpr size_t TILE_CACHE_SIZE = 512;
+// A search result fills this much of the window, and is shown at least this
+// many degrees across so a single node doesn't zoom in without bound
+constexpr double SEARCH_FILL = 0.8;
+constexpr double SEARCH_MIN_SPAN = 0.002;
+// Density raster mode: x,y (projected) and s,t of each corner of the quad
+constexpr size_t FLOATS_PER_DENSITY_VERTEX = 4;
+
+// x,y,r,g,b layout of the vertex buffer bound to GL_ARRAY_BUFFER, recorded
+// in the bound VAO
+static void SetVertexAttributes() {
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), reinterpret_cast<void *>(0));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float),
+                          reinterpret_cast<void *>(2 * sizeof(float)));
+}
+
+static size_t ChunkBytes(const GeometryChunk &chunk) {
+    return chunk.vertexCount * FLOATS_PER_VERTEX * sizeof(float) + chunk.indexCount * sizeof(uint16_t);
+}
+
 // GL debug callback function used when KHR_debug is available. Logs
 // messages (skips notifications) through wxLogError and stderr for
 // high-severity messages.
@@ -90,7 +137,8 @@ static void GLDebugCallbackFunc(GLenum source, GLenum type, GLuint id, GLenum se
     std::cerr << ss.str() << std::endl;
 }
 
-OpenGLCanvas::OpenGLCanvas(wxWindow *parent, const wxGLAttributes &canvasAttrs) : wxGLCanvas(parent, canvasAttrs) {
+OpenGLCanvas::OpenGLCanvas(wxWindow *parent, const wxGLAttributes &canvasAttrs)
+    : wxGLCanvas(parent, canvasAttrs), residency_(0, VRAM_UPLOAD_BYTES_PER_FRAME) {
     wxGLContextAttrs ctxAttrs;
     ctxAttrs.PlatformDefaults().CoreProfile().OGLVersion(3, 3).EndList();
     openGLContext_ = new wxGLContext(this, nullptr, &ctxAttrs);
@@ -123,14 +171,10 @@ OpenGLCanvas::OpenGLCanvas(wxWindow *parent, const wxGLAttributes &canvasAttrs)
     timer_.Start(1000 / FPS);
 }
 
-void OpenGLCanvas::SetData(const OSMLoader::OSMData &data, const osmium::Box &bounds) {
-    const auto &ways = data.first;
+void OpenGLCanvas::SetData(OSMLoader::OSMDataPtr data, const osmium::Box &bounds) {
     // TODO: render relationships
-    const auto &areas = data.second;
     coordinateBounds_ = bounds;
     // Find the longest ways and store only those for testing
-    storedRoutes_.clear();
-    storedAreas_.clear();
 
     // const size_t NUM_WAYS = std::min(ways.size(), static_cast<size_t>(1));
 
@@ -171,68 +215,185 @@ void OpenGLCanvas::SetData(const OSMLoader::OSMData &data, const osmium::Box &bo
     // }
 
     // Take all ways
-    storedRoutes_ = ways;
-    storedAreas_ = areas;
+    storedData_ = std::move(data);
+
+    pickedText_.clear();
+    const auto indexStart = std::chrono::steady_clock::now();
+    featureIndex_ = storedData_ ? FeatureIndex{*storedData_} : FeatureIndex{};
+    const auto indexTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - indexStart);
+    wxLogDebug("Indexed %zu segments of %zu features for picking in %.1f ms", featureIndex_.SegmentCount(),
+               featureIndex_.FeatureCount(), indexTime.count());
+    const auto nameStart = std::chrono::steady_clock::now();
+    nameIndex_ = storedData_ ? NameIndex{*storedData_} : NameIndex{};
+    const auto nameTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - nameStart);
+    wxLogDebug("Indexed %zu names (%.1f MB) for search in %.1f ms", nameIndex_.EntryCount(),
+               nameIndex_.MemoryBytes() / BYTES_PER_MB, nameTime.count());
+
+    routePlanner_.reset();
+    routeHierarchy_.reset();
+    routeStart_ = RoadGraph::NO_VERTEX;
+    routeText_.clear();
+    pathCoordinates_.clear();
+    pathBuffersDirty_ = true;
+    const auto graphStart = std::chrono::steady_clock::now();
+    roadGraph_ = std::make_unique<RoadGraph>(storedData_ ? RoadGraph{storedData_->first} : RoadGraph{});
+    const auto graphTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - graphStart);
+    wxLogDebug("Built road graph with %zu vertices and %zu edges in %.1f ms", roadGraph_->VertexCount(),
+               roadGraph_->EdgeCount(), graphTime.count());
+    if (useContractionHierarchy_) {
+        const auto hierarchyStart = std::chrono::steady_clock::now();
+        routeHierarchy_ = std::make_unique<ContractionHierarchy>(*roadGraph_);
+        const auto hierarchyTime =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - hierarchyStart);
+        wxLogDebug("Contracted road graph with %zu shortcuts in %.1f ms", routeHierarchy_->ShortcutCount(),
+                   hierarchyTime.count());
+    }
+    routePlanner_ = std::make_unique<RoutePlanner>(*roadGraph_, routeHierarchy_.get());
 
     // add the boundary
-    OSMLoader::Route_t boundsWay{};
-    boundsWay.id = 42;
-    boundsWay.tags[NAME_TAG] = "bounds";
-    boundsWay.nodes = {osmium::Location(bounds.left(), bounds.bottom()),
-                       osmium::Location(bounds.right(), bounds.bottom()),
-                       osmium::Location(bounds.right(), bounds.top()), osmium::Location(bounds.left(), bounds.top()),
-                       osmium::Location(bounds.left(), bounds.bottom())};
-    boundsWay.tags[HIGHWAY_TAG] = "footpath";
-    storedRoutes_[boundsWay.id] = boundsWay;
+    boundsOutline_ = {osmium::Location(bounds.left(), bounds.bottom()), osmium::Location(bounds.right(), bounds.bottom()),
+                      osmium::Location(bounds.right(), bounds.top()), osmium::Location(bounds.left(), bounds.top()),
+                      osmium::Location(bounds.left(), bounds.bottom())};
 
     UpdateBuffersFromRoutes();
 }
 
-void OpenGLCanvas::AddLineStripAdjacencyToBuffers(const OSMLoader::Coordinates &coords, const Color_t &color,
-                                                  std::vector<float> &vertices, std::vector<GLuint> &indices,
-                                                  size_t &indexOffset) {
-    if (coords.size() < 2) {
-        return;
+void OpenGLCanvas::SetTilePyramid(std::shared_ptr<const TilePyramid> pyramid) {
+    if (pendingTiles_.valid()) {
+        pendingTiles_.wait();
+        pendingTiles_ = {};
     }
+    tilePyramid_ = std::move(pyramid);
+    visibleTiles_ = TileRange{};
+    tileCache_.clear();
+    // Start empty; the first frame loads the tiles in view
+    const auto bounds = tilePyramid_->Bounds();
+    SetData(std::make_shared<const OSMLoader::OSMData>(), bounds);
+}
 
-    // Store the starting index for this line strip in the vertices array
-    GLuint base = static_cast<GLuint>(vertices.size() / 5);
+void OpenGLCanvas::UpdateVisibleTiles(const osmium::Box &visibleBounds) {
+    if (pendingTiles_.valid()) {
+        if (pendingTiles_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            return; // the view changes again once these are shown
+        }
+        auto snapshot = pendingTiles_.get();
+        for (auto &[key, features] : snapshot.decoded) {
+            tileCache_[key] = std::move(features);
+        }
+        const auto &range = snapshot.range;
+        if (tileCache_.size() > TILE_CACHE_SIZE) {
+            for (auto it = tileCache_.begin(); it != tileCache_.end();) {
+                const auto z = static_cast<uint32_t>(it->first >> 56);
+                const auto x = static_cast<uint32_t>((it->first >> 28) & 0xFFFFFFF);
+                const auto y = static_cast<uint32_t>(it->first & 0xFFFFFFF);
+                const bool visible =
+                    z == range.z && x >= range.minX && x <= range.maxX && y >= range.minY && y <= range.maxY;
+                it = visible ? std::next(it) : tileCache_.erase(it);
+            }
+        }
 
-    // Add vertices for the current line strip
-    for (const auto &loc : coords) {
-        assert(loc.valid());
-        double lon = loc.lon();
-        double lat = loc.lat();
-        // Store raw lon/lat in vertex attributes; shader will normalize
-        vertices.push_back(static_cast<float>(lon));
-        vertices.push_back(static_cast<float>(lat));
-        vertices.push_back(color[0]);
-        vertices.push_back(color[1]);
-        vertices.push_back(color[2]);
+        const auto uploadStart = std::chrono::steady_clock::now();
+        storedData_ = std::move(snapshot.data);
+        featureIndex_ = std::move(snapshot.featureIndex);
+        nameIndex_ = std::move(snapshot.nameIndex);
+        UploadGeometry(std::move(snapshot.geometry));
+        const auto uploadTime =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart);
+        wxLogDebug("Showing %zu tiles at zoom %u (%zu decoded), swapped in %.1f ms", range.Count(), range.z,
+                   snapshot.decoded.size(), uploadTime.count());
     }
 
-    // Indices for GL_LINE_STRIP_ADJACENCY: duplicate first and last
-    // This is required for the geometry shader to calculate normals for the end segments.
-    GLuint countHere = 0;
-
-    // Start: duplicate first vertex
-    indices.push_back(base);
-    countHere += 1;
+    const auto &bounds = tilePyramid_->Bounds();
+    const double left = std::max(visibleBounds.left(), bounds.left());
+    const double bottom = std::max(visibleBounds.bottom(), bounds.bottom());
+    const double right = std::min(visibleBounds.right(), bounds.right());
+    const double top = std::min(visibleBounds.top(), bounds.top());
+    if (left > right || bottom > top || viewportBounds_.width <= 0) {
+        return; // nothing of the pyramid in view; keep what is loaded
+    }
+    const osmium::Box view{left, bottom, right, top};
+
+    const double pixelsPerLon = viewportBounds_.width / (coordinateBounds_.right() - coordinateBounds_.left());
+    const auto minZoom = static_cast<long>(tilePyramid_->MinZoom());
+    const auto maxZoom = static_cast<long>(tilePyramid_->MaxZoom());
+    auto zoom = std::clamp(std::lround(std::log2(pixelsPerLon * 360.0 / TILE_DISPLAY_SIZE)), minZoom, maxZoom);
+    auto range = TilesCovering(view, static_cast<uint32_t>(zoom));
+    while (range.Count() > MAX_VISIBLE_TILES && zoom > minZoom) {
+        range = TilesCovering(view, static_cast<uint32_t>(--zoom));
+    }
+    if (range == visibleTiles_) {
+        return;
+    }
+    visibleTiles_ = range;
+
+    // Hand the worker the cached tiles it needs so it never touches tileCache_
+    std::vector<std::pair<TileId, TileFeatures>> cached;
+    cached.reserve(range.Count());
+    for (uint32_t y = range.minY; y <= range.maxY; ++y) {
+        for (uint32_t x = range.minX; x <= range.maxX; ++x) {
+            const TileId tile{range.z, x, y};
+            const auto it = tileCache_.find(tile.Key());
+            cached.emplace_back(tile, it == tileCache_.end() ? nullptr : it->second);
+        }
+    }
+    pendingTiles_ = std::async(std::launch::async, [this, range, cached = std::move(cached)]() mutable {
+        return LoadTiles(range, std::move(cached));
+    });
+}
 
-    // Add all vertices of the current line strip
-    for (size_t i = 0; i < (vertices.size() / 5) - base; ++i) {
-        indices.push_back(base + static_cast<GLuint>(i));
-        ++countHere;
+OpenGLCanvas::TileSnapshot OpenGLCanvas::LoadTiles(const TileRange &range,
+                                                   std::vector<std::pair<TileId, TileFeatures>> cached) const {
+    const auto start = std::chrono::steady_clock::now();
+    TileSnapshot snapshot;
+    snapshot.range = range;
+    auto data = std::make_shared<OSMLoader::OSMData>();
+    // A way cut by tile edges has a piece in every tile, so pieces are keyed
+    // by load order; Route_t::id stays the OSM id for picking
+    osmium::object_id_type id = 0;
+    for (auto &[tile, features] : cached) {
+        if (!features) {
+            try {
+                features = std::make_shared<const std::vector<TileFeature>>(tilePyramid_->ReadTile(tile));
+            } catch (const std::runtime_error &e) {
+                std::cerr << "Tile " << tile.z << "/" << tile.x << "/" << tile.y << ": " << e.what() << std::endl;
+                features = std::make_shared<const std::vector<TileFeature>>();
+            }
+            snapshot.decoded.emplace_back(tile.Key(), features);
+        }
+        for (const auto &feature : *features) {
+            if (feature.area) {
+                auto &area = data->second[++id];
+                area.id = feature.id;
+                area.outerRings.push_back(feature.nodes);
+                area.tags = feature.tags;
+            } else {
+                auto &route = data->first[++id];
+                route.id = feature.id;
+                route.nodes = feature.nodes;
+                route.tags = feature.tags;
+            }
+        }
     }
 
-    // End: duplicate last vertex
-    indices.push_back(base + static_cast<GLuint>((vertices.size() / 5) - 1 - base));
-    countHere += 1;
+    snapshot.featureIndex = FeatureIndex{*data};
+    snapshot.nameIndex = NameIndex{*data};
+    snapshot.geometry = BuildGeometry(*data);
+    snapshot.data = std::move(data);
+    const auto loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    wxLogDebug("Loaded %zu tiles at zoom %u (%zu decoded) in %.1f ms", range.Count(), range.z,
+               snapshot.decoded.size(), loadTime.count());
+    return snapshot;
+}
+
+void OpenGLCanvas::SetVramBudget(size_t bytes) { vramBudgetBytes_ = bytes; }
 
-    // Record draw command (count, byte offset)
-    size_t startByteOffset = indexOffset * sizeof(GLuint);
-    drawCommands_.emplace_back(static_cast<GLsizei>(countHere), startByteOffset);
-    indexOffset += countHere;
+void OpenGLCanvas::SetProjection(Projection projection) {
+    projection_ = projection;
+    pathBuffersDirty_ = true;
+    if (isOpenGLInitialized_) {
+        SetCurrent(*openGLContext_);
+        UpdateBuffersFromRoutes();
+    }
 }
 
 void OpenGLCanvas::UpdateBuffersFromRoutes() {
@@ -240,100 +401,276 @@ void OpenGLCanvas::UpdateBuffersFromRoutes() {
         return;
     }
 
-    // Build vertex and index arrays from storedRoutes_. Vertex layout:
-    // x,y,r,g,b
-    std::vector<float> vertices;
-    std::vector<GLuint> indices;
-    drawCommands_.clear();
-
-    if (storedRoutes_.empty()) {
-        elementCount_ = 0;
+    if (!storedData_) {
+        // Either nothing was loaded or the CPU copy was already released
+        // after upload; keep whatever is on the GPU.
+        if (!chunks_.empty()) {
+            std::cerr << "CPU geometry was released; GPU buffers cannot be rebuilt." << std::endl;
+        }
         return;
     }
 
-    using MapType = std::unordered_map<std::string, Color_t>;
-    static MapType HIGHWAY2COLOR = {{"motorway", {1.0f, 0.35f, 0.35f}},   {"motorway_link", {1.0f, 0.6f, 0.6f}},
-                                    {"secondary", {1.0f, 0.75f, 0.4f}},   {"tertiary", {1.0f, 1.0f, 0.6f}},
-                                    {"residential", {1.0f, 1.0f, 1.0f}},  {"unclassified", {0.95f, 0.95f, 0.95f}},
-                                    {"service", {0.8f, 0.8f, 0.8f}},      {"track", {0.65f, 0.55f, 0.4f}},
-                                    {"pedestrian", {0.85f, 0.8f, 0.85f}}, {"footway", {0.9f, 0.7f, 0.7f}},
-                                    {"path", {0.6f, 0.7f, 0.6f}},         {"steps", {0.7f, 0.4f, 0.4f}},
-                                    {"platform", {0.6f, 0.6f, 0.8f}}};
-    Color_t DEFAULT_COLOR = {0.5f, 0.5f, 0.5f};
-    Color_t AREA_COLOR = {0.2f, 0.89f, 0.1f};
-
-    size_t indexOffset = 0;
-
-    auto color = AREA_COLOR;
-    for (const auto &area : storedAreas_) {
-        for (const auto &outerRing : area.second.outerRings) {
-            AddLineStripAdjacencyToBuffers(outerRing, color, vertices, indices, indexOffset);
-            for (auto &component : color) {
-                component *= 0.8f;
-            }
-        }
+    UploadGeometry(BuildGeometry(*storedData_));
+}
+
+ChunkedGeometry OpenGLCanvas::BuildGeometry(const OSMLoader::OSMData &data) const {
+    if (data.first.empty() && data.second.empty()) {
+        return {};
     }
 
-    for (const auto &entry : storedRoutes_) {
-        const auto &coords = entry.second;
-        if (coords.nodes.size() < 2)
-            continue;
+    // Vertex layout: x,y,r,g,b
+    GeometryBuilder builder(coordinateBounds_, 16, layerTable_.LayerCount(), projection_);
+    builder.SetShareVertices(shareVertices_);
+    AddMapFeatures(data, layerTable_, builder);
+    builder.AddLineStrip(boundsOutline_, DEFAULT_ROUTE_COLOR, layerTable_.BoundaryLayer());
+
+    const auto buildStart = std::chrono::steady_clock::now();
+    auto geometry = builder.Build();
+    const auto buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - buildStart);
+    wxLogDebug("Built %zu vertices in %zu chunks in %.1f ms", geometry.vertices.size() / FLOATS_PER_VERTEX,
+               geometry.chunks.size(), buildTime.count());
+    if (shareVertices_) {
+        const size_t unsharedBytes = geometry.stripVertexCount * FLOATS_PER_VERTEX * sizeof(float);
+        const size_t sharedBytes = geometry.vertices.size() * sizeof(float);
+        wxLogDebug("Shared vertices shrink the VBO from %.1f MB to %.1f MB (%.1f%% less)", unsharedBytes / BYTES_PER_MB,
+                   sharedBytes / BYTES_PER_MB,
+                   100.0 * (1.0 - static_cast<double>(sharedBytes) / static_cast<double>(unsharedBytes)));
+    }
+    return geometry;
+}
 
-        GLuint base = static_cast<GLuint>(vertices.size() / 5);
-        const std::string &highwayType = entry.second.tags.count(HIGHWAY_TAG) ? entry.second.tags.at(HIGHWAY_TAG) : "";
-        const auto &color = HIGHWAY2COLOR.count(highwayType) ? HIGHWAY2COLOR.at(highwayType) : DEFAULT_COLOR;
-        AddLineStripAdjacencyToBuffers(coords.nodes, color, vertices, indices, indexOffset);
+void OpenGLCanvas::UploadGeometry(ChunkedGeometry geometry) {
+    chunks_.clear();
+    layerRanges_.clear();
+    fillIndexCount_ = 0;
+    densityGridWidth_ = densityGridHeight_ = 0;
+    ReleaseChunkBuffers();
+    textRenderer_.InvalidateLabels();
+    if (geometry.chunks.empty()) {
+        return;
     }
 
-    elementCount_ = static_cast<GLsizei>(indices.size());
+    auto &vertices = geometry.vertices;
+    auto &indices = geometry.indices;
+    chunks_ = std::move(geometry.chunks);
+    UpdateFillBuffers();
+    UpdateDensityTexture();
+    layerRanges_ = std::move(geometry.layers);
+
+    if (vramBudgetBytes_ > 0) {
+        // Nothing is uploaded yet; OnPaint requests chunks as they come into
+        // view. Free the shared buffers in case they were used before.
+        glDeleteVertexArrays(1, &VAO_);
+        glDeleteBuffers(1, &VBO_);
+        glDeleteBuffers(1, &EBO_);
+        VAO_ = VBO_ = EBO_ = 0;
+
+        std::vector<size_t> chunkBytes(chunks_.size());
+        std::transform(chunks_.begin(), chunks_.end(), chunkBytes.begin(), ChunkBytes);
+        residency_.SetBudget(vramBudgetBytes_);
+        residency_.Reset(std::move(chunkBytes));
+        chunkBuffers_.resize(chunks_.size());
+        chunkVertices_ = std::move(vertices);
+        chunkIndices_ = std::move(indices);
+        wxLogDebug("Streaming %zu chunks (%.1f MB) within a %.1f MB VRAM budget", chunks_.size(),
+                   residency_.GetStats().totalBytes / BYTES_PER_MB, vramBudgetBytes_ / BYTES_PER_MB);
+    } else {
+        const auto uploadStart = std::chrono::steady_clock::now();
 
-    // Create VAO/VBO/EBO if necessary and upload
-    if (VAO_ == 0)
-        glGenVertexArrays(1, &VAO_);
-    glBindVertexArray(VAO_);
+        // Create VAO/VBO/EBO if necessary and upload
+        if (VAO_ == 0)
+            glGenVertexArrays(1, &VAO_);
+        glBindVertexArray(VAO_);
 
-    if (VBO_ == 0)
-        glGenBuffers(1, &VBO_);
-    glBindBuffer(GL_ARRAY_BUFFER, VBO_);
-    if (!vertices.empty())
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+        if (VBO_ == 0)
+            glGenBuffers(1, &VBO_);
+        glBindBuffer(GL_ARRAY_BUFFER, VBO_);
+        if (!vertices.empty())
+            glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW);
+
+        if (EBO_ == 0)
+            glGenBuffers(1, &EBO_);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_);
+        if (!indices.empty())
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t), indices.data(), GL_STATIC_DRAW);
+
+        // vertex attributes
+        SetVertexAttributes();
+
+        // Unbind
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindVertexArray(0);
+
+        // Wait for the copies so the time covers the whole upload
+        glFinish();
+        const auto uploadTime =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - uploadStart);
+        wxLogDebug("Uploaded %.1f MB of vertices and %.1f MB of indices in %.1f ms",
+                   vertices.size() * sizeof(float) / BYTES_PER_MB, indices.size() * sizeof(uint16_t) / BYTES_PER_MB,
+                   uploadTime.count());
+    }
 
-    if (EBO_ == 0)
-        glGenBuffers(1, &EBO_);
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO_);
-    if (!indices.empty())
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
+    if (releaseCpuGeometry_) {
+        // The GPU (or, with a VRAM budget, the packed chunk geometry) now
+        // holds the only copy the canvas needs. Place labels for the current
+        // zoom first since they cannot be re-placed afterwards.
+        const double pixelsPerLon = viewportBounds_.width / (coordinateBounds_.right() - coordinateBounds_.left());
+        const double pixelsPerLat = viewportBounds_.height / ProjectedLatRange();
+        textRenderer_.UpdateLabels(storedData_->first, projection_, pixelsPerLon, pixelsPerLat,
+                                   LABEL_FONT_SIZE * static_cast<float>(GetContentScaleFactor()));
+        vertices.clear();
+        vertices.shrink_to_fit();
+        indices.clear();
+        indices.shrink_to_fit();
+        storedData_.reset();
+    }
+}
 
-    // vertex attributes
-    glEnableVertexAttribArray(0);
-    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 5 * sizeof(float), reinterpret_cast<void *>(0));
-    glEnableVertexAttribArray(1);
-    glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), reinterpret_cast<void *>(2 * sizeof(float)));
+bool OpenGLCanvas::UploadChunk(size_t chunkIndex) {
+    const auto &chunk = chunks_[chunkIndex];
+    auto &buffers = chunkBuffers_[chunkIndex];
+
+    // Clear stale errors so an out-of-memory below is this upload's
+    while (glGetError() != GL_NO_ERROR) {
+    }
+
+    glGenVertexArrays(1, &buffers.VAO);
+    glBindVertexArray(buffers.VAO);
+
+    glGenBuffers(1, &buffers.VBO);
+    glBindBuffer(GL_ARRAY_BUFFER, buffers.VBO);
+    glBufferData(GL_ARRAY_BUFFER, chunk.vertexCount * FLOATS_PER_VERTEX * sizeof(float),
+                 chunkVertices_.data() + static_cast<size_t>(chunk.baseVertex) * FLOATS_PER_VERTEX, GL_STATIC_DRAW);
+
+    glGenBuffers(1, &buffers.EBO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, buffers.EBO);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, chunk.indexCount * sizeof(uint16_t), chunkIndices_.data() + chunk.firstIndex,
+                 GL_STATIC_DRAW);
+
+    SetVertexAttributes();
 
-    // Unbind
     glBindBuffer(GL_ARRAY_BUFFER, 0);
     glBindVertexArray(0);
+
+    if (glGetError() == GL_OUT_OF_MEMORY) {
+        EvictChunk(chunkIndex);
+        std::cerr << "Out of GPU memory uploading chunk " << chunkIndex << " with "
+                  << residency_.GetStats().residentBytes / BYTES_PER_MB << " MB resident; lowering the VRAM budget"
+                  << std::endl;
+        return false;
+    }
+    return true;
+}
+
+void OpenGLCanvas::EvictChunk(size_t chunkIndex) {
+    auto &buffers = chunkBuffers_[chunkIndex];
+    glDeleteVertexArrays(1, &buffers.VAO);
+    glDeleteBuffers(1, &buffers.VBO);
+    glDeleteBuffers(1, &buffers.EBO);
+    buffers = ChunkBuffers{};
+}
+
+void OpenGLCanvas::ReleaseChunkBuffers() {
+    for (size_t i = 0; i < chunkBuffers_.size(); ++i) {
+        if (chunkBuffers_[i].VAO != 0) {
+            EvictChunk(i);
+        }
+    }
+    chunkBuffers_.clear();
+    chunkVertices_.clear();
+    chunkVertices_.shrink_to_fit();
+    chunkIndices_.clear();
+    chunkIndices_.shrink_to_fit();
+    residency_.Reset({});
 }
 
 void OpenGLCanvas::CompileShaderProgram() {
+    // The fallback is tiny so build it synchronously; it is what gets drawn
+    // while the driver works on the real programs.
+    fallbackShaderProgram_.vertexShaderSource_ = VertexShader;
+    fallbackShaderProgram_.fragmentShaderSource_ = FallbackFragmentShader;
+    fallbackShaderProgram_.Build();
+
+    if (!fallbackShaderProgram_.IsReady()) {
+        std::cerr << "Fallback shader failed to compile." << std::endl;
+        std::cerr << fallbackShaderProgram_.lastBuildLog_.str() << std::endl;
+        throw std::runtime_error("Shader compilation error");
+    }
+
     shaderProgram_.vertexShaderSource_ = VertexShader;
     shaderProgram_.geometryShaderSource_ = GeometryShader;
     shaderProgram_.fragmentShaderSource_ = FragmentShader;
-    shaderProgram_.Build();
+    SubmitShaderProgram(shaderProgram_);
 
-    if (!GetShaderBuildLog().empty()) {
-        std::cerr << "Shader failed to compile." << std::endl;
-        std::cerr << GetShaderBuildLog() << std::endl;
-        throw std::runtime_error("Shader compilation error");
+    fillShaderProgram_.vertexShaderSource_ = VertexShader;
+    fillShaderProgram_.fragmentShaderSource_ = FillFragmentShader;
+    SubmitShaderProgram(fillShaderProgram_);
+
+    densityShaderProgram_.vertexShaderSource_ = DensityVertexShader;
+    densityShaderProgram_.fragmentShaderSource_ = DensityFragmentShader;
+    SubmitShaderProgram(densityShaderProgram_);
+
+    SubmitShaderProgram(textRenderer_.GetShaderProgram());
+}
+
+void OpenGLCanvas::SubmitShaderProgram(ShaderProgram &program) {
+    program.BuildAsync(isParallelShaderCompileAvailable_);
+    pendingShaderPrograms_.push_back(&program);
+}
+
+void OpenGLCanvas::PollPendingShaderPrograms() {
+    for (auto it = pendingShaderPrograms_.begin(); it != pendingShaderPrograms_.end();) {
+        auto *program = *it;
+        if (!program->IsBuildComplete()) {
+            ++it;
+            continue;
+        }
+
+        if (!program->FinishBuild()) {
+            // Keep drawing with the fallback rather than tearing down the frame
+            std::cerr << "Shader failed to compile." << std::endl;
+            std::cerr << program->lastBuildLog_.str() << std::endl;
+        }
+        it = pendingShaderPrograms_.erase(it);
+    }
+}
+
+const ShaderProgram *OpenGLCanvas::ActiveLineProgram() const {
+    if (shaderProgram_.IsReady()) {
+        return &shaderProgram_;
     }
+    if (fallbackShaderProgram_.IsReady()) {
+        return &fallbackShaderProgram_;
+    }
+    return nullptr;
 }
 
 OpenGLCanvas::~OpenGLCanvas() {
+    // A tile load in flight reads the canvas' members
+    if (pendingTiles_.valid()) {
+        pendingTiles_.wait();
+    }
     glDeleteVertexArrays(1, &VAO_);
     glDeleteBuffers(1, &VBO_);
 
     glDeleteBuffers(1, &EBO_);
 
+    glDeleteVertexArrays(1, &fillVAO_);
+    glDeleteBuffers(1, &fillVBO_);
+    glDeleteBuffers(1, &fillEBO_);
+
+    glDeleteTextures(1, &densityTexture_);
+    glDeleteVertexArrays(1, &densityVAO_);
+    glDeleteBuffers(1, &densityVBO_);
+
+    ReleaseChunkBuffers();
+
+    glDeleteVertexArrays(1, &pathVAO_);
+    glDeleteBuffers(1, &pathVBO_);
+    glDeleteBuffers(1, &pathEBO_);
+
+    textRenderer_.Destroy();
+
     delete openGLContext_;
 }
 
@@ -380,10 +717,20 @@ bool OpenGLCanvas::InitializeOpenGL() {
         wxLogDebug("KHR_debug not available; GL debug output disabled");
     }
 
+    isParallelShaderCompileAvailable_ = ShaderProgram::EnableParallelCompile();
+    wxLogDebug("Parallel shader compile %s", isParallelShaderCompileAvailable_ ? "available" : "not available");
+
+    textRenderer_.Initialize();
+
     CompileShaderProgram();
 
     isOpenGLInitialized_ = true;
 
+    auto initRect = GetClientRect();
+    initRect.SetSize(GetSize() * GetContentScaleFactor());
+
+    this->viewportBounds_ = initRect;
+
     // If ways were provided before GL initialization, upload them now.
     UpdateBuffersFromRoutes();
 
@@ -392,10 +739,6 @@ bool OpenGLCanvas::InitializeOpenGL() {
     lastFpsUpdateTime_ = std::chrono::high_resolution_clock::now();
     framesSinceLastFps_ = 0;
 
-    auto initRect = GetClientRect();
-    initRect.SetSize(GetSize() * GetContentScaleFactor());
-
-    this->viewportBounds_ = initRect;
     // std::cout << "InitializeOpenGL: called\n";
 
     wxCommandEvent evt(wxEVT_OPENGL_INITIALIZED);
@@ -414,81 +757,226 @@ void OpenGLCanvas::OnPaint(wxPaintEvent &WXUNUSED(event)) {
 
     SetCurrent(*openGLContext_);
 
+    // Update FPS counters
+    ++framesSinceLastFps_;
+    auto now = std::chrono::high_resolution_clock::now();
+    auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastFpsUpdateTime_);
+    if (dur.count() >= 250) { // update FPS every 250ms for smoother display
+        float seconds = dur.count() / 1000.0f;
+        if (seconds > 0.0f) {
+            fps_ = static_cast<float>(framesSinceLastFps_) / seconds;
+        }
+        framesSinceLastFps_ = 0;
+        lastFpsUpdateTime_ = now;
+    }
+
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    float clearColor = 0.87f;
-    glClearColor(clearColor, clearColor, clearColor, 0.5f);
+    glClearColor(MAP_CLEAR_COLOR, MAP_CLEAR_COLOR, MAP_CLEAR_COLOR, 0.5f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    if (shaderProgram_.shaderProgram_.has_value()) {
-        glUseProgram(shaderProgram_.shaderProgram_.value());
+    PollPendingShaderPrograms();
 
-        auto size = GetClientSize() * GetContentScaleFactor();
+    if (const auto *program = ActiveLineProgram(); program) {
+        glUseProgram(program->shaderProgram_.value());
+
+        const double contentScale = GetContentScaleFactor();
+        auto size = GetClientSize() * contentScale;
         wxPoint bottomLeft{};
         wxPoint topRight(size.x, size.y);
 
+        // The shaders see projected coordinates; culling works in lon/lat
         auto bottomLeftCoord = mapViewport2OSM(bottomLeft);
         auto topRightCoord = mapViewport2OSM(topRight);
-        double minLon = bottomLeftCoord.lon();
-        double minLat = bottomLeftCoord.lat();
+        const auto bottomLeftProjected = mapViewport2Projected(bottomLeft);
+        const auto topRightProjected = mapViewport2Projected(topRight);
+        double minLon = bottomLeftProjected.x;
+        double minLat = bottomLeftProjected.y;
 
-        double lonRange = (topRightCoord.lon() - bottomLeftCoord.lon());
-        double latRange = (topRightCoord.lat() - bottomLeftCoord.lat());
+        double lonRange = (topRightProjected.x - bottomLeftProjected.x);
+        double latRange = (topRightProjected.y - bottomLeftProjected.y);
 
         // Avoid zero ranges
         if (lonRange == 0.0)
             lonRange = 1.0;
         if (latRange == 0.0)
             latRange = 1.0;
-        GLint loc = glGetUniformLocation(shaderProgram_.shaderProgram_.value(), "uBounds");
+
+        // Far enough out that a pixel covers whole cells of the density grid,
+        // one textured quad stands in for the fills and every line layer
+        const double texelsPerPixel =
+            densityGridWidth_ == 0 || viewportBounds_.IsEmpty()
+                ? 0.0
+                : std::max(densityGridWidth_ / static_cast<double>(viewportBounds_.width),
+                           densityGridHeight_ / static_cast<double>(viewportBounds_.height));
+        const bool densityRaster = densityRasterThreshold_ > 0.0 && texelsPerPixel >= densityRasterThreshold_ &&
+                                   densityShaderProgram_.IsReady();
+        if (densityRaster) {
+            const GLuint densityProgram = densityShaderProgram_.shaderProgram_.value();
+            glUseProgram(densityProgram);
+            glUniform4f(glGetUniformLocation(densityProgram, "uBounds"), static_cast<float>(minLon),
+                        static_cast<float>(minLat), static_cast<float>(lonRange), static_cast<float>(latRange));
+            glUniform1f(glGetUniformLocation(densityProgram, "uTexelsPerPixel"), static_cast<float>(texelsPerPixel));
+            // Full line widths in pixels: the layers' widths are half widths
+            // in clip space, where the viewport is two units across
+            const auto layerWidth = [this, &size](const char *layer) {
+                return layerTable_.GetLayer(layerTable_.LayerIndex(layer)).lineWidth * static_cast<float>(size.x);
+            };
+            // Secondary and tertiary roads are in the major roads layer by default
+            const float majorWidth = layerWidth(RenderLayerTable::MAJOR_ROADS_LAYER);
+            glUniform4f(glGetUniformLocation(densityProgram, "uLineWidths"), majorWidth, majorWidth,
+                        layerWidth(RenderLayerTable::MINOR_ROADS_LAYER), layerWidth(RenderLayerTable::AREAS_LAYER));
+            std::array<float, DENSITY_CLASS_COUNT * 3> classColors;
+            for (size_t c = 0; c < DENSITY_CLASS_COUNT; ++c) {
+                std::copy_n(DensityClassColor(c).begin(), 3, classColors.begin() + c * 3);
+            }
+            glUniform3fv(glGetUniformLocation(densityProgram, "uClassColors"),
+                         static_cast<GLsizei>(DENSITY_CLASS_COUNT), classColors.data());
+            glUniform1i(glGetUniformLocation(densityProgram, "uDensity"), 0);
+            glActiveTexture(GL_TEXTURE0);
+            glBindTexture(GL_TEXTURE_2D, densityTexture_);
+            glBindVertexArray(densityVAO_);
+            glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+            glBindVertexArray(0);
+            glBindTexture(GL_TEXTURE_2D, 0);
+            glUseProgram(program->shaderProgram_.value());
+        }
+
+        // Area fills go under every line layer, in a single draw call
+        if (!densityRaster && fillIndexCount_ > 0 && fillShaderProgram_.IsReady()) {
+            const GLuint fillProgram = fillShaderProgram_.shaderProgram_.value();
+            glUseProgram(fillProgram);
+            GLint fillBoundsLoc = glGetUniformLocation(fillProgram, "uBounds");
+            if (fillBoundsLoc >= 0) {
+                glUniform4f(fillBoundsLoc, static_cast<float>(minLon), static_cast<float>(minLat),
+                            static_cast<float>(lonRange), static_cast<float>(latRange));
+            }
+            glUniform1f(glGetUniformLocation(fillProgram, "uAlpha"), AREA_FILL_ALPHA);
+            glBindVertexArray(fillVAO_);
+            glDrawElements(GL_TRIANGLES, fillIndexCount_, GL_UNSIGNED_INT, nullptr);
+            glBindVertexArray(0);
+            glUseProgram(program->shaderProgram_.value());
+        }
+
+        GLint loc = glGetUniformLocation(program->shaderProgram_.value(), "uBounds");
         if (loc >= 0) {
             glUniform4f(loc, static_cast<float>(minLon), static_cast<float>(minLat), static_cast<float>(lonRange),
                         static_cast<float>(latRange));
         }
 
+        // Only submit chunks that overlap the visible part of the map
+        const osmium::Box visibleBounds{bottomLeftCoord, topRightCoord};
+        if (tilePyramid_) {
+            UpdateVisibleTiles(visibleBounds);
+        }
+
+        glEnable(GL_PRIMITIVE_RESTART);
+        glPrimitiveRestartIndex(PRIMITIVE_RESTART_INDEX);
+
+        // One contiguous chunk range per layer, lowest priority first; state
+        // only changes between layers
+        GLint lineWidthLoc = glGetUniformLocation(program->shaderProgram_.value(), "uLineWidth");
+        // With a VRAM budget each visible chunk is made resident (evicting
+        // ones that have been out of view longest) and drawn from its own
+        // buffers; chunks that don't fit this frame are skipped
+        const bool streamChunks = !chunkBuffers_.empty();
+        auto uploadChunk = [this](size_t chunk) { return UploadChunk(chunk); };
+        auto evictChunk = [this](size_t chunk) { EvictChunk(chunk); };
+        residency_.BeginFrame();
         glBindVertexArray(VAO_);
-        if (!drawCommands_.empty()) {
-            for (const auto &cmd : drawCommands_) {
-                GLsizei count = cmd.first;
-                const void *offset = reinterpret_cast<const void *>(cmd.second);
-                glDrawElements(GL_LINE_STRIP_ADJACENCY, count, GL_UNSIGNED_INT, offset);
+        for (size_t layer = 0; layer < (densityRaster ? 0 : layerRanges_.size()); ++layer) {
+            const auto &style = layerTable_.GetLayer(layer);
+            if (style.blend) {
+                glEnable(GL_BLEND);
+            } else {
+                glDisable(GL_BLEND);
+            }
+            if (lineWidthLoc >= 0) {
+                glUniform1f(lineWidthLoc, style.lineWidth);
+            }
+
+            const auto &range = layerRanges_[layer];
+            for (size_t i = range.firstChunk; i < range.firstChunk + range.chunkCount; ++i) {
+                const auto &chunk = chunks_[i];
+                if (!BoxesIntersect(chunk.bounds, visibleBounds)) {
+                    continue;
+                }
+                if (streamChunks) {
+                    if (!residency_.Request(i, uploadChunk, evictChunk)) {
+                        continue;
+                    }
+                    glBindVertexArray(chunkBuffers_[i].VAO);
+                    glDrawElements(GL_LINE_STRIP_ADJACENCY, static_cast<GLsizei>(chunk.indexCount), GL_UNSIGNED_SHORT,
+                                   nullptr);
+                    continue;
+                }
+                const void *offset = reinterpret_cast<const void *>(chunk.firstIndex * sizeof(uint16_t));
+                glDrawElementsBaseVertex(GL_LINE_STRIP_ADJACENCY, static_cast<GLsizei>(chunk.indexCount),
+                                         GL_UNSIGNED_SHORT, offset, chunk.baseVertex);
+            }
+        }
+        glEnable(GL_BLEND);
+
+        if (pathBuffersDirty_) {
+            UpdatePathBuffers();
+        }
+        if (!pathChunks_.empty()) {
+            if (lineWidthLoc >= 0) {
+                glUniform1f(lineWidthLoc, PATH_LINE_WIDTH);
+            }
+            glBindVertexArray(pathVAO_);
+            for (const auto &chunk : pathChunks_) {
+                const void *offset = reinterpret_cast<const void *>(chunk.firstIndex * sizeof(uint16_t));
+                glDrawElementsBaseVertex(GL_LINE_STRIP_ADJACENCY, static_cast<GLsizei>(chunk.indexCount),
+                                         GL_UNSIGNED_SHORT, offset, chunk.baseVertex);
             }
-        } else {
-            glDrawElements(GL_LINE_STRIP_ADJACENCY, elementCount_, GL_UNSIGNED_INT, 0);
         }
         glBindVertexArray(0); // Unbind VAO_ for safety
-    }
-    SwapBuffers();
 
-    // Update FPS counters and draw overlay text
-    ++framesSinceLastFps_;
-    auto now = std::chrono::high_resolution_clock::now();
-    auto dur = std::chrono::duration_cast<std::chrono::milliseconds>(now - lastFpsUpdateTime_);
-    if (dur.count() >= 250) { // update FPS every 250ms for smoother display
-        float seconds = dur.count() / 1000.0f;
-        if (seconds > 0.0f) {
-            fps_ = static_cast<float>(framesSinceLastFps_) / seconds;
+        // Street labels are laid out in pixels, so only re-place them when
+        // the zoom changes; panning reuses the cached placement.
+        const double pixelsPerLon = viewportBounds_.width / (coordinateBounds_.right() - coordinateBounds_.left());
+        const double pixelsPerLat = viewportBounds_.height / ProjectedLatRange();
+        if (storedData_ && textRenderer_.NeedsLabelUpdate(pixelsPerLon, pixelsPerLat)) {
+            textRenderer_.UpdateLabels(storedData_->first, projection_, pixelsPerLon, pixelsPerLat,
+                                       LABEL_FONT_SIZE * contentScale);
         }
-        framesSinceLastFps_ = 0;
-        lastFpsUpdateTime_ = now;
-    }
 
-    // Draw FPS using wx overlay drawing so it's on top of GL content.
-    // Use a small margin from the top-left corner.
-    wxClientDC overlayDc(this);
-    wxFont font = overlayDc.GetFont();
-    font.SetWeight(wxFONTWEIGHT_BOLD);
-    font.SetPointSize(10);
-    overlayDc.SetFont(font);
-    overlayDc.SetTextForeground(*wxBLACK);
-    std::ostringstream ss;
-    ss.setf(std::ios::fixed);
-    ss.precision(1);
-    ss << "FPS: " << fps_;
-    const std::string fpsText = ss.str();
-    const int margin = 8;
-    overlayDc.DrawText(fpsText, margin, margin);
+        // FPS overlay, batched with the labels into a single draw call
+        std::array<char, 32> fpsText;
+        std::snprintf(fpsText.data(), fpsText.size(), "FPS: %.1f", fps_);
+        textRenderer_.ClearHud();
+        textRenderer_.AddHudText(fpsText.data(), HUD_MARGIN * contentScale, HUD_MARGIN * contentScale,
+                                 HUD_FONT_SIZE * contentScale, size);
+        std::string statusText;
+        if (densityRaster) {
+            std::array<char, 96> text;
+            std::snprintf(text.data(), text.size(), "Density raster: %ux%u grid, %.1f cells/px", densityGridWidth_,
+                          densityGridHeight_, texelsPerPixel);
+            statusText = text.data();
+        } else if (streamChunks) {
+            const auto &stats = residency_.GetStats();
+            std::array<char, 128> text;
+            std::snprintf(text.data(), text.size(), "VRAM: %.1f / %.1f MB, %zu / %zu chunks, %llu evicted",
+                          stats.residentBytes / BYTES_PER_MB, stats.budgetBytes / BYTES_PER_MB, stats.residentBatches,
+                          stats.totalBatches, static_cast<unsigned long long>(stats.evictions));
+            statusText = text.data();
+        }
+        float hudY = HUD_MARGIN + 1.25f * HUD_FONT_SIZE;
+        for (const auto *line : {&statusText, &pickedText_, &routeText_}) {
+            if (!line->empty()) {
+                textRenderer_.AddHudText(line->c_str(), HUD_MARGIN * contentScale, hudY * contentScale,
+                                         HUD_FONT_SIZE * contentScale, size);
+                hudY += 1.25f * HUD_FONT_SIZE;
+            }
+        }
+
+        const float bounds[4] = {static_cast<float>(minLon), static_cast<float>(minLat),
+                                 static_cast<float>(lonRange), static_cast<float>(latRange)};
+        textRenderer_.Draw(bounds, size);
+    }
+    SwapBuffers();
 }
 
 void OpenGLCanvas::OnSize(wxSizeEvent &event) {
@@ -530,6 +1018,7 @@ void OpenGLCanvas::OnTimer(wxTimerEvent &WXUNUSED(event)) {
 
 void OpenGLCanvas::OnLeftDown(wxMouseEvent &event) {
     isDragging_ = true;
+    mouseDownPos_ = event.GetPosition();
     lastMousePos_ = event.GetPosition();
     lastMousePos_.y = GetClientSize().y - lastMousePos_.y; // flip Y
     // CaptureMouse();
@@ -540,6 +1029,15 @@ void OpenGLCanvas::OnLeftUp(wxMouseEvent &event) {
         isDragging_ = false;
         if (HasCapture())
             ReleaseMouse();
+
+        const wxPoint moved = event.GetPosition() - mouseDownPos_;
+        if (std::abs(moved.x) <= CLICK_SLOP && std::abs(moved.y) <= CLICK_SLOP) {
+            if (event.ShiftDown()) {
+                Route(event.GetPosition());
+            } else {
+                Pick(event.GetPosition());
+            }
+        }
     }
 }
 
@@ -650,31 +1148,318 @@ void OpenGLCanvas::Zoom(double scale, const wxPoint &mousePosIn) {
     Refresh(false);
 }
 
-osmium::Location OpenGLCanvas::mapViewport2OSM(const wxPoint &viewportCoord) {
+void OpenGLCanvas::ZoomToBounds(const osmium::Box &bounds) {
+    if (viewportBounds_.width <= 0 || viewportBounds_.height <= 0) {
+        return;
+    }
+
+    const double lonRange = coordinateBounds_.right() - coordinateBounds_.left();
+    const double latRange = ProjectedLatRange();
+    const double boundsBottom = ProjectLat(projection_, bounds.bottom());
+    const double boundsTop = ProjectLat(projection_, bounds.top());
+    const double boundsWidth = std::max(bounds.right() - bounds.left(), SEARCH_MIN_SPAN);
+    const double boundsHeight = std::max(boundsTop - boundsBottom, SEARCH_MIN_SPAN);
+
+    // Scale both sides of viewportBounds_ by the same factor, as Zoom does
+    const auto size = GetClientSize() * GetContentScaleFactor();
+    const double scale = SEARCH_FILL * std::min(size.x * lonRange / (boundsWidth * viewportBounds_.width),
+                                                size.y * latRange / (boundsHeight * viewportBounds_.height));
+    const double width = viewportBounds_.width * scale;
+    const double height = viewportBounds_.height * scale;
+
+    // Physical, y-up pixels, like viewportBounds_
+    const double centerX = 0.5 * (bounds.left() + bounds.right());
+    const double centerY = 0.5 * (boundsBottom + boundsTop);
+    const double x = 0.5 * size.x - (centerX - coordinateBounds_.left()) / lonRange * width;
+    const double y = 0.5 * size.y - (centerY - ProjectedBottom()) / latRange * height;
+    viewportBounds_.x = static_cast<int>(std::round(x));
+    viewportBounds_.y = static_cast<int>(std::round(y));
+    viewportBounds_.width = static_cast<int>(std::round(width));
+    viewportBounds_.height = static_cast<int>(std::round(height));
+    Refresh(false);
+}
+
+bool OpenGLCanvas::SearchName(const std::string &query, size_t resultIndex) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto matches = nameIndex_.FindPrefix(query);
+    const auto lookupTime = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+
+    if (matches.empty()) {
+        pickedText_ = "No name starts with \"" + query + "\"";
+    } else {
+        const auto &match = matches[resultIndex % matches.size()];
+        std::ostringstream text;
+        text << (match.kind == NameIndex::Kind::Route ? "way " : "relation ") << match.id << " \"" << match.name
+             << "\"";
+        if (match.featureCount > 1) {
+            text << " (" << match.featureCount << " ways)";
+        }
+        text << ", " << resultIndex % matches.size() + 1 << " of " << matches.size();
+        pickedText_ = text.str();
+        ZoomToBounds(match.bounds);
+    }
+    wxLogDebug("Search \"%s\": %s in %.1f us", query.c_str(), pickedText_.c_str(), lookupTime.count());
+    Refresh(false);
+    return !matches.empty();
+}
+
+void OpenGLCanvas::Pick(const wxPoint &mousePos) {
+    if (viewportBounds_.width <= 0 || viewportBounds_.height <= 0) {
+        return;
+    }
+
+    const double contentScale = GetContentScaleFactor();
+    const auto location = MouseToOSM(mousePos);
+
+    // The radius is in pixels; its height in degrees depends on the latitude,
+    // so map it back through the inverse projection
+    const double radius = PICK_RADIUS * contentScale;
+    const double radiusLon = radius * (coordinateBounds_.right() - coordinateBounds_.left()) / viewportBounds_.width;
+    const double radiusY = radius * ProjectedLatRange() / viewportBounds_.height;
+    const double y = ProjectLat(projection_, location.lat());
+    const double radiusLat = 0.5 * (UnprojectY(projection_, y + radiusY) - UnprojectY(projection_, y - radiusY));
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto hit = featureIndex_.Nearest(location, radiusLon, radiusLat);
+    const auto lookupTime = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start);
+
+    if (!hit.feature) {
+        pickedText_.clear();
+    } else {
+        const auto &feature = *hit.feature;
+        std::ostringstream text;
+        text << (feature.kind == FeatureIndex::Kind::Route ? "way " : "relation ") << feature.id;
+        if (!feature.name.empty()) {
+            text << " \"" << feature.name << "\"";
+        }
+        if (!feature.featureClass.empty()) {
+            text << " (" << feature.featureClass << ")";
+        }
+        pickedText_ = text.str();
+    }
+    wxLogDebug("Pick at %f,%f: %s in %.1f us", location.lon(), location.lat(),
+               pickedText_.empty() ? "nothing" : pickedText_.c_str(), lookupTime.count());
+    Refresh(false);
+}
+
+void OpenGLCanvas::Route(const wxPoint &mousePos) {
+    if (tilePyramid_) {
+        // The road graph would only cover the loaded tiles, and change with them
+        routeText_ = "Route: not available on tile pyramids";
+        Refresh(false);
+        return;
+    }
+    if (!roadGraph_ || !routePlanner_) {
+        return;
+    }
+    const auto vertex = roadGraph_->NearestVertex(MouseToOSM(mousePos));
+    if (vertex == RoadGraph::NO_VERTEX) {
+        return;
+    }
+
+    // A click after a finished route starts a new one
+    if (routeStart_ == RoadGraph::NO_VERTEX || !pathCoordinates_.empty()) {
+        routeStart_ = vertex;
+        routeText_ = "Route: shift-click the destination";
+        pathCoordinates_.clear();
+        pathBuffersDirty_ = true;
+        Refresh(false);
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto path = routePlanner_->ShortestPath(routeStart_, vertex);
+    const auto queryTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+
+    std::array<char, 128> text;
+    if (path.vertices.empty()) {
+        std::snprintf(text.data(), text.size(), "Route: no path (%.2f ms)", queryTime.count());
+        routeStart_ = RoadGraph::NO_VERTEX;
+    } else {
+        const auto seconds = path.timeMs / 1000;
+        std::snprintf(text.data(), text.size(), "Route: %llu min %02llu s, %zu vertices (%.2f ms, %s)",
+                      static_cast<unsigned long long>(seconds / 60), static_cast<unsigned long long>(seconds % 60),
+                      path.vertices.size(), queryTime.count(), routeHierarchy_ ? "CH" : "A*");
+        pathCoordinates_.reserve(path.vertices.size());
+        for (const auto v : path.vertices) {
+            pathCoordinates_.push_back(roadGraph_->GetLocation(v));
+        }
+    }
+    routeText_ = text.data();
+    wxLogDebug("%s, %zu vertices settled", routeText_.c_str(), path.settled);
+    pathBuffersDirty_ = true;
+    Refresh(false);
+}
+
+void OpenGLCanvas::UpdateFillBuffers() {
+    fillIndexCount_ = 0;
+    if (tilePyramid_ || storedData_->second.empty()) {
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto fills = BuildAreaFills(*storedData_, 0, projection_);
+    const auto triangulateTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    wxLogDebug("Triangulated %zu areas into %zu triangles in %.1f ms", storedData_->second.size(),
+               fills.indices.size() / 3, triangulateTime.count());
+    if (fills.indices.empty()) {
+        return;
+    }
+
+    if (fillVAO_ == 0)
+        glGenVertexArrays(1, &fillVAO_);
+    glBindVertexArray(fillVAO_);
+
+    if (fillVBO_ == 0)
+        glGenBuffers(1, &fillVBO_);
+    glBindBuffer(GL_ARRAY_BUFFER, fillVBO_);
+    glBufferData(GL_ARRAY_BUFFER, fills.vertices.size() * sizeof(float), fills.vertices.data(), GL_STATIC_DRAW);
+
+    if (fillEBO_ == 0)
+        glGenBuffers(1, &fillEBO_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, fillEBO_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, fills.indices.size() * sizeof(uint32_t), fills.indices.data(),
+                 GL_STATIC_DRAW);
+
+    SetVertexAttributes();
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+    fillIndexCount_ = static_cast<GLsizei>(fills.indices.size());
+}
+
+void OpenGLCanvas::UpdateDensityTexture() {
+    densityGridWidth_ = densityGridHeight_ = 0;
+    if (tilePyramid_ || densityRasterThreshold_ <= 0.0) {
+        return;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    const auto pyramid = BuildDensityPyramid(*storedData_, coordinateBounds_, projection_);
+    const auto buildTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    if (pyramid.Empty()) {
+        return;
+    }
+    const auto &finest = pyramid.levels.front();
+    wxLogDebug("Built %zu density grids from %ux%u cells in %.1f ms", pyramid.levels.size(), finest.width,
+               finest.height, buildTime.count());
+
+    if (densityTexture_ == 0)
+        glGenTextures(1, &densityTexture_);
+    glBindTexture(GL_TEXTURE_2D, densityTexture_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    // Each level is the mean of the one above, so the pyramid is a valid mip
+    // chain and minification averages line length like a coarser grid would
+    for (size_t level = 0; level < pyramid.levels.size(); ++level) {
+        const auto &grid = pyramid.levels[level];
+        glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), GL_RGBA16F, static_cast<GLsizei>(grid.width),
+                     static_cast<GLsizei>(grid.height), 0, GL_RGBA, GL_FLOAT, grid.cells.data());
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(pyramid.levels.size() - 1));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    const auto left = static_cast<float>(pyramid.left);
+    const auto bottom = static_cast<float>(pyramid.bottom);
+    const auto right = static_cast<float>(pyramid.right);
+    const auto top = static_cast<float>(pyramid.top);
+    const float quad[4 * FLOATS_PER_DENSITY_VERTEX] = {left,  bottom, 0.0f, 0.0f, right, bottom, 1.0f, 0.0f,
+                                                       left,  top,    0.0f, 1.0f, right, top,    1.0f, 1.0f};
+    if (densityVAO_ == 0)
+        glGenVertexArrays(1, &densityVAO_);
+    glBindVertexArray(densityVAO_);
+    if (densityVBO_ == 0)
+        glGenBuffers(1, &densityVBO_);
+    glBindBuffer(GL_ARRAY_BUFFER, densityVBO_);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(quad), quad, GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, FLOATS_PER_DENSITY_VERTEX * sizeof(float),
+                          reinterpret_cast<void *>(0));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, FLOATS_PER_DENSITY_VERTEX * sizeof(float),
+                          reinterpret_cast<void *>(2 * sizeof(float)));
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    densityGridWidth_ = finest.width;
+    densityGridHeight_ = finest.height;
+}
+
+void OpenGLCanvas::UpdatePathBuffers() {
+    pathBuffersDirty_ = false;
+    pathChunks_.clear();
+    if (pathCoordinates_.size() < 2) {
+        return;
+    }
+
+    GeometryBuilder builder(coordinateBounds_, 1, 1, projection_);
+    builder.AddLineStrip(pathCoordinates_, PATH_COLOR);
+    auto geometry = builder.Build(1);
+    pathChunks_ = std::move(geometry.chunks);
+
+    if (pathVAO_ == 0)
+        glGenVertexArrays(1, &pathVAO_);
+    glBindVertexArray(pathVAO_);
+
+    if (pathVBO_ == 0)
+        glGenBuffers(1, &pathVBO_);
+    glBindBuffer(GL_ARRAY_BUFFER, pathVBO_);
+    glBufferData(GL_ARRAY_BUFFER, geometry.vertices.size() * sizeof(float), geometry.vertices.data(),
+                 GL_DYNAMIC_DRAW);
+
+    if (pathEBO_ == 0)
+        glGenBuffers(1, &pathEBO_);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, pathEBO_);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, geometry.indices.size() * sizeof(uint16_t), geometry.indices.data(),
+                 GL_DYNAMIC_DRAW);
+
+    SetVertexAttributes();
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
+
+osmium::Location OpenGLCanvas::MouseToOSM(const wxPoint &mousePos) {
+    // Same physical, y-up pixels as viewportBounds_
+    const double contentScale = GetContentScaleFactor();
+    const wxPoint viewportPos(static_cast<int>(mousePos.x * contentScale),
+                              static_cast<int>((GetClientSize().y - mousePos.y) * contentScale));
+    return mapViewport2OSM(viewportPos);
+}
+
+wxRealPoint OpenGLCanvas::mapViewport2Projected(const wxPoint &viewportCoord) {
     const auto extents = viewportBounds_.GetSize();
 
     const auto offset = viewportCoord - viewportBounds_.GetPosition();
 
     auto normalized = static_cast<double>(offset.x) / (extents.x - 1);
-    double lon = coordinateBounds_.left() + normalized * (coordinateBounds_.right() - coordinateBounds_.left());
+    const double x = coordinateBounds_.left() + normalized * (coordinateBounds_.right() - coordinateBounds_.left());
 
     normalized = static_cast<double>(offset.y) / (extents.y - 1);
-    double lat = coordinateBounds_.bottom() + normalized * (coordinateBounds_.top() - coordinateBounds_.bottom());
+    const double y = ProjectedBottom() + normalized * ProjectedLatRange();
 
-    return osmium::Location(lon, lat);
+    return wxRealPoint(x, y);
+}
+
+osmium::Location OpenGLCanvas::mapViewport2OSM(const wxPoint &viewportCoord) {
+    const auto projected = mapViewport2Projected(viewportCoord);
+    return osmium::Location(projected.x, UnprojectY(projection_, projected.y));
 }
 
 wxPoint OpenGLCanvas::mapOSM2Viewport(const osmium::Location &coords) {
     const auto extents = viewportBounds_.GetSize();
 
     double lonRange = (coordinateBounds_.right() - coordinateBounds_.left());
-    double latRange = (coordinateBounds_.top() - coordinateBounds_.bottom());
 
     double xNorm = (coords.lon() - coordinateBounds_.left()) / lonRange;
-    double yNorm = (coords.lat() - coordinateBounds_.bottom()) / latRange;
+    double yNorm = (ProjectLat(projection_, coords.lat()) - ProjectedBottom()) / ProjectedLatRange();
 
     int x = static_cast<int>(xNorm * extents.x) + viewportBounds_.GetLeft();
     int y = static_cast<int>(yNorm * extents.y) + viewportBounds_.GetTop();
 
     return wxPoint(x, y);
-}
\ No newline at end of file
+}
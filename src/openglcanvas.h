@@ -5,9 +5,20 @@
 #include <wx/wx.h>
 
 #include <chrono>
+#include <future>
+#include <memory>
 
+#include "density_grid.h"
+#include "feature_index.h"
+#include "geometry_builder.h"
+#include "gpu_residency.h"
+#include "name_index.h"
 #include "osm_loader.h"
+#include "render_layers.h"
+#include "route_planner.h"
 #include "shaderprogram.h"
+#include "text_renderer.h"
+#include "tile_pyramid.h"
 #include <unordered_map>
 
 wxDECLARE_EVENT(wxEVT_OPENGL_INITIALIZED, wxCommandEvent);
@@ -33,36 +44,178 @@ class OpenGLCanvas : public wxGLCanvas {
     void OnZoomGesture(wxZoomGestureEvent &event);
 
     // Upload routes from OSMLoader into GPU buffers. This replaces the
-    // existing VBO_/EBO_ contents when called.
-    void SetData(const OSMLoader::OSMData &data, const osmium::Box &bounds);
+    // existing VBO_/EBO_ contents when called. The canvas shares ownership of
+    // the snapshot; pass it with std::move to avoid an extra reference.
+    void SetData(OSMLoader::OSMDataPtr data, const osmium::Box &bounds);
+
+    // Show a prebuilt tile pyramid instead of SetData. Only the tiles covering
+    // the view, at the zoom level closest to the screen resolution, are
+    // decoded and uploaded, and they are swapped as the view changes. Picking
+    // works on the loaded tiles; routing needs the full data and is off, which
+    // a shift-click reports in the HUD.
+    void SetTilePyramid(std::shared_ptr<const TilePyramid> pyramid);
+
+    // Drop the canvas' reference to the CPU-side geometry once it has been
+    // uploaded. Saves memory, but layer table changes can no longer rebuild
+    // the buffers and street labels are no longer re-placed on zoom.
+    void SetReleaseCpuGeometry(bool release) { releaseCpuGeometry_ = release; }
+
+    // Preprocess the road graph into a contraction hierarchy in SetData, so
+    // route queries take well under a millisecond at the cost of load time.
+    // Without it routes are found with bidirectional A*.
+    void SetUseContractionHierarchy(bool use) { useContractionHierarchy_ = use; }
+
+    // Limit the GPU memory used by map geometry; 0 (the default) uploads
+    // everything up front. With a budget every chunk gets its own buffers,
+    // uploaded when it comes into view; chunks that have been out of view
+    // the longest are evicted to make room. The packed geometry stays in CPU
+    // memory for re-uploads, even with SetReleaseCpuGeometry. The area fill
+    // buffer is not counted. Takes effect on the next SetData.
+    void SetVramBudget(size_t bytes);
+
+    // Build the map buffers with one vertex per distinct location and colour
+    // in each chunk, shared through the index buffer by every way that
+    // passes through it (see GeometryBuilder::SetShareVertices). Takes
+    // effect on the next SetData.
+    void SetShareVertices(bool share) { shareVertices_ = share; }
+
+    // Draw the line density grids instead of the vector layers once a screen
+    // pixel spans at least `texelsPerPixel` cells of the finest grid, so
+    // frame time stays flat however far out the view is zoomed; 0 always
+    // draws vectors. Tile pyramids are always drawn as vectors. The grids
+    // are built with the buffers, so this takes effect on the next SetData.
+    void SetDensityRasterThreshold(double texelsPerPixel) { densityRasterThreshold_ = texelsPerPixel; }
+
+    const GpuResidency::Stats &GetResidencyStats() const { return residency_.GetStats(); }
+
+    // Names of the loaded routes and areas, for search box completions. In
+    // tile pyramid mode only the loaded tiles are searched.
+    const NameIndex &GetNameIndex() const { return nameIndex_; }
+
+    // Zoom to the `resultIndex`th name starting with `query` (wrapping
+    // around the first DEFAULT_NAME_MATCHES) and show it in the HUD. Returns
+    // false if no name matches.
+    bool SearchName(const std::string &query, size_t resultIndex = 0);
+
+    // Map projection of the vertex buffers (Web Mercator by default). Picking
+    // and the view bounds map the screen back through the inverse. Rebuilds
+    // the buffers if OpenGL is up.
+    void SetProjection(Projection projection);
 
   protected:
     void CompileShaderProgram();
 
+    // Start an asynchronous build of `program` and track it until it is ready
+    void SubmitShaderProgram(ShaderProgram &program);
+
+    // Poll outstanding shader builds; called once per frame
+    void PollPendingShaderPrograms();
+
+    // The program used for roads/areas: the real one once it has linked,
+    // otherwise the fallback. nullptr if neither is usable.
+    const ShaderProgram *ActiveLineProgram() const;
+
     std::string GetShaderBuildLog() const { return shaderProgram_.lastBuildLog_.str(); }
 
     bool InitializeOpenGLFunctions();
 
-    // Update GPU buffers from `storedRoutes_` (called after GL init or when
-    // SetData is invoked while GL is available).
+    // Update GPU buffers from `storedData_` (called after GL init or when
+    // SetData is invoked while GL is available). Geometry is regrouped into
+    // spatial chunks so OnPaint can skip the ones outside the view.
     void UpdateBuffersFromRoutes();
 
+    // Chunked line geometry of `data` and the bounds outline. Only reads
+    // members fixed by SetData, so it may run on a worker thread.
+    ChunkedGeometry BuildGeometry(const OSMLoader::OSMData &data) const;
+
+    // Replace the GPU geometry with `geometry`, built from storedData_
+    void UploadGeometry(ChunkedGeometry geometry);
+
+    // Triangulate the outer rings of storedData_'s areas and upload them to
+    // the fill buffers. Tile pyramids only hold clipped pieces of rings, so
+    // they get no fills.
+    void UpdateFillBuffers();
+
+    // Build the line density pyramid of storedData_ and upload it as the mip
+    // chain of densityTexture_, with a quad over the loaded bounds to draw it
+    void UpdateDensityTexture();
+
+    // Tile pyramid mode: swap in the tiles of a finished LoadTiles, then
+    // start one for the tiles covering `visibleBounds` if they changed. The
+    // view keeps showing the previous tiles until the new ones are ready.
+    void UpdateVisibleTiles(const osmium::Box &visibleBounds);
+
+    using TileFeatures = std::shared_ptr<const std::vector<TileFeature>>;
+
+    // What the canvas shows for one set of tiles, built off the GL thread
+    struct TileSnapshot {
+        TileRange range;
+        OSMLoader::OSMDataPtr data;
+        FeatureIndex featureIndex;
+        NameIndex nameIndex;
+        ChunkedGeometry geometry;
+        // Tiles that were not in the cache, by TileId::Key
+        std::vector<std::pair<uint64_t, TileFeatures>> decoded;
+    };
+
+    // Decode the tiles of `range` missing from `cached` (every tile of the
+    // range with its cache entry, null if not cached) and build everything
+    // shown for them. Runs on a worker thread.
+    TileSnapshot LoadTiles(const TileRange &range, std::vector<std::pair<TileId, TileFeatures>> cached) const;
+
+    // Per-chunk buffers used with a VRAM budget. UploadChunk returns false
+    // if the driver ran out of memory.
+    bool UploadChunk(size_t chunk);
+    void EvictChunk(size_t chunk);
+    void ReleaseChunkBuffers();
+
     void Zoom(double scale, const wxPoint &mousePos);
 
+    // Centre `bounds` in the window and zoom so it fills most of it, keeping
+    // the current aspect ratio of the map
+    void ZoomToBounds(const osmium::Box &bounds);
+
+    // Look up the feature nearest to a click and show it in the HUD
+    void Pick(const wxPoint &mousePos);
+
+    // Shift-click: the first click sets the start of a route, the second the
+    // destination, which computes the route and shows it as an overlay
+    void Route(const wxPoint &mousePos);
+
+    // Upload `pathCoordinates_` to the path overlay buffers
+    void UpdatePathBuffers();
+
+    // Map location under a mouse position (logical, y-down pixels)
+    osmium::Location MouseToOSM(const wxPoint &mousePos);
+
     // utility methods to convert from Viewport->OSM and OSM->Viewport
     osmium::Location mapViewport2OSM(const wxPoint &viewportCoord);
     wxPoint mapOSM2Viewport(const osmium::Location &coords);
+    // Viewport -> projected coordinates, the space of the vertex buffers
+    wxRealPoint mapViewport2Projected(const wxPoint &viewportCoord);
 
-    using Color_t = std::array<GLfloat, 3>;
-    void AddLineStripAdjacencyToBuffers(const OSMLoader::Coordinates &coords, const Color_t &color,
-                                        std::vector<float> &vertices, std::vector<GLuint> &indices,
-                                        size_t &indexOffset);
+    // Projected y of coordinateBounds_' bottom and its projected height; the
+    // viewport maps linearly onto these
+    double ProjectedBottom() const { return ProjectLat(projection_, coordinateBounds_.bottom()); }
+    double ProjectedLatRange() const { return ProjectLat(projection_, coordinateBounds_.top()) - ProjectedBottom(); }
+
+    using Color_t = GeometryBuilder::Color_t;
 
   private:
     wxGLContext *openGLContext_;
     bool isOpenGLInitialized_{false};
 
     ShaderProgram shaderProgram_{};
+    // Cheap program (no geometry shader) drawn until shaderProgram_ is ready
+    ShaderProgram fallbackShaderProgram_{};
+    // Area fills: plain triangles, drawn under every line layer
+    ShaderProgram fillShaderProgram_{};
+    // The density texture, drawn instead of the map when zoomed far out
+    ShaderProgram densityShaderProgram_{};
+    // Street labels (NAME_TAG) and the FPS overlay
+    TextRenderer textRenderer_{};
+    std::vector<ShaderProgram *> pendingShaderPrograms_{};
+    bool isParallelShaderCompileAvailable_{false};
 
     wxTimer timer_;
     std::chrono::high_resolution_clock::time_point openGLInitializationTime_{};
@@ -75,27 +228,96 @@ class OpenGLCanvas : public wxGLCanvas {
 
     GLuint VAO_{0};
     GLuint VBO_{0};           // vertex buffer object
-    GLuint EBO_{0};           // element buffer object
-    GLsizei elementCount_{0}; // number of indices in the EBO
+    GLuint EBO_{0};           // element buffer object (16-bit indices)
+
+    // Triangulated areas, drawn with one glDrawElements call
+    GLuint fillVAO_{0};
+    GLuint fillVBO_{0};
+    GLuint fillEBO_{0}; // 32-bit indices
+    GLsizei fillIndexCount_{0};
+
+    // Line density per class (see DensityPyramid) as a mipmapped RGBA16F
+    // texture, drawn on one quad over the loaded bounds
+    double densityRasterThreshold_{1.0};
+    GLuint densityTexture_{0};
+    GLuint densityVAO_{0};
+    GLuint densityVBO_{0};
+    uint32_t densityGridWidth_{0}; // 0 when there is no texture
+    uint32_t densityGridHeight_{0};
 
     // OSM Coordinate bounds
     osmium::Box coordinateBounds_{};
+    Projection projection_{Projection::WebMercator};
 
     // bounding box in viewport coordinate system
     wxSize viewportSize_{};
     wxRect viewportBounds_{};
 
-    // Stored routes (kept so buffers can be uploaded after GL init)
-    OSMLoader::Id2Route storedRoutes_{};
-    OSMLoader::Id2Area storedAreas_{};
+    // Stored routes and areas (kept so buffers can be uploaded after GL init).
+    // Shared with the loader's snapshot, never copied.
+    OSMLoader::OSMDataPtr storedData_{};
+    bool releaseCpuGeometry_{false};
+
+    // Tile pyramid mode; decoded tiles are cached by TileId::Key.
+    // visibleTiles_ is the range shown or being loaded by pendingTiles_.
+    std::shared_ptr<const TilePyramid> tilePyramid_{};
+    TileRange visibleTiles_{};
+    std::unordered_map<uint64_t, TileFeatures> tileCache_{};
+    std::future<TileSnapshot> pendingTiles_{};
+
+    // Outline of the loaded bounds, drawn in the boundary layer
+    OSMLoader::Coordinates boundsOutline_{};
+
+    // Spatial chunks in VBO_/EBO_; only the ones intersecting the view are drawn
+    std::vector<GeometryChunk> chunks_{};
+    bool shareVertices_{false};
+    // Chunk range of every layer, in draw order
+    std::vector<LayerRange> layerRanges_{};
+
+    // With a VRAM budget chunks are not in VBO_/EBO_ but in buffers of their
+    // own, uploaded from the packed geometry as they become visible
+    struct ChunkBuffers {
+        GLuint VAO{0};
+        GLuint VBO{0};
+        GLuint EBO{0};
+    };
+    size_t vramBudgetBytes_{0};
+    GpuResidency residency_;
+    std::vector<ChunkBuffers> chunkBuffers_{};
+    std::vector<float> chunkVertices_{};
+    std::vector<uint16_t> chunkIndices_{};
+    const RenderLayerTable layerTable_{RenderLayerTable::Default()};
+
+    // Segment grid for click-to-inspect, built in SetData. It keeps its own
+    // copy of the ids and labels, so it survives releaseCpuGeometry_.
+    FeatureIndex featureIndex_{};
+    std::string pickedText_{};
+    // Name search, built in SetData; like the feature index it keeps its own
+    // copy of the names
+    NameIndex nameIndex_{};
+
+    // Routing over the loaded highways, built in SetData. Like the feature
+    // index it survives releaseCpuGeometry_.
+    bool useContractionHierarchy_{false};
+    std::unique_ptr<RoadGraph> roadGraph_{};
+    std::unique_ptr<ContractionHierarchy> routeHierarchy_{};
+    std::unique_ptr<RoutePlanner> routePlanner_{};
+    RoadGraph::Vertex routeStart_{RoadGraph::NO_VERTEX};
+    std::string routeText_{};
 
-    // Draw commands: pair<count, byteOffsetInEBO>
-    std::vector<std::pair<GLsizei, size_t>> drawCommands_{};
+    // Path overlay, drawn above every layer
+    OSMLoader::Coordinates pathCoordinates_{};
+    bool pathBuffersDirty_{false};
+    GLuint pathVAO_{0};
+    GLuint pathVBO_{0};
+    GLuint pathEBO_{0};
+    std::vector<GeometryChunk> pathChunks_{};
 
     // Event handling state
     // Mouse drag state for panning
     bool isDragging_{false};
     wxPoint lastMousePos_{0, 0};
+    wxPoint mouseDownPos_{0, 0}; // unflipped, to tell clicks from drags
     long prevEventTimestamp_{0};
     double lastZoomFactor_{1.0};
 };
\ No newline at end of file
@@ -18,12 +18,19 @@
 */
 
 #include "osm_loader.h"
-
-// Only work with XML input files here
+#include "external_way_join.h"
+#include "fast_xml_reader.h"
+#include "osm_loader_detail.h"
+#include "parallel.h"
+#include "parallel_decompress.h"
+
+// Only work with XML input files here. .osm.bz2 and .osm.gz go through the
+// parallel decompressors registered in getData().
 #include <osmium/io/xml_input.hpp>
 
 // We want to use the handler interface
 #include <osmium/handler.hpp>
+#include <osmium/memory/buffer.hpp>
 #include <osmium/osm/node.hpp>
 #include <osmium/osm/way.hpp>
 
@@ -40,36 +47,24 @@
 #include <osmium/handler/node_locations_for_ways.hpp>
 
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdint> // for std::uint64_t
 #include <exception>
+#include <functional>
 #include <iostream> // for std::cout, std::cerr
+#include <memory>
 #include <unordered_set>
+#include <vector>
 namespace {
-struct IdIndexPair {
-    osmium::object_id_type pairID;
-    int64_t pairIndex;
-
-    IdIndexPair(osmium::object_id_type wID, int64_t nIndex) : pairID(wID), pairIndex(nIndex) {}
-
-    bool operator==(const IdIndexPair &other) const { return pairID == other.pairID && pairIndex == other.pairIndex; }
-};
-
-struct IdIndexPairHash {
-    std::size_t operator()(const IdIndexPair &p) const {
-        return std::hash<osmium::object_id_type>()(p.pairID) ^ (std::hash<int64_t>()(p.pairIndex) << 1);
-    }
-};
+using detail::cleanupWay;
+using detail::MappedWayData;
+using detail::populateWay;
 
-using Id2IdIndexMap = std::unordered_map<osmium::object_id_type, std::unordered_set<IdIndexPair, IdIndexPairHash>>;
 using Id2String = std::unordered_map<osmium::object_id_type, std::string>;
 using Id2Index = std::unordered_map<osmium::object_id_type, int64_t>;
 using Id2Id2Index = std::unordered_map<osmium::object_id_type, Id2Index>;
 
-struct MappedWayData {
-    Id2IdIndexMap node2Ways;
-    OSMLoader::Id2Tags id2Tags;
-};
-
 // Map of Way -> Relationships
 using Id2Ids = std::unordered_map<osmium::object_id_type, std::unordered_set<osmium::object_id_type>>;
 struct RelationshipData {
@@ -80,17 +75,13 @@ struct RelationshipData {
 };
 
 struct RelationshipHandler : public osmium::handler::Handler {
+    const TagFilter &filter_;
     RelationshipData relationshipData;
 
-    bool containsTagValue(const osmium::TagList &tags, const char *key, const char *value) {
-        auto tag_value = tags.get_value_by_key(key);
-        return tag_value && std::strcmp(tag_value, value) == 0;
-    }
+    RelationshipHandler(const TagFilter &filter) : filter_(filter) {}
 
     void relation(const osmium::Relation &relation) noexcept {
-        if (!(containsTagValue(relation.tags(), ::TYPE_TAG, ::BOUNDARY_VALUE) ||
-              containsTagValue(relation.tags(), ::BUILDING_TAG, ::YES_VALUE) ||
-              containsTagValue(relation.tags(), ::AREA_TAG, ::YES_VALUE))) {
+        if (!filter_.Matches(osmium::item_type::relation, relation.tags())) {
             return;
         }
 
@@ -106,298 +97,536 @@ struct RelationshipHandler : public osmium::handler::Handler {
             }
         }
 
-        if (auto tag_value = relation.tags().get_value_by_key(NAME_TAG); tag_value) {
-            relationshipData.id2Tags[relation.id()][NAME_TAG] = tag_value;
-        }
-        if (auto tag_value = relation.tags().get_value_by_key(TYPE_TAG); tag_value) {
-            relationshipData.id2Tags[relation.id()][TYPE_TAG] = tag_value;
-        }
+        filter_.ForEachKeptTag(osmium::item_type::relation, relation.tags(),
+                               [this, &relation](const char *key, const char *value) {
+                                   relationshipData.id2Tags[relation.id()][key] = value;
+                               });
     };
 };
 
-struct WayHandler : public osmium::handler::Handler {
+// Number of buffers handed to each thread per group; more than one evens out
+// buffers of different sizes
+constexpr size_t BUFFERS_PER_THREAD = 2;
+
+// The way pass: collect the ways that are routes or relation members, and
+// the (way, index) of each of their nodes
+struct WayPass {
+    // What one worker collects from one buffer
+    struct Result {
+        detail::ShardedWayNodeRefs nodeRefs;
+        OSMLoader::Id2Tags id2Tags;
+        // Ways of the buffer that are relation members, in file order
+        std::vector<const osmium::Way *> relationshipWays;
+        // Nodes of the other ways when they are joined on disk
+        std::vector<detail::WayNodeRef> joinRefs;
+    };
+
     // Map of Node IDs -> Way IDs to be retrieved later
     const RelationshipData &inputRelationships_;
+    const TagFilter &filter_;
+    const size_t threadCount_;
+    // Route ways are joined with their nodes here instead of through
+    // node2Ways if set. Relation members always stay in memory.
+    ExternalWayJoin *join_;
 
     Id2Index relationship2RingIndex{};
     Id2Id2Index way2Relationship2RingIndex{};
     MappedWayData wayData;
 
-    // size_t largestWaySize = 0;
-    // osmium::object_id_type largestWayID = 0;
-
-    WayHandler(const RelationshipData &relationshipData) : inputRelationships_(relationshipData) {}
+    WayPass(const RelationshipData &relationshipData, const TagFilter &filter, size_t threadCount,
+            ExternalWayJoin *join)
+        : inputRelationships_(relationshipData), filter_(filter), threadCount_(threadCount), join_(join) {}
 
     bool isWayInRelationship(const osmium::Way &way) const {
         return inputRelationships_.way2Relationships.count(way.id()) > 0;
     }
     bool isWayAValidRoute(const osmium::Way &way) const {
-        return way.tags().get_value_by_key(HIGHWAY_TAG) != nullptr || way.tags().get_value_by_key(AREA_TAG) != nullptr;
+        return filter_.Matches(osmium::item_type::way, way.tags());
     }
 
-    void way(const osmium::Way &way) noexcept {
-        if (!(isWayInRelationship(way) || isWayAValidRoute(way))) {
-            return;
-        }
-
-        // if (way.nodes().size() > largestWaySize) {
-        //     largestWaySize = way.nodes().size();
-        //     largestWayID = way.id();
-        // }
-
-        auto &wayData = this->wayData;
-
-        if (isWayInRelationship(way)) {
-            const auto &tags = way.tags();
-            if (auto tag_value = tags.get_value_by_key(TYPE_TAG); tag_value) {
-                wayData.id2Tags[way.id()][TYPE_TAG] = tag_value;
+    // Runs on a worker thread and only reads the pass' state
+    Result process(const osmium::memory::Buffer &buffer) const {
+        Result result;
+        for (const auto &way : buffer.select<osmium::Way>()) {
+            const bool inRelationship = isWayInRelationship(way);
+            if (!(inRelationship || isWayAValidRoute(way))) {
+                continue;
+            }
+            if (inRelationship) {
+                result.relationshipWays.push_back(&way);
             }
 
-            std::cout << "Relationship Way " << way.id() << " is in relationship ";
-            for (const auto &relationshipId : inputRelationships_.way2Relationships.at(way.id())) {
-                auto &ringIndex = relationship2RingIndex[relationshipId];
-                way2Relationship2RingIndex[way.id()][relationshipId] = ringIndex;
-                std::cout << relationshipId << ", ringIndx=" << ringIndex << ", ";
-                ++ringIndex;
+            // Only the tags the filter keeps are copied
+            filter_.ForEachKeptTag(osmium::item_type::way, way.tags(),
+                                   [&result, &way](const char *key, const char *value) {
+                                       result.id2Tags[way.id()][key] = value;
+                                   });
+
+            const bool joinOnDisk = join_ != nullptr && !inRelationship;
+            for (size_t ii = 0; ii < way.nodes().size(); ++ii) {
+                const auto &node_ref = way.nodes()[ii];
+                // Assume that we only get po
+                assert(node_ref.ref() > 0);
+                const detail::WayNodeRef ref{node_ref.ref(), way.id(), static_cast<int64_t>(ii)};
+                if (joinOnDisk) {
+                    result.joinRefs.push_back(ref);
+                } else {
+                    result.nodeRefs[detail::shardOf(node_ref.ref())].push_back(ref);
+                }
             }
-            std::array<char, 128> buffer;
-            std::snprintf(buffer.data(), buffer.size(), " and has %lu nodes\n", way.nodes().size());
-            std::cout << buffer.data();
         }
+        return result;
+    }
 
-        if (isWayAValidRoute(way)) {
-            const auto &tags = way.tags();
-
-            if (auto tag_value = tags.get_value_by_key(HIGHWAY_TAG); tag_value) {
-                wayData.id2Tags[way.id()][HIGHWAY_TAG] = tag_value;
+    // Fold the results of a group of buffers into the pass, in file order so
+    // that ring indices follow the order of the ways in the file
+    void merge(std::vector<Result> &results) {
+        std::vector<detail::ShardedWayNodeRefs> nodeRefs;
+        nodeRefs.reserve(results.size());
+        for (auto &result : results) {
+            for (const auto *way : result.relationshipWays) {
+                std::cout << "Relationship Way " << way->id() << " is in relationship ";
+                for (const auto &relationshipId : inputRelationships_.way2Relationships.at(way->id())) {
+                    auto &ringIndex = relationship2RingIndex[relationshipId];
+                    way2Relationship2RingIndex[way->id()][relationshipId] = ringIndex;
+                    std::cout << relationshipId << ", ringIndx=" << ringIndex << ", ";
+                    ++ringIndex;
+                }
+                std::array<char, 128> buffer;
+                std::snprintf(buffer.data(), buffer.size(), " and has %lu nodes\n", way->nodes().size());
+                std::cout << buffer.data();
             }
-
-            if (auto tag_value = tags.get_value_by_key(NAME_TAG); tag_value) {
-                wayData.id2Tags[way.id()][NAME_TAG] = tag_value;
+            // Splices the entries over without copying the tags
+            wayData.id2Tags.merge(result.id2Tags);
+            nodeRefs.push_back(std::move(result.nodeRefs));
+            for (const auto &ref : result.joinRefs) {
+                join_->AddWayNode(ref.nodeID, ref.wayID, ref.index);
             }
         }
-
-        if (isWayInRelationship(way)) {
-        }
-        // const size_t offset = isWayInRelationship(way) ? way.nodes().size() : 0;
-        for (size_t ii = 0; ii < way.nodes().size(); ++ii) {
-            const auto &node_ref = way.nodes()[ii];
-            // Assume that we only get po
-            assert(node_ref.ref() > 0);
-            auto &nodeMap = wayData.node2Ways[node_ref.ref()];
-            nodeMap.emplace(way.id(), ii); // + offset);
-        }
+        detail::mergeWayNodeRefs(nodeRefs, wayData, threadCount_);
     }
 };
 
-struct NodeHandler : public osmium::handler::Handler {
+// The node pass: find the nodes of the ways from the way pass that are within
+// bounds and store their locations in the routes and area rings
+struct NodePass {
+    struct RouteNode {
+        osmium::object_id_type wayID;
+        int64_t index;
+        osmium::Location location;
+    };
+    struct RingNode {
+        osmium::object_id_type relationshipID;
+        int64_t ring;
+        int64_t index;
+        osmium::Location location;
+    };
+    // What one worker collects from one buffer
+    struct Result {
+        // Sharded by way ID, like routes_
+        std::array<std::vector<RouteNode>, detail::SHARD_COUNT> routeNodes;
+        std::vector<RingNode> ringNodes;
+        std::vector<std::pair<osmium::object_id_type, OSMLoader::AreaNode>> areaNodes;
+        // Every node within bounds, in file order, when ways are joined on disk
+        std::vector<std::pair<osmium::object_id_type, osmium::Location>> joinNodes;
+    };
 
     const osmium::Box &bounds_;
     const MappedWayData &wayData_;
     const RelationshipData &relationshipData_;
     const Id2Id2Index &way2Relationship2RingIndex_;
+    const size_t threadCount_;
+    ExternalWayJoin *join_;
 
-    OSMLoader::Id2Route routes_;
+    // Sharded by way ID so that each thread fills its own maps
+    std::array<OSMLoader::Id2Route, detail::SHARD_COUNT> routes_;
     OSMLoader::Id2Area areas_;
 
-    NodeHandler(const osmium::Box &bounds, const MappedWayData &wayData, const RelationshipData &relationshipData,
-                const Id2Id2Index &way2Relationship2RingIndex)
+    NodePass(const osmium::Box &bounds, const MappedWayData &wayData, const RelationshipData &relationshipData,
+             const Id2Id2Index &way2Relationship2RingIndex, size_t threadCount, ExternalWayJoin *join)
         : bounds_(bounds), wayData_(wayData), relationshipData_(relationshipData),
-          way2Relationship2RingIndex_(way2Relationship2RingIndex) {}
-
-    void node(const osmium::Node &node) noexcept {
-        if (!node.location().valid()) {
-            return;
-        }
+          way2Relationship2RingIndex_(way2Relationship2RingIndex), threadCount_(threadCount), join_(join) {}
+
+    // Runs on a worker thread and only reads the pass' state. The bounds
+    // check and the relationship and way lookups happen here.
+    Result process(const osmium::memory::Buffer &buffer) const {
+        Result result;
+        for (const auto &node : buffer.select<osmium::Node>()) {
+            if (!node.location().valid()) {
+                continue;
+            }
 
-        // NOTE: maybe bounds needs to be expanded to include more nodes?
-        if (!bounds_.contains(node.location())) {
-            return;
-        }
+            // NOTE: maybe bounds needs to be expanded to include more nodes?
+            if (!bounds_.contains(node.location())) {
+                continue;
+            }
+            if (join_ != nullptr) {
+                result.joinNodes.emplace_back(node.id(), node.location());
+            }
 
-        // check if node is in relationship
-        if (auto it = relationshipData_.node2Relationships.find(node.id());
-            it != relationshipData_.node2Relationships.end()) {
-            for (const auto &relationshipId : it->second) {
-                auto &area = areas_[relationshipId];
-                OSMLoader::AreaNode aNode{
-                    .id = node.id(),
-                    .role = relationshipData_.node2Roles.at(node.id()),
-                    .location = node.location(),
-                };
-                area.nodes.push_back(aNode);
+            // check if node is in relationship
+            if (auto it = relationshipData_.node2Relationships.find(node.id());
+                it != relationshipData_.node2Relationships.end()) {
+                for (const auto &relationshipId : it->second) {
+                    OSMLoader::AreaNode aNode{
+                        .id = node.id(),
+                        .role = relationshipData_.node2Roles.at(node.id()),
+                        .location = node.location(),
+                    };
+                    result.areaNodes.emplace_back(relationshipId, std::move(aNode));
+                }
             }
-        }
 
-        // check if node is in a way
-        if (auto it = wayData_.node2Ways.find(node.id()); it != wayData_.node2Ways.end()) {
+            // check if node is in a way
+            const auto *ways = wayData_.findWays(node.id());
+            if (ways == nullptr) {
+                continue;
+            }
             // This node is part of one or more requested ways
-            for (const auto &way : it->second) {
-                if (relationshipData_.way2Relationships.count(way.pairID) > 0) {
-                    for (const auto &relationshipId : relationshipData_.way2Relationships.at(way.pairID)) {
-                        auto &area = areas_[relationshipId];
-                        const auto &ringIdx = way2Relationship2RingIndex_.at(way.pairID).at(relationshipId);
-                        if (ringIdx >= area.outerRings.size()) {
-                            area.outerRings.resize(ringIdx + 1);
-                        }
-                        auto &outerRing = area.outerRings.at(ringIdx);
-                        populateWay(node, way.pairIndex, outerRing);
+            for (const auto &way : *ways) {
+                if (auto it = relationshipData_.way2Relationships.find(way.pairID);
+                    it != relationshipData_.way2Relationships.end()) {
+                    for (const auto &relationshipId : it->second) {
+                        const auto ringIdx = way2Relationship2RingIndex_.at(way.pairID).at(relationshipId);
+                        result.ringNodes.push_back({relationshipId, ringIdx, way.pairIndex, node.location()});
                     }
                 } else {
-                    // Find or create the route for this wayID
-                    auto &route = routes_[way.pairID];
-                    populateWay(node, way.pairIndex, route.nodes);
-                    route.id = way.pairID;
-                    if (wayData_.id2Tags.count(way.pairID) > 0) {
-                        const auto &tags = wayData_.id2Tags.at(way.pairID);
-                        route.tags[NAME_TAG] = tags.count(NAME_TAG) > 0 ? tags.at(NAME_TAG) : "";
-                        route.tags[HIGHWAY_TAG] = tags.count(HIGHWAY_TAG) > 0 ? tags.at(HIGHWAY_TAG) : "";
-                    }
+                    result.routeNodes[detail::shardOf(way.pairID)].push_back(
+                        {way.pairID, way.pairIndex, node.location()});
+                }
+            }
+        }
+        return result;
+    }
+
+    // Fold the results of a group of buffers into the routes and areas. Each
+    // thread fills whole route shards; area nodes are appended in file order.
+    void merge(std::vector<Result> &results) {
+        ParallelFor(detail::SHARD_COUNT, threadCount_, [this, &results](size_t shard) {
+            auto &routes = routes_[shard];
+            for (auto &result : results) {
+                for (const auto &routeNode : result.routeNodes[shard]) {
+                    addRouteNode(routes, routeNode);
+                }
+                result.routeNodes[shard] = {};
+            }
+        });
+
+        for (auto &result : results) {
+            for (const auto &[nodeID, location] : result.joinNodes) {
+                join_->AddNode(nodeID, location);
+            }
+            for (auto &[relationshipId, aNode] : result.areaNodes) {
+                areas_[relationshipId].nodes.push_back(std::move(aNode));
+            }
+            for (const auto &ringNode : result.ringNodes) {
+                auto &area = areas_[ringNode.relationshipID];
+                const auto ringIdx = static_cast<size_t>(ringNode.ring);
+                if (ringIdx >= area.outerRings.size()) {
+                    area.outerRings.resize(ringIdx + 1);
                 }
+                populateWay(ringNode.location, ringNode.index, area.outerRings[ringIdx]);
             }
         }
     }
 
-    void populateWay(const osmium::Node &node, const int nodeIndex, OSMLoader::Coordinates &nodes) {
-        if (nodes.size() <= nodeIndex) {
-            nodes.resize(nodeIndex + 1);
+    void addRouteNode(OSMLoader::Id2Route &routes, const RouteNode &routeNode) const {
+        // Find or create the route for this wayID
+        auto [routeIt, created] = routes.try_emplace(routeNode.wayID);
+        auto &route = routeIt->second;
+        populateWay(routeNode.location, routeNode.index, route.nodes);
+        if (created) {
+            route.id = routeNode.wayID;
+            assignTags(route);
         }
-        nodes[nodeIndex] = node.location();
+    }
+
+    void assignTags(OSMLoader::Route_t &route) const {
+        // Every tag the filter kept; name and highway are always present
+        if (auto tags = wayData_.id2Tags.find(route.id); tags != wayData_.id2Tags.end()) {
+            route.tags = tags->second;
+            route.tags.try_emplace(NAME_TAG);
+            route.tags.try_emplace(HIGHWAY_TAG);
+        }
+    }
+
+    // Remove incomplete routes, one shard per thread, and join the shards.
+    // With `keepGaps` the routes are left as they are for stitching.
+    OSMLoader::Id2Route takeRoutes(bool keepGaps) {
+        if (!keepGaps) {
+            ParallelFor(detail::SHARD_COUNT, threadCount_, [this](size_t shard) {
+                auto &routes = routes_[shard];
+                for (auto it = routes.begin(); it != routes.end();) {
+                    if (cleanupWay(it->second.nodes)) {
+                        it = routes.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            });
+        }
+
+        size_t total = 0;
+        for (const auto &shard : routes_) {
+            total += shard.size();
+        }
+        OSMLoader::Id2Route routes;
+        routes.reserve(total);
+        for (auto &shard : routes_) {
+            // Splices the routes over without copying their nodes
+            routes.merge(shard);
+        }
+
+        if (join_ != nullptr) {
+            // Ways come out of the join with the nodes it never saw left invalid
+            join_->AssembleWays([this, &routes, keepGaps](osmium::object_id_type wayID,
+                                                          OSMLoader::Coordinates &nodes) {
+                if (!keepGaps) {
+                    cleanupWay(nodes);
+                }
+                OSMLoader::Route_t route;
+                route.id = wayID;
+                route.nodes = std::move(nodes);
+                assignTags(route);
+                routes.emplace(wayID, std::move(route));
+            });
+        }
+        return routes;
     }
 };
 
-bool cleanupWay(OSMLoader::Coordinates &nodes) {
-    auto new_end =
-        std::remove_if(nodes.begin(), nodes.end(), [](const OSMLoader::Coordinate &loc) { return !loc.valid(); });
-    nodes.erase(new_end, nodes.end());
+// Run one pass of `handler` over the `entities` of the input: through the fast
+// XML reader when the file is mapped, otherwise through osmium's reader
+template <typename THandler>
+void applyPass(const osmium::io::File &input_file, const MappedFile *mapped, osmium::osm_entity_bits::type entities,
+               THandler &handler) {
+    if (mapped != nullptr) {
+        ForEachOsmXmlBuffer(mapped->data(), mapped->size(), entities, 0,
+                            [&handler](osmium::memory::Buffer &buffer) { osmium::apply(buffer, handler); });
+        return;
+    }
+    osmium::io::Reader reader{input_file, entities};
+    osmium::apply(reader, handler);
+    reader.close();
+}
 
-    return nodes.empty();
+// Call `fn` with groups of up to `groupSize` buffers of the input's
+// `entities`, in file order
+void forEachBufferGroup(const osmium::io::File &input_file, const MappedFile *mapped,
+                        osmium::osm_entity_bits::type entities, size_t threadCount, size_t groupSize,
+                        const std::function<void(std::vector<osmium::memory::Buffer> &)> &fn) {
+    std::vector<osmium::memory::Buffer> group;
+    auto add = [&group, groupSize, &fn](osmium::memory::Buffer &&buffer) {
+        group.push_back(std::move(buffer));
+        if (group.size() == groupSize) {
+            fn(group);
+            group.clear();
+        }
+    };
+
+    if (mapped != nullptr) {
+        ForEachOsmXmlBuffer(mapped->data(), mapped->size(), entities, threadCount,
+                            [&add](osmium::memory::Buffer &buffer) { add(std::move(buffer)); });
+    } else {
+        osmium::io::Reader reader{input_file, entities};
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            add(std::move(buffer));
+        }
+        reader.close();
+    }
+    if (!group.empty()) {
+        fn(group);
+    }
 }
 
-} // namespace
+// Run `pass` over the `entities` of the input on `threadCount` threads. Each
+// buffer of a group is processed on its own thread into a partial result,
+// then the group's results are merged in file order.
+template <typename TPass>
+void applyParallelPass(const osmium::io::File &input_file, const MappedFile *mapped,
+                       osmium::osm_entity_bits::type entities, size_t threadCount, TPass &pass) {
+    forEachBufferGroup(input_file, mapped, entities, threadCount, BUFFERS_PER_THREAD * threadCount,
+                       [&pass, threadCount](std::vector<osmium::memory::Buffer> &group) {
+                           std::vector<typename TPass::Result> results(group.size());
+                           ParallelFor(group.size(), threadCount,
+                                       [&](size_t i) { results[i] = pass.process(group[i]); });
+                           pass.merge(results);
+                       });
+}
 
-std::optional<OSMLoader::OSMData> OSMLoader::getData(const CoordinateBounds &bounds) const {
-    OSMData data;
+struct LoadOptions {
+    const TagFilter &filter;
+    size_t threadCount;
+    // Join route ways with their nodes on disk within this much memory; 0
+    // joins them in memory
+    size_t joinMemoryBytes;
+    // Leave the routes and rings uncleaned and record the way of every ring,
+    // so the result can be merged with other files (see PartialData)
+    bool keepGaps;
+};
 
-    if (filepath_.empty()) {
-        std::cerr << "No input file specified." << std::endl;
-        return data;
+detail::PartialData loadData(const osmium::io::File &input_file, const MappedFile *mapped,
+                            const OSMLoader::CoordinateBounds &bounds, const LoadOptions &options) {
+    const auto &filter = options.filter;
+    const size_t threadCount = options.threadCount == 0 ? DefaultThreadCount() : options.threadCount;
+    const auto start = std::chrono::steady_clock::now();
+
+    std::unique_ptr<ExternalWayJoin> join;
+    if (options.joinMemoryBytes > 0) {
+        join = std::make_unique<ExternalWayJoin>(options.joinMemoryBytes);
     }
 
-    try {
-        const osmium::io::File input_file{filepath_};
-
-        // 1) Generate a mapping of ways&nodes to relationships
-        osmium::io::Reader relationshipReader{input_file, osmium::osm_entity_bits::relation};
-        RelationshipHandler relationshipHandler;
-        osmium::apply(relationshipReader, relationshipHandler);
-        relationshipReader.close();
-        const auto &relationshipData = relationshipHandler.relationshipData;
-
-        // 2) generate a mapping of node to ways
-        osmium::io::Reader wayReader{input_file, osmium::osm_entity_bits::way};
-        WayHandler wayHandler(relationshipData);
-        osmium::apply(wayReader, wayHandler);
-        wayReader.close();
-        const auto &wayData = wayHandler.wayData;
-
-        // std::cout << "Largest way " << wayHandler.largestWayID << ", size: " << wayHandler.largestWaySize <<
-        // std::endl;
-
-        //
-        // 2) find the nodes which were requested in (1) and are within bounds
-        // and build a buffer to hold them
-        osmium::io::Reader nodeReader{input_file, osmium::osm_entity_bits::node};
-        NodeHandler nodeHandler(bounds, wayData, relationshipData, wayHandler.way2Relationship2RingIndex);
-        osmium::apply(nodeReader, nodeHandler);
-        nodeReader.close();
-        auto &routes = nodeHandler.routes_;
-        auto &areas = nodeHandler.areas_;
-
-        // clean up routes to remove any incomplete ways
-        for (auto it = routes.begin(); it != routes.end();) {
-            auto &way = it->second;
-            if (cleanupWay(way.nodes)) {
-                it = routes.erase(it);
-            } else {
-                ++it;
+    // 1) Generate a mapping of ways&nodes to relationships. There are few
+    // relations, so this pass stays on one thread.
+    RelationshipHandler relationshipHandler(filter);
+    applyPass(input_file, mapped, osmium::osm_entity_bits::relation, relationshipHandler);
+    const auto &relationshipData = relationshipHandler.relationshipData;
+
+    // 2) generate a mapping of node to ways
+    WayPass wayPass(relationshipData, filter, threadCount, join.get());
+    applyParallelPass(input_file, mapped, osmium::osm_entity_bits::way, threadCount, wayPass);
+    const auto &wayData = wayPass.wayData;
+
+    //
+    // 2) find the nodes which were requested in (1) and are within bounds
+    // and build a buffer to hold them
+    NodePass nodePass(bounds, wayData, relationshipData, wayPass.way2Relationship2RingIndex, threadCount, join.get());
+    applyParallelPass(input_file, mapped, osmium::osm_entity_bits::node, threadCount, nodePass);
+
+    // clean up routes to remove any incomplete ways
+    auto routes = nodePass.takeRoutes(options.keepGaps);
+    auto &areas = nodePass.areas_;
+
+    detail::Id2RingWays ringWays;
+    if (options.keepGaps) {
+        // Rings are matched up across files by the way they were read from
+        for (const auto &[wayID, relationships] : wayPass.way2Relationship2RingIndex) {
+            for (const auto &[relationshipID, ringIdx] : relationships) {
+                if (areas.count(relationshipID) == 0) {
+                    continue;
+                }
+                auto &ways = ringWays[relationshipID];
+                if (ways.size() <= static_cast<size_t>(ringIdx)) {
+                    ways.resize(static_cast<size_t>(ringIdx) + 1);
+                }
+                ways[static_cast<size_t>(ringIdx)] = wayID;
             }
+        }
+        for (const auto &entry : areas) {
+            ringWays.try_emplace(entry.first);
+        }
+    } else {
+        detail::cleanupAreas(areas);
+    }
 
-            // auto new_end =
-            //     std::remove_if(way.nodes.begin(), way.nodes.end(), [](const Coordinate &loc) { return !loc.valid();
-            //     });
-            // way.nodes.erase(new_end, way.nodes.end());
+    // // move routes -> Area_t::outerRing
+    // for (const auto &way : relationshipData.way2Relationships) {
+    //     if (!routes.count(way.first)) {
+    //         continue;
+    //     }
+    //     const auto &route = routes.at(way.first);
+    //     for (auto &area : way.second) {
+    //         if (areas.count(area)) {
+    //             // TODO: figure out how to allow more then one outerRing
+    //             auto &outerRing = areas.at(area).outerRing;
+    //             outerRing.reserve(outerRing.size() + route.nodes.size());
+    //             std::copy(route.nodes.begin(), route.nodes.end(), std::back_inserter(outerRing));
+    //         }
+    //     }
+    //     // TODO: maybe allow a way to be both a route and an area outer/inner
+    //     routes.erase(way.first);
+    // }
+
+    // for (auto &area : areas) {
+    //     auto &outerRing = area.second.outerRing;
+    //     if (outerRing.empty()) {
+    //         std::cout << "Area " << area.first << " has no outer ring" << std::endl;
+    //         continue;
+    //     }
+    //     // close the area
+    //     if (outerRing.front() != outerRing.back()) {
+    //         std::cout << "Closing area " << area.first << " since beginning and end vertices do not match\n";
+    //         // outerRing.push_back(outerRing.front());
+    //     }
+    // }
+
+    // Uncomment for data analysis
+    // std::unordered_map<std::string, uint32_t> types;
+    // for (const auto &entry : routes) {
+    //     types[entry.second.type] += 1;
+    // }
+    // std::cout << "Highway types:" << std::endl;
+    // for (const auto &type : types) {
+    //     std::cout << type.first << ": " << type.second << std::endl;
+    // }
+
+    const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+    std::cout << "OSM passes took " << elapsed.count() << " ms on " << threadCount << " threads" << std::endl;
+    if (join) {
+        const auto stats = join->GetStats();
+        std::cout << "External join: " << stats.joined << " of " << stats.wayNodes << " way nodes located, "
+                  << stats.runs << " runs, " << (stats.spilledBytes >> 20) << " MB spilled" << std::endl;
+    }
+
+    // Hand the pass' maps over without copying them
+    return {{std::move(routes), std::move(areas)}, std::move(ringWays)};
+}
 
-            // if (way.nodes.empty()) {
-            //     it = routes.erase(it);
-            // } else {
-            //     ++it;
-            // }
+// Load one file, through the fast XML reader if enabled and it can read it
+detail::PartialData loadFile(const std::string &filepath, bool useFastXmlParser,
+                             const OSMLoader::CoordinateBounds &bounds, const LoadOptions &options) {
+    const osmium::io::File input_file{filepath};
+    if (useFastXmlParser && input_file.format() == osmium::io::file_format::xml &&
+        input_file.compression() == osmium::io::file_compression::none) {
+        try {
+            const MappedFile mapped{filepath};
+            return loadData(input_file, &mapped, bounds, options);
+        } catch (const FastXmlUnsupported &e) {
+            std::cout << "Fast XML parser cannot read " << filepath << " (" << e.what() << "), falling back to expat"
+                      << std::endl;
         }
+    }
+    return loadData(input_file, nullptr, bounds, options);
+}
 
-        for (auto &[k, v] : areas) {
-            for (auto it = v.outerRings.begin(); it != v.outerRings.end();) {
-                if (cleanupWay(*it)) {
-                    std::cout << "cleaning up area " << k << " outer ring " << std::distance(v.outerRings.begin(), it)
-                              << std::endl;
-                    it = v.outerRings.erase(it);
-                } else {
-                    ++it;
-                }
-            }
-            // If there's no valid outerRing, then remove the area
-            if (v.outerRings.empty()) {
-                std::cout << "Erasing area " << k << " since it has no valid outer ring" << std::endl;
-                areas.erase(k);
-            }
+} // namespace
+
+OSMLoader::OSMDataPtr OSMLoader::getData(const CoordinateBounds &bounds) const {
+    if (filepaths_.empty()) {
+        std::cerr << "No input file specified." << std::endl;
+        return std::make_shared<const OSMData>();
+    }
+
+    try {
+        RegisterParallelDecompressors();
+        if (filepaths_.size() == 1) {
+            const LoadOptions options{tagFilter_, threadCount_, joinMemoryBytes_, false};
+            return std::make_shared<const OSMData>(
+                loadFile(filepaths_.front(), useFastXmlParser_, bounds, options).data);
         }
 
-        // // move routes -> Area_t::outerRing
-        // for (const auto &way : relationshipData.way2Relationships) {
-        //     if (!routes.count(way.first)) {
-        //         continue;
-        //     }
-        //     const auto &route = routes.at(way.first);
-        //     for (auto &area : way.second) {
-        //         if (areas.count(area)) {
-        //             // TODO: figure out how to allow more then one outerRing
-        //             auto &outerRing = areas.at(area).outerRing;
-        //             outerRing.reserve(outerRing.size() + route.nodes.size());
-        //             std::copy(route.nodes.begin(), route.nodes.end(), std::back_inserter(outerRing));
-        //         }
-        //     }
-        //     // TODO: maybe allow a way to be both a route and an area outer/inner
-        //     routes.erase(way.first);
-        // }
-
-        // for (auto &area : areas) {
-        //     auto &outerRing = area.second.outerRing;
-        //     if (outerRing.empty()) {
-        //         std::cout << "Area " << area.first << " has no outer ring" << std::endl;
-        //         continue;
-        //     }
-        //     // close the area
-        //     if (outerRing.front() != outerRing.back()) {
-        //         std::cout << "Closing area " << area.first << " since beginning and end vertices do not match\n";
-        //         // outerRing.push_back(outerRing.front());
-        //     }
-        // }
-
-        // Uncomment for data analysis
-        // std::unordered_map<std::string, uint32_t> types;
-        // for (const auto &entry : routes) {
-        //     types[entry.second.type] += 1;
-        // }
-        // std::cout << "Highway types:" << std::endl;
-        // for (const auto &type : types) {
-        //     std::cout << type.first << ": " << type.second << std::endl;
-        // }
-
-        return std::make_pair(routes, areas);
+        // One loader per file, all at once, each with its share of the
+        // threads and of the join memory
+        const auto start = std::chrono::steady_clock::now();
+        const size_t fileCount = filepaths_.size();
+        const size_t threadCount = threadCount_ == 0 ? DefaultThreadCount() : threadCount_;
+        const LoadOptions options{tagFilter_, std::max<size_t>(1, threadCount / fileCount),
+                                  joinMemoryBytes_ / fileCount, true};
+        std::vector<detail::PartialData> parts(fileCount);
+        ParallelFor(fileCount, fileCount,
+                    [&](size_t i) { parts[i] = loadFile(filepaths_[i], useFastXmlParser_, bounds, options); });
+
+        const auto mergeStart = std::chrono::steady_clock::now();
+        auto data = std::make_shared<const OSMData>(detail::mergePartialData(parts));
+        const auto end = std::chrono::steady_clock::now();
+        std::cout << "Loaded " << fileCount << " files in "
+                  << std::chrono::duration<double, std::milli>(end - start).count() << " ms (merge "
+                  << std::chrono::duration<double, std::milli>(end - mergeStart).count() << " ms)" << std::endl;
+        return data;
 
     } catch (const std::exception &e) {
         std::cerr << e.what() << std::endl;
     }
 
-    return std::nullopt;
+    return nullptr;
 }
@@ -1,11 +1,16 @@
 #pragma once
 
+#include "tag_filter.h"
+
 #include <osmium/osm/box.hpp>
 #include <osmium/osm/location.hpp>
 #include <osmium/osm/types.hpp>
 
-#include <optional>
+#include <cstddef>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 constexpr auto NAME_TAG = "name";
@@ -15,12 +20,29 @@ constexpr auto BOUNDARY_VALUE = "boundary";
 constexpr auto BUILDING_TAG = "building";
 constexpr auto AREA_TAG = "area";
 constexpr auto YES_VALUE = "yes";
+constexpr auto ONEWAY_TAG = "oneway";
 
 class OSMLoader {
   public:
     OSMLoader() = default;
 
-    void setFilepath(const std::string &filepath) { filepath_ = filepath; }
+    void setFilepath(const std::string &filepath) { filepaths_ = {filepath}; }
+    // Load several adjacent extracts, each on its own thread, and merge them
+    // into one snapshot. Objects in more than one file are kept once and ways
+    // cut at a file border are stitched back together.
+    void setFilepaths(std::vector<std::string> filepaths) { filepaths_ = std::move(filepaths); }
+    // Read uncompressed .osm files with the memory-mapped, parallel XML
+    // scanner instead of expat. Files it cannot handle fall back to expat.
+    void setFastXmlParser(bool enabled) { useFastXmlParser_ = enabled; }
+    // Which relations and ways are loaded and which of their tags are kept
+    void setTagFilter(TagFilter filter) { tagFilter_ = std::move(filter); }
+    // Threads the way and node passes run their handlers on; 0 uses every core
+    void setThreadCount(size_t threadCount) { threadCount_ = threadCount; }
+    // Join route ways with their nodes through sorted runs on disk, using at
+    // most this much memory for the join, so inputs whose node -> way map
+    // does not fit in RAM can be loaded. Needs nodes sorted by id. 0 (the
+    // default) joins in memory.
+    void setJoinMemoryLimit(size_t bytes) { joinMemoryBytes_ = bytes; }
     bool Count();
 
     // Using definition of Location:
@@ -62,8 +84,15 @@ class OSMLoader {
      * of coordinates
      */
     using OSMData = std::pair<Id2Route, Id2Area>;
-    std::optional<OSMData> getData(const CoordinateBounds &bounds) const;
+    // Immutable, reference-counted snapshot of the loaded data. It is moved
+    // (never copied) from the loader to its consumers; nullptr on error.
+    using OSMDataPtr = std::shared_ptr<const OSMData>;
+    OSMDataPtr getData(const CoordinateBounds &bounds) const;
 
   protected:
-    std::string filepath_{};
+    std::vector<std::string> filepaths_{};
+    bool useFastXmlParser_{false};
+    size_t threadCount_{0};
+    size_t joinMemoryBytes_{0};
+    TagFilter tagFilter_{TagFilter::Default()};
 };
\ No newline at end of file
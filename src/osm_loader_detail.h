@@ -0,0 +1,243 @@
+#pragma once
+
+// Data structures and helpers the loader passes share. They live in a header
+// (rather than osm_loader.cpp) so the benchmarks can exercise them on
+// synthetic input without osmium handlers or an input file.
+
+#include "osm_loader.h"
+#include "parallel.h"
+
+#include <osmium/osm/location.hpp>
+#include <osmium/osm/types.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace detail {
+
+// A way (or node) id and the position of a node in it
+struct IdIndexPair {
+    osmium::object_id_type pairID;
+    int64_t pairIndex;
+
+    IdIndexPair(osmium::object_id_type wID, int64_t nIndex) : pairID(wID), pairIndex(nIndex) {}
+
+    bool operator==(const IdIndexPair &other) const { return pairID == other.pairID && pairIndex == other.pairIndex; }
+};
+
+struct IdIndexPairHash {
+    std::size_t operator()(const IdIndexPair &p) const {
+        return std::hash<osmium::object_id_type>()(p.pairID) ^ (std::hash<int64_t>()(p.pairIndex) << 1);
+    }
+};
+
+// Node ID -> every (way ID, index in the way) it appears at
+using Id2IdIndexMap = std::unordered_map<osmium::object_id_type, std::unordered_set<IdIndexPair, IdIndexPairHash>>;
+
+// The per-id tables the handler passes build are split into shards so that
+// each worker thread can fill one shard without locks. Ids are hashed rather
+// than split into ranges: a buffer holds a run of consecutive ids, which would
+// otherwise all land in one shard.
+constexpr size_t SHARD_BITS = 6;
+constexpr size_t SHARD_COUNT = size_t{1} << SHARD_BITS;
+
+inline size_t shardOf(osmium::object_id_type id) {
+    return static_cast<size_t>((static_cast<uint64_t>(id) * 0x9E3779B97F4A7C15ull) >> (64 - SHARD_BITS));
+}
+
+struct MappedWayData {
+    // Sharded by node ID
+    std::array<Id2IdIndexMap, SHARD_COUNT> node2Ways;
+    OSMLoader::Id2Tags id2Tags;
+
+    // Every (way ID, index) `nodeID` appears at, or nullptr
+    const Id2IdIndexMap::mapped_type *findWays(osmium::object_id_type nodeID) const {
+        const auto &shard = node2Ways[shardOf(nodeID)];
+        const auto it = shard.find(nodeID);
+        return it == shard.end() ? nullptr : &it->second;
+    }
+};
+
+// A node of a way, as collected by a worker of the way pass
+struct WayNodeRef {
+    osmium::object_id_type nodeID;
+    osmium::object_id_type wayID;
+    int64_t index;
+};
+using ShardedWayNodeRefs = std::array<std::vector<WayNodeRef>, SHARD_COUNT>;
+
+// Insert the refs every worker collected into node2Ways. Each thread owns
+// whole shards, so no two threads touch the same map. The refs are freed.
+inline void mergeWayNodeRefs(std::vector<ShardedWayNodeRefs> &partials, MappedWayData &wayData, size_t threadCount) {
+    ParallelFor(SHARD_COUNT, threadCount, [&partials, &wayData](size_t shard) {
+        auto &node2Ways = wayData.node2Ways[shard];
+        for (auto &partial : partials) {
+            for (const auto &ref : partial[shard]) {
+                node2Ways[ref.nodeID].emplace(ref.wayID, ref.index);
+            }
+            partial[shard] = {};
+        }
+    });
+}
+
+// Store `location` at `nodeIndex` of `nodes`, growing it as needed. Nodes
+// arrive in file order, not way order, so gaps stay invalid until filled.
+inline void populateWay(const osmium::Location &location, int64_t nodeIndex, OSMLoader::Coordinates &nodes) {
+    const auto index = static_cast<size_t>(nodeIndex);
+    if (nodes.size() <= index) {
+        nodes.resize(index + 1);
+    }
+    nodes[index] = location;
+}
+
+// Drop the locations of nodes that were never seen (outside the bounds or
+// missing from the file). Returns true if nothing is left.
+inline bool cleanupWay(OSMLoader::Coordinates &nodes) {
+    auto new_end =
+        std::remove_if(nodes.begin(), nodes.end(), [](const OSMLoader::Coordinate &loc) { return !loc.valid(); });
+    nodes.erase(new_end, nodes.end());
+
+    return nodes.empty();
+}
+
+// Remove the outer rings left empty by cleanupWay, then the areas without any
+// outer ring. A closed ring with nodes missing is opened after its last gap,
+// so the ends of the piece left are not joined up across the gap.
+inline void cleanupAreas(OSMLoader::Id2Area &areas) {
+    for (auto areaIt = areas.begin(); areaIt != areas.end();) {
+        auto &[k, v] = *areaIt;
+        for (auto it = v.outerRings.begin(); it != v.outerRings.end();) {
+            auto &ring = *it;
+            if (ring.size() > 1 && ring.front() == ring.back()) {
+                const auto gap = std::find_if(ring.rbegin() + 1, ring.rend(),
+                                              [](const OSMLoader::Coordinate &loc) { return !loc.valid(); });
+                if (gap != ring.rend()) {
+                    const auto start = std::distance(ring.begin(), gap.base());
+                    ring.pop_back();
+                    std::rotate(ring.begin(), ring.begin() + start, ring.end());
+                }
+            }
+            if (cleanupWay(ring)) {
+                std::cout << "cleaning up area " << k << " outer ring " << std::distance(v.outerRings.begin(), it)
+                          << std::endl;
+                it = v.outerRings.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        // If there's no valid outerRing, then remove the area
+        if (v.outerRings.empty()) {
+            std::cout << "Erasing area " << k << " since it has no valid outer ring" << std::endl;
+            areaIt = areas.erase(areaIt);
+        } else {
+            ++areaIt;
+        }
+    }
+}
+
+// Relation ID -> the way each outer ring of the area was read from, by ring
+using Id2RingWays = std::unordered_map<osmium::object_id_type, std::vector<osmium::object_id_type>>;
+
+// What one file of a multi-file load yields. Routes and rings are not cleaned
+// up: the nodes the file lacks stay invalid at their index in the way, so the
+// pieces of a way cut by a file border line up index by index. Every area has
+// an entry in ringWays at least as long as its outerRings.
+struct PartialData {
+    OSMLoader::OSMData data;
+    Id2RingWays ringWays;
+};
+
+// Fill the missing locations of `nodes` from the same way as read from
+// another file
+inline void stitchWay(OSMLoader::Coordinates &nodes, const OSMLoader::Coordinates &other) {
+    if (nodes.size() < other.size()) {
+        nodes.resize(other.size());
+    }
+    for (size_t i = 0; i < other.size(); ++i) {
+        if (!nodes[i].valid()) {
+            nodes[i] = other[i];
+        }
+    }
+}
+
+// Fold `other`, the same relation read from another file, into `area`. Rings
+// read from the same way are stitched, rings of other ways are appended, and
+// node members are kept once.
+inline void stitchArea(OSMLoader::Area_t &area, std::vector<osmium::object_id_type> &ringWays,
+                       OSMLoader::Area_t &other, const std::vector<osmium::object_id_type> &otherRingWays) {
+    for (size_t ring = 0; ring < other.outerRings.size(); ++ring) {
+        const auto way = otherRingWays[ring];
+        const auto it = std::find(ringWays.begin(), ringWays.end(), way);
+        if (it == ringWays.end()) {
+            ringWays.push_back(way);
+            area.outerRings.push_back(std::move(other.outerRings[ring]));
+            continue;
+        }
+        const auto index = static_cast<size_t>(it - ringWays.begin());
+        if (area.outerRings.size() <= index) {
+            area.outerRings.resize(index + 1);
+        }
+        stitchWay(area.outerRings[index], other.outerRings[ring]);
+    }
+
+    std::unordered_set<osmium::object_id_type> nodeIDs;
+    for (const auto &node : area.nodes) {
+        nodeIDs.insert(node.id);
+    }
+    for (auto &node : other.nodes) {
+        if (nodeIDs.insert(node.id).second) {
+            area.nodes.push_back(std::move(node));
+        }
+    }
+    area.tags.merge(other.tags);
+}
+
+// Merge the results of loading several files, in file order: each route and
+// area is kept once, with its pieces from every file stitched together and
+// the tags of the first file that has it. Then drops the nodes no file had
+// and the routes and areas left empty, as a single-file load does. `parts`
+// is consumed.
+inline OSMLoader::OSMData mergePartialData(std::vector<PartialData> &parts) {
+    OSMLoader::OSMData merged;
+    auto &[routes, areas] = merged;
+    Id2RingWays ringWays;
+    for (auto &part : parts) {
+        auto &[partRoutes, partAreas] = part.data;
+        // Splices over the objects no earlier file had; the duplicates stay
+        // behind in the part
+        routes.merge(partRoutes);
+        for (auto &[id, route] : partRoutes) {
+            auto &kept = routes.at(id);
+            stitchWay(kept.nodes, route.nodes);
+            kept.tags.merge(route.tags);
+        }
+        areas.merge(partAreas);
+        for (auto &[id, area] : partAreas) {
+            stitchArea(areas.at(id), ringWays[id], area, part.ringWays[id]);
+        }
+        for (auto &[id, ways] : part.ringWays) {
+            ringWays.try_emplace(id, std::move(ways));
+        }
+        part = {};
+    }
+
+    for (auto it = routes.begin(); it != routes.end();) {
+        if (cleanupWay(it->second.nodes)) {
+            it = routes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    cleanupAreas(areas);
+    return merged;
+}
+
+} // namespace detail
@@ -0,0 +1,154 @@
+// Headless map renderer: loads an OSM file with OSMLoader and draws it with
+// the software rasterizer into a PNG, for machines without a GPU.
+
+#include "geometry_builder.h"
+#include "map_style.h"
+#include "osm_loader.h"
+#include "png_writer.h"
+#include "render_layers.h"
+#include "software_rasterizer.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void PrintUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] <input.osm> <output.png>\n"
+              << "  --size <WxH>          image size in pixels (default 1024x1024)\n"
+              << "  --bounds <l,b,r,t>    load and draw only these bounds (default: all the data)\n"
+              << "  --threads <n>         rasterizer threads (default: every core)\n"
+              << "  --tile-size <px>      side of the tiles rendered in parallel (default 64)\n"
+              << "  --projection <name>   mercator (default) or equirectangular\n"
+              << "  --fast-xml            parse .osm with the parallel memory-mapped scanner\n"
+              << "  --tag-filter <file>   tag filter file, as for the viewer\n";
+}
+
+void ParseSize(const std::string &value, RasterOptions &options) {
+    unsigned width, height;
+    char extra;
+    if (std::sscanf(value.c_str(), "%ux%u%c", &width, &height, &extra) != 2 || width == 0 || height == 0 ||
+        width > 65536 || height > 65536) {
+        throw std::runtime_error("invalid image size: " + value);
+    }
+    options.width = width;
+    options.height = height;
+}
+
+osmium::Box ParseBounds(const std::string &value) {
+    double left, bottom, right, top;
+    char extra;
+    if (std::sscanf(value.c_str(), "%lf,%lf,%lf,%lf%c", &left, &bottom, &right, &top, &extra) != 4 ||
+        left >= right || bottom >= top) {
+        throw std::runtime_error("invalid bounds: " + value);
+    }
+    return osmium::Box{left, bottom, right, top};
+}
+
+// Extent of every route and area outline
+osmium::Box DataBounds(const OSMLoader::OSMData &data) {
+    osmium::Box bounds;
+    for (const auto &entry : data.first) {
+        for (const auto &location : entry.second.nodes) {
+            bounds.extend(location);
+        }
+    }
+    for (const auto &entry : data.second) {
+        for (const auto &ring : entry.second.outerRings) {
+            for (const auto &location : ring) {
+                bounds.extend(location);
+            }
+        }
+    }
+    return bounds;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    RasterOptions options;
+    options.projection = Projection::WebMercator;
+    osmium::Box bounds{-180.0, -90.0, 180.0, 90.0};
+    bool boundsGiven = false;
+    std::string input;
+    std::string output;
+    OSMLoader loader;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--size") {
+                ParseSize(value(), options);
+            } else if (arg == "--bounds") {
+                bounds = ParseBounds(value());
+                boundsGiven = true;
+            } else if (arg == "--threads") {
+                options.threadCount = std::stoul(value());
+            } else if (arg == "--tile-size") {
+                options.tileSize = static_cast<uint32_t>(std::stoul(value()));
+            } else if (arg == "--projection") {
+                options.projection = ParseProjection(value());
+            } else if (arg == "--fast-xml") {
+                loader.setFastXmlParser(true);
+            } else if (arg == "--tag-filter") {
+                loader.setTagFilter(TagFilter::FromFile(value()));
+            } else if (arg == "-h" || arg == "--help") {
+                PrintUsage(argv[0]);
+                return 0;
+            } else if (input.empty()) {
+                input = arg;
+            } else if (output.empty()) {
+                output = arg;
+            } else {
+                throw std::runtime_error("unexpected argument: " + arg);
+            }
+        }
+        if (input.empty() || output.empty()) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        loader.setFilepath(input);
+        const auto data = loader.getData(bounds);
+        if (!data) {
+            std::cerr << "Failed to load " << input << std::endl;
+            return 1;
+        }
+        const osmium::Box view = boundsGiven ? bounds : DataBounds(*data);
+        if (!view.valid()) {
+            std::cerr << "Nothing to draw in " << input << std::endl;
+            return 1;
+        }
+
+        const auto layerTable = RenderLayerTable::Default();
+        GeometryBuilder builder(view, 16, layerTable.LayerCount(), options.projection);
+        AddMapFeatures(*data, layerTable, builder);
+        const auto geometry = builder.Build(options.threadCount);
+
+        RasterStats stats;
+        const auto image = RasterizeGeometry(geometry, layerTable, view, options, &stats);
+        std::cout << "Rasterised " << stats.segments << " segments into " << image.width << "x" << image.height
+                  << " pixels (" << stats.tiles << " tiles) in " << stats.binMilliseconds + stats.rasterMilliseconds
+                  << " ms: " << stats.MegapixelsPerSecond(image) << " MP/s" << std::endl;
+
+        const auto writeStart = std::chrono::steady_clock::now();
+        WritePng(output, image.width, image.height, image.pixels.data());
+        const auto writeTime =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - writeStart);
+        std::cout << "Wrote " << output << " in " << writeTime.count() << " ms" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
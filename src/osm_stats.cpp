@@ -0,0 +1,361 @@
+// Tag statistics for an OSM file: how often each highway value occurs, with
+// the width/surface combinations seen for it, and the most common relation
+// tag keys and key=value pairs. Streams .osm, .osm.bz2, .osm.gz and .osm.pbf
+// input, so it works on extracts far larger than memory.
+
+#include "fast_xml_reader.h"
+#include "osm_loader.h"
+#include "osm_xml_scanner.h"
+#include "parallel.h"
+#include "parallel_decompress.h"
+
+#include <osmium/io/pbf_input.hpp>
+#include <osmium/io/xml_input.hpp>
+#include <osmium/memory/buffer.hpp>
+#include <osmium/osm/object.hpp>
+#include <osmium/osm/relation.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace {
+
+constexpr auto WIDTH_TAG = "width";
+constexpr auto SURFACE_TAG = "surface";
+// Reported for a missing width or surface
+constexpr auto NOT_AVAILABLE = "N/A";
+
+// Buffers handed to each thread per read-ahead group
+constexpr size_t BUFFERS_PER_THREAD = 2;
+
+void PrintUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] <input.osm|.osm.bz2|.osm.gz|.osm.pbf>\n"
+              << "  --json                write the report as JSON\n"
+              << "  --top-keys <n>        relation tag keys to list, 0 for all (default 5)\n"
+              << "  --top-tags <n>        relation key=value pairs to list, 0 for all (default 10)\n"
+              << "  --threads <n>         worker threads (default: every core)\n"
+              << "  --fast-xml            parse .osm with the parallel memory-mapped scanner\n";
+}
+
+struct HighwayStats {
+    uint64_t count{0};
+    // (width, surface), NOT_AVAILABLE when the tag is missing
+    std::set<std::pair<std::string, std::string>> widthSurface;
+};
+
+// Histograms of one worker thread; merged once the whole file has been read
+struct OsmStats {
+    uint64_t nodes{0};
+    uint64_t ways{0};
+    uint64_t relations{0};
+    std::unordered_map<std::string, HighwayStats> highways;
+    std::unordered_map<std::string, uint64_t> relationKeys;
+    std::unordered_map<std::string, uint64_t> relationTags; // "key=value"
+
+    void Add(const osmium::OSMObject &object) {
+        switch (object.type()) {
+        case osmium::item_type::node:
+            ++nodes;
+            break;
+        case osmium::item_type::way:
+            ++ways;
+            break;
+        case osmium::item_type::relation:
+            ++relations;
+            break;
+        default:
+            return;
+        }
+
+        const auto &tags = object.tags();
+        if (const char *highway = tags.get_value_by_key(HIGHWAY_TAG)) {
+            auto &entry = highways[highway];
+            ++entry.count;
+            entry.widthSurface.emplace(tags.get_value_by_key(WIDTH_TAG, NOT_AVAILABLE),
+                                       tags.get_value_by_key(SURFACE_TAG, NOT_AVAILABLE));
+        }
+
+        if (object.type() == osmium::item_type::relation) {
+            std::string tag;
+            for (const auto &t : tags) {
+                if (*t.key() == '\0') {
+                    continue;
+                }
+                ++relationKeys[t.key()];
+                if (*t.value() != '\0') {
+                    tag.assign(t.key()).append("=").append(t.value());
+                    ++relationTags[tag];
+                }
+            }
+        }
+    }
+
+    void Merge(OsmStats &&other) {
+        nodes += other.nodes;
+        ways += other.ways;
+        relations += other.relations;
+        for (auto &entry : other.highways) {
+            auto &highway = highways[entry.first];
+            highway.count += entry.second.count;
+            highway.widthSurface.merge(entry.second.widthSurface);
+        }
+        for (const auto &entry : other.relationKeys) {
+            relationKeys[entry.first] += entry.second;
+        }
+        for (const auto &entry : other.relationTags) {
+            relationTags[entry.first] += entry.second;
+        }
+    }
+};
+
+// Stream `path` through `threadCount` workers. Buffers are read ahead in
+// groups; worker t takes every threadCount-th buffer of a group into its own
+// histograms, so no counter is shared between threads.
+OsmStats CollectStats(const std::string &path, size_t threadCount, bool fastXml) {
+    std::vector<OsmStats> partials(threadCount);
+    std::vector<osmium::memory::Buffer> group;
+    auto processGroup = [&]() {
+        ParallelFor(threadCount, threadCount, [&](size_t t) {
+            for (size_t i = t; i < group.size(); i += threadCount) {
+                for (const auto &object : group[i].select<osmium::OSMObject>()) {
+                    partials[t].Add(object);
+                }
+            }
+        });
+        group.clear();
+    };
+    auto add = [&](osmium::memory::Buffer &&buffer) {
+        group.push_back(std::move(buffer));
+        if (group.size() == BUFFERS_PER_THREAD * threadCount) {
+            processGroup();
+        }
+    };
+
+    const osmium::io::File input{path};
+    bool done = false;
+    if (fastXml && input.format() == osmium::io::file_format::xml &&
+        input.compression() == osmium::io::file_compression::none) {
+        try {
+            const MappedFile mapped{path};
+            ForEachOsmXmlBuffer(mapped.data(), mapped.size(), osmium::osm_entity_bits::nwr, threadCount,
+                                [&add](osmium::memory::Buffer &buffer) { add(std::move(buffer)); });
+            done = true;
+        } catch (const FastXmlUnsupported &e) {
+            std::cerr << "Fast XML parser cannot read " << path << " (" << e.what() << "), falling back to expat"
+                      << std::endl;
+            group.clear();
+            partials.assign(threadCount, OsmStats{});
+        }
+    }
+    if (!done) {
+        osmium::io::Reader reader{input, osmium::osm_entity_bits::nwr};
+        while (osmium::memory::Buffer buffer = reader.read()) {
+            add(std::move(buffer));
+        }
+        reader.close();
+    }
+    processGroup();
+
+    OsmStats stats;
+    for (auto &partial : partials) {
+        stats.Merge(std::move(partial));
+    }
+    return stats;
+}
+
+// Most frequent first, ties by name; at most `limit` entries unless it is 0
+std::vector<std::pair<std::string, uint64_t>> MostCommon(const std::unordered_map<std::string, uint64_t> &counts,
+                                                         size_t limit) {
+    std::vector<std::pair<std::string, uint64_t>> sorted(counts.begin(), counts.end());
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) {
+        return a.second > b.second || (a.second == b.second && a.first < b.first);
+    });
+    if (limit > 0 && sorted.size() > limit) {
+        sorted.resize(limit);
+    }
+    return sorted;
+}
+
+std::vector<std::pair<std::string, const HighwayStats *>> SortedHighways(const OsmStats &stats) {
+    std::vector<std::pair<std::string, const HighwayStats *>> sorted;
+    for (const auto &entry : stats.highways) {
+        sorted.emplace_back(entry.first, &entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto &a, const auto &b) { return a.first < b.first; });
+    return sorted;
+}
+
+void PrintText(const OsmStats &stats, size_t topKeys, size_t topTags) {
+    std::cout << std::left << std::setw(20) << "Highway Value" << " | " << std::setw(8) << "Count" << " | "
+              << std::setw(10) << "Width" << " | " << std::setw(15) << "Surface" << "\n"
+              << std::string(60, '-') << "\n";
+    uint64_t totalHighways = 0;
+    for (const auto &[value, highway] : SortedHighways(stats)) {
+        totalHighways += highway->count;
+        for (const auto &[width, surface] : highway->widthSurface) {
+            std::cout << std::setw(20) << value << " | " << std::setw(8) << highway->count << " | " << std::setw(10)
+                      << width << " | " << std::setw(15) << surface << "\n";
+        }
+    }
+    std::cout << "Total number of highway types: " << stats.highways.size() << "\n"
+              << "Total number of highways: " << totalHighways << "\n\n";
+
+    if (stats.relations == 0) {
+        std::cout << "No relation elements found in the file." << std::endl;
+        return;
+    }
+    std::cout << "Analyzed " << stats.relations << " relations.\n\n--- Most Common Tag Keys ---\n";
+    for (const auto &[key, count] : MostCommon(stats.relationKeys, topKeys)) {
+        std::cout << key << ": " << count << "\n";
+    }
+    std::cout << "\n--- Most Common Tag Types (Key=Value) ---\n";
+    for (const auto &[tag, count] : MostCommon(stats.relationTags, topTags)) {
+        std::cout << tag << ": " << count << "\n";
+    }
+    std::cout << std::flush;
+}
+
+std::string JsonString(const std::string &value) {
+    std::string out = "\"";
+    for (const char c : value) {
+        switch (c) {
+        case '"':
+            out += "\\\"";
+            break;
+        case '\\':
+            out += "\\\\";
+            break;
+        case '\n':
+            out += "\\n";
+            break;
+        case '\r':
+            out += "\\r";
+            break;
+        case '\t':
+            out += "\\t";
+            break;
+        default:
+            if (static_cast<unsigned char>(c) < 0x20) {
+                char escaped[8];
+                std::snprintf(escaped, sizeof(escaped), "\\u%04x", static_cast<unsigned>(c));
+                out += escaped;
+            } else {
+                out += c;
+            }
+        }
+    }
+    return out + "\"";
+}
+
+// Missing widths and surfaces are null rather than "N/A"
+std::string JsonTagValue(const std::string &value) { return value == NOT_AVAILABLE ? "null" : JsonString(value); }
+
+void PrintJson(const OsmStats &stats, size_t topKeys, size_t topTags) {
+    std::cout << "{\n  \"nodes\": " << stats.nodes << ",\n  \"ways\": " << stats.ways
+              << ",\n  \"relations\": " << stats.relations << ",\n  \"highways\": [";
+    const char *separator = "\n";
+    for (const auto &[value, highway] : SortedHighways(stats)) {
+        std::cout << separator << "    {\"value\": " << JsonString(value) << ", \"count\": " << highway->count
+                  << ", \"combinations\": [";
+        const char *comboSeparator = "";
+        for (const auto &[width, surface] : highway->widthSurface) {
+            std::cout << comboSeparator << "{\"width\": " << JsonTagValue(width)
+                      << ", \"surface\": " << JsonTagValue(surface) << "}";
+            comboSeparator = ", ";
+        }
+        std::cout << "]}";
+        separator = ",\n";
+    }
+    std::cout << "\n  ],\n  \"relationTagKeys\": [";
+    separator = "\n";
+    for (const auto &[key, count] : MostCommon(stats.relationKeys, topKeys)) {
+        std::cout << separator << "    {\"key\": " << JsonString(key) << ", \"count\": " << count << "}";
+        separator = ",\n";
+    }
+    std::cout << "\n  ],\n  \"relationTags\": [";
+    separator = "\n";
+    for (const auto &[tag, count] : MostCommon(stats.relationTags, topTags)) {
+        const auto equals = tag.find('=');
+        std::cout << separator << "    {\"key\": " << JsonString(tag.substr(0, equals))
+                  << ", \"value\": " << JsonString(tag.substr(equals + 1)) << ", \"count\": " << count << "}";
+        separator = ",\n";
+    }
+    std::cout << "\n  ]\n}" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    bool json = false;
+    size_t topKeys = 5;
+    size_t topTags = 10;
+    size_t threadCount = 0;
+    bool fastXml = false;
+    std::string input;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--json") {
+                json = true;
+            } else if (arg == "--top-keys") {
+                topKeys = std::stoul(value());
+            } else if (arg == "--top-tags") {
+                topTags = std::stoul(value());
+            } else if (arg == "--threads") {
+                threadCount = std::stoul(value());
+            } else if (arg == "--fast-xml") {
+                fastXml = true;
+            } else if (arg == "-h" || arg == "--help") {
+                PrintUsage(argv[0]);
+                return 0;
+            } else if (input.empty()) {
+                input = arg;
+            } else {
+                throw std::runtime_error("unexpected argument: " + arg);
+            }
+        }
+        if (input.empty()) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        if (threadCount == 0) {
+            threadCount = DefaultThreadCount();
+        }
+
+        RegisterParallelDecompressors(threadCount);
+        const auto start = std::chrono::steady_clock::now();
+        const OsmStats stats = CollectStats(input, threadCount, fastXml);
+        const auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start);
+        // Timing goes to stderr so --json output stays machine readable
+        std::cerr << "Read " << stats.nodes << " nodes, " << stats.ways << " ways and " << stats.relations
+                  << " relations in " << elapsed.count() << " ms on " << threadCount << " threads" << std::endl;
+
+        if (json) {
+            PrintJson(stats, topKeys, topTags);
+        } else {
+            PrintText(stats, topKeys, topTags);
+        }
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
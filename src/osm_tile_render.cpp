@@ -0,0 +1,330 @@
+// Batch tile exporter: loads an OSM file once and renders z/x/y tiles to PNG
+// files on the GPU through a headless EGL context, with the viewer's shaders.
+
+#include "geometry_builder.h"
+#include "gl_tile_renderer.h"
+#include "map_style.h"
+#include "offscreen_context.h"
+#include "osm_loader.h"
+#include "parallel.h"
+#include "png_writer.h"
+#include "render_layers.h"
+#include "tile_pyramid.h"
+#include "web_mercator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+
+constexpr uint32_t MAX_ZOOM = 24;
+
+void PrintUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] <input.osm> <output directory>\n"
+              << "  --min-zoom <z>        lowest zoom level (default 10)\n"
+              << "  --max-zoom <z>        highest zoom level (default 14)\n"
+              << "  --bounds <l,b,r,t>    load and render only these bounds (default: all the data)\n"
+              << "  --tiles <file>        render the z/x/y tiles listed in this file instead, one per line\n"
+              << "  --size <px>           tile size in pixels (default 256)\n"
+              << "  --samples <n>         MSAA samples, 0 for aliased lines like the viewer (default 4)\n"
+              << "  --readback-depth <n>  tiles in flight between drawing and readback (default 3)\n"
+              << "  --threads <n>         PNG encoder threads (default: every core)\n"
+              << "  --share-vertices      one vertex per location and colour in each chunk, shared by its ways\n"
+              << "  --fast-xml            parse .osm with the parallel memory-mapped scanner\n"
+              << "  --tag-filter <file>   tag filter file, as for the viewer\n";
+}
+
+uint32_t ParseZoom(const std::string &value) {
+    char *end = nullptr;
+    const unsigned long zoom = std::strtoul(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || zoom > MAX_ZOOM) {
+        throw std::runtime_error("invalid zoom level: " + value);
+    }
+    return static_cast<uint32_t>(zoom);
+}
+
+osmium::Box ParseBounds(const std::string &value) {
+    double left, bottom, right, top;
+    char extra;
+    if (std::sscanf(value.c_str(), "%lf,%lf,%lf,%lf%c", &left, &bottom, &right, &top, &extra) != 4 ||
+        left >= right || bottom >= top) {
+        throw std::runtime_error("invalid bounds: " + value);
+    }
+    return osmium::Box{left, bottom, right, top};
+}
+
+// One "z/x/y" per line; blank lines and lines starting with # are skipped
+std::vector<TileId> ReadTileList(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        throw std::runtime_error("cannot open tile list " + path);
+    }
+    std::vector<TileId> tiles;
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#') {
+            continue;
+        }
+        unsigned z, x, y;
+        char extra;
+        if (std::sscanf(line.c_str(), "%u/%u/%u%c", &z, &x, &y, &extra) != 3 || z > MAX_ZOOM ||
+            (uint64_t{x} >> z) != 0 || (uint64_t{y} >> z) != 0) {
+            throw std::runtime_error("invalid tile in " + path + ": " + line);
+        }
+        tiles.push_back({z, x, y});
+    }
+    return tiles;
+}
+
+std::vector<TileId> TilesOfZooms(const osmium::Box &bounds, uint32_t minZoom, uint32_t maxZoom) {
+    std::vector<TileId> tiles;
+    for (uint32_t z = minZoom; z <= maxZoom; ++z) {
+        const TileRange range = TilesCovering(bounds, z);
+        for (uint32_t x = range.minX; x <= range.maxX && range.Count() > 0; ++x) {
+            for (uint32_t y = range.minY; y <= range.maxY; ++y) {
+                tiles.push_back({z, x, y});
+            }
+        }
+    }
+    return tiles;
+}
+
+// Same extent as osm_render uses
+osmium::Box DataBounds(const OSMLoader::OSMData &data) {
+    osmium::Box bounds;
+    for (const auto &entry : data.first) {
+        for (const auto &location : entry.second.nodes) {
+            bounds.extend(location);
+        }
+    }
+    for (const auto &entry : data.second) {
+        for (const auto &ring : entry.second.outerRings) {
+            for (const auto &location : ring) {
+                bounds.extend(location);
+            }
+        }
+    }
+    return bounds;
+}
+
+// Encodes and writes tiles to <directory>/z/x/y.png on worker threads so the
+// GL thread only waits on them when `capacity` tiles are already queued
+class PngTileWriter {
+  public:
+    PngTileWriter(std::filesystem::path directory, size_t threadCount, size_t capacity)
+        : directory_(std::move(directory)), capacity_(std::max<size_t>(capacity, 1)) {
+        for (size_t i = 0; i < std::max<size_t>(threadCount, 1); ++i) {
+            workers_.emplace_back([this] { Work(); });
+        }
+    }
+    ~PngTileWriter() {
+        if (!workers_.empty()) {
+            Stop();
+        }
+    }
+
+    void Push(TileImage &&image) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        notFull_.wait(lock, [this] { return queue_.size() < capacity_ || error_; });
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+        queue_.push_back(std::move(image));
+        notEmpty_.notify_one();
+    }
+
+    // Wait for every queued tile; rethrows the first write error
+    void Finish() {
+        Stop();
+        if (error_) {
+            std::rethrow_exception(error_);
+        }
+    }
+
+    uint64_t BytesWritten() const { return bytesWritten_; }
+
+  private:
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+        }
+        notEmpty_.notify_all();
+        for (auto &worker : workers_) {
+            worker.join();
+        }
+        workers_.clear();
+    }
+
+    void Work() {
+        for (;;) {
+            TileImage image;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                notEmpty_.wait(lock, [this] { return !queue_.empty() || done_; });
+                if (queue_.empty()) {
+                    return;
+                }
+                image = std::move(queue_.front());
+                queue_.pop_front();
+            }
+            notFull_.notify_one();
+
+            try {
+                const auto directory = directory_ / std::to_string(image.tile.z) / std::to_string(image.tile.x);
+                std::filesystem::create_directories(directory);
+                const auto png = EncodePng(image.size, image.size, image.pixels.data());
+                const auto path = directory / (std::to_string(image.tile.y) + ".png");
+                std::ofstream file(path, std::ios::binary);
+                file.write(reinterpret_cast<const char *>(png.data()), static_cast<std::streamsize>(png.size()));
+                if (!file) {
+                    throw std::runtime_error("cannot write " + path.string());
+                }
+                bytesWritten_ += png.size();
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!error_) {
+                    error_ = std::current_exception();
+                }
+                notFull_.notify_all();
+            }
+        }
+    }
+
+    std::filesystem::path directory_;
+    size_t capacity_;
+    std::vector<std::thread> workers_;
+
+    std::mutex mutex_;
+    std::condition_variable notEmpty_;
+    std::condition_variable notFull_;
+    std::deque<TileImage> queue_;
+    bool done_{false};
+    std::exception_ptr error_;
+    std::atomic<uint64_t> bytesWritten_{0};
+};
+
+} // namespace
+
+int main(int argc, char **argv) {
+    GLTileRendererOptions options;
+    uint32_t minZoom = 10;
+    uint32_t maxZoom = 14;
+    osmium::Box bounds{-180.0, -web_mercator::MAX_LATITUDE, 180.0, web_mercator::MAX_LATITUDE};
+    bool boundsGiven = false;
+    std::string tileList;
+    size_t threadCount = 0;
+    bool shareVertices = false;
+    std::string input;
+    std::string output;
+    OSMLoader loader;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--min-zoom") {
+                minZoom = ParseZoom(value());
+            } else if (arg == "--max-zoom") {
+                maxZoom = ParseZoom(value());
+            } else if (arg == "--bounds") {
+                bounds = ParseBounds(value());
+                boundsGiven = true;
+            } else if (arg == "--tiles") {
+                tileList = value();
+            } else if (arg == "--size") {
+                options.tileSize = static_cast<uint32_t>(std::stoul(value()));
+            } else if (arg == "--samples") {
+                options.samples = std::stoi(value());
+            } else if (arg == "--readback-depth") {
+                options.readbackDepth = std::stoul(value());
+            } else if (arg == "--threads") {
+                threadCount = std::stoul(value());
+            } else if (arg == "--share-vertices") {
+                shareVertices = true;
+            } else if (arg == "--fast-xml") {
+                loader.setFastXmlParser(true);
+            } else if (arg == "--tag-filter") {
+                loader.setTagFilter(TagFilter::FromFile(value()));
+            } else if (arg == "-h" || arg == "--help") {
+                PrintUsage(argv[0]);
+                return 0;
+            } else if (input.empty()) {
+                input = arg;
+            } else if (output.empty()) {
+                output = arg;
+            } else {
+                throw std::runtime_error("unexpected argument: " + arg);
+            }
+        }
+        if (input.empty() || output.empty()) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+        if (minZoom > maxZoom) {
+            throw std::runtime_error("--min-zoom must not exceed --max-zoom");
+        }
+
+        loader.setFilepath(input);
+        const auto data = loader.getData(bounds);
+        if (!data) {
+            std::cerr << "Failed to load " << input << std::endl;
+            return 1;
+        }
+        const osmium::Box dataBounds = DataBounds(*data);
+        if (!dataBounds.valid()) {
+            std::cerr << "Nothing to draw in " << input << std::endl;
+            return 1;
+        }
+        const auto tiles = tileList.empty() ? TilesOfZooms(boundsGiven ? bounds : dataBounds, minZoom, maxZoom)
+                                            : ReadTileList(tileList);
+
+        if (threadCount == 0) {
+            threadCount = DefaultThreadCount();
+        }
+        const auto layerTable = RenderLayerTable::Default();
+        GeometryBuilder builder(dataBounds, 16, layerTable.LayerCount(), options.projection);
+        builder.SetShareVertices(shareVertices);
+        AddMapFeatures(*data, layerTable, builder);
+        const auto geometry = builder.Build(threadCount);
+
+        OffscreenContext context;
+        std::cout << "Rendering " << tiles.size() << " tiles of " << options.tileSize << " px on "
+                  << context.Describe() << std::endl;
+        GLTileRenderer renderer(geometry, layerTable, options);
+
+        const auto start = std::chrono::steady_clock::now();
+        PngTileWriter writer(output, threadCount, 4 * threadCount);
+        renderer.Render(tiles, [&writer](TileImage &&image) { writer.Push(std::move(image)); });
+        const auto renderTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+        writer.Finish();
+        const auto totalTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+        std::cout << "Rendered " << tiles.size() << " tiles in " << renderTime.count() * 1000.0 << " ms and wrote "
+                  << writer.BytesWritten() / 1024 << " KB of PNG in " << totalTime.count() * 1000.0
+                  << " ms: " << static_cast<double>(tiles.size()) / totalTime.count() << " tiles/s" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,118 @@
+// Offline tile pyramid builder: loads an OSM file with OSMLoader and writes
+// the z/x/y tile container that the viewer opens instead of raw OSM.
+
+#include "osm_loader.h"
+#include "tile_pyramid.h"
+#include "web_mercator.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+namespace {
+
+void PrintUsage(const char *program) {
+    std::cerr << "Usage: " << program << " [options] <input.osm> <output" << TILE_PYRAMID_EXTENSION << ">\n"
+              << "  --min-zoom <z>        lowest zoom level (default 10)\n"
+              << "  --max-zoom <z>        highest zoom level (default 16)\n"
+              << "  --bounds <l,b,r,t>    only load data inside these bounds (default: everything)\n"
+              << "  --tolerance <units>   simplification tolerance in tile grid units (default 2)\n"
+              << "  --fast-xml            parse .osm with the parallel memory-mapped scanner\n"
+              << "  --tag-filter <file>   tag filter file, as for the viewer\n"
+              << "  --join-memory <MB>    join ways with their nodes on disk within this much memory\n";
+}
+
+uint32_t ParseZoom(const std::string &value) {
+    char *end = nullptr;
+    const unsigned long zoom = std::strtoul(value.c_str(), &end, 10);
+    if (value.empty() || *end != '\0' || zoom > 24) {
+        throw std::runtime_error("invalid zoom level: " + value);
+    }
+    return static_cast<uint32_t>(zoom);
+}
+
+osmium::Box ParseBounds(const std::string &value) {
+    double left, bottom, right, top;
+    char extra;
+    if (std::sscanf(value.c_str(), "%lf,%lf,%lf,%lf%c", &left, &bottom, &right, &top, &extra) != 4 ||
+        left >= right || bottom >= top) {
+        throw std::runtime_error("invalid bounds: " + value);
+    }
+    return osmium::Box{left, bottom, right, top};
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+    TilePyramidOptions options;
+    osmium::Box bounds{-180.0, -web_mercator::MAX_LATITUDE, 180.0, web_mercator::MAX_LATITUDE};
+    std::string input;
+    std::string output;
+    OSMLoader loader;
+
+    try {
+        for (int i = 1; i < argc; ++i) {
+            const std::string arg = argv[i];
+            auto value = [&]() -> std::string {
+                if (i + 1 >= argc) {
+                    throw std::runtime_error(arg + " needs a value");
+                }
+                return argv[++i];
+            };
+            if (arg == "--min-zoom") {
+                options.minZoom = ParseZoom(value());
+            } else if (arg == "--max-zoom") {
+                options.maxZoom = ParseZoom(value());
+            } else if (arg == "--bounds") {
+                bounds = ParseBounds(value());
+            } else if (arg == "--tolerance") {
+                options.tolerance = std::stod(value());
+            } else if (arg == "--fast-xml") {
+                loader.setFastXmlParser(true);
+            } else if (arg == "--tag-filter") {
+                loader.setTagFilter(TagFilter::FromFile(value()));
+            } else if (arg == "--join-memory") {
+                loader.setJoinMemoryLimit(static_cast<size_t>(std::stoul(value())) << 20);
+            } else if (arg == "-h" || arg == "--help") {
+                PrintUsage(argv[0]);
+                return 0;
+            } else if (input.empty()) {
+                input = arg;
+            } else if (output.empty()) {
+                output = arg;
+            } else {
+                throw std::runtime_error("unexpected argument: " + arg);
+            }
+        }
+        if (input.empty() || output.empty()) {
+            PrintUsage(argv[0]);
+            return 1;
+        }
+
+        const auto loadStart = std::chrono::steady_clock::now();
+        loader.setFilepath(input);
+        const auto data = loader.getData(bounds);
+        if (!data) {
+            std::cerr << "Failed to load " << input << std::endl;
+            return 1;
+        }
+        const auto loadTime = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - loadStart);
+        std::cout << "Loaded " << data->first.size() << " routes and " << data->second.size() << " areas in "
+                  << loadTime.count() << " ms" << std::endl;
+
+        const auto writeStart = std::chrono::steady_clock::now();
+        const auto stats = WriteTilePyramid(*data, options, output);
+        const auto writeTime =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - writeStart);
+        std::cout << "Wrote " << stats.tiles << " tiles (z" << options.minZoom << "-" << options.maxZoom << ", "
+                  << stats.features << " features, " << stats.vertices << " vertices, " << stats.bytes
+                  << " bytes) to " << output << " in " << writeTime.count() << " ms" << std::endl;
+    } catch (const std::exception &e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
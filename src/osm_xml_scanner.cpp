@@ -0,0 +1,487 @@
+#include "osm_xml_scanner.h"
+
+#include <cstdint>
+#include <cstring>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define OSM_XML_HAVE_MMAP 1
+#endif
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+MappedFile::MappedFile(const std::string &path) {
+#ifdef OSM_XML_HAVE_MMAP
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw FastXmlUnsupported("cannot open " + path);
+    }
+    struct stat info {};
+    if (::fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        ::close(fd);
+        throw FastXmlUnsupported(path + " is not a regular file");
+    }
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ > 0) {
+        void *mapping = ::mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping == MAP_FAILED) {
+            ::close(fd);
+            throw FastXmlUnsupported("cannot map " + path);
+        }
+        // Chunks are scanned front to back by several threads at once
+        ::madvise(mapping, size_, MADV_WILLNEED);
+        data_ = static_cast<const char *>(mapping);
+    }
+    ::close(fd);
+#else
+    throw FastXmlUnsupported("memory mapped input is not available on this platform");
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef OSM_XML_HAVE_MMAP
+    if (data_ != nullptr) {
+        ::munmap(const_cast<char *>(data_), size_);
+    }
+#endif
+}
+
+namespace {
+
+// First byte in [p, end) equal to a, b or c (or below 0x20 if `controls`),
+// 16 bytes at a time. This is the inner loop of the scanner: it runs over
+// every attribute value and every start tag that gets skipped.
+const char *FindFirstOf(const char *p, const char *end, char a, char b, char c, bool controls) {
+#if defined(__SSE2__)
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i vb = _mm_set1_epi8(b);
+    const __m128i vc = _mm_set1_epi8(c);
+    const __m128i vControl = _mm_set1_epi8(controls ? 0x1F : 0);
+    for (; end - p >= 16; p += 16) {
+        const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+        __m128i match = _mm_or_si128(_mm_cmpeq_epi8(bytes, va), _mm_cmpeq_epi8(bytes, vb));
+        match = _mm_or_si128(match, _mm_cmpeq_epi8(bytes, vc));
+        if (controls) {
+            // Unsigned bytes <= 0x1F
+            match = _mm_or_si128(match, _mm_cmpeq_epi8(_mm_min_epu8(bytes, vControl), bytes));
+        }
+        if (const int mask = _mm_movemask_epi8(match); mask != 0) {
+            return p + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#elif defined(__ARM_NEON)
+    const uint8x16_t va = vdupq_n_u8(static_cast<uint8_t>(a));
+    const uint8x16_t vb = vdupq_n_u8(static_cast<uint8_t>(b));
+    const uint8x16_t vc = vdupq_n_u8(static_cast<uint8_t>(c));
+    const uint8x16_t vControl = vdupq_n_u8(controls ? 0x20 : 0);
+    for (; end - p >= 16; p += 16) {
+        const uint8x16_t bytes = vld1q_u8(reinterpret_cast<const uint8_t *>(p));
+        uint8x16_t match = vorrq_u8(vceqq_u8(bytes, va), vceqq_u8(bytes, vb));
+        match = vorrq_u8(match, vceqq_u8(bytes, vc));
+        match = vorrq_u8(match, vcltq_u8(bytes, vControl));
+        if (vmaxvq_u8(match) != 0) {
+            break; // locate it with the scalar loop below
+        }
+    }
+#endif
+    for (; p < end; ++p) {
+        const char byte = *p;
+        if (byte == a || byte == b || byte == c || (controls && static_cast<unsigned char>(byte) < 0x20)) {
+            return p;
+        }
+    }
+    return end;
+}
+
+bool IsSpace(char c) { return c == ' ' || c == '\t' || c == '\n' || c == '\r'; }
+
+bool IsNameEnd(char c) { return IsSpace(c) || c == '/' || c == '>' || c == '='; }
+
+void AppendUtf8(std::string &out, uint32_t codepoint) {
+    if (codepoint < 0x80) {
+        out.push_back(static_cast<char>(codepoint));
+    } else if (codepoint < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else if (codepoint < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    } else {
+        out.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+    }
+}
+
+// Decode an attribute value the way an XML parser reports it: predefined
+// entities and character references are replaced, and literal tabs, line
+// breaks (CRLF counts as one) are normalised to spaces
+std::string DecodeValue(std::string_view raw) {
+    std::string out;
+    out.reserve(raw.size());
+    for (size_t i = 0; i < raw.size(); ++i) {
+        const char c = raw[i];
+        if (c == '\r') {
+            if (i + 1 < raw.size() && raw[i + 1] == '\n') {
+                ++i;
+            }
+            out.push_back(' ');
+        } else if (c == '\n' || c == '\t') {
+            out.push_back(' ');
+        } else if (c == '<' || (static_cast<unsigned char>(c) < 0x20)) {
+            throw FastXmlUnsupported("invalid character in attribute value");
+        } else if (c != '&') {
+            out.push_back(c);
+        } else {
+            const size_t semicolon = raw.find(';', i);
+            if (semicolon == std::string_view::npos) {
+                throw FastXmlUnsupported("unterminated entity reference");
+            }
+            const std::string_view entity = raw.substr(i + 1, semicolon - i - 1);
+            if (entity == "amp") {
+                out.push_back('&');
+            } else if (entity == "lt") {
+                out.push_back('<');
+            } else if (entity == "gt") {
+                out.push_back('>');
+            } else if (entity == "quot") {
+                out.push_back('"');
+            } else if (entity == "apos") {
+                out.push_back('\'');
+            } else if (entity.size() >= 2 && entity[0] == '#') {
+                const bool hex = entity[1] == 'x';
+                uint32_t codepoint = 0;
+                const size_t first = hex ? 2 : 1;
+                if (entity.size() <= first || entity.size() - first > 8) {
+                    throw FastXmlUnsupported("invalid character reference");
+                }
+                for (size_t k = first; k < entity.size(); ++k) {
+                    const char digit = entity[k];
+                    uint32_t value = 0;
+                    if (digit >= '0' && digit <= '9') {
+                        value = static_cast<uint32_t>(digit - '0');
+                    } else if (hex && digit >= 'a' && digit <= 'f') {
+                        value = static_cast<uint32_t>(digit - 'a' + 10);
+                    } else if (hex && digit >= 'A' && digit <= 'F') {
+                        value = static_cast<uint32_t>(digit - 'A' + 10);
+                    } else {
+                        throw FastXmlUnsupported("invalid character reference");
+                    }
+                    codepoint = codepoint * (hex ? 16 : 10) + value;
+                }
+                if (codepoint == 0 || codepoint > 0x10FFFF || (codepoint >= 0xD800 && codepoint <= 0xDFFF)) {
+                    throw FastXmlUnsupported("invalid character reference");
+                }
+                AppendUtf8(out, codepoint);
+            } else {
+                throw FastXmlUnsupported("entity &" + std::string(entity) + "; is not supported");
+            }
+            i = semicolon;
+        }
+    }
+    return out;
+}
+
+bool StartsObject(const char *p, const char *end) {
+    // p points at '<'
+    for (std::string_view name : {std::string_view{"node"}, std::string_view{"way"}, std::string_view{"relation"}}) {
+        if (static_cast<size_t>(end - p) > name.size() + 1 && std::memcmp(p + 1, name.data(), name.size()) == 0 &&
+            IsNameEnd(p[1 + name.size()])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace
+
+OsmXmlScanner::OsmXmlScanner(const char *begin, const char *end, unsigned types)
+    : p_(begin), end_(end), types_(types) {}
+
+std::string_view OsmXmlScanner::ReadName() {
+    const char *start = p_;
+    while (p_ < end_ && !IsNameEnd(*p_)) {
+        ++p_;
+    }
+    if (p_ == end_) {
+        throw FastXmlUnsupported("truncated element name");
+    }
+    return {start, static_cast<size_t>(p_ - start)};
+}
+
+std::string_view OsmXmlScanner::ReadValue(char quote) {
+    const char *start = p_;
+    const char *stop = FindFirstOf(p_, end_, quote, '&', quote, true);
+    if (stop < end_ && *stop == quote) {
+        // Common case: nothing to decode, point straight into the input
+        p_ = stop + 1;
+        return {start, static_cast<size_t>(stop - start)};
+    }
+    const auto *close = static_cast<const char *>(std::memchr(stop, quote, static_cast<size_t>(end_ - stop)));
+    if (close == nullptr) {
+        throw FastXmlUnsupported("unterminated attribute value");
+    }
+    p_ = close + 1;
+    const auto &decoded = decoded_.emplace_back(DecodeValue({start, static_cast<size_t>(close - start)}));
+    return decoded;
+}
+
+bool OsmXmlScanner::ReadAttributes(std::vector<OsmXmlObject::Attribute> &attributes) {
+    attributes.clear();
+    while (true) {
+        while (p_ < end_ && IsSpace(*p_)) {
+            ++p_;
+        }
+        if (p_ == end_) {
+            throw FastXmlUnsupported("truncated start tag");
+        }
+        if (*p_ == '>') {
+            ++p_;
+            return false;
+        }
+        if (*p_ == '/') {
+            if (p_ + 1 == end_ || p_[1] != '>') {
+                throw FastXmlUnsupported("malformed start tag");
+            }
+            p_ += 2;
+            return true;
+        }
+
+        const std::string_view key = ReadName();
+        while (p_ < end_ && IsSpace(*p_)) {
+            ++p_;
+        }
+        if (p_ == end_ || *p_ != '=') {
+            throw FastXmlUnsupported("attribute without value");
+        }
+        ++p_;
+        while (p_ < end_ && IsSpace(*p_)) {
+            ++p_;
+        }
+        if (p_ == end_ || (*p_ != '"' && *p_ != '\'')) {
+            throw FastXmlUnsupported("unquoted attribute value");
+        }
+        const char quote = *p_++;
+        attributes.emplace_back(key, ReadValue(quote));
+    }
+}
+
+void OsmXmlScanner::SkipTag() {
+    // Skip to the end of the current tag; values may legally contain '>'
+    while (true) {
+        p_ = FindFirstOf(p_, end_, '>', '"', '\'', false);
+        if (p_ == end_) {
+            throw FastXmlUnsupported("truncated tag");
+        }
+        if (*p_ == '>') {
+            ++p_;
+            return;
+        }
+        const auto *close = static_cast<const char *>(std::memchr(p_ + 1, *p_, static_cast<size_t>(end_ - p_ - 1)));
+        if (close == nullptr) {
+            throw FastXmlUnsupported("unterminated attribute value");
+        }
+        p_ = close + 1;
+    }
+}
+
+void OsmXmlScanner::ReadEndTag(std::string_view name) {
+    // p_ is just past "</"
+    if (ReadName() != name) {
+        throw FastXmlUnsupported("mismatched end tag");
+    }
+    while (p_ < end_ && IsSpace(*p_)) {
+        ++p_;
+    }
+    if (p_ == end_ || *p_ != '>') {
+        throw FastXmlUnsupported("malformed end tag");
+    }
+    ++p_;
+}
+
+void OsmXmlScanner::SkipElement(std::string_view name, bool selfClosing) {
+    if (selfClosing) {
+        return;
+    }
+    // Objects only contain <tag>, <nd> and <member> children, which cannot
+    // contain '<' in their values, so the next "</" closes the element unless
+    // it closes a child
+    int depth = 0;
+    while (true) {
+        const auto *open = static_cast<const char *>(std::memchr(p_, '<', static_cast<size_t>(end_ - p_)));
+        if (open == nullptr || open + 1 == end_) {
+            throw FastXmlUnsupported("truncated element");
+        }
+        p_ = open + 1;
+        if (*p_ == '/') {
+            ++p_;
+            if (depth == 0) {
+                ReadEndTag(name);
+                return;
+            }
+            SkipTag();
+            --depth;
+        } else if (*p_ == '!' || *p_ == '?') {
+            throw FastXmlUnsupported("comments, CDATA and processing instructions are not supported");
+        } else {
+            ReadName();
+            SkipTag();
+            if (p_[-2] != '/') {
+                ++depth;
+            }
+        }
+    }
+}
+
+void OsmXmlScanner::ReadChildren(OsmXmlObject &object, std::string_view name) {
+    while (true) {
+        const auto *open = static_cast<const char *>(std::memchr(p_, '<', static_cast<size_t>(end_ - p_)));
+        if (open == nullptr || open + 1 == end_) {
+            throw FastXmlUnsupported("truncated element");
+        }
+        p_ = open + 1;
+        if (*p_ == '/') {
+            ++p_;
+            ReadEndTag(name);
+            return;
+        }
+        if (*p_ == '!' || *p_ == '?') {
+            throw FastXmlUnsupported("comments, CDATA and processing instructions are not supported");
+        }
+
+        const std::string_view child = ReadName();
+        const bool selfClosing = ReadAttributes(childAttributes_);
+        if (!selfClosing) {
+            // Only an immediate end tag is allowed, e.g. <tag k="a" v="b"></tag>
+            const auto *close = static_cast<const char *>(std::memchr(p_, '<', static_cast<size_t>(end_ - p_)));
+            if (close == nullptr || close + 1 == end_ || close[1] != '/') {
+                throw FastXmlUnsupported("unexpected content in <" + std::string(child) + ">");
+            }
+            p_ = close + 2;
+            ReadEndTag(child);
+        }
+
+        auto attribute = [this](std::string_view key) {
+            for (const auto &[k, v] : childAttributes_) {
+                if (k == key) {
+                    return v;
+                }
+            }
+            return std::string_view{};
+        };
+
+        if (child == "tag") {
+            object.tags.emplace_back(attribute("k"), attribute("v"));
+        } else if (child == "nd" && object.type == OsmXmlObject::Type::Way) {
+            object.nodeRefs.push_back(attribute("ref"));
+        } else if (child == "member" && object.type == OsmXmlObject::Type::Relation) {
+            object.members.push_back({attribute("type"), attribute("ref"), attribute("role")});
+        } else {
+            throw FastXmlUnsupported("<" + std::string(child) + "> elements are not supported");
+        }
+    }
+}
+
+bool OsmXmlScanner::Next(OsmXmlObject &object) {
+    decoded_.clear();
+    while (true) {
+        const auto *open = static_cast<const char *>(std::memchr(p_, '<', static_cast<size_t>(end_ - p_)));
+        if (open == nullptr) {
+            p_ = end_;
+            return false;
+        }
+        if (open + 1 == end_) {
+            throw FastXmlUnsupported("truncated document");
+        }
+        p_ = open + 1;
+
+        if (*p_ == '?') {
+            // XML declaration
+            const auto *close = static_cast<const char *>(std::memchr(p_, '>', static_cast<size_t>(end_ - p_)));
+            if (close == nullptr) {
+                throw FastXmlUnsupported("truncated processing instruction");
+            }
+            p_ = close + 1;
+            continue;
+        }
+        if (*p_ == '!') {
+            throw FastXmlUnsupported("comments, CDATA and DOCTYPE are not supported");
+        }
+        if (*p_ == '/') {
+            // </osm>
+            ++p_;
+            ReadName();
+            SkipTag();
+            continue;
+        }
+
+        const std::string_view name = ReadName();
+        OsmXmlObject::Type type;
+        unsigned bit = 0;
+        if (name == "node") {
+            type = OsmXmlObject::Type::Node;
+            bit = NODES;
+        } else if (name == "way") {
+            type = OsmXmlObject::Type::Way;
+            bit = WAYS;
+        } else if (name == "relation") {
+            type = OsmXmlObject::Type::Relation;
+            bit = RELATIONS;
+        } else if (name == "osm" || name == "bounds") {
+            SkipTag();
+            continue;
+        } else {
+            throw FastXmlUnsupported("<" + std::string(name) + "> elements are not supported");
+        }
+
+        if ((types_ & bit) == 0) {
+            SkipTag();
+            SkipElement(name, p_[-2] == '/');
+            continue;
+        }
+
+        object.type = type;
+        object.tags.clear();
+        object.nodeRefs.clear();
+        object.members.clear();
+        if (!ReadAttributes(object.attributes)) {
+            ReadChildren(object, name);
+        }
+        return true;
+    }
+}
+
+std::vector<std::pair<size_t, size_t>> SplitOsmXmlChunks(const char *data, size_t size, size_t chunkBytes) {
+    std::vector<std::pair<size_t, size_t>> chunks;
+    const char *end = data + size;
+    size_t start = 0;
+    while (start < size) {
+        size_t next = size;
+        if (size - start > chunkBytes) {
+            const char *p = data + start + chunkBytes;
+            while (p < end) {
+                p = static_cast<const char *>(std::memchr(p, '<', static_cast<size_t>(end - p)));
+                if (p == nullptr) {
+                    break;
+                }
+                if (StartsObject(p, end)) {
+                    next = static_cast<size_t>(p - data);
+                    break;
+                }
+                ++p;
+            }
+        }
+        chunks.emplace_back(start, next);
+        start = next;
+    }
+    return chunks;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Fast path for the subset of OSM XML the loader reads: <node>, <way>/<nd>,
+// <relation>/<member> and <tag>, as written by osmium, osmosis and the OSM
+// API. Anything outside that subset (comments, CDATA, DTDs, osmChange,
+// unknown elements) raises FastXmlUnsupported so callers can fall back to the
+// general expat-based parser.
+
+struct FastXmlUnsupported : public std::runtime_error {
+    using std::runtime_error::runtime_error;
+};
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+  public:
+    explicit MappedFile(const std::string &path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    const char *data() const { return data_; }
+    size_t size() const { return size_; }
+
+  private:
+    const char *data_{nullptr};
+    size_t size_{0};
+};
+
+// One top-level object. Names and values point into the scanned data, or into
+// the scanner when a value had to be decoded, and stay valid until the next
+// call to OsmXmlScanner::Next(). Values are decoded exactly like expat does
+// (entities, character references, attribute whitespace normalisation).
+struct OsmXmlObject {
+    enum class Type { Node, Way, Relation };
+
+    struct Member {
+        std::string_view type;
+        std::string_view ref;
+        std::string_view role;
+    };
+
+    using Attribute = std::pair<std::string_view, std::string_view>;
+
+    Type type{Type::Node};
+    std::vector<Attribute> attributes; // of the element itself, in document order
+    std::vector<Attribute> tags;       // <tag k v>
+    std::vector<std::string_view> nodeRefs;
+    std::vector<Member> members;
+};
+
+class OsmXmlScanner {
+  public:
+    // Bit mask of the object types Next() returns; others are skipped
+    static constexpr unsigned NODES = 1;
+    static constexpr unsigned WAYS = 2;
+    static constexpr unsigned RELATIONS = 4;
+
+    OsmXmlScanner(const char *begin, const char *end, unsigned types = NODES | WAYS | RELATIONS);
+
+    // Scan to the next requested object; false at the end of the range
+    bool Next(OsmXmlObject &object);
+
+  private:
+    std::string_view ReadName();
+    // Parses attributes up to the end of the start tag; returns true if the
+    // element was self-closing
+    bool ReadAttributes(std::vector<OsmXmlObject::Attribute> &attributes);
+    std::string_view ReadValue(char quote);
+    void SkipTag();
+    void SkipElement(std::string_view name, bool selfClosing);
+    void ReadEndTag(std::string_view name);
+    void ReadChildren(OsmXmlObject &object, std::string_view name);
+
+    const char *p_;
+    const char *end_;
+    unsigned types_;
+    std::vector<OsmXmlObject::Attribute> childAttributes_;
+    std::deque<std::string> decoded_; // values that needed decoding, cleared per object
+};
+
+// Split [data, data + size) into ranges of roughly `chunkBytes` that each
+// start at a <node, <way or <relation element (the first one starts at 0), so
+// that every range can be scanned independently
+std::vector<std::pair<size_t, size_t>> SplitOsmXmlChunks(const char *data, size_t size, size_t chunkBytes);
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+// Number of worker threads to use when the caller passes 0
+inline size_t DefaultThreadCount() { return std::max<size_t>(1, std::thread::hardware_concurrency()); }
+
+// Split [0, count) into one contiguous range per thread and run
+// `fn(begin, end)` on each. The calling thread processes the first range.
+// Ranges are deterministic for a given (count, threadCount). If `fn` throws,
+// the other ranges still run to the end and the exception of the lowest
+// range that threw is rethrown on the calling thread.
+template <typename Fn> void ParallelForRanges(size_t count, size_t threadCount, Fn &&fn) {
+    if (threadCount == 0) {
+        threadCount = DefaultThreadCount();
+    }
+    threadCount = std::min(threadCount, count);
+    if (threadCount <= 1) {
+        if (count > 0) {
+            fn(size_t{0}, count);
+        }
+        return;
+    }
+
+    const size_t perThread = (count + threadCount - 1) / threadCount;
+    std::vector<std::exception_ptr> errors(threadCount);
+    auto run = [&fn, &errors](size_t t, size_t begin, size_t end) {
+        try {
+            fn(begin, end);
+        } catch (...) {
+            errors[t] = std::current_exception();
+        }
+    };
+    std::vector<std::thread> workers;
+    workers.reserve(threadCount - 1);
+    for (size_t t = 1; t < threadCount; ++t) {
+        const size_t begin = std::min(count, t * perThread);
+        const size_t end = std::min(count, begin + perThread);
+        if (begin < end) {
+            try {
+                workers.emplace_back([&run, t, begin, end]() { run(t, begin, end); });
+            } catch (...) {
+                // Out of threads: run the range here rather than leave it out
+                run(t, begin, end);
+            }
+        }
+    }
+    run(0, 0, std::min(count, perThread));
+
+    for (auto &worker : workers) {
+        worker.join();
+    }
+    for (const auto &error : errors) {
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+}
+
+// Run `fn(i)` for every i in [0, count)
+template <typename Fn> void ParallelFor(size_t count, size_t threadCount, Fn &&fn) {
+    ParallelForRanges(count, threadCount, [&fn](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            fn(i);
+        }
+    });
+}
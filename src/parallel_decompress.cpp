@@ -0,0 +1,611 @@
+#include "parallel_decompress.h"
+#include "parallel.h"
+
+#include <osmium/io/compression.hpp>
+#include <osmium/io/detail/read_write.hpp>
+#include <osmium/io/error.hpp>
+#include <osmium/io/file_compression.hpp>
+
+#include <bzlib.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+constexpr size_t INPUT_CHUNK = 1024 * 1024;
+
+// ---------------------------------------------------------------- bzip2
+
+constexpr uint64_t BZ2_BLOCK_MAGIC = 0x314159265359ULL; // BCD pi
+constexpr uint64_t BZ2_EOS_MAGIC = 0x177245385090ULL;   // BCD sqrt(pi)
+constexpr uint64_t MAGIC_MASK = (uint64_t{1} << 48) - 1;
+constexpr int MAGIC_BITS = 48;
+// Block magic + CRC + randomised flag + origPtr, used to reject false
+// positives of the magic inside compressed data
+constexpr int BLOCK_HEADER_BITS = MAGIC_BITS + 32 + 1 + 24;
+// End of stream magic + combined CRC
+constexpr int STREAM_FOOTER_BITS = MAGIC_BITS + 32;
+
+// Appends bits MSB first, the order bzip2 uses
+class BitWriter {
+  public:
+    void Put(uint64_t value, int count) {
+        for (int i = count - 1; i >= 0; --i) {
+            PutBit((value >> i) & 1);
+        }
+    }
+
+    // Copy `bitCount` bits of `src` starting at bit `bitOffset`
+    void PutBits(const std::string &src, uint64_t bitOffset, uint64_t bitCount) {
+        const auto *bytes = reinterpret_cast<const unsigned char *>(src.data());
+        if (used_ == 0) {
+            // Byte aligned output: assemble whole bytes with one shift
+            const unsigned shift = bitOffset % 8;
+            size_t byte = bitOffset / 8;
+            out_.reserve(out_.size() + bitCount / 8 + 1);
+            for (; bitCount >= 8; bitCount -= 8, ++byte) {
+                unsigned value = bytes[byte] << shift;
+                if (shift != 0) {
+                    value |= bytes[byte + 1] >> (8 - shift);
+                }
+                out_.push_back(static_cast<char>(value & 0xFF));
+            }
+            bitOffset = byte * 8 + shift;
+        }
+        for (; bitCount > 0; --bitCount, ++bitOffset) {
+            PutBit((bytes[bitOffset / 8] >> (7 - bitOffset % 8)) & 1);
+        }
+    }
+
+    std::string Finish() {
+        if (used_ != 0) {
+            out_.push_back(static_cast<char>(current_ << (8 - used_)));
+            used_ = 0;
+            current_ = 0;
+        }
+        return std::move(out_);
+    }
+
+  private:
+    void PutBit(unsigned bit) {
+        current_ = (current_ << 1) | bit;
+        if (++used_ == 8) {
+            out_.push_back(static_cast<char>(current_));
+            used_ = 0;
+            current_ = 0;
+        }
+    }
+
+    std::string out_;
+    unsigned current_{0};
+    int used_{0};
+};
+
+std::string DecodeBzip2Stream(std::string stream) {
+    bz_stream bz{};
+    if (BZ2_bzDecompressInit(&bz, 0, 0) != BZ_OK) {
+        throw std::runtime_error("bzip2: failed to initialise decompressor");
+    }
+    bz.next_in = stream.data();
+    bz.avail_in = static_cast<unsigned>(stream.size());
+
+    // A block decodes to at most ~level * 100k bytes (plus RLE1 expansion)
+    std::string output(stream.size() * 4 + INPUT_CHUNK, '\0');
+    size_t produced = 0;
+    while (true) {
+        bz.next_out = output.data() + produced;
+        bz.avail_out = static_cast<unsigned>(output.size() - produced);
+        const int result = BZ2_bzDecompress(&bz);
+        produced = output.size() - bz.avail_out;
+        if (result == BZ_STREAM_END) {
+            break;
+        }
+        if (result != BZ_OK || (bz.avail_out != 0 && bz.avail_in == 0)) {
+            BZ2_bzDecompressEnd(&bz);
+            throw std::runtime_error("bzip2: corrupt block (error " + std::to_string(result) + ")");
+        }
+        if (bz.avail_out == 0) {
+            output.resize(output.size() * 2);
+        }
+    }
+    BZ2_bzDecompressEnd(&bz);
+    output.resize(produced);
+    return output;
+}
+
+// ---------------------------------------------------------------- gzip
+
+// Speculative batches span at least this much compressed input
+constexpr size_t GZIP_BATCH_BYTES = 1024 * 1024;
+constexpr size_t GZIP_OUTPUT_CHUNK = 1024 * 1024;
+// Fixed part of a member header: magic, method, flags, mtime, xfl, os
+constexpr size_t GZIP_HEADER_BYTES = 10;
+
+bool IsGzipHeaderCandidate(const unsigned char *bytes) {
+    // Magic, deflate and no reserved flag bits
+    return bytes[0] == 0x1f && bytes[1] == 0x8b && bytes[2] == 8 && (bytes[3] & 0xE0) == 0;
+}
+
+// Decode `data` as a sequence of complete gzip members, in pieces of at most
+// GZIP_OUTPUT_CHUNK bytes (small pieces stay in cache while they are written).
+// Returns nullptr if it isn't one, which is expected for batches that started
+// at false candidates.
+std::unique_ptr<std::deque<std::string>> DecodeGzipMembers(const std::string &data) {
+    z_stream zs{};
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK) {
+        return nullptr;
+    }
+
+    auto output = std::make_unique<std::deque<std::string>>();
+    size_t consumed = 0;
+    bool ok = true;
+    while (ok && consumed < data.size()) {
+        std::string piece(GZIP_OUTPUT_CHUNK, '\0');
+        zs.next_out = reinterpret_cast<Bytef *>(piece.data());
+        zs.avail_out = static_cast<uInt>(piece.size());
+        while (zs.avail_out != 0 && consumed < data.size()) {
+            zs.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(data.data())) + consumed;
+            zs.avail_in = static_cast<uInt>(data.size() - consumed);
+            const int result = inflate(&zs, Z_NO_FLUSH);
+            consumed = data.size() - zs.avail_in;
+            if (result == Z_STREAM_END) {
+                if (consumed < data.size() && inflateReset(&zs) != Z_OK) {
+                    ok = false;
+                }
+            } else if (result != Z_OK || consumed == data.size()) {
+                // Corrupt data, or the batch ended inside a member
+                ok = false;
+            }
+            if (!ok) {
+                break;
+            }
+        }
+        piece.resize(piece.size() - zs.avail_out);
+        if (!piece.empty()) {
+            output->push_back(std::move(piece));
+        }
+    }
+    inflateEnd(&zs);
+
+    if (!ok) {
+        return nullptr;
+    }
+    return output;
+}
+
+} // namespace
+
+ParallelBzip2Reader::ParallelBzip2Reader(DecompressInputSource input, size_t threadCount)
+    // One block per worker: every in-flight future is a running thread, and
+    // oversubscribing only makes the blocks' large working sets fight over cache
+    : input_(std::move(input)), maxInFlight_(threadCount == 0 ? DefaultThreadCount() : threadCount) {}
+
+bool ParallelBzip2Reader::ReadMore() {
+    if (inputEnd_) {
+        return false;
+    }
+    const size_t oldSize = buffer_.size();
+    buffer_.resize(oldSize + INPUT_CHUNK);
+    const size_t count = input_(buffer_.data() + oldSize, INPUT_CHUNK);
+    buffer_.resize(oldSize + count);
+    bytesRead_ += count;
+    if (count == 0) {
+        inputEnd_ = true;
+    }
+    return true;
+}
+
+uint32_t ParallelBzip2Reader::GetBits(uint64_t bit, int count) const {
+    uint32_t value = 0;
+    for (int i = 0; i < count; ++i, ++bit) {
+        const auto byte = static_cast<unsigned char>(buffer_[bit / 8 - bufferBase_]);
+        value = (value << 1) | ((byte >> (7 - bit % 8)) & 1);
+    }
+    return value;
+}
+
+void ParallelBzip2Reader::Trim() {
+    // Keep everything from the oldest bit that is still needed
+    uint64_t keepBit = scanBit_;
+    if (hasOpenBlock_) {
+        keepBit = std::min(keepBit, openBlockBit_);
+    }
+    const uint64_t keepByte = keepBit / 8;
+    if (keepByte - bufferBase_ >= 16 * INPUT_CHUNK) {
+        buffer_.erase(0, keepByte - bufferBase_);
+        bufferBase_ = keepByte;
+    }
+}
+
+void ParallelBzip2Reader::Dispatch(uint64_t startBit, uint64_t endBit) {
+    const uint64_t firstByte = startBit / 8;
+    const uint64_t lastByte = (endBit + 7) / 8;
+    std::string bytes = buffer_.substr(firstByte - bufferBase_, lastByte - firstByte);
+    const uint64_t bitOffset = startBit % 8;
+    const uint64_t bitCount = endBit - startBit;
+    const char level = level_;
+
+    inFlight_.push_back(std::async(std::launch::async, [bytes = std::move(bytes), bitOffset, bitCount, level]() {
+        // Wrap the block as a stream of its own: header, the block itself,
+        // end of stream magic and a combined CRC. With a single block the
+        // combined CRC is just the block CRC that follows the block magic.
+        BitWriter writer;
+        writer.Put('B', 8);
+        writer.Put('Z', 8);
+        writer.Put('h', 8);
+        writer.Put(static_cast<unsigned char>(level), 8);
+        writer.PutBits(bytes, bitOffset, bitCount);
+        writer.Put(BZ2_EOS_MAGIC, MAGIC_BITS);
+        uint32_t crc = 0;
+        for (uint64_t bit = bitOffset + MAGIC_BITS; bit < bitOffset + MAGIC_BITS + 32; ++bit) {
+            crc = (crc << 1) | ((static_cast<unsigned char>(bytes[bit / 8]) >> (7 - bit % 8)) & 1);
+        }
+        writer.Put(crc, 32);
+        return DecodeBzip2Stream(writer.Finish());
+    }));
+}
+
+bool ParallelBzip2Reader::Advance() {
+    if (finished_) {
+        return false;
+    }
+
+    if (expectStreamHeader_) {
+        const uint64_t headerByte = scanBit_ / 8;
+        if (!HaveBytes(headerByte + 4)) {
+            if (ReadMore() && !inputEnd_) {
+                return true;
+            }
+            if (!HaveBytes(headerByte + 4)) {
+                if (!sawStream_) {
+                    throw std::runtime_error("bzip2: input is not a bzip2 file");
+                }
+                finished_ = true; // clean end (trailing bytes shorter than a header are ignored)
+                return false;
+            }
+        }
+        const char *header = buffer_.data() + (headerByte - bufferBase_);
+        if (header[0] != 'B' || header[1] != 'Z' || header[2] != 'h' || header[3] < '1' || header[3] > '9') {
+            if (!sawStream_) {
+                throw std::runtime_error("bzip2: input is not a bzip2 file");
+            }
+            // Trailing garbage after the last stream, same as bzip2 -d
+            finished_ = true;
+            return false;
+        }
+        level_ = header[3];
+        sawStream_ = true;
+        expectStreamHeader_ = false;
+        scanBit_ = (headerByte + 4) * 8;
+        return true;
+    }
+
+    // Scan every bit offset that still has a full block header behind it (at
+    // the end of input, everything that can still hold a magic). A 64-bit
+    // big-endian window starting at byte `byte` contains the 48 bits at bit
+    // offsets 0..7 of that byte.
+    const uint64_t availableBits = (bufferBase_ + buffer_.size()) * 8;
+    const uint64_t needBits = inputEnd_ ? 64 : BLOCK_HEADER_BITS + 64;
+    const uint64_t limitBit = availableBits > needBits ? availableBits - needBits : 0;
+    const auto *bytes = reinterpret_cast<const unsigned char *>(buffer_.data());
+
+    for (uint64_t bit = scanBit_; bit < limitBit;) {
+        const uint64_t byte = bit / 8;
+        uint64_t window = 0;
+        for (int i = 0; i < 8; ++i) {
+            window = (window << 8) | bytes[byte - bufferBase_ + i];
+        }
+        for (uint64_t shift = bit % 8; shift < 8; ++shift) {
+            const uint64_t candidate = (window >> (64 - MAGIC_BITS - shift)) & MAGIC_MASK;
+            const uint64_t position = byte * 8 + shift;
+            if (candidate == BZ2_BLOCK_MAGIC) {
+                // Not randomised (deprecated, never written by bzip2 >= 0.9.5)
+                // and origPtr within the block size
+                if (position + BLOCK_HEADER_BITS > availableBits) {
+                    continue;
+                }
+                const bool randomised = GetBits(position + MAGIC_BITS + 32, 1) != 0;
+                const uint32_t origPtr = GetBits(position + MAGIC_BITS + 33, 24);
+                if (randomised || origPtr >= static_cast<uint32_t>(level_ - '0') * 100000) {
+                    continue;
+                }
+                if (hasOpenBlock_) {
+                    Dispatch(openBlockBit_, position);
+                }
+                hasOpenBlock_ = true;
+                openBlockBit_ = position;
+                scanBit_ = position + MAGIC_BITS;
+                Trim();
+                return true;
+            }
+            if (candidate == BZ2_EOS_MAGIC) {
+                if (hasOpenBlock_) {
+                    Dispatch(openBlockBit_, position);
+                    hasOpenBlock_ = false;
+                }
+                // The next stream (if any) starts at the following byte
+                scanBit_ = ((position + STREAM_FOOTER_BITS + 7) / 8) * 8;
+                expectStreamHeader_ = true;
+                Trim();
+                return true;
+            }
+        }
+        bit = (byte + 1) * 8;
+    }
+    scanBit_ = std::max(scanBit_, limitBit);
+
+    if (inputEnd_) {
+        throw std::runtime_error("bzip2: unexpected end of file");
+    }
+    ReadMore();
+    return true;
+}
+
+std::string ParallelBzip2Reader::Read() {
+    while (true) {
+        while (inFlight_.size() < maxInFlight_ && Advance()) {
+        }
+        if (inFlight_.empty()) {
+            return {};
+        }
+        auto output = inFlight_.front().get();
+        inFlight_.pop_front();
+        if (!output.empty()) {
+            return output;
+        }
+    }
+}
+
+ParallelGzipReader::ParallelGzipReader(DecompressInputSource input, size_t threadCount)
+    : input_(std::move(input)), maxInFlight_(2 * (threadCount == 0 ? DefaultThreadCount() : threadCount)) {
+    // Read far enough ahead to keep every in-flight batch supplied
+    window_ = std::max<size_t>(32 * INPUT_CHUNK, (maxInFlight_ + 1) * GZIP_BATCH_BYTES);
+
+    auto *zs = new z_stream{};
+    if (inflateInit2(zs, 16 + MAX_WBITS) != Z_OK) {
+        delete zs;
+        throw std::runtime_error("gzip: failed to initialise decompressor");
+    }
+    stream_ = zs;
+}
+
+ParallelGzipReader::~ParallelGzipReader() {
+    auto *zs = static_cast<z_stream *>(stream_);
+    inflateEnd(zs);
+    delete zs;
+    // Outstanding batches are joined by their futures' destructors
+}
+
+bool ParallelGzipReader::ReadMore() {
+    if (inputEnd_) {
+        return false;
+    }
+    const size_t oldSize = buffer_.size();
+    buffer_.resize(oldSize + INPUT_CHUNK);
+    const size_t count = input_(buffer_.data() + oldSize, INPUT_CHUNK);
+    buffer_.resize(oldSize + count);
+    bytesRead_ += count;
+    if (count == 0) {
+        inputEnd_ = true;
+    }
+    return true;
+}
+
+void ParallelGzipReader::Trim() {
+    if (pos_ - bufferBase_ >= 16 * INPUT_CHUNK) {
+        buffer_.erase(0, pos_ - bufferBase_);
+        bufferBase_ = pos_;
+    }
+}
+
+void ParallelGzipReader::Speculate() {
+    // Collect candidate member headers in the newly read data
+    const auto *bytes = reinterpret_cast<const unsigned char *>(buffer_.data());
+    const uint64_t scanEnd = BufferEnd() >= GZIP_HEADER_BYTES ? BufferEnd() - GZIP_HEADER_BYTES + 1 : 0;
+    for (uint64_t offset = std::max(scanPos_, pos_ + 1); offset < scanEnd; ++offset) {
+        const auto *found = static_cast<const unsigned char *>(
+            std::memchr(bytes + (offset - bufferBase_), 0x1f, scanEnd - offset));
+        if (found == nullptr) {
+            break;
+        }
+        offset = bufferBase_ + static_cast<uint64_t>(found - bytes);
+        if (IsGzipHeaderCandidate(found)) {
+            candidates_.push_back(offset);
+        }
+    }
+    scanPos_ = std::max(scanPos_, scanEnd);
+
+    while (!candidates_.empty() && candidates_.front() <= pos_) {
+        candidates_.pop_front();
+    }
+
+    // Turn runs of candidates into batches of at least GZIP_BATCH_BYTES. A
+    // batch must end at a candidate too (or at the end of input) so a correct
+    // guess decodes as whole members.
+    while (!candidates_.empty() && batches_.size() < maxInFlight_) {
+        const uint64_t start = candidates_.front();
+        size_t next = 1;
+        while (next < candidates_.size() && candidates_[next] - start < GZIP_BATCH_BYTES) {
+            ++next;
+        }
+        uint64_t end = 0;
+        if (next < candidates_.size()) {
+            end = candidates_[next];
+        } else if (inputEnd_) {
+            end = BufferEnd();
+        } else {
+            break; // wait for more input
+        }
+        candidates_.erase(candidates_.begin(), candidates_.begin() + static_cast<std::ptrdiff_t>(next));
+
+        std::string data = buffer_.substr(start - bufferBase_, end - start);
+        batches_.emplace(start, Batch{end, std::async(std::launch::async, [data = std::move(data)]() {
+                                          return DecodeGzipMembers(data);
+                                      })});
+    }
+}
+
+std::string ParallelGzipReader::TakeReady() {
+    auto piece = std::move(ready_.front());
+    ready_.pop_front();
+    return piece;
+}
+
+std::string ParallelGzipReader::Read() {
+    if (!ready_.empty()) {
+        return TakeReady();
+    }
+
+    auto *zs = static_cast<z_stream *>(stream_);
+    while (true) {
+        while (!inputEnd_ && BufferEnd() - pos_ < window_) {
+            ReadMore();
+        }
+        Speculate();
+
+        if (!inMember_) {
+            // Batches behind the cursor can no longer be used
+            while (!batches_.empty() && batches_.begin()->first < pos_) {
+                batches_.erase(batches_.begin());
+            }
+            if (pos_ == BufferEnd() && inputEnd_) {
+                return {};
+            }
+
+            if (auto it = batches_.find(pos_); it != batches_.end()) {
+                auto output = it->second.output.get();
+                const uint64_t end = it->second.end;
+                batches_.erase(it);
+                if (output) {
+                    pos_ = end;
+                    Trim();
+                    ready_ = std::move(*output);
+                    if (!ready_.empty()) {
+                        return TakeReady();
+                    }
+                    continue;
+                }
+            }
+
+            const auto *header = reinterpret_cast<const unsigned char *>(buffer_.data() + (pos_ - bufferBase_));
+            if (BufferEnd() - pos_ < GZIP_HEADER_BYTES || !IsGzipHeaderCandidate(header)) {
+                if (pos_ == 0) {
+                    throw std::runtime_error("gzip: input is not a gzip file");
+                }
+                // Trailing garbage after the last member, same as gzip -d
+                inputEnd_ = true;
+                pos_ = BufferEnd();
+                return {};
+            }
+            if (inflateReset(zs) != Z_OK) {
+                throw std::runtime_error("gzip: failed to reset decompressor");
+            }
+            inMember_ = true;
+        }
+
+        std::string output(GZIP_OUTPUT_CHUNK, '\0');
+        zs->next_in = reinterpret_cast<Bytef *>(buffer_.data() + (pos_ - bufferBase_));
+        zs->avail_in = static_cast<uInt>(std::min<uint64_t>(BufferEnd() - pos_, UINT32_MAX));
+        zs->next_out = reinterpret_cast<Bytef *>(output.data());
+        zs->avail_out = static_cast<uInt>(output.size());
+        const uInt availIn = zs->avail_in;
+
+        const int result = inflate(zs, Z_NO_FLUSH);
+        pos_ += availIn - zs->avail_in;
+        output.resize(output.size() - zs->avail_out);
+        if (result == Z_STREAM_END) {
+            inMember_ = false;
+        } else if (result == Z_BUF_ERROR && zs->avail_in == 0) {
+            if (inputEnd_) {
+                throw std::runtime_error("gzip: unexpected end of file");
+            }
+            ReadMore(); // window top-up only runs when the cursor gets close
+        } else if (result != Z_OK) {
+            throw std::runtime_error(std::string{"gzip: "} + (zs->msg ? zs->msg : "corrupt data"));
+        }
+        Trim();
+        if (!output.empty()) {
+            return output;
+        }
+    }
+}
+
+namespace {
+
+// Adapts the readers to osmium's Decompressor interface. osmium calls read()
+// from its input thread, so the parallel decoding overlaps with parsing.
+template <typename ReaderT> class ParallelDecompressor : public osmium::io::Decompressor {
+  public:
+    ParallelDecompressor(int fd, size_t threadCount)
+        : fd_(fd), reader_(
+                       [fd](char *buffer, size_t size) {
+                           return static_cast<size_t>(osmium::io::detail::reliable_read(fd, buffer, size));
+                       },
+                       threadCount) {}
+
+    ParallelDecompressor(const char *data, size_t size, size_t threadCount)
+        : reader_(
+              [data, size, offset = size_t{0}](char *buffer, size_t count) mutable {
+                  count = std::min(count, size - offset);
+                  std::memcpy(buffer, data + offset, count);
+                  offset += count;
+                  return count;
+              },
+              threadCount) {}
+
+    ~ParallelDecompressor() noexcept override {
+        try {
+            close();
+        } catch (...) {
+            // Destructors must not throw
+        }
+    }
+
+    std::string read() override {
+        auto output = reader_.Read();
+        set_offset(static_cast<size_t>(reader_.BytesConsumed()));
+        return output;
+    }
+
+    void close() override {
+        if (fd_ >= 0) {
+            const int fd = fd_;
+            fd_ = -1;
+            osmium::io::detail::reliable_close(fd);
+        }
+    }
+
+  private:
+    int fd_{-1};
+    ReaderT reader_;
+};
+
+} // namespace
+
+void RegisterParallelDecompressors(size_t threadCount) {
+    static std::once_flag registered;
+    std::call_once(registered, [threadCount]() {
+        auto &factory = osmium::io::CompressionFactory::instance();
+        auto noCompressor = [](int, osmium::io::fsync) -> osmium::io::Compressor * {
+            throw osmium::io_error{"writing compressed OSM files is not supported"};
+        };
+
+        factory.register_compression(
+            osmium::io::file_compression::bzip2, noCompressor,
+            [threadCount](int fd) { return new ParallelDecompressor<ParallelBzip2Reader>(fd, threadCount); },
+            [threadCount](const char *data, size_t size) {
+                return new ParallelDecompressor<ParallelBzip2Reader>(data, size, threadCount);
+            });
+        factory.register_compression(
+            osmium::io::file_compression::gzip, noCompressor,
+            [threadCount](int fd) { return new ParallelDecompressor<ParallelGzipReader>(fd, threadCount); },
+            [threadCount](const char *data, size_t size) {
+                return new ParallelDecompressor<ParallelGzipReader>(data, size, threadCount);
+            });
+    });
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <string>
+
+// Parallel readers for compressed OSM input. Both split the compressed
+// stream into independently decodable pieces, decompress them on worker
+// threads and hand the output back strictly in input order, so the osmium
+// parser sees exactly the bytes a single-threaded decompressor would produce.
+
+// Fills `buffer` with up to `size` bytes; returns 0 at end of input
+using DecompressInputSource = std::function<size_t(char *buffer, size_t size)>;
+
+// bzip2: every compressed block starts with a 48-bit magic at an arbitrary
+// bit offset. Blocks are located by scanning for that magic (and for the end
+// of stream magic, so pbzip2-style multi-stream files work too), re-wrapped
+// as single-block streams and decoded in parallel.
+class ParallelBzip2Reader {
+  public:
+    explicit ParallelBzip2Reader(DecompressInputSource input, size_t threadCount = 0);
+
+    // Next piece of decompressed output; empty at end of input
+    std::string Read();
+
+    uint64_t BytesConsumed() const { return bytesRead_; }
+
+  private:
+    bool Advance();
+    bool ReadMore();
+    void Dispatch(uint64_t startBit, uint64_t endBit);
+    uint32_t GetBits(uint64_t bit, int count) const;
+    bool HaveBytes(uint64_t endByte) const { return endByte <= bufferBase_ + buffer_.size(); }
+    void Trim();
+
+    DecompressInputSource input_;
+    size_t maxInFlight_;
+
+    std::string buffer_;
+    uint64_t bufferBase_{0}; // absolute offset of buffer_[0]
+    uint64_t bytesRead_{0};
+    bool inputEnd_{false};
+    bool finished_{false};
+
+    bool expectStreamHeader_{true};
+    bool sawStream_{false};
+    char level_{'9'};
+    uint64_t scanBit_{0};
+    bool hasOpenBlock_{false};
+    uint64_t openBlockBit_{0};
+
+    std::deque<std::future<std::string>> inFlight_;
+};
+
+// gzip: members can only be delimited by decoding them, so the reader decodes
+// sequentially but speculatively decompresses batches starting at candidate
+// member headers ahead of the cursor. A batch is used only if it started at
+// the exact offset where the previous member ended and consisted of complete
+// members, so false candidates merely waste work. Single-member files fall
+// back to streaming inflate; multi-member files (bgzip, concatenated gzip)
+// decode in parallel.
+class ParallelGzipReader {
+  public:
+    explicit ParallelGzipReader(DecompressInputSource input, size_t threadCount = 0);
+    ~ParallelGzipReader();
+
+    std::string Read();
+
+    uint64_t BytesConsumed() const { return bytesRead_; }
+
+  private:
+    struct Batch {
+        uint64_t end;
+        std::future<std::unique_ptr<std::deque<std::string>>> output; // nullptr if the batch wasn't whole members
+    };
+
+    bool ReadMore();
+    void Speculate();
+    void Trim();
+    std::string TakeReady();
+    uint64_t BufferEnd() const { return bufferBase_ + buffer_.size(); }
+
+    DecompressInputSource input_;
+    size_t maxInFlight_;
+    size_t window_;
+
+    std::string buffer_;
+    uint64_t bufferBase_{0};
+    uint64_t bytesRead_{0};
+    bool inputEnd_{false};
+
+    uint64_t pos_{0}; // next byte the sequential decoder consumes
+    bool inMember_{false};
+    void *stream_{nullptr}; // z_stream, kept opaque to avoid zlib.h here
+
+    uint64_t scanPos_{0};
+    std::deque<uint64_t> candidates_;
+    std::map<uint64_t, Batch> batches_;
+    std::deque<std::string> ready_; // output of the last batch not yet returned
+};
+
+// Register the readers above with osmium's CompressionFactory for .bz2 and
+// .gz input. Must run before the first osmium::io::Reader is created, and
+// osmium's own bzip2/gzip compression headers must not be included anywhere
+// else (first registration wins). Safe to call repeatedly.
+void RegisterParallelDecompressors(size_t threadCount = 0);
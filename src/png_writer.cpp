@@ -0,0 +1,73 @@
+#include "png_writer.h"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <fstream>
+#include <stdexcept>
+
+namespace {
+
+void PutUint32(std::vector<uint8_t> &out, uint32_t value) {
+    out.push_back(static_cast<uint8_t>(value >> 24));
+    out.push_back(static_cast<uint8_t>(value >> 16));
+    out.push_back(static_cast<uint8_t>(value >> 8));
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+// Length, type, data and a CRC over type and data
+void PutChunk(std::vector<uint8_t> &out, const char *type, const uint8_t *data, size_t size) {
+    PutUint32(out, static_cast<uint32_t>(size));
+    const size_t start = out.size();
+    out.insert(out.end(), type, type + 4);
+    out.insert(out.end(), data, data + size);
+    PutUint32(out, static_cast<uint32_t>(crc32(0, out.data() + start, static_cast<uInt>(size + 4))));
+}
+
+} // namespace
+
+std::vector<uint8_t> EncodePng(uint32_t width, uint32_t height, const uint8_t *rgba, int level) {
+    // Every row starts with its filter type. The Sub filter (difference to the
+    // pixel on the left) turns the long flat runs of a map into zeros.
+    const size_t rowBytes = static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> filtered((rowBytes + 1) * height);
+    for (uint32_t y = 0; y < height; ++y) {
+        const uint8_t *row = rgba + y * rowBytes;
+        uint8_t *out = filtered.data() + y * (rowBytes + 1);
+        out[0] = 1;
+        std::memcpy(out + 1, row, std::min<size_t>(4, rowBytes));
+        for (size_t i = 4; i < rowBytes; ++i) {
+            out[1 + i] = static_cast<uint8_t>(row[i] - row[i - 4]);
+        }
+    }
+
+    uLongf compressedSize = compressBound(static_cast<uLong>(filtered.size()));
+    std::vector<uint8_t> compressed(compressedSize);
+    if (compress2(compressed.data(), &compressedSize, filtered.data(), static_cast<uLong>(filtered.size()), level) !=
+        Z_OK) {
+        throw std::runtime_error("cannot compress the PNG image data");
+    }
+
+    static const uint8_t SIGNATURE[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    std::vector<uint8_t> png(std::begin(SIGNATURE), std::end(SIGNATURE));
+
+    std::vector<uint8_t> header;
+    PutUint32(header, width);
+    PutUint32(header, height);
+    // 8 bits per channel, RGBA, deflate, adaptive filtering, no interlace
+    header.insert(header.end(), {8, 6, 0, 0, 0});
+    PutChunk(png, "IHDR", header.data(), header.size());
+    PutChunk(png, "IDAT", compressed.data(), compressedSize);
+    PutChunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+void WritePng(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba, int level) {
+    const auto png = EncodePng(width, height, rgba, level);
+    std::ofstream out(path, std::ios::binary);
+    if (!out.write(reinterpret_cast<const char *>(png.data()), static_cast<std::streamsize>(png.size()))) {
+        throw std::runtime_error("cannot write " + path);
+    }
+}
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Encode 8-bit RGBA pixels (rows top to bottom) as a PNG. `level` is the
+// zlib compression level.
+std::vector<uint8_t> EncodePng(uint32_t width, uint32_t height, const uint8_t *rgba, int level = 6);
+
+// EncodePng into `path`. Throws std::runtime_error if it cannot be written.
+void WritePng(const std::string &path, uint32_t width, uint32_t height, const uint8_t *rgba, int level = 6);
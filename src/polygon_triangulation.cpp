@@ -0,0 +1,568 @@
+#include "polygon_triangulation.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <deque>
+#include <limits>
+
+namespace {
+
+// Polygons with more vertices than this use the z-order hashed ear test
+constexpr size_t HASHED_EAR_THRESHOLD = 80;
+
+class Earcut {
+  public:
+    Earcut(const std::vector<double> &xy, std::vector<uint32_t> &triangles) : xy_(xy), triangles_(triangles) {}
+
+    void Run(const std::vector<uint32_t> &holeStarts) {
+        const uint32_t vertexCount = static_cast<uint32_t>(xy_.size() / 2);
+        const uint32_t outerEnd = holeStarts.empty() ? vertexCount : std::min(holeStarts.front(), vertexCount);
+        Node *outer = LinkedList(0, outerEnd, true);
+        if (outer == nullptr || outer->next == outer->prev) {
+            return;
+        }
+        if (!holeStarts.empty()) {
+            outer = EliminateHoles(holeStarts, outer);
+        }
+
+        if (vertexCount > HASHED_EAR_THRESHOLD) {
+            minX_ = maxX_ = xy_[0];
+            minY_ = maxY_ = xy_[1];
+            for (uint32_t i = 1; i < outerEnd; ++i) {
+                minX_ = std::min(minX_, xy_[2 * i]);
+                minY_ = std::min(minY_, xy_[2 * i + 1]);
+                maxX_ = std::max(maxX_, xy_[2 * i]);
+                maxY_ = std::max(maxY_, xy_[2 * i + 1]);
+            }
+            // z-order coordinates are 15 bits
+            const double size = std::max(maxX_ - minX_, maxY_ - minY_);
+            invSize_ = size != 0.0 ? 32767.0 / size : 0.0;
+        }
+        EarcutLinked(outer, 0);
+    }
+
+  private:
+    struct Node {
+        uint32_t i;
+        double x;
+        double y;
+        Node *prev{nullptr};
+        Node *next{nullptr};
+        int32_t z{0};
+        Node *prevZ{nullptr};
+        Node *nextZ{nullptr};
+        bool steiner{false};
+    };
+
+    Node *NewNode(uint32_t i, double x, double y) {
+        nodes_.push_back(Node{i, x, y});
+        return &nodes_.back();
+    }
+
+    Node *InsertNode(uint32_t i, Node *last) {
+        Node *p = NewNode(i, xy_[2 * i], xy_[2 * i + 1]);
+        if (last == nullptr) {
+            p->prev = p;
+            p->next = p;
+        } else {
+            p->next = last->next;
+            p->prev = last;
+            last->next->prev = p;
+            last->next = p;
+        }
+        return p;
+    }
+
+    static void RemoveNode(Node *p) {
+        p->next->prev = p->prev;
+        p->prev->next = p->next;
+        if (p->prevZ != nullptr) {
+            p->prevZ->nextZ = p->nextZ;
+        }
+        if (p->nextZ != nullptr) {
+            p->nextZ->prevZ = p->prevZ;
+        }
+    }
+
+    // Circular list of the ring [start, end) in the requested winding
+    Node *LinkedList(uint32_t start, uint32_t end, bool clockwise) {
+        double sum = 0.0;
+        for (uint32_t i = start, j = end - 1; i < end; j = i++) {
+            sum += (xy_[2 * j] - xy_[2 * i]) * (xy_[2 * i + 1] + xy_[2 * j + 1]);
+        }
+        Node *last = nullptr;
+        if (clockwise == (sum > 0.0)) {
+            for (uint32_t i = start; i < end; ++i) {
+                last = InsertNode(i, last);
+            }
+        } else {
+            for (uint32_t i = end; i-- > start;) {
+                last = InsertNode(i, last);
+            }
+        }
+        if (last != nullptr && Equals(last, last->next)) {
+            RemoveNode(last);
+            last = last->next;
+        }
+        return last;
+    }
+
+    static double Area(const Node *p, const Node *q, const Node *r) {
+        return (q->y - p->y) * (r->x - q->x) - (q->x - p->x) * (r->y - q->y);
+    }
+
+    static bool Equals(const Node *a, const Node *b) { return a->x == b->x && a->y == b->y; }
+
+    static bool PointInTriangle(double ax, double ay, double bx, double by, double cx, double cy, double px,
+                                double py) {
+        return (cx - px) * (ay - py) >= (ax - px) * (cy - py) && (ax - px) * (by - py) >= (bx - px) * (ay - py) &&
+               (bx - px) * (cy - py) >= (cx - px) * (by - py);
+    }
+
+    static int Sign(double value) { return value > 0.0 ? 1 : value < 0.0 ? -1 : 0; }
+
+    // q lies on segment pr, given that the three are collinear
+    static bool OnSegment(const Node *p, const Node *q, const Node *r) {
+        return q->x <= std::max(p->x, r->x) && q->x >= std::min(p->x, r->x) && q->y <= std::max(p->y, r->y) &&
+               q->y >= std::min(p->y, r->y);
+    }
+
+    static bool Intersects(const Node *p1, const Node *q1, const Node *p2, const Node *q2) {
+        const int o1 = Sign(Area(p1, q1, p2));
+        const int o2 = Sign(Area(p1, q1, q2));
+        const int o3 = Sign(Area(p2, q2, p1));
+        const int o4 = Sign(Area(p2, q2, q1));
+        if (o1 != o2 && o3 != o4) {
+            return true;
+        }
+        return (o1 == 0 && OnSegment(p1, p2, q1)) || (o2 == 0 && OnSegment(p1, q2, q1)) ||
+               (o3 == 0 && OnSegment(p2, p1, q2)) || (o4 == 0 && OnSegment(p2, q1, q2));
+    }
+
+    // The diagonal ab crosses an edge of the polygon
+    static bool IntersectsPolygon(const Node *a, const Node *b) {
+        const Node *p = a;
+        do {
+            if (p->i != a->i && p->next->i != a->i && p->i != b->i && p->next->i != b->i &&
+                Intersects(p, p->next, a, b)) {
+                return true;
+            }
+            p = p->next;
+        } while (p != a);
+        return false;
+    }
+
+    static bool LocallyInside(const Node *a, const Node *b) {
+        return Area(a->prev, a, a->next) < 0.0 ? Area(a, b, a->next) >= 0.0 && Area(a, a->prev, b) >= 0.0
+                                               : Area(a, b, a->prev) < 0.0 || Area(a, a->next, b) < 0.0;
+    }
+
+    // The middle of the diagonal ab is inside the polygon
+    static bool MiddleInside(const Node *a, const Node *b) {
+        const Node *p = a;
+        bool inside = false;
+        const double px = (a->x + b->x) / 2.0;
+        const double py = (a->y + b->y) / 2.0;
+        do {
+            if ((p->y > py) != (p->next->y > py) && p->next->y != p->y &&
+                px < (p->next->x - p->x) * (py - p->y) / (p->next->y - p->y) + p->x) {
+                inside = !inside;
+            }
+            p = p->next;
+        } while (p != a);
+        return inside;
+    }
+
+    static bool IsValidDiagonal(const Node *a, const Node *b) {
+        return a->next->i != b->i && a->prev->i != b->i && !IntersectsPolygon(a, b) &&
+               ((LocallyInside(a, b) && LocallyInside(b, a) && MiddleInside(a, b) &&
+                 (Area(a->prev, a, b->prev) != 0.0 || Area(a, b->prev, b) != 0.0)) ||
+                (Equals(a, b) && Area(a->prev, a, a->next) > 0.0 && Area(b->prev, b, b->next) > 0.0));
+    }
+
+    // Remove duplicate and collinear points between start and end
+    static Node *FilterPoints(Node *start, Node *end = nullptr) {
+        if (start == nullptr) {
+            return start;
+        }
+        if (end == nullptr) {
+            end = start;
+        }
+        Node *p = start;
+        bool again;
+        do {
+            again = false;
+            if (!p->steiner && (Equals(p, p->next) || Area(p->prev, p, p->next) == 0.0)) {
+                RemoveNode(p);
+                p = end = p->prev;
+                if (p == p->next) {
+                    break;
+                }
+                again = true;
+            } else {
+                p = p->next;
+            }
+        } while (again || p != end);
+        return end;
+    }
+
+    // Link a and b with a bridge, splitting the polygon in two. Returns the
+    // copy of b that starts the second polygon.
+    Node *SplitPolygon(Node *a, Node *b) {
+        Node *a2 = NewNode(a->i, a->x, a->y);
+        Node *b2 = NewNode(b->i, b->x, b->y);
+        Node *an = a->next;
+        Node *bp = b->prev;
+
+        a->next = b;
+        b->prev = a;
+        a2->next = an;
+        an->prev = a2;
+        b2->next = a2;
+        a2->prev = b2;
+        bp->next = b2;
+        b2->prev = bp;
+        return b2;
+    }
+
+    void AddTriangle(const Node *a, const Node *b, const Node *c) {
+        triangles_.push_back(a->i);
+        triangles_.push_back(b->i);
+        triangles_.push_back(c->i);
+    }
+
+    // Pass 0 clips ears, pass 1 retries after filtering points, pass 2 after
+    // curing local self-intersections; what is left is split in two
+    void EarcutLinked(Node *ear, int pass) {
+        if (ear == nullptr) {
+            return;
+        }
+        if (pass == 0 && invSize_ != 0.0) {
+            IndexCurve(ear);
+        }
+
+        Node *stop = ear;
+        while (ear->prev != ear->next) {
+            Node *prev = ear->prev;
+            Node *next = ear->next;
+            if (invSize_ != 0.0 ? IsEarHashed(ear) : IsEar(ear)) {
+                AddTriangle(prev, ear, next);
+                RemoveNode(ear);
+                // Skipping the next vertex leads to fewer sliver triangles
+                ear = next->next;
+                stop = next->next;
+                continue;
+            }
+            ear = next;
+
+            if (ear == stop) {
+                if (pass == 0) {
+                    EarcutLinked(FilterPoints(ear), 1);
+                } else if (pass == 1) {
+                    EarcutLinked(CureLocalIntersections(FilterPoints(ear)), 2);
+                } else {
+                    SplitEarcut(ear);
+                }
+                break;
+            }
+        }
+    }
+
+    static bool IsEar(const Node *ear) {
+        const Node *a = ear->prev;
+        const Node *b = ear;
+        const Node *c = ear->next;
+        if (Area(a, b, c) >= 0.0) {
+            return false; // reflex
+        }
+        const double x0 = std::min({a->x, b->x, c->x});
+        const double y0 = std::min({a->y, b->y, c->y});
+        const double x1 = std::max({a->x, b->x, c->x});
+        const double y1 = std::max({a->y, b->y, c->y});
+
+        for (const Node *p = c->next; p != a; p = p->next) {
+            if (p->x >= x0 && p->x <= x1 && p->y >= y0 && p->y <= y1 &&
+                PointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) && Area(p->prev, p, p->next) >= 0.0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    bool IsEarHashed(const Node *ear) const {
+        const Node *a = ear->prev;
+        const Node *b = ear;
+        const Node *c = ear->next;
+        if (Area(a, b, c) >= 0.0) {
+            return false;
+        }
+        const double x0 = std::min({a->x, b->x, c->x});
+        const double y0 = std::min({a->y, b->y, c->y});
+        const double x1 = std::max({a->x, b->x, c->x});
+        const double y1 = std::max({a->y, b->y, c->y});
+        const int32_t minZ = ZOrder(x0, y0);
+        const int32_t maxZ = ZOrder(x1, y1);
+
+        auto blocks = [&](const Node *p) {
+            return p->x >= x0 && p->x <= x1 && p->y >= y0 && p->y <= y1 && p != a && p != c &&
+                   PointInTriangle(a->x, a->y, b->x, b->y, c->x, c->y, p->x, p->y) &&
+                   Area(p->prev, p, p->next) >= 0.0;
+        };
+
+        // Walk the z-order curve in both directions from the ear
+        const Node *p = ear->prevZ;
+        const Node *n = ear->nextZ;
+        while (p != nullptr && p->z >= minZ && n != nullptr && n->z <= maxZ) {
+            if (blocks(p)) {
+                return false;
+            }
+            p = p->prevZ;
+            if (blocks(n)) {
+                return false;
+            }
+            n = n->nextZ;
+        }
+        for (; p != nullptr && p->z >= minZ; p = p->prevZ) {
+            if (blocks(p)) {
+                return false;
+            }
+        }
+        for (; n != nullptr && n->z <= maxZ; n = n->nextZ) {
+            if (blocks(n)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Clip the triangle of every local self-intersection a-p-p.next-b
+    Node *CureLocalIntersections(Node *start) {
+        Node *p = start;
+        do {
+            Node *a = p->prev;
+            Node *b = p->next->next;
+            if (!Equals(a, b) && Intersects(a, p, p->next, b) && LocallyInside(a, b) && LocallyInside(b, a)) {
+                AddTriangle(a, p, b);
+                RemoveNode(p);
+                RemoveNode(p->next);
+                p = start = b;
+            }
+            p = p->next;
+        } while (p != start);
+        return FilterPoints(p);
+    }
+
+    // Split the polygon along a valid diagonal and triangulate both halves
+    void SplitEarcut(Node *start) {
+        Node *a = start;
+        do {
+            for (Node *b = a->next->next; b != a->prev; b = b->next) {
+                if (a->i != b->i && IsValidDiagonal(a, b)) {
+                    Node *c = SplitPolygon(a, b);
+                    a = FilterPoints(a, a->next);
+                    c = FilterPoints(c, c->next);
+                    EarcutLinked(a, 0);
+                    EarcutLinked(c, 0);
+                    return;
+                }
+            }
+            a = a->next;
+        } while (a != start);
+    }
+
+    static Node *GetLeftmost(Node *start) {
+        Node *p = start;
+        Node *leftmost = start;
+        do {
+            if (p->x < leftmost->x || (p->x == leftmost->x && p->y < leftmost->y)) {
+                leftmost = p;
+            }
+            p = p->next;
+        } while (p != start);
+        return leftmost;
+    }
+
+    // Link every hole into the outer ring, leftmost hole first
+    Node *EliminateHoles(const std::vector<uint32_t> &holeStarts, Node *outer) {
+        const uint32_t vertexCount = static_cast<uint32_t>(xy_.size() / 2);
+        std::vector<Node *> queue;
+        for (size_t h = 0; h < holeStarts.size(); ++h) {
+            const uint32_t start = holeStarts[h];
+            const uint32_t end = h + 1 < holeStarts.size() ? holeStarts[h + 1] : vertexCount;
+            if (start >= end || end > vertexCount) {
+                continue;
+            }
+            Node *list = LinkedList(start, end, false);
+            if (list == nullptr) {
+                continue;
+            }
+            if (list == list->next) {
+                list->steiner = true;
+            }
+            queue.push_back(GetLeftmost(list));
+        }
+        std::sort(queue.begin(), queue.end(), [](const Node *a, const Node *b) { return a->x < b->x; });
+        for (Node *hole : queue) {
+            outer = EliminateHole(hole, outer);
+        }
+        return outer;
+    }
+
+    Node *EliminateHole(Node *hole, Node *outer) {
+        Node *bridge = FindHoleBridge(hole, outer);
+        if (bridge == nullptr) {
+            return outer;
+        }
+        Node *bridgeReverse = SplitPolygon(bridge, hole);
+        FilterPoints(bridgeReverse, bridgeReverse->next);
+        return FilterPoints(bridge, bridge->next);
+    }
+
+    // David Eberly's algorithm for finding a bridge between a hole and the
+    // outer polygon
+    static Node *FindHoleBridge(Node *hole, Node *outer) {
+        Node *p = outer;
+        const double hx = hole->x;
+        const double hy = hole->y;
+        double qx = -std::numeric_limits<double>::infinity();
+        Node *m = nullptr;
+
+        // Find the segment left of the hole point closest to it on its
+        // horizontal ray; its endpoint with the smaller x is the candidate
+        do {
+            if (hy <= p->y && hy >= p->next->y && p->next->y != p->y) {
+                const double x = p->x + (hy - p->y) * (p->next->x - p->x) / (p->next->y - p->y);
+                if (x <= hx && x > qx) {
+                    qx = x;
+                    m = p->x < p->next->x ? p : p->next;
+                    if (x == hx) {
+                        return m; // the hole touches the outer segment
+                    }
+                }
+            }
+            p = p->next;
+        } while (p != outer);
+        if (m == nullptr) {
+            return nullptr;
+        }
+
+        // Points inside the triangle of the hole point, the intersection and
+        // m may be visible instead; take the one with the smallest angle
+        Node *stop = m;
+        const double mx = m->x;
+        const double my = m->y;
+        double tanMin = std::numeric_limits<double>::infinity();
+        p = m;
+        do {
+            if (hx >= p->x && p->x >= mx && hx != p->x &&
+                PointInTriangle(hy < my ? hx : qx, hy, mx, my, hy < my ? qx : hx, hy, p->x, p->y)) {
+                const double tan = std::abs(hy - p->y) / (hx - p->x);
+                if (LocallyInside(p, hole) &&
+                    (tan < tanMin ||
+                     (tan == tanMin && (p->x > m->x || (p->x == m->x && SectorContainsSector(m, p)))))) {
+                    m = p;
+                    tanMin = tan;
+                }
+            }
+            p = p->next;
+        } while (p != stop);
+        return m;
+    }
+
+    static bool SectorContainsSector(const Node *m, const Node *p) {
+        return Area(m->prev, m, p->prev) < 0.0 && Area(p->next, m, m->next) < 0.0;
+    }
+
+    // Interleave the bits of 15-bit x and y
+    int32_t ZOrder(double x, double y) const {
+        auto spread = [](int32_t v) {
+            v = (v | (v << 8)) & 0x00FF00FF;
+            v = (v | (v << 4)) & 0x0F0F0F0F;
+            v = (v | (v << 2)) & 0x33333333;
+            return (v | (v << 1)) & 0x55555555;
+        };
+        return spread(static_cast<int32_t>((x - minX_) * invSize_)) |
+               (spread(static_cast<int32_t>((y - minY_) * invSize_)) << 1);
+    }
+
+    void IndexCurve(Node *start) {
+        Node *p = start;
+        do {
+            if (p->z == 0) {
+                p->z = ZOrder(p->x, p->y);
+            }
+            p->prevZ = p->prev;
+            p->nextZ = p->next;
+            p = p->next;
+        } while (p != start);
+        p->prevZ->nextZ = nullptr;
+        p->prevZ = nullptr;
+        SortLinked(p);
+    }
+
+    // Simon Tatham's merge sort of the z list
+    static Node *SortLinked(Node *list) {
+        size_t inSize = 1;
+        size_t merges;
+        do {
+            Node *p = list;
+            list = nullptr;
+            Node *tail = nullptr;
+            merges = 0;
+            while (p != nullptr) {
+                ++merges;
+                Node *q = p;
+                size_t pSize = 0;
+                for (size_t i = 0; i < inSize && q != nullptr; ++i) {
+                    ++pSize;
+                    q = q->nextZ;
+                }
+                size_t qSize = inSize;
+                while (pSize > 0 || (qSize > 0 && q != nullptr)) {
+                    Node *e;
+                    if (pSize != 0 && (qSize == 0 || q == nullptr || p->z <= q->z)) {
+                        e = p;
+                        p = p->nextZ;
+                        --pSize;
+                    } else {
+                        e = q;
+                        q = q->nextZ;
+                        --qSize;
+                    }
+                    if (tail != nullptr) {
+                        tail->nextZ = e;
+                    } else {
+                        list = e;
+                    }
+                    e->prevZ = tail;
+                    tail = e;
+                }
+                p = q;
+            }
+            tail->nextZ = nullptr;
+            inSize *= 2;
+        } while (merges > 1);
+        return list;
+    }
+
+    const std::vector<double> &xy_;
+    std::vector<uint32_t> &triangles_;
+    // Nodes are linked by pointer, so they live in a deque that never moves them
+    std::deque<Node> nodes_;
+    double minX_{0.0};
+    double minY_{0.0};
+    double maxX_{0.0};
+    double maxY_{0.0};
+    double invSize_{0.0};
+};
+
+} // namespace
+
+void TriangulatePolygon(const std::vector<double> &xy, const std::vector<uint32_t> &holeStarts,
+                        std::vector<uint32_t> &triangles) {
+    if (xy.size() < 6) {
+        return;
+    }
+    Earcut(xy, triangles).Run(holeStarts);
+}
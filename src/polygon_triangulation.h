@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Ear-clipping triangulation of polygons with holes, after Mapbox's earcut.
+// Holes are bridged into the outer ring first. Large polygons index their
+// vertices along a z-order curve so the ear test only checks nearby points.
+// Polygons that are not simple (self-intersections, or OSM rings that touch)
+// still get a best-effort result, never an error. The result has the same
+// winding as earcut.
+//
+// `xy` holds the x,y pairs of the outer ring and then each hole.
+// `holeStarts` holds the vertex index where each hole begins. Rings are
+// implicitly closed; a repeated first vertex is harmless. Triangles are
+// appended to `triangles` as vertex indices into `xy`.
+void TriangulatePolygon(const std::vector<double> &xy, const std::vector<uint32_t> &holeStarts,
+                        std::vector<uint32_t> &triangles);
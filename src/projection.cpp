@@ -0,0 +1,265 @@
+#include "projection.h"
+#include "web_mercator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <stdexcept>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+constexpr uint64_t MANTISSA_BITS = 0x000FFFFFFFFFFFFFull;
+constexpr uint64_t ONE_BITS = 0x3FF0000000000000ull; // 1.0
+// Or-ing a small integer into the mantissa of 2^52 turns it into a double
+constexpr uint64_t TWO_POW_52_BITS = 0x4330000000000000ull;
+constexpr double TWO_POW_52_PLUS_BIAS = 4503599627370496.0 + 1023.0;
+
+// As many doubles as one SIMD register holds, with the few operations the
+// Mercator kernel needs. Exponent() and Mantissa() split a positive normal
+// value into 2^e * m with m in [1, 2).
+#if defined(__AVX2__)
+struct Doubles {
+    static constexpr size_t COUNT = 4;
+    __m256d v;
+
+    static Doubles Set(double x) { return {_mm256_set1_pd(x)}; }
+    static Doubles Load(const double *p) { return {_mm256_loadu_pd(p)}; }
+    void Store(double *p) const { _mm256_storeu_pd(p, v); }
+    // Split COUNT interleaved x,y integer pairs into doubles
+    static void LoadPairs(const int32_t *xy, Doubles &x, Doubles &y) {
+        const __m256i pairs = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(xy));
+        const __m256i split = _mm256_permutevar8x32_epi32(pairs, _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7));
+        x.v = _mm256_cvtepi32_pd(_mm256_castsi256_si128(split));
+        y.v = _mm256_cvtepi32_pd(_mm256_extracti128_si256(split, 1));
+    }
+
+    friend Doubles operator+(Doubles a, Doubles b) { return {_mm256_add_pd(a.v, b.v)}; }
+    friend Doubles operator-(Doubles a, Doubles b) { return {_mm256_sub_pd(a.v, b.v)}; }
+    friend Doubles operator*(Doubles a, Doubles b) { return {_mm256_mul_pd(a.v, b.v)}; }
+    friend Doubles operator/(Doubles a, Doubles b) { return {_mm256_div_pd(a.v, b.v)}; }
+    friend Doubles Min(Doubles a, Doubles b) { return {_mm256_min_pd(a.v, b.v)}; }
+    friend Doubles Max(Doubles a, Doubles b) { return {_mm256_max_pd(a.v, b.v)}; }
+    friend Doubles Exponent(Doubles a) {
+        const __m256i biased = _mm256_srli_epi64(_mm256_castpd_si256(a.v), 52);
+        const __m256i asDouble = _mm256_or_si256(biased, _mm256_set1_epi64x(static_cast<long long>(TWO_POW_52_BITS)));
+        return {_mm256_sub_pd(_mm256_castsi256_pd(asDouble), _mm256_set1_pd(TWO_POW_52_PLUS_BIAS))};
+    }
+    friend Doubles Mantissa(Doubles a) {
+        const __m256i bits = _mm256_and_si256(_mm256_castpd_si256(a.v),
+                                              _mm256_set1_epi64x(static_cast<long long>(MANTISSA_BITS)));
+        return {_mm256_castsi256_pd(_mm256_or_si256(bits, _mm256_set1_epi64x(static_cast<long long>(ONE_BITS))))};
+    }
+};
+#elif defined(__SSE2__)
+struct Doubles {
+    static constexpr size_t COUNT = 2;
+    __m128d v;
+
+    static Doubles Set(double x) { return {_mm_set1_pd(x)}; }
+    static Doubles Load(const double *p) { return {_mm_loadu_pd(p)}; }
+    void Store(double *p) const { _mm_storeu_pd(p, v); }
+    static void LoadPairs(const int32_t *xy, Doubles &x, Doubles &y) {
+        const __m128i pairs = _mm_loadu_si128(reinterpret_cast<const __m128i *>(xy));
+        const __m128i split = _mm_shuffle_epi32(pairs, _MM_SHUFFLE(3, 1, 2, 0));
+        x.v = _mm_cvtepi32_pd(split);
+        y.v = _mm_cvtepi32_pd(_mm_unpackhi_epi64(split, split));
+    }
+
+    friend Doubles operator+(Doubles a, Doubles b) { return {_mm_add_pd(a.v, b.v)}; }
+    friend Doubles operator-(Doubles a, Doubles b) { return {_mm_sub_pd(a.v, b.v)}; }
+    friend Doubles operator*(Doubles a, Doubles b) { return {_mm_mul_pd(a.v, b.v)}; }
+    friend Doubles operator/(Doubles a, Doubles b) { return {_mm_div_pd(a.v, b.v)}; }
+    friend Doubles Min(Doubles a, Doubles b) { return {_mm_min_pd(a.v, b.v)}; }
+    friend Doubles Max(Doubles a, Doubles b) { return {_mm_max_pd(a.v, b.v)}; }
+    friend Doubles Exponent(Doubles a) {
+        const __m128i biased = _mm_srli_epi64(_mm_castpd_si128(a.v), 52);
+        const __m128i asDouble = _mm_or_si128(biased, _mm_set1_epi64x(static_cast<long long>(TWO_POW_52_BITS)));
+        return {_mm_sub_pd(_mm_castsi128_pd(asDouble), _mm_set1_pd(TWO_POW_52_PLUS_BIAS))};
+    }
+    friend Doubles Mantissa(Doubles a) {
+        const __m128i bits =
+            _mm_and_si128(_mm_castpd_si128(a.v), _mm_set1_epi64x(static_cast<long long>(MANTISSA_BITS)));
+        return {_mm_castsi128_pd(_mm_or_si128(bits, _mm_set1_epi64x(static_cast<long long>(ONE_BITS))))};
+    }
+};
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+struct Doubles {
+    static constexpr size_t COUNT = 2;
+    float64x2_t v;
+
+    static Doubles Set(double x) { return {vdupq_n_f64(x)}; }
+    static Doubles Load(const double *p) { return {vld1q_f64(p)}; }
+    void Store(double *p) const { vst1q_f64(p, v); }
+    static void LoadPairs(const int32_t *xy, Doubles &x, Doubles &y) {
+        const int32x2x2_t split = vld2_s32(xy);
+        x.v = vcvtq_f64_s64(vmovl_s32(split.val[0]));
+        y.v = vcvtq_f64_s64(vmovl_s32(split.val[1]));
+    }
+
+    friend Doubles operator+(Doubles a, Doubles b) { return {vaddq_f64(a.v, b.v)}; }
+    friend Doubles operator-(Doubles a, Doubles b) { return {vsubq_f64(a.v, b.v)}; }
+    friend Doubles operator*(Doubles a, Doubles b) { return {vmulq_f64(a.v, b.v)}; }
+    friend Doubles operator/(Doubles a, Doubles b) { return {vdivq_f64(a.v, b.v)}; }
+    friend Doubles Min(Doubles a, Doubles b) { return {vminq_f64(a.v, b.v)}; }
+    friend Doubles Max(Doubles a, Doubles b) { return {vmaxq_f64(a.v, b.v)}; }
+    friend Doubles Exponent(Doubles a) {
+        const uint64x2_t biased = vshrq_n_u64(vreinterpretq_u64_f64(a.v), 52);
+        return {vsubq_f64(vcvtq_f64_u64(biased), vdupq_n_f64(1023.0))};
+    }
+    friend Doubles Mantissa(Doubles a) {
+        const uint64x2_t bits = vandq_u64(vreinterpretq_u64_f64(a.v), vdupq_n_u64(MANTISSA_BITS));
+        return {vreinterpretq_f64_u64(vorrq_u64(bits, vdupq_n_u64(ONE_BITS)))};
+    }
+};
+#else
+struct Doubles {
+    static constexpr size_t COUNT = 1;
+    double v;
+
+    static Doubles Set(double x) { return {x}; }
+    static Doubles Load(const double *p) { return {*p}; }
+    void Store(double *p) const { *p = v; }
+    static void LoadPairs(const int32_t *xy, Doubles &x, Doubles &y) {
+        x.v = xy[0];
+        y.v = xy[1];
+    }
+
+    friend Doubles operator+(Doubles a, Doubles b) { return {a.v + b.v}; }
+    friend Doubles operator-(Doubles a, Doubles b) { return {a.v - b.v}; }
+    friend Doubles operator*(Doubles a, Doubles b) { return {a.v * b.v}; }
+    friend Doubles operator/(Doubles a, Doubles b) { return {a.v / b.v}; }
+    friend Doubles Min(Doubles a, Doubles b) { return {std::min(a.v, b.v)}; }
+    friend Doubles Max(Doubles a, Doubles b) { return {std::max(a.v, b.v)}; }
+    friend Doubles Exponent(Doubles a) {
+        uint64_t bits;
+        std::memcpy(&bits, &a.v, sizeof(bits));
+        return {static_cast<double>(static_cast<int>(bits >> 52) - 1023)};
+    }
+    friend Doubles Mantissa(Doubles a) {
+        uint64_t bits;
+        std::memcpy(&bits, &a.v, sizeof(bits));
+        bits = (bits & MANTISSA_BITS) | ONE_BITS;
+        double m;
+        std::memcpy(&m, &bits, sizeof(m));
+        return {m};
+    }
+};
+#endif
+
+constexpr double SQRT2 = 1.41421356237309504880;
+constexpr double LN2 = 0.69314718055994530942;
+
+// Taylor coefficients of sin(x) / x in x^2, highest order first. Up to x^15
+// the error for |lat| <= MAX_LATITUDE is below 3e-12, and the log then
+// amplifies it to at most 1e-7 degrees, far under a float ulp.
+constexpr double SIN_TERMS[] = {-7.6471637318198164e-13, 1.6059043836821613e-10, -2.5052108385441720e-08,
+                                2.7557319223985893e-06,  -1.9841269841269841e-04, 8.3333333333333333e-03,
+                                -1.6666666666666667e-01, 1.0};
+// Coefficients of atanh(t) / t in t^2, highest order first. |t| stays below
+// 0.172, so terms past t^13 are below double precision.
+constexpr double ATANH_TERMS[] = {1.0 / 13, 1.0 / 11, 1.0 / 9, 1.0 / 7, 1.0 / 5, 1.0 / 3, 1.0};
+
+// Horner's rule, unrolled by the compiler
+template <size_t N> Doubles Polynomial(Doubles x, const double (&coefficients)[N]) {
+    Doubles sum = Doubles::Set(coefficients[0]);
+    for (size_t k = 1; k < N; ++k) {
+        sum = sum * x + Doubles::Set(coefficients[k]);
+    }
+    return sum;
+}
+
+// Mercator y in degrees, atanh(sin(lat)), from polynomials alone so it
+// vectorises. The log splits off the binary exponent so the mantissa lies in
+// [sqrt(1/2), sqrt(2)), where ln(m) = 2 atanh((m - 1) / (m + 1)) converges
+// quickly.
+Doubles MercatorY(Doubles lat) {
+    lat = Min(Max(lat, Doubles::Set(-web_mercator::MAX_LATITUDE)), Doubles::Set(web_mercator::MAX_LATITUDE));
+    const Doubles r = lat * Doubles::Set(web_mercator::PI / 180.0);
+    const Doubles sinLat = r * Polynomial(r * r, SIN_TERMS);
+
+    const Doubles one = Doubles::Set(1.0);
+    const Doubles scaled = (one + sinLat) / (one - sinLat) * Doubles::Set(SQRT2);
+    const Doubles m = Mantissa(scaled) * Doubles::Set(1.0 / SQRT2);
+    const Doubles t = (m - one) / (m + one);
+    const Doubles logQ = Exponent(scaled) * Doubles::Set(LN2) + Doubles::Set(2.0) * t * Polynomial(t * t, ATANH_TERMS);
+    return logQ * Doubles::Set(90.0 / web_mercator::PI);
+}
+
+void ProjectMercator(const osmium::Location *locations, size_t count, float *out, size_t stride) {
+    constexpr size_t LANES = Doubles::COUNT;
+    static_assert(sizeof(osmium::Location) == 2 * sizeof(int32_t), "Location is a pair of fixed point integers");
+    const Doubles precision = Doubles::Set(osmium::coordinate_precision);
+    int32_t fixed[2 * LANES] = {};
+    double x[LANES];
+    double y[LANES];
+    for (size_t first = 0; first < count; first += LANES) {
+        const size_t n = std::min(LANES, count - first);
+        // Converted like Location::lon() and lat(), a register at a time. A
+        // full block copies a constant size, which compiles to one load.
+        if (n == LANES) {
+            std::memcpy(fixed, locations + first, sizeof(fixed));
+        } else {
+            std::memcpy(fixed, locations + first, n * sizeof(osmium::Location));
+        }
+        Doubles lon, lat;
+        Doubles::LoadPairs(fixed, lon, lat);
+        (lon / precision).Store(x);
+        MercatorY(lat / precision).Store(y);
+        for (size_t k = 0; k < n; ++k) {
+            float *vertex = out + (first + k) * stride;
+            vertex[0] = static_cast<float>(x[k]);
+            vertex[1] = static_cast<float>(y[k]);
+        }
+    }
+}
+
+} // namespace
+
+Projection ParseProjection(const std::string &name) {
+    if (name == "equirectangular") {
+        return Projection::Equirectangular;
+    }
+    if (name == "mercator") {
+        return Projection::WebMercator;
+    }
+    throw std::runtime_error("unknown projection: " + name + " (expected equirectangular or mercator)");
+}
+
+const char *ProjectionName(Projection projection) {
+    return projection == Projection::WebMercator ? "mercator" : "equirectangular";
+}
+
+double ProjectLat(Projection projection, double lat) {
+    if (projection == Projection::Equirectangular) {
+        return lat;
+    }
+    return (0.5 - web_mercator::LatToY(lat)) * 360.0;
+}
+
+double UnprojectY(Projection projection, double y) {
+    if (projection == Projection::Equirectangular) {
+        return y;
+    }
+    return web_mercator::YToLat(0.5 - y / 360.0);
+}
+
+void ProjectLocations(Projection projection, const osmium::Location *locations, size_t count, float *out,
+                      size_t stride) {
+    if (projection == Projection::WebMercator) {
+        ProjectMercator(locations, count, out, stride);
+        return;
+    }
+    for (size_t i = 0; i < count; ++i) {
+        out[i * stride] = static_cast<float>(locations[i].lon_without_check());
+        out[i * stride + 1] = static_cast<float>(locations[i].lat_without_check());
+    }
+}
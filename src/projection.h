@@ -0,0 +1,34 @@
+#pragma once
+
+#include <osmium/osm/location.hpp>
+
+#include <cstddef>
+#include <string>
+
+// Map projections applied to vertex positions when the render buffers are
+// built. Projected coordinates stay in degrees: x is the longitude and only y
+// changes, scaled so that it matches x at the equator. Both projections keep
+// latitude order, so a lon/lat box maps to the projected box of its corners.
+// Chunk bounds and culling therefore stay in lon/lat, and only the vertices
+// and the uBounds uniform are projected.
+enum class Projection {
+    Equirectangular, // y = latitude, the raw lon/lat the shaders used to see
+    WebMercator,     // spherical Mercator, clamped to web_mercator::MAX_LATITUDE
+};
+
+// "equirectangular" or "mercator"; throws std::runtime_error for anything else
+Projection ParseProjection(const std::string &name);
+const char *ProjectionName(Projection projection);
+
+// Projected y of a latitude, and the inverse used to map the screen back to
+// lon/lat for picking
+double ProjectLat(Projection projection, double lat);
+double UnprojectY(Projection projection, double y);
+
+// Batch kernel: the projected x,y of `count` locations as floats, written to
+// out[i * stride] and out[i * stride + 1] so it can fill interleaved vertices
+// in place. Web Mercator is evaluated several locations at a time with AVX2,
+// SSE2 or NEON (double precision throughout) and with a scalar loop
+// elsewhere; all of them agree with ProjectLat to well under a float ulp.
+void ProjectLocations(Projection projection, const osmium::Location *locations, size_t count, float *out,
+                      size_t stride);
@@ -0,0 +1,54 @@
+#include "render_layers.h"
+
+#include <algorithm>
+
+RenderLayerTable RenderLayerTable::Default() {
+    RenderLayerTable table;
+    table.SetLayer({AREAS_LAYER, 0, 0.003f, true});
+    table.SetLayer({MINOR_ROADS_LAYER, 10, 0.004f, true});
+    table.SetLayer({MAJOR_ROADS_LAYER, 20, 0.007f, false});
+    table.SetLayer({BOUNDARY_LAYER, 30, 0.002f, true});
+
+    for (const auto *highway : {"motorway", "motorway_link", "trunk", "trunk_link", "primary", "primary_link",
+                                "secondary", "secondary_link", "tertiary", "tertiary_link"}) {
+        table.SetHighwayLayer(highway, MAJOR_ROADS_LAYER);
+    }
+    return table;
+}
+
+size_t RenderLayerTable::SetLayer(const LayerStyle &style) {
+    auto it = std::find_if(layers_.begin(), layers_.end(),
+                           [&style](const LayerStyle &layer) { return layer.name == style.name; });
+    if (it != layers_.end()) {
+        layers_.erase(it);
+    }
+
+    // Insert after every layer with the same or lower priority (stable)
+    it = std::upper_bound(layers_.begin(), layers_.end(), style,
+                          [](const LayerStyle &a, const LayerStyle &b) { return a.priority < b.priority; });
+    return static_cast<size_t>(std::distance(layers_.begin(), layers_.insert(it, style)));
+}
+
+void RenderLayerTable::SetHighwayLayer(const std::string &highwayValue, const std::string &layerName) {
+    highway2Layer_[highwayValue] = layerName;
+}
+
+size_t RenderLayerTable::LayerIndex(const std::string &layerName) const {
+    for (size_t i = 0; i < layers_.size(); ++i) {
+        if (layers_[i].name == layerName) {
+            return i;
+        }
+    }
+    // Unknown layers draw last so misconfiguration is visible rather than hidden
+    return layers_.empty() ? 0 : layers_.size() - 1;
+}
+
+size_t RenderLayerTable::RouteLayer(const OSMLoader::Route_t &route) const {
+    auto tag = route.tags.find(HIGHWAY_TAG);
+    if (tag != route.tags.end()) {
+        if (auto it = highway2Layer_.find(tag->second); it != highway2Layer_.end()) {
+            return LayerIndex(it->second);
+        }
+    }
+    return LayerIndex(defaultRoadLayer_);
+}
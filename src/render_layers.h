@@ -0,0 +1,48 @@
+#pragma once
+
+#include "osm_loader.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Draw state shared by every feature in a layer
+struct LayerStyle {
+    std::string name;
+    int priority{0};          // lower priorities are drawn first (underneath)
+    float lineWidth{0.005f};  // half width of the line quads in clip space
+    bool blend{true};         // alpha blend the layer over what is below it
+};
+
+// Maps features to render layers. Layers are kept sorted by priority so the
+// layer index is also the draw order; ties keep insertion order.
+class RenderLayerTable {
+  public:
+    static constexpr auto AREAS_LAYER = "areas";
+    static constexpr auto MINOR_ROADS_LAYER = "minor_roads";
+    static constexpr auto MAJOR_ROADS_LAYER = "major_roads";
+    static constexpr auto BOUNDARY_LAYER = "boundary";
+
+    // areas < minor roads < major roads < boundary
+    static RenderLayerTable Default();
+
+    // Add (or replace) a layer. Returns its index in draw order.
+    size_t SetLayer(const LayerStyle &style);
+    // Route `highwayValue` ways into `layerName`; unknown highway values use
+    // the default road layer
+    void SetHighwayLayer(const std::string &highwayValue, const std::string &layerName);
+    void SetDefaultRoadLayer(const std::string &layerName) { defaultRoadLayer_ = layerName; }
+
+    size_t LayerCount() const { return layers_.size(); }
+    const LayerStyle &GetLayer(size_t index) const { return layers_.at(index); }
+
+    size_t LayerIndex(const std::string &layerName) const;
+    size_t RouteLayer(const OSMLoader::Route_t &route) const;
+    size_t AreaLayer() const { return LayerIndex(AREAS_LAYER); }
+    size_t BoundaryLayer() const { return LayerIndex(BOUNDARY_LAYER); }
+
+  private:
+    std::vector<LayerStyle> layers_;
+    std::unordered_map<std::string, std::string> highway2Layer_;
+    std::string defaultRoadLayer_{MINOR_ROADS_LAYER};
+};
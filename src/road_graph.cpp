@@ -0,0 +1,180 @@
+#include "road_graph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <unordered_map>
+
+namespace {
+
+constexpr double PI = 3.14159265358979323846;
+// WGS84 equatorial radius, as in Web Mercator
+constexpr double METRES_PER_DEGREE = 6378137.0 * PI / 180.0;
+
+enum class Direction { Both, Forward, Backward };
+
+Direction RouteDirection(const OSMLoader::Route_t &route, const std::string &highway) {
+    const auto oneway = route.tags.find(ONEWAY_TAG);
+    if (oneway != route.tags.end()) {
+        const auto &value = oneway->second;
+        if (value == "yes" || value == "true" || value == "1") {
+            return Direction::Forward;
+        }
+        if (value == "-1" || value == "reverse") {
+            return Direction::Backward;
+        }
+        if (value == "no") {
+            return Direction::Both;
+        }
+    }
+    // Motorways are implicitly oneway
+    return highway == "motorway" || highway == "motorway_link" ? Direction::Forward : Direction::Both;
+}
+
+void BuildCsr(size_t vertexCount, const std::vector<std::pair<RoadGraph::Vertex, RoadGraph::Edge>> &edges,
+              std::vector<uint32_t> &offsets, std::vector<RoadGraph::Edge> &csr) {
+    offsets.assign(vertexCount + 1, 0);
+    for (const auto &[source, edge] : edges) {
+        ++offsets[source + 1];
+    }
+    for (size_t v = 1; v <= vertexCount; ++v) {
+        offsets[v] += offsets[v - 1];
+    }
+    csr.resize(edges.size());
+    std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+    for (const auto &[source, edge] : edges) {
+        csr[cursor[source]++] = edge;
+    }
+}
+
+} // namespace
+
+double RoadGraph::SpeedKmh(const std::string &highwayValue) {
+    static const std::unordered_map<std::string, double> SPEEDS = {
+        {"motorway", 100.0},     {"motorway_link", 60.0}, {"trunk", 80.0},          {"trunk_link", 50.0},
+        {"primary", 60.0},       {"primary_link", 45.0},  {"secondary", 50.0},      {"secondary_link", 40.0},
+        {"tertiary", 40.0},      {"tertiary_link", 30.0}, {"unclassified", 30.0},   {"residential", 30.0},
+        {"living_street", 10.0}, {"service", 20.0},       {"road", 30.0},           {"track", 15.0},
+        {"pedestrian", 5.0},     {"footway", 5.0},        {"path", 5.0},            {"steps", 2.0},
+        {"cycleway", 15.0},      {"bridleway", 5.0},      {"platform", 0.0},        {"construction", 0.0},
+        {"proposed", 0.0},       {"abandoned", 0.0},      {"raceway", 0.0},         {"bus_stop", 0.0}};
+    const auto it = SPEEDS.find(highwayValue);
+    if (it != SPEEDS.end()) {
+        return it->second;
+    }
+    // Unknown classes are routed as minor roads, ways without one not at all
+    return highwayValue.empty() ? 0.0 : 30.0;
+}
+
+RoadGraph::RoadGraph(const OSMLoader::Id2Route &routes) {
+    // Routes in id order so vertex numbering is the same on every load
+    std::vector<const OSMLoader::Route_t *> sorted;
+    sorted.reserve(routes.size());
+    for (const auto &entry : routes) {
+        sorted.push_back(&entry.second);
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const auto *a, const auto *b) { return a->id < b->id; });
+
+    std::unordered_map<osmium::Location, Vertex> location2Vertex;
+    auto vertexAt = [&](const osmium::Location &location) {
+        const auto [it, inserted] = location2Vertex.try_emplace(location, static_cast<Vertex>(locations_.size()));
+        if (inserted) {
+            if (locations_.size() >= NO_VERTEX) {
+                throw std::length_error("too many vertices for the road graph");
+            }
+            locations_.push_back(location);
+        }
+        return it->second;
+    };
+
+    struct Segment {
+        Vertex from;
+        Vertex to;
+        double speed; // metres per millisecond
+        Direction direction;
+    };
+    std::vector<Segment> segments;
+    double maxSpeed = 0.0;
+    for (const auto *route : sorted) {
+        const auto highway = route->tags.find(HIGHWAY_TAG);
+        const double speedKmh = SpeedKmh(highway == route->tags.end() ? std::string{} : highway->second);
+        if (speedKmh <= 0.0) {
+            continue;
+        }
+        const double speed = speedKmh / 3600.0;
+        maxSpeed = std::max(maxSpeed, speed);
+        const auto direction = RouteDirection(*route, highway->second);
+        for (size_t i = 1; i < route->nodes.size(); ++i) {
+            if (!route->nodes[i - 1].valid() || !route->nodes[i].valid()) {
+                continue;
+            }
+            const Vertex from = vertexAt(route->nodes[i - 1]);
+            const Vertex to = vertexAt(route->nodes[i]);
+            if (from != to) {
+                segments.push_back({from, to, speed, direction});
+            }
+        }
+    }
+    if (locations_.empty()) {
+        outOffsets_.assign(1, 0);
+        inOffsets_.assign(1, 0);
+        return;
+    }
+    maxSpeedMetresPerMs_ = maxSpeed;
+
+    double latSum = 0.0;
+    for (const auto &location : locations_) {
+        latSum += location.lat();
+    }
+    metresPerDegreeLon_ = METRES_PER_DEGREE * std::cos(latSum / static_cast<double>(locations_.size()) * PI / 180.0);
+    x_.resize(locations_.size());
+    y_.resize(locations_.size());
+    for (size_t v = 0; v < locations_.size(); ++v) {
+        x_[v] = locations_[v].lon() * metresPerDegreeLon_;
+        y_[v] = locations_[v].lat() * METRES_PER_DEGREE;
+    }
+
+    std::vector<std::pair<Vertex, Edge>> out;
+    std::vector<std::pair<Vertex, Edge>> in;
+    out.reserve(segments.size() * 2);
+    in.reserve(segments.size() * 2);
+    auto addEdge = [&](Vertex from, Vertex to, Weight weight) {
+        out.push_back({from, {to, weight}});
+        in.push_back({to, {from, weight}});
+    };
+    for (const auto &segment : segments) {
+        // Rounded up so LowerBoundMs stays a lower bound
+        const double length = std::hypot(x_[segment.to] - x_[segment.from], y_[segment.to] - y_[segment.from]);
+        const auto weight = static_cast<Weight>(std::max(1.0, std::ceil(length / segment.speed)));
+        if (segment.direction != Direction::Backward) {
+            addEdge(segment.from, segment.to, weight);
+        }
+        if (segment.direction != Direction::Forward) {
+            addEdge(segment.to, segment.from, weight);
+        }
+    }
+    BuildCsr(locations_.size(), out, outOffsets_, outEdges_);
+    BuildCsr(locations_.size(), in, inOffsets_, inEdges_);
+}
+
+double RoadGraph::LowerBoundMs(Vertex a, Vertex b) const {
+    return std::hypot(x_[b] - x_[a], y_[b] - y_[a]) / maxSpeedMetresPerMs_;
+}
+
+RoadGraph::Vertex RoadGraph::NearestVertex(const osmium::Location &location) const {
+    if (locations_.empty() || !location.valid()) {
+        return NO_VERTEX;
+    }
+    const double x = location.lon() * metresPerDegreeLon_;
+    const double y = location.lat() * METRES_PER_DEGREE;
+    Vertex nearest = NO_VERTEX;
+    double nearestDistanceSq = std::numeric_limits<double>::max();
+    for (Vertex v = 0; v < locations_.size(); ++v) {
+        const double distanceSq = (x_[v] - x) * (x_[v] - x) + (y_[v] - y) * (y_[v] - y);
+        if (distanceSq < nearestDistanceSq) {
+            nearestDistanceSq = distanceSq;
+            nearest = v;
+        }
+    }
+    return nearest;
+}
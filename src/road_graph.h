@@ -0,0 +1,74 @@
+#pragma once
+
+#include "osm_loader.h"
+
+#include <osmium/osm/location.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+// Directed road graph over the loaded highway routes, in CSR form (one flat
+// edge array per direction plus per-vertex offsets). Every route vertex is a
+// graph vertex; routes meet where they share a location, which is where
+// they shared an OSM node. Edge weights are travel times from the segment
+// length and a speed per highway class, and oneway ways only get the edges
+// they allow.
+class RoadGraph {
+  public:
+    using Vertex = uint32_t;
+    using Weight = uint32_t; // milliseconds
+    static constexpr Vertex NO_VERTEX = std::numeric_limits<Vertex>::max();
+
+    struct Edge {
+        Vertex target; // head for outgoing edges, tail for incoming ones
+        Weight weight;
+    };
+
+    struct EdgeRange {
+        const Edge *first;
+        const Edge *last;
+        const Edge *begin() const { return first; }
+        const Edge *end() const { return last; }
+    };
+
+    RoadGraph() = default;
+    explicit RoadGraph(const OSMLoader::Id2Route &routes);
+
+    // Speed for a highway value in km/h; 0 for ways that aren't routed over
+    static double SpeedKmh(const std::string &highwayValue);
+
+    size_t VertexCount() const { return locations_.size(); }
+    size_t EdgeCount() const { return outEdges_.size(); }
+    const osmium::Location &GetLocation(Vertex v) const { return locations_[v]; }
+
+    EdgeRange OutEdges(Vertex v) const {
+        return {outEdges_.data() + outOffsets_[v], outEdges_.data() + outOffsets_[v + 1]};
+    }
+    EdgeRange InEdges(Vertex v) const { return {inEdges_.data() + inOffsets_[v], inEdges_.data() + inOffsets_[v + 1]}; }
+
+    // Travel time no path from `a` to `b` can beat: the straight line at the
+    // fastest speed in the graph. Consistent with the edge weights, so it is
+    // a valid A* potential.
+    double LowerBoundMs(Vertex a, Vertex b) const;
+
+    // Vertex closest to `location` (a linear scan); NO_VERTEX if the graph is
+    // empty
+    Vertex NearestVertex(const osmium::Location &location) const;
+
+  private:
+    std::vector<osmium::Location> locations_;
+    // Local equirectangular projection in metres, shared by edge lengths and
+    // LowerBoundMs so the bound never exceeds an edge weight
+    std::vector<double> x_;
+    std::vector<double> y_;
+    double metresPerDegreeLon_{0.0};
+    double maxSpeedMetresPerMs_{1.0};
+
+    std::vector<uint32_t> outOffsets_;
+    std::vector<Edge> outEdges_;
+    std::vector<uint32_t> inOffsets_;
+    std::vector<Edge> inEdges_;
+};
@@ -0,0 +1,198 @@
+#include "route_planner.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+
+namespace {
+
+constexpr uint64_t UNREACHED = std::numeric_limits<uint64_t>::max();
+
+} // namespace
+
+RoutePlanner::RoutePlanner(const RoadGraph &graph, const ContractionHierarchy *hierarchy)
+    : graph_(graph), hierarchy_(hierarchy) {
+    for (int side = 0; side < 2; ++side) {
+        distance_[side].assign(graph.VertexCount(), UNREACHED);
+        parent_[side].assign(graph.VertexCount(), RoadGraph::NO_VERTEX);
+    }
+}
+
+void RoutePlanner::Reset() {
+    for (const auto v : touched_) {
+        for (int side = 0; side < 2; ++side) {
+            distance_[side][v] = UNREACHED;
+            parent_[side][v] = RoadGraph::NO_VERTEX;
+        }
+    }
+    touched_.clear();
+    queue_[0].clear();
+    queue_[1].clear();
+}
+
+void RoutePlanner::Push(int side, Vertex v, uint64_t distance, Vertex parent, double key) {
+    if (distance_[0][v] == UNREACHED && distance_[1][v] == UNREACHED) {
+        touched_.push_back(v);
+    }
+    distance_[side][v] = distance;
+    parent_[side][v] = parent;
+    auto &queue = queue_[side];
+    queue.push_back({key, distance, v});
+    std::push_heap(queue.begin(), queue.end(), std::greater<>{});
+}
+
+std::vector<RoutePlanner::Vertex> RoutePlanner::ParentChain(Vertex meeting) const {
+    std::vector<Vertex> chain;
+    for (Vertex v = meeting; v != RoadGraph::NO_VERTEX; v = parent_[0][v]) {
+        chain.push_back(v);
+    }
+    std::reverse(chain.begin(), chain.end());
+    for (Vertex v = parent_[1][meeting]; v != RoadGraph::NO_VERTEX; v = parent_[1][v]) {
+        chain.push_back(v);
+    }
+    return chain;
+}
+
+RoutePlanner::Path RoutePlanner::ShortestPath(Vertex from, Vertex to) {
+    return hierarchy_ ? ShortestPathContracted(from, to) : ShortestPathAStar(from, to);
+}
+
+RoutePlanner::Path RoutePlanner::ShortestPathAStar(Vertex from, Vertex to) {
+    Path path;
+    if (from >= graph_.VertexCount() || to >= graph_.VertexCount()) {
+        return path;
+    }
+    Reset();
+    if (from == to) {
+        path.vertices = {from};
+        return path;
+    }
+
+    // Forward potential; the backward search uses its negation. Reduced edge
+    // costs are the same in both directions, so the sum of the two queue
+    // keys is a path length and the usual bidirectional stopping rule holds.
+    const auto potential = [&](Vertex v) {
+        return 0.5 * (graph_.LowerBoundMs(v, to) - graph_.LowerBoundMs(from, v));
+    };
+    Push(0, from, 0, RoadGraph::NO_VERTEX, potential(from));
+    Push(1, to, 0, RoadGraph::NO_VERTEX, -potential(to));
+
+    uint64_t best = UNREACHED;
+    Vertex meeting = RoadGraph::NO_VERTEX;
+    while (!queue_[0].empty() && !queue_[1].empty()) {
+        const double forwardKey = queue_[0].front().key;
+        const double backwardKey = queue_[1].front().key;
+        if (best != UNREACHED && forwardKey + backwardKey >= static_cast<double>(best)) {
+            break;
+        }
+        const int side = forwardKey <= backwardKey ? 0 : 1;
+        auto &queue = queue_[side];
+        std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+        const auto entry = queue.back();
+        queue.pop_back();
+        if (entry.distance != distance_[side][entry.vertex]) {
+            continue;
+        }
+        ++path.settled;
+
+        const double sign = side == 0 ? 1.0 : -1.0;
+        const auto &other = distance_[1 - side];
+        for (const auto &edge : side == 0 ? graph_.OutEdges(entry.vertex) : graph_.InEdges(entry.vertex)) {
+            const uint64_t distance = entry.distance + edge.weight;
+            if (distance >= distance_[side][edge.target]) {
+                continue;
+            }
+            const double key = static_cast<double>(distance) + sign * potential(edge.target);
+            Push(side, edge.target, distance, entry.vertex, key);
+            if (other[edge.target] != UNREACHED && distance + other[edge.target] < best) {
+                best = distance + other[edge.target];
+                meeting = edge.target;
+            }
+        }
+    }
+
+    if (meeting != RoadGraph::NO_VERTEX) {
+        path.vertices = ParentChain(meeting);
+        path.timeMs = best;
+    }
+    return path;
+}
+
+RoutePlanner::Path RoutePlanner::ShortestPathContracted(Vertex from, Vertex to) {
+    Path path;
+    if (!hierarchy_ || from >= graph_.VertexCount() || to >= graph_.VertexCount()) {
+        return path;
+    }
+    Reset();
+    if (from == to) {
+        path.vertices = {from};
+        return path;
+    }
+
+    Push(0, from, 0, RoadGraph::NO_VERTEX, 0.0);
+    Push(1, to, 0, RoadGraph::NO_VERTEX, 0.0);
+
+    uint64_t best = UNREACHED;
+    Vertex meeting = RoadGraph::NO_VERTEX;
+    for (;;) {
+        // Each search stops once its queue can't improve on the best path
+        int side = -1;
+        for (int candidate = 0; candidate < 2; ++candidate) {
+            const auto &queue = queue_[candidate];
+            if (!queue.empty() && queue.front().distance < best &&
+                (side < 0 || queue.front().key < queue_[side].front().key)) {
+                side = candidate;
+            }
+        }
+        if (side < 0) {
+            break;
+        }
+        auto &queue = queue_[side];
+        std::pop_heap(queue.begin(), queue.end(), std::greater<>{});
+        const auto entry = queue.back();
+        queue.pop_back();
+        if (entry.distance != distance_[side][entry.vertex]) {
+            continue;
+        }
+        ++path.settled;
+
+        const auto &other = distance_[1 - side];
+        if (other[entry.vertex] != UNREACHED && entry.distance + other[entry.vertex] < best) {
+            best = entry.distance + other[entry.vertex];
+            meeting = entry.vertex;
+        }
+
+        // Stall on demand: a shorter way in from a more important vertex
+        // means this vertex isn't on a shortest up-down path
+        bool stalled = false;
+        for (const auto &edge :
+             side == 0 ? hierarchy_->DownEdges(entry.vertex) : hierarchy_->UpEdges(entry.vertex)) {
+            const auto reached = distance_[side][edge.target];
+            if (reached != UNREACHED && reached + edge.weight < entry.distance) {
+                stalled = true;
+                break;
+            }
+        }
+        if (stalled) {
+            continue;
+        }
+
+        for (const auto &edge :
+             side == 0 ? hierarchy_->UpEdges(entry.vertex) : hierarchy_->DownEdges(entry.vertex)) {
+            const uint64_t distance = entry.distance + edge.weight;
+            if (distance < distance_[side][edge.target]) {
+                Push(side, edge.target, distance, entry.vertex, static_cast<double>(distance));
+            }
+        }
+    }
+
+    if (meeting != RoadGraph::NO_VERTEX) {
+        const auto chain = ParentChain(meeting);
+        path.vertices = {chain.front()};
+        for (size_t i = 1; i < chain.size(); ++i) {
+            hierarchy_->Unpack(chain[i - 1], chain[i], path.vertices);
+        }
+        path.timeMs = best;
+    }
+    return path;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "contraction_hierarchy.h"
+#include "road_graph.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Point-to-point shortest paths on a RoadGraph. Holds the per-query search
+// state, sized once for the graph and reset by touched vertex rather than
+// cleared, so a query only costs what it visits. Not thread-safe; use one
+// planner per thread.
+class RoutePlanner {
+  public:
+    using Vertex = RoadGraph::Vertex;
+
+    struct Path {
+        std::vector<Vertex> vertices; // empty if there is no path
+        uint64_t timeMs{0};
+        size_t settled{0}; // vertices taken off the queues
+    };
+
+    // `hierarchy`, if given, must have been built from `graph`; both must
+    // outlive the planner
+    explicit RoutePlanner(const RoadGraph &graph, const ContractionHierarchy *hierarchy = nullptr);
+
+    // Contraction hierarchy query when the planner has one, A* otherwise
+    Path ShortestPath(Vertex from, Vertex to);
+
+    // Bidirectional A* with the average of the forward and backward
+    // straight-line potentials, which keeps both searches consistent
+    Path ShortestPathAStar(Vertex from, Vertex to);
+    // Bidirectional Dijkstra over the upward edges of the hierarchy
+    Path ShortestPathContracted(Vertex from, Vertex to);
+
+  private:
+    struct QueueEntry {
+        double key;
+        uint64_t distance;
+        Vertex vertex;
+        bool operator>(const QueueEntry &other) const { return key > other.key; }
+    };
+    using Queue = std::vector<QueueEntry>;
+
+    void Reset();
+    void Push(int side, Vertex v, uint64_t distance, Vertex parent, double key);
+    // Forward parents from `from` to `meeting`, then backward parents to the target
+    std::vector<Vertex> ParentChain(Vertex meeting) const;
+
+    const RoadGraph &graph_;
+    const ContractionHierarchy *hierarchy_;
+
+    // Index 0 is the forward search, 1 the backward one
+    std::vector<uint64_t> distance_[2];
+    std::vector<Vertex> parent_[2];
+    Queue queue_[2];
+    std::vector<Vertex> touched_;
+};
@@ -0,0 +1,172 @@
+#include "sdf_font.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace {
+
+constexpr float INF = 1e20f;
+
+// 1D squared Euclidean distance transform (Felzenszwalb & Huttenlocher)
+void DistanceTransform1D(const float *f, float *d, int n, std::vector<int> &v, std::vector<float> &z) {
+    int k = 0;
+    v[0] = 0;
+    z[0] = -INF;
+    z[1] = INF;
+    for (int q = 1; q < n; ++q) {
+        float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        while (s <= z[k]) {
+            --k;
+            s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2.0f * q - 2.0f * v[k]);
+        }
+        ++k;
+        v[k] = q;
+        z[k] = s;
+        z[k + 1] = INF;
+    }
+
+    k = 0;
+    for (int q = 0; q < n; ++q) {
+        while (z[k + 1] < q) {
+            ++k;
+        }
+        const float dq = static_cast<float>(q - v[k]);
+        d[q] = dq * dq + f[v[k]];
+    }
+}
+
+// 2D squared distance transform in place; `grid` holds 0 for feature pixels
+// and INF elsewhere
+void DistanceTransform2D(std::vector<float> &grid, int width, int height) {
+    const int maxDim = std::max(width, height);
+    std::vector<float> f(maxDim);
+    std::vector<float> d(maxDim);
+    std::vector<int> v(maxDim);
+    std::vector<float> z(maxDim + 1);
+
+    for (int x = 0; x < width; ++x) {
+        for (int y = 0; y < height; ++y) {
+            f[y] = grid[y * width + x];
+        }
+        DistanceTransform1D(f.data(), d.data(), height, v, z);
+        for (int y = 0; y < height; ++y) {
+            grid[y * width + x] = d[y];
+        }
+    }
+
+    for (int y = 0; y < height; ++y) {
+        DistanceTransform1D(&grid[y * width], d.data(), width, v, z);
+        std::copy(d.begin(), d.begin() + width, grid.begin() + y * width);
+    }
+}
+
+} // namespace
+
+SdfFont::SdfFont(int atlasWidth, int padding) : atlasWidth_(atlasWidth), padding_(padding) {}
+
+bool SdfFont::AddGlyph(uint32_t codepoint, const std::vector<uint8_t> &coverage, int width, int height,
+                       float advance) {
+    if (width <= 0 || height <= 0 || width > atlasWidth_ || coverage.size() < static_cast<size_t>(width * height)) {
+        return false;
+    }
+
+    lineHeight_ = std::max(lineHeight_, height - 2 * padding_);
+
+    // Start a new shelf when this glyph doesn't fit on the current one
+    if (shelfX_ + width > atlasWidth_) {
+        shelfY_ += shelfHeight_;
+        shelfX_ = 0;
+        shelfHeight_ = 0;
+    }
+    shelfHeight_ = std::max(shelfHeight_, height);
+    if (shelfY_ + shelfHeight_ > atlasHeight_) {
+        atlasHeight_ = shelfY_ + shelfHeight_;
+        atlas_.resize(static_cast<size_t>(atlasWidth_) * atlasHeight_, 0);
+    }
+
+    const auto field = ComputeDistanceField(coverage, width, height, static_cast<float>(padding_));
+    for (int y = 0; y < height; ++y) {
+        std::copy(field.begin() + y * width, field.begin() + (y + 1) * width,
+                  atlas_.begin() + (shelfY_ + y) * atlasWidth_ + shelfX_);
+    }
+
+    glyphs_[codepoint] = Glyph{shelfX_, shelfY_, width, height, advance};
+    shelfX_ += width;
+    return true;
+}
+
+const SdfFont::Glyph *SdfFont::FindGlyph(uint32_t codepoint) const {
+    if (auto it = glyphs_.find(codepoint); it != glyphs_.end()) {
+        return &it->second;
+    }
+    if (auto it = glyphs_.find('?'); it != glyphs_.end()) {
+        return &it->second;
+    }
+    return nullptr;
+}
+
+float SdfFont::MeasureText(const std::string &utf8) const {
+    float width = 0.0f;
+    for (size_t pos = 0; pos < utf8.size();) {
+        if (const auto *glyph = FindGlyph(NextCodepoint(utf8, pos)); glyph) {
+            width += glyph->advance;
+        }
+    }
+    return width;
+}
+
+uint32_t SdfFont::NextCodepoint(const std::string &utf8, size_t &pos) {
+    constexpr uint32_t REPLACEMENT = 0xFFFD;
+    const auto lead = static_cast<unsigned char>(utf8[pos++]);
+    if (lead < 0x80) {
+        return lead;
+    }
+
+    int extra = 0;
+    uint32_t codepoint = 0;
+    if ((lead & 0xE0) == 0xC0) {
+        extra = 1;
+        codepoint = lead & 0x1F;
+    } else if ((lead & 0xF0) == 0xE0) {
+        extra = 2;
+        codepoint = lead & 0x0F;
+    } else if ((lead & 0xF8) == 0xF0) {
+        extra = 3;
+        codepoint = lead & 0x07;
+    } else {
+        return REPLACEMENT;
+    }
+
+    for (int i = 0; i < extra; ++i) {
+        if (pos >= utf8.size() || (static_cast<unsigned char>(utf8[pos]) & 0xC0) != 0x80) {
+            return REPLACEMENT;
+        }
+        codepoint = (codepoint << 6) | (static_cast<unsigned char>(utf8[pos++]) & 0x3F);
+    }
+    return codepoint;
+}
+
+std::vector<uint8_t> SdfFont::ComputeDistanceField(const std::vector<uint8_t> &coverage, int width, int height,
+                                                   float spread) {
+    const size_t size = static_cast<size_t>(width) * height;
+    std::vector<float> outside(size);
+    std::vector<float> inside(size);
+    for (size_t i = 0; i < size; ++i) {
+        const bool isInside = coverage[i] >= 128;
+        outside[i] = isInside ? 0.0f : INF;
+        inside[i] = isInside ? INF : 0.0f;
+    }
+
+    DistanceTransform2D(outside, width, height);
+    DistanceTransform2D(inside, width, height);
+
+    std::vector<uint8_t> field(size);
+    for (size_t i = 0; i < size; ++i) {
+        // Positive inside the glyph, negative outside
+        const float distance = std::sqrt(inside[i]) - std::sqrt(outside[i]);
+        const float value = 128.0f + 127.0f * distance / spread;
+        field[i] = static_cast<uint8_t>(std::clamp(value, 0.0f, 255.0f));
+    }
+    return field;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Signed distance field glyph atlas. Glyph coverage bitmaps are supplied by
+// the caller (OpenGLCanvas rasterizes them with wxWidgets) so this stays
+// independent of any windowing or GL code.
+class SdfFont {
+  public:
+    struct Glyph {
+        // Atlas rectangle in texels
+        int atlasX{0};
+        int atlasY{0};
+        int width{0};
+        int height{0};
+        // Horizontal advance in pixels at the atlas font size
+        float advance{0.0f};
+    };
+
+    // `padding` is the empty border around every glyph cell and doubles as
+    // the distance (in texels) that maps to the full 0..255 range.
+    SdfFont(int atlasWidth, int padding);
+
+    // Add a glyph from an 8-bit coverage bitmap of `width` x `height` that
+    // already includes `padding` pixels on every side. The atlas grows
+    // downwards as shelves fill up. Returns false for an empty bitmap.
+    bool AddGlyph(uint32_t codepoint, const std::vector<uint8_t> &coverage, int width, int height, float advance);
+
+    // Glyph for `codepoint`, or '?' when it isn't in the atlas
+    const Glyph *FindGlyph(uint32_t codepoint) const;
+
+    // Width in atlas pixels of a UTF-8 string
+    float MeasureText(const std::string &utf8) const;
+
+    int GetAtlasWidth() const { return atlasWidth_; }
+    int GetAtlasHeight() const { return atlasHeight_; }
+    int GetPadding() const { return padding_; }
+    int GetLineHeight() const { return lineHeight_; }
+    const std::vector<uint8_t> &GetAtlasPixels() const { return atlas_; }
+
+    // Decode the next code point from a UTF-8 string, advancing `pos`.
+    // Malformed sequences yield U+FFFD.
+    static uint32_t NextCodepoint(const std::string &utf8, size_t &pos);
+
+    // Convert a coverage bitmap to a signed distance field where 128 is the
+    // glyph edge and `spread` texels maps to 0 (outside) / 255 (inside).
+    static std::vector<uint8_t> ComputeDistanceField(const std::vector<uint8_t> &coverage, int width, int height,
+                                                     float spread);
+
+  private:
+    int atlasWidth_;
+    int atlasHeight_{0};
+    int padding_;
+    int lineHeight_{0};
+
+    // Shelf packing state
+    int shelfX_{0};
+    int shelfY_{0};
+    int shelfHeight_{0};
+
+    std::vector<uint8_t> atlas_;
+    std::unordered_map<uint32_t, Glyph> glyphs_;
+};
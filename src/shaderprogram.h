@@ -6,25 +6,91 @@
 #include <sstream>
 #include <string>
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
 struct ShaderProgram {
 
+    // Ask the driver to use as many background compiler threads as it likes.
+    // Must be called once after GLEW is initialized. Returns true if
+    // KHR/ARB_parallel_shader_compile is available so GL_COMPLETION_STATUS_KHR
+    // can be polled without blocking.
+    static bool EnableParallelCompile() {
+#ifdef GL_KHR_parallel_shader_compile
+        if (GLEW_KHR_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFFu);
+            return true;
+        }
+#endif
+#ifdef GL_ARB_parallel_shader_compile
+        if (GLEW_ARB_parallel_shader_compile) {
+            glMaxShaderCompilerThreadsARB(0xFFFFFFFFu);
+            return true;
+        }
+#endif
+        return false;
+    }
+
+    // Compile and link synchronously (blocks until the driver is done)
     void Build() {
+        BuildAsync(false);
+        FinishBuild();
+    }
+
+    // Submit all stages and the link without querying any status so the driver
+    // can compile them in the background. Call IsBuildComplete() on later frames
+    // and FinishBuild() once it returns true.
+    void BuildAsync(bool canPollCompletion) {
         lastBuildLog_ = {};
+        isReady_ = false;
+        canPollCompletion_ = canPollCompletion;
 
-        unsigned int vertexShader = CompileShader(GL_VERTEX_SHADER, vertexShaderSource_.c_str());
-        unsigned int fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentShaderSource_.c_str());
+        vertexShader_ = CompileShader(GL_VERTEX_SHADER, vertexShaderSource_.c_str());
+        fragmentShader_ = CompileShader(GL_FRAGMENT_SHADER, fragmentShaderSource_.c_str());
 
         shaderProgram_ = glCreateProgram();
-        glAttachShader(shaderProgram_.value(), vertexShader);
-        glAttachShader(shaderProgram_.value(), fragmentShader);
+        glAttachShader(shaderProgram_.value(), vertexShader_);
+        glAttachShader(shaderProgram_.value(), fragmentShader_);
 
-        unsigned int geometryShader = 0;
+        geometryShader_ = 0;
         if (geometryShaderSource_.size() > 0) {
-            geometryShader = CompileShader(GL_GEOMETRY_SHADER, geometryShaderSource_.c_str());
-            glAttachShader(shaderProgram_.value(), geometryShader);
+            geometryShader_ = CompileShader(GL_GEOMETRY_SHADER, geometryShaderSource_.c_str());
+            glAttachShader(shaderProgram_.value(), geometryShader_);
         }
 
         glLinkProgram(shaderProgram_.value());
+        isPending_ = true;
+    }
+
+    // Non-blocking when parallel compile is available; otherwise the program
+    // is reported complete and FinishBuild() will block on the status query.
+    bool IsBuildComplete() const {
+        if (!isPending_) {
+            return true;
+        }
+        if (!canPollCompletion_) {
+            return true;
+        }
+
+        int complete = 0;
+        glGetProgramiv(shaderProgram_.value(), GL_COMPLETION_STATUS_KHR, &complete);
+        return complete != 0;
+    }
+
+    // Collect compile/link logs and release the shader objects. Returns true
+    // if the program linked successfully.
+    bool FinishBuild() {
+        if (!isPending_) {
+            return isReady_;
+        }
+        isPending_ = false;
+
+        CheckCompileStatus(vertexShader_);
+        CheckCompileStatus(fragmentShader_);
+        if (geometryShader_ != 0) {
+            CheckCompileStatus(geometryShader_);
+        }
 
         // check linking errors
         int success;
@@ -37,19 +103,29 @@ struct ShaderProgram {
             lastBuildLog_ << "Shader program linking failed: " << infoLog;
         }
 
-        glDeleteShader(vertexShader);
-        glDeleteShader(fragmentShader);
+        glDeleteShader(vertexShader_);
+        glDeleteShader(fragmentShader_);
 
-        if (geometryShaderSource_.size() > 0) {
-            glDeleteShader(geometryShader);
+        if (geometryShader_ != 0) {
+            glDeleteShader(geometryShader_);
         }
+        vertexShader_ = fragmentShader_ = geometryShader_ = 0;
+
+        isReady_ = lastBuildLog_.str().empty();
+        return isReady_;
     }
 
+    bool IsPending() const { return isPending_; }
+    bool IsReady() const { return isReady_; }
+
     unsigned int CompileShader(unsigned int shaderType, const char *shaderSource) {
         unsigned int shader = glCreateShader(shaderType);
         glShaderSource(shader, 1, &shaderSource, nullptr);
         glCompileShader(shader);
+        return shader;
+    }
 
+    void CheckCompileStatus(unsigned int shader) {
         int success;
         glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
 
@@ -58,8 +134,6 @@ struct ShaderProgram {
             glGetShaderInfoLog(shader, 512, nullptr, infoLog);
             lastBuildLog_ << "Shader compilation failed: " << infoLog;
         }
-
-        return shader;
     }
 
     std::optional<unsigned int> shaderProgram_ = std::nullopt;
@@ -69,4 +143,13 @@ struct ShaderProgram {
     std::string fragmentShaderSource_{};
 
     std::stringstream lastBuildLog_;
+
+  private:
+    unsigned int vertexShader_{0};
+    unsigned int fragmentShader_{0};
+    unsigned int geometryShader_{0};
+
+    bool canPollCompletion_{false};
+    bool isPending_{false};
+    bool isReady_{false};
 };
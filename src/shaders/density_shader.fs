@@ -0,0 +1,27 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 vTexCoord;
+
+// Line length per level-0 cell, one density class per channel, in units of
+// the cell side (density_grid.h); mipmapped
+uniform sampler2D uDensity;
+uniform float uTexelsPerPixel;  // level-0 cells per screen pixel
+uniform vec4 uLineWidths;       // line width of each class in pixels
+uniform vec3 uClassColors[4];
+
+// The raster stand-in for the line layers when zoomed far out. A pixel holds
+// density * uTexelsPerPixel pixels of line of each class; at their widths
+// they cover that area of it, assuming lines fall independently. The alpha
+// is MAP_LINE_ALPHA in map_style.h.
+void main()
+{
+	vec4 area = texture(uDensity, vTexCoord) * uTexelsPerPixel * uLineWidths;
+	float total = area.x + area.y + area.z + area.w;
+	if (total <= 0.0) {
+		discard;
+	}
+	vec3 color = (uClassColors[0] * area.x + uClassColors[1] * area.y + uClassColors[2] * area.z +
+	              uClassColors[3] * area.w) / total;
+	FragColor = vec4(color, (1.0 - exp(-total)) * 0.5);
+}
@@ -0,0 +1,13 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;      // projected corner of the density grid
+layout (location = 1) in vec2 aTexCoord; // the same corner of the grid texture
+
+uniform vec4 uBounds; // (minLon, minLat, lonRange, latRange)
+
+out vec2 vTexCoord;
+
+void main()
+{
+	vTexCoord = aTexCoord;
+	gl_Position = vec4((aPos - uBounds.xy) / uBounds.zw * 2.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,15 @@
+#version 330 core
+out vec4 FragColor;
+
+in VS_OUT {
+    vec3 color;
+} fs_in;
+
+// AREA_FILL_ALPHA in map_style.h
+uniform float uAlpha;
+
+// Area fills use house_shader.vs
+void main()
+{
+    FragColor = vec4(fs_in.color, uAlpha);
+}
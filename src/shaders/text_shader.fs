@@ -0,0 +1,21 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 vTexCoord;
+
+uniform sampler2D uAtlas;
+
+const vec3 TEXT_COLOR = vec3(0.1);
+const vec3 HALO_COLOR = vec3(1.0);
+// distance field value of the glyph edge and the outer edge of the halo
+const float EDGE = 0.5;
+const float HALO_EDGE = 0.3;
+
+void main()
+{
+    float dist = texture(uAtlas, vTexCoord).r;
+    float width = fwidth(dist);
+    float fill = smoothstep(EDGE - width, EDGE + width, dist);
+    float halo = smoothstep(HALO_EDGE - width, HALO_EDGE + width, dist);
+    FragColor = vec4(mix(HALO_COLOR, TEXT_COLOR, fill), halo);
+}
@@ -0,0 +1,21 @@
+#version 330 core
+layout (location = 0) in vec2 aAnchor;      // lon/lat for labels, y-up pixels for HUD text
+layout (location = 1) in vec2 aOffset;      // pixel offset of this corner from the anchor
+layout (location = 2) in vec2 aTexCoord;    // glyph atlas coordinates
+layout (location = 3) in float aScreenSpace;
+
+uniform vec4 uBounds;       // (minLon, minLat, lonRange, latRange)
+uniform vec2 uViewportSize; // pixels
+
+out vec2 vTexCoord;
+
+void main()
+{
+	vec2 anchor = aAnchor;
+	if (aScreenSpace < 0.5) {
+		anchor = (aAnchor - uBounds.xy) / uBounds.zw * uViewportSize;
+	}
+	vec2 pixel = anchor + aOffset;
+	gl_Position = vec4(pixel / uViewportSize * 2.0 - 1.0, 0.0, 1.0);
+	vTexCoord = aTexCoord;
+}
@@ -0,0 +1,431 @@
+#include "software_rasterizer.h"
+#include "map_style.h"
+#include "parallel.h"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+// Four floats processed together: one SIMD register where available
+#if defined(__SSE2__)
+struct Float4 {
+    __m128 v;
+
+    static Float4 Set(float x) { return {_mm_set1_ps(x)}; }
+    static Float4 Set(float a, float b, float c, float d) { return {_mm_setr_ps(a, b, c, d)}; }
+    static Float4 Load(const float *p) { return {_mm_loadu_ps(p)}; }
+    void Store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend Float4 operator+(Float4 a, Float4 b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend Float4 operator-(Float4 a, Float4 b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend Float4 operator*(Float4 a, Float4 b) { return {_mm_mul_ps(a.v, b.v)}; }
+    friend Float4 Min(Float4 a, Float4 b) { return {_mm_min_ps(a.v, b.v)}; }
+    friend Float4 Max(Float4 a, Float4 b) { return {_mm_max_ps(a.v, b.v)}; }
+    friend Float4 Abs(Float4 a) { return {_mm_andnot_ps(_mm_set1_ps(-0.0f), a.v)}; }
+};
+
+// Four opaque RGBA pixels from channels in [0, 1]
+void StorePixels(Float4 r, Float4 g, Float4 b, uint8_t *out) {
+    const __m128 scale = _mm_set1_ps(255.0f);
+    auto toInt = [&scale](Float4 c) {
+        return _mm_cvtps_epi32(_mm_mul_ps(_mm_min_ps(_mm_max_ps(c.v, _mm_setzero_ps()), _mm_set1_ps(1.0f)), scale));
+    };
+    __m128i pixels = _mm_or_si128(toInt(r), _mm_slli_epi32(toInt(g), 8));
+    pixels = _mm_or_si128(pixels, _mm_slli_epi32(toInt(b), 16));
+    pixels = _mm_or_si128(pixels, _mm_set1_epi32(static_cast<int>(0xFF000000u)));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(out), pixels);
+}
+#elif defined(__ARM_NEON)
+struct Float4 {
+    float32x4_t v;
+
+    static Float4 Set(float x) { return {vdupq_n_f32(x)}; }
+    static Float4 Set(float a, float b, float c, float d) {
+        const float values[4] = {a, b, c, d};
+        return {vld1q_f32(values)};
+    }
+    static Float4 Load(const float *p) { return {vld1q_f32(p)}; }
+    void Store(float *p) const { vst1q_f32(p, v); }
+
+    friend Float4 operator+(Float4 a, Float4 b) { return {vaddq_f32(a.v, b.v)}; }
+    friend Float4 operator-(Float4 a, Float4 b) { return {vsubq_f32(a.v, b.v)}; }
+    friend Float4 operator*(Float4 a, Float4 b) { return {vmulq_f32(a.v, b.v)}; }
+    friend Float4 Min(Float4 a, Float4 b) { return {vminq_f32(a.v, b.v)}; }
+    friend Float4 Max(Float4 a, Float4 b) { return {vmaxq_f32(a.v, b.v)}; }
+    friend Float4 Abs(Float4 a) { return {vabsq_f32(a.v)}; }
+};
+
+// Four opaque RGBA pixels from channels in [0, 1]
+void StorePixels(Float4 r, Float4 g, Float4 b, uint8_t *out) {
+    auto toInt = [](Float4 c) {
+        const float32x4_t clamped = vminq_f32(vmaxq_f32(c.v, vdupq_n_f32(0.0f)), vdupq_n_f32(1.0f));
+        return vcvtq_u32_f32(vmlaq_f32(vdupq_n_f32(0.5f), clamped, vdupq_n_f32(255.0f)));
+    };
+    uint32x4_t pixels = vorrq_u32(toInt(r), vshlq_n_u32(toInt(g), 8));
+    pixels = vorrq_u32(pixels, vshlq_n_u32(toInt(b), 16));
+    pixels = vorrq_u32(pixels, vdupq_n_u32(0xFF000000u));
+    vst1q_u8(out, vreinterpretq_u8_u32(pixels));
+}
+#else
+struct Float4 {
+    std::array<float, 4> v;
+
+    static Float4 Set(float x) { return {{x, x, x, x}}; }
+    static Float4 Set(float a, float b, float c, float d) { return {{a, b, c, d}}; }
+    static Float4 Load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+    void Store(float *p) const { std::copy(v.begin(), v.end(), p); }
+
+    template <typename Op> static Float4 Apply(Float4 a, Float4 b, Op op) {
+        return {{op(a.v[0], b.v[0]), op(a.v[1], b.v[1]), op(a.v[2], b.v[2]), op(a.v[3], b.v[3])}};
+    }
+    friend Float4 operator+(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return x + y; }); }
+    friend Float4 operator-(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return x - y; }); }
+    friend Float4 operator*(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return x * y; }); }
+    friend Float4 Min(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return std::min(x, y); }); }
+    friend Float4 Max(Float4 a, Float4 b) { return Apply(a, b, [](float x, float y) { return std::max(x, y); }); }
+    friend Float4 Abs(Float4 a) { return Apply(a, a, [](float x, float) { return std::fabs(x); }); }
+};
+
+// Four opaque RGBA pixels from channels in [0, 1]
+void StorePixels(Float4 r, Float4 g, Float4 b, uint8_t *out) {
+    for (size_t i = 0; i < 4; ++i) {
+        for (const auto &channel : {r, g, b}) {
+            *out++ = static_cast<uint8_t>(std::min(std::max(channel.v[i], 0.0f), 1.0f) * 255.0f + 0.5f);
+        }
+        *out++ = 255;
+    }
+}
+#endif
+
+// One line segment in pixel coordinates
+struct Segment {
+    float x0, y0, x1, y1;
+    float dirX, dirY; // unit direction from (x0, y0)
+    float length;
+    float halfWidth; // across the segment
+    std::array<float, 3> color0;
+    std::array<float, 3> colorDelta; // colour at the end minus colour at the start
+    float alpha;
+};
+
+// Pixels within this distance of a quad's edge are partially covered
+constexpr float AA_MARGIN = 1.0f;
+
+// The segment quad grown by the antialiasing margin, as four corners in order
+std::array<std::array<float, 2>, 4> SegmentCorners(const Segment &s) {
+    const float nx = -s.dirY * (s.halfWidth + AA_MARGIN);
+    const float ny = s.dirX * (s.halfWidth + AA_MARGIN);
+    const float ex = s.dirX * AA_MARGIN;
+    const float ey = s.dirY * AA_MARGIN;
+    return {{{s.x0 - ex + nx, s.y0 - ey + ny},
+             {s.x1 + ex + nx, s.y1 + ey + ny},
+             {s.x1 + ex - nx, s.y1 + ey - ny},
+             {s.x0 - ex - nx, s.y0 - ey - ny}}};
+}
+
+// Horizontal extent of the convex polygon `corners` between rows `top` and
+// `bottom`; false if it does not reach them
+bool RowSpan(const std::array<std::array<float, 2>, 4> &corners, float top, float bottom, float &minX, float &maxX) {
+    minX = INFINITY;
+    maxX = -INFINITY;
+    for (size_t i = 0; i < corners.size(); ++i) {
+        const auto &p = corners[i];
+        const auto &q = corners[(i + 1) % corners.size()];
+        const float low = std::max(std::min(p[1], q[1]), top);
+        const float high = std::min(std::max(p[1], q[1]), bottom);
+        if (low > high) {
+            continue;
+        }
+        if (p[1] == q[1]) {
+            minX = std::min({minX, p[0], q[0]});
+            maxX = std::max({maxX, p[0], q[0]});
+            continue;
+        }
+        const float slope = (q[0] - p[0]) / (q[1] - p[1]);
+        for (const float y : {low, high}) {
+            const float x = p[0] + (y - p[1]) * slope;
+            minX = std::min(minX, x);
+            maxX = std::max(maxX, x);
+        }
+    }
+    return minX <= maxX;
+}
+
+// Every segment of the chunks inside `view`, in draw order. Vertices are in
+// `projection`, so the view's latitudes are projected to match.
+std::vector<Segment> CollectSegments(const ChunkedGeometry &geometry, const RenderLayerTable &layerTable,
+                                     const osmium::Box &view, Projection projection, uint32_t width,
+                                     uint32_t height) {
+    const double minLon = view.left();
+    const double maxLat = ProjectLat(projection, view.top());
+    const double lonRange = view.right() - view.left();
+    const double latRange = maxLat - ProjectLat(projection, view.bottom());
+    const double pixelsPerLon = lonRange == 0.0 ? 0.0 : width / lonRange;
+    const double pixelsPerLat = latRange == 0.0 ? 0.0 : height / latRange;
+
+    std::vector<Segment> segments;
+    for (size_t layer = 0; layer < geometry.layers.size(); ++layer) {
+        const auto &style = layerTable.GetLayer(layer);
+        const float alpha = style.blend ? MAP_LINE_ALPHA : 1.0f;
+        const auto &range = geometry.layers[layer];
+        for (size_t c = range.firstChunk; c < range.firstChunk + range.chunkCount; ++c) {
+            const auto &chunk = geometry.chunks[c];
+            if (!BoxesIntersect(chunk.bounds, view)) {
+                continue;
+            }
+            const float *vertices =
+                geometry.vertices.data() + static_cast<size_t>(chunk.baseVertex) * FLOATS_PER_VERTEX;
+            const uint16_t *indices = geometry.indices.data() + chunk.firstIndex;
+
+            // GL_LINE_STRIP_ADJACENCY: each window of four strip vertices
+            // draws the segment between the middle two
+            size_t stripLength = 0;
+            std::array<uint16_t, 3> previous{};
+            for (size_t i = 0; i < chunk.indexCount; ++i) {
+                const uint16_t index = indices[i];
+                if (index == PRIMITIVE_RESTART_INDEX) {
+                    stripLength = 0;
+                    continue;
+                }
+                if (++stripLength >= 4) {
+                    const float *a = vertices + previous[1] * FLOATS_PER_VERTEX;
+                    const float *b = vertices + previous[2] * FLOATS_PER_VERTEX;
+                    Segment s;
+                    s.x0 = static_cast<float>((a[0] - minLon) * pixelsPerLon);
+                    s.y0 = static_cast<float>((maxLat - a[1]) * pixelsPerLat);
+                    s.x1 = static_cast<float>((b[0] - minLon) * pixelsPerLon);
+                    s.y1 = static_cast<float>((maxLat - b[1]) * pixelsPerLat);
+                    const float dx = s.x1 - s.x0;
+                    const float dy = s.y1 - s.y0;
+                    s.length = std::sqrt(dx * dx + dy * dy);
+                    // A zero length segment normalises to NaN in the shader
+                    // and draws nothing
+                    if (s.length > 0.0f) {
+                        s.dirX = dx / s.length;
+                        s.dirY = dy / s.length;
+                        // The shader offsets by the line width perpendicular
+                        // to the segment in clip space; measure that offset
+                        // across the segment in pixels
+                        const float clipX = dx * 2.0f / width;
+                        const float clipY = dy * 2.0f / height;
+                        const float clipLength = std::sqrt(clipX * clipX + clipY * clipY);
+                        const float offsetX = clipY / clipLength * style.lineWidth * width * 0.5f;
+                        const float offsetY = -clipX / clipLength * style.lineWidth * height * 0.5f;
+                        s.halfWidth = std::fabs(-s.dirY * offsetX + s.dirX * offsetY);
+                        for (size_t k = 0; k < 3; ++k) {
+                            s.color0[k] = a[2 + k];
+                            s.colorDelta[k] = b[2 + k] - a[2 + k];
+                        }
+                        s.alpha = alpha;
+                        segments.push_back(s);
+                    }
+                }
+                previous = {previous[1], previous[2], index};
+            }
+        }
+    }
+    return segments;
+}
+
+// Blend `segment` into one tile's planar float buffers. `stride` is a
+// multiple of 4 so whole groups of four pixels can be written.
+void RasterizeSegment(const Segment &s, uint32_t tileX, uint32_t tileY, uint32_t tileWidth, uint32_t tileHeight,
+                      uint32_t stride, float *red, float *green, float *blue) {
+    const auto corners = SegmentCorners(s);
+    float top = INFINITY;
+    float bottom = -INFINITY;
+    for (const auto &corner : corners) {
+        top = std::min(top, corner[1]);
+        bottom = std::max(bottom, corner[1]);
+    }
+    // Clamp in float first: zoomed in, segments can end far outside the image
+    top = std::max(top - static_cast<float>(tileY), 0.0f);
+    bottom = std::min(bottom - static_cast<float>(tileY), static_cast<float>(tileHeight) - 1.0f);
+    if (top > bottom) {
+        return;
+    }
+    const int firstRow = static_cast<int>(top);
+    const int lastRow = static_cast<int>(bottom);
+
+    const Float4 four = Float4::Set(4.0f);
+    // Strips have one colour, so the gradient is almost never needed
+    const bool uniformColor = s.colorDelta == std::array<float, 3>{};
+    const Float4 dirX = Float4::Set(s.dirX);
+    const Float4 dirY = Float4::Set(s.dirY);
+    const Float4 widthEdge = Float4::Set(s.halfWidth + 0.5f);
+    const Float4 length = Float4::Set(s.length);
+    const Float4 invLength = Float4::Set(1.0f / s.length);
+    const Float4 half = Float4::Set(0.5f);
+    const Float4 zero = Float4::Set(0.0f);
+    const Float4 one = Float4::Set(1.0f);
+    const Float4 alpha = Float4::Set(s.alpha);
+    const std::array<Float4, 3> color0{Float4::Set(s.color0[0]), Float4::Set(s.color0[1]), Float4::Set(s.color0[2])};
+    const std::array<Float4, 3> colorDelta{Float4::Set(s.colorDelta[0]), Float4::Set(s.colorDelta[1]),
+                                           Float4::Set(s.colorDelta[2])};
+
+    for (int row = firstRow; row <= lastRow; ++row) {
+        const float y = static_cast<float>(tileY + row);
+        float minX, maxX;
+        if (!RowSpan(corners, y, y + 1.0f, minX, maxX)) {
+            continue;
+        }
+        minX = std::max(minX - static_cast<float>(tileX), 0.0f);
+        maxX = std::min(maxX - static_cast<float>(tileX), static_cast<float>(tileWidth) - 1.0f);
+        if (minX > maxX) {
+            continue;
+        }
+        // Start on a multiple of 4; the planes are padded to whole groups
+        const int first = static_cast<int>(minX) & ~3;
+        const int last = static_cast<int>(maxX);
+        const float relY = y + 0.5f - s.y0;
+        const Float4 rowAlong = Float4::Set(relY * s.dirY);
+        const Float4 rowAcross = Float4::Set(relY * s.dirX);
+
+        // Pixel centres relative to the start of the segment
+        const float relX = static_cast<float>(tileX + first) + 0.5f - s.x0;
+        Float4 relX4 = Float4::Set(relX, relX + 1.0f, relX + 2.0f, relX + 3.0f);
+        for (int x = first; x <= last; x += 4, relX4 = relX4 + four) {
+            const Float4 along = relX4 * dirX + rowAlong;
+            const Float4 across = Abs(rowAcross - relX4 * dirY);
+
+            // Coverage falls off over one pixel at the sides and butt ends
+            const Float4 sideCoverage = Min(Max(widthEdge - across, zero), one);
+            const Float4 endCoverage = Min(Max(Min(along, length - along) + half, zero), one);
+            const Float4 a = sideCoverage * endCoverage * alpha;
+
+            const size_t offset = static_cast<size_t>(row) * stride + static_cast<size_t>(x);
+            float *channels[3] = {red + offset, green + offset, blue + offset};
+            if (uniformColor) {
+                for (size_t k = 0; k < 3; ++k) {
+                    const Float4 dst = Float4::Load(channels[k]);
+                    (dst + (color0[k] - dst) * a).Store(channels[k]);
+                }
+                continue;
+            }
+            const Float4 t = Min(Max(along * invLength, zero), one);
+            for (size_t k = 0; k < 3; ++k) {
+                const Float4 dst = Float4::Load(channels[k]);
+                const Float4 src = color0[k] + colorDelta[k] * t;
+                (dst + (src - dst) * a).Store(channels[k]);
+            }
+        }
+    }
+}
+
+uint8_t ToByte(float value) {
+    return static_cast<uint8_t>(std::min(std::max(value, 0.0f), 1.0f) * 255.0f + 0.5f);
+}
+
+} // namespace
+
+double RasterStats::MegapixelsPerSecond(const RasterImage &image) const {
+    const double seconds = (binMilliseconds + rasterMilliseconds) / 1000.0;
+    return seconds > 0.0 ? static_cast<double>(image.width) * image.height / 1e6 / seconds : 0.0;
+}
+
+RasterImage RasterizeGeometry(const ChunkedGeometry &geometry, const RenderLayerTable &layerTable,
+                              const osmium::Box &view, const RasterOptions &options, RasterStats *stats) {
+    RasterImage image;
+    image.width = options.width;
+    image.height = options.height;
+    image.pixels.resize(static_cast<size_t>(image.width) * image.height * 4);
+    if (image.pixels.empty()) {
+        return image;
+    }
+
+    const auto binStart = std::chrono::steady_clock::now();
+    const auto segments = CollectSegments(geometry, layerTable, view, options.projection, image.width, image.height);
+
+    // Bin segment indices into every tile their quad's bounding box touches;
+    // bins keep draw order
+    const uint32_t tileSize = std::max<uint32_t>(4, options.tileSize);
+    const uint32_t tilesX = (image.width + tileSize - 1) / tileSize;
+    const uint32_t tilesY = (image.height + tileSize - 1) / tileSize;
+    std::vector<std::vector<uint32_t>> bins(static_cast<size_t>(tilesX) * tilesY);
+    size_t visibleSegments = 0;
+    for (size_t i = 0; i < segments.size(); ++i) {
+        float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+        for (const auto &corner : SegmentCorners(segments[i])) {
+            minX = std::min(minX, corner[0]);
+            maxX = std::max(maxX, corner[0]);
+            minY = std::min(minY, corner[1]);
+            maxY = std::max(maxY, corner[1]);
+        }
+        if (maxX < 0.0f || maxY < 0.0f || minX >= image.width || minY >= image.height) {
+            continue;
+        }
+        ++visibleSegments;
+        const auto firstX = static_cast<uint32_t>(std::max(0.0f, minX)) / tileSize;
+        const auto firstY = static_cast<uint32_t>(std::max(0.0f, minY)) / tileSize;
+        // Clamp before converting: zoomed in, quads can reach far past the image
+        const uint32_t lastX =
+            std::min(tilesX - 1, static_cast<uint32_t>(std::min(maxX, static_cast<float>(image.width))) / tileSize);
+        const uint32_t lastY =
+            std::min(tilesY - 1, static_cast<uint32_t>(std::min(maxY, static_cast<float>(image.height))) / tileSize);
+        for (uint32_t ty = firstY; ty <= lastY; ++ty) {
+            for (uint32_t tx = firstX; tx <= lastX; ++tx) {
+                bins[static_cast<size_t>(ty) * tilesX + tx].push_back(static_cast<uint32_t>(i));
+            }
+        }
+    }
+    const auto rasterStart = std::chrono::steady_clock::now();
+
+    // Tiles differ a lot in cost, so threads take the next one as they finish
+    // rather than a fixed range each
+    const uint32_t stride = (tileSize + 3) & ~3u;
+    std::atomic<size_t> nextTile{0};
+    const size_t threadCount = options.threadCount == 0 ? DefaultThreadCount() : options.threadCount;
+    ParallelFor(threadCount, threadCount, [&](size_t) {
+        std::vector<float> planes(static_cast<size_t>(stride) * tileSize * 3);
+        float *red = planes.data();
+        float *green = red + static_cast<size_t>(stride) * tileSize;
+        float *blue = green + static_cast<size_t>(stride) * tileSize;
+
+        for (size_t tile = nextTile++; tile < bins.size(); tile = nextTile++) {
+            const uint32_t tileX = static_cast<uint32_t>(tile % tilesX) * tileSize;
+            const uint32_t tileY = static_cast<uint32_t>(tile / tilesX) * tileSize;
+            const uint32_t tileWidth = std::min(tileSize, image.width - tileX);
+            const uint32_t tileHeight = std::min(tileSize, image.height - tileY);
+
+            std::fill(planes.begin(), planes.end(), MAP_CLEAR_COLOR);
+            for (const uint32_t segment : bins[tile]) {
+                RasterizeSegment(segments[segment], tileX, tileY, tileWidth, tileHeight, stride, red, green, blue);
+            }
+
+            for (uint32_t row = 0; row < tileHeight; ++row) {
+                uint8_t *out = image.pixels.data() + (static_cast<size_t>(tileY + row) * image.width + tileX) * 4;
+                const size_t offset = static_cast<size_t>(row) * stride;
+                uint32_t x = 0;
+                for (; x + 4 <= tileWidth; x += 4) {
+                    StorePixels(Float4::Load(red + offset + x), Float4::Load(green + offset + x),
+                                Float4::Load(blue + offset + x), out + 4 * x);
+                }
+                for (; x < tileWidth; ++x) {
+                    out[4 * x] = ToByte(red[offset + x]);
+                    out[4 * x + 1] = ToByte(green[offset + x]);
+                    out[4 * x + 2] = ToByte(blue[offset + x]);
+                    out[4 * x + 3] = 255;
+                }
+            }
+        }
+    });
+
+    if (stats != nullptr) {
+        const auto end = std::chrono::steady_clock::now();
+        stats->segments = visibleSegments;
+        stats->tiles = bins.size();
+        stats->binMilliseconds = std::chrono::duration<double, std::milli>(rasterStart - binStart).count();
+        stats->rasterMilliseconds = std::chrono::duration<double, std::milli>(end - rasterStart).count();
+    }
+    return image;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "geometry_builder.h"
+#include "render_layers.h"
+
+#include <osmium/osm/box.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// CPU counterpart of the OpenGL line renderer, for rendering map images on
+// machines without a GPU. It draws the ChunkedGeometry the canvas uploads
+// the way house_shader does: each segment of a strip becomes a quad of the
+// layer's line width (in clip space, like the geometry shader), blended at
+// MAP_LINE_ALPHA in blended layers and opaque in the others, over the
+// background. Unlike the GL path the edges are antialiased.
+//
+// The image is split into square tiles. Segments are binned into the tiles
+// they touch and the tiles are rasterised in parallel, each into its own
+// float buffer, four pixels at a time with SSE2 or NEON.
+
+// 8-bit RGBA pixels, rows from top to bottom
+struct RasterImage {
+    uint32_t width{0};
+    uint32_t height{0};
+    std::vector<uint8_t> pixels;
+};
+
+struct RasterOptions {
+    uint32_t width{1024};
+    uint32_t height{1024};
+    uint32_t tileSize{64};
+    size_t threadCount{0}; // 0 uses every core
+    // Projection the geometry was built with
+    Projection projection{Projection::Equirectangular};
+};
+
+struct RasterStats {
+    size_t segments{0}; // segments that touch the image
+    size_t tiles{0};
+    double binMilliseconds{0.0};
+    double rasterMilliseconds{0.0};
+
+    // Output pixels per second over binning and rasterisation, in millions
+    double MegapixelsPerSecond(const RasterImage &image) const;
+};
+
+// Render the part of `geometry` inside `view` (lon/lat, projected and
+// stretched over the whole image like the GL viewport) with the line widths
+// of `layerTable`
+RasterImage RasterizeGeometry(const ChunkedGeometry &geometry, const RenderLayerTable &layerTable,
+                              const osmium::Box &view, const RasterOptions &options, RasterStats *stats = nullptr);
@@ -0,0 +1,227 @@
+#include "tag_filter.h"
+#include "osm_loader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+
+namespace {
+
+// Compares accepted values with tag values straight from the osmium buffer
+struct ValueLess {
+    bool operator()(const std::string &a, const char *b) const { return std::strcmp(a.c_str(), b) < 0; }
+    bool operator()(const char *a, const std::string &b) const { return std::strcmp(a, b.c_str()) < 0; }
+};
+
+} // namespace
+
+TagFilter TagFilter::Default() {
+    TagFilter filter;
+    filter.AddMatch(osmium::item_type::relation, TYPE_TAG, BOUNDARY_VALUE);
+    filter.AddMatch(osmium::item_type::relation, BUILDING_TAG, YES_VALUE);
+    filter.AddMatch(osmium::item_type::relation, AREA_TAG, YES_VALUE);
+    filter.AddKeep(osmium::item_type::relation, NAME_TAG);
+    filter.AddKeep(osmium::item_type::relation, TYPE_TAG);
+
+    filter.AddMatch(osmium::item_type::way, HIGHWAY_TAG);
+    filter.AddMatch(osmium::item_type::way, AREA_TAG);
+    filter.AddKeep(osmium::item_type::way, HIGHWAY_TAG);
+    filter.AddKeep(osmium::item_type::way, NAME_TAG);
+    filter.AddKeep(osmium::item_type::way, TYPE_TAG);
+    filter.AddKeep(osmium::item_type::way, ONEWAY_TAG);
+    return filter;
+}
+
+TagFilter TagFilter::Parse(std::istream &input, const std::string &sourceName) {
+    TagFilter filter;
+    std::string line;
+    for (size_t lineNumber = 1; std::getline(input, line); ++lineNumber) {
+        auto fail = [&](const std::string &message) {
+            throw std::runtime_error("tag filter " + sourceName + ":" + std::to_string(lineNumber) + ": " + message);
+        };
+
+        if (const auto comment = line.find('#'); comment != std::string::npos) {
+            line.erase(comment);
+        }
+        std::istringstream words(line);
+        std::string typeName;
+        std::string action;
+        if (!(words >> typeName)) {
+            continue;
+        }
+        if (!(words >> action)) {
+            fail("expected 'match' or 'keep' after '" + typeName + "'");
+        }
+
+        auto type = osmium::item_type::undefined;
+        if (typeName == "node") {
+            // The loader only reads nodes as way members, so their tags never reach the data
+            throw std::invalid_argument("tag filter " + sourceName + ":" + std::to_string(lineNumber) +
+                                        ": node rules are not supported, only ways and relations are filtered");
+        } else if (typeName == "way") {
+            type = osmium::item_type::way;
+        } else if (typeName == "relation") {
+            type = osmium::item_type::relation;
+        } else {
+            fail("unknown object type '" + typeName + "'");
+        }
+        if (action != "match" && action != "keep") {
+            fail("unknown action '" + action + "'");
+        }
+
+        std::string word;
+        size_t count = 0;
+        for (; words >> word; ++count) {
+            if (action == "keep") {
+                filter.AddKeep(type, word);
+                continue;
+            }
+            const auto equals = word.find('=');
+            const std::string key = word.substr(0, equals);
+            std::string value = equals == std::string::npos ? std::string{} : word.substr(equals + 1);
+            if (key.empty()) {
+                fail("empty key in '" + word + "'");
+            }
+            if (value == "*") {
+                value.clear();
+            }
+            filter.AddMatch(type, key, value);
+        }
+        if (count == 0) {
+            fail("expected at least one tag after '" + action + "'");
+        }
+    }
+    return filter;
+}
+
+TagFilter TagFilter::FromFile(const std::string &path) {
+    std::ifstream input(path);
+    if (!input) {
+        throw std::runtime_error("cannot open tag filter " + path);
+    }
+    return Parse(input, path);
+}
+
+void TagFilter::AddMatch(osmium::item_type type, const std::string &key, const std::string &value) {
+    auto *table = GetTable(type);
+    if (table == nullptr) {
+        throw std::invalid_argument("tag filters only apply to ways and relations");
+    }
+    auto &entry = table->FindOrInsert(key);
+    if (value.empty()) {
+        entry.matchAnyValue = true;
+        entry.values.clear();
+    } else if (!entry.matchAnyValue) {
+        const auto it = std::lower_bound(entry.values.begin(), entry.values.end(), value);
+        if (it == entry.values.end() || *it != value) {
+            entry.values.insert(it, value);
+        }
+    }
+}
+
+void TagFilter::AddKeep(osmium::item_type type, const std::string &key) {
+    auto *table = GetTable(type);
+    if (table == nullptr) {
+        throw std::invalid_argument("tag filters only apply to ways and relations");
+    }
+    auto &entry = table->FindOrInsert(key);
+    if (!entry.keep) {
+        entry.keep = true;
+        ++table->keepCount;
+    }
+}
+
+bool TagFilter::Matches(osmium::item_type type, const osmium::TagList &tags) const {
+    const auto *table = GetTable(type);
+    if (table == nullptr) {
+        return false;
+    }
+    for (const auto &tag : tags) {
+        const auto *entry = table->Find(tag.key());
+        if (entry == nullptr) {
+            continue;
+        }
+        if (entry->matchAnyValue) {
+            return true;
+        }
+        if (std::binary_search(entry->values.begin(), entry->values.end(), tag.value(), ValueLess{})) {
+            return true;
+        }
+    }
+    return false;
+}
+
+uint32_t TagFilter::Hash(const char *key, size_t &length) {
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    const char *p = key;
+    for (; *p != '\0'; ++p) {
+        hash = (hash ^ static_cast<unsigned char>(*p)) * 16777619u;
+    }
+    length = static_cast<size_t>(p - key);
+    return hash;
+}
+
+TagFilter::Table *TagFilter::GetTable(osmium::item_type type) {
+    return const_cast<Table *>(static_cast<const TagFilter *>(this)->GetTable(type));
+}
+
+const TagFilter::Table *TagFilter::GetTable(osmium::item_type type) const {
+    switch (type) {
+    case osmium::item_type::way:
+        return &tables_[0];
+    case osmium::item_type::relation:
+        return &tables_[1];
+    default:
+        return nullptr;
+    }
+}
+
+const TagFilter::Entry *TagFilter::Table::Find(const char *key) const {
+    if (slots.empty()) {
+        return nullptr;
+    }
+    size_t length = 0;
+    const uint32_t hash = Hash(key, length);
+    const size_t mask = slots.size() - 1;
+    for (size_t slot = hash & mask;; slot = (slot + 1) & mask) {
+        const int32_t index = slots[slot];
+        if (index < 0) {
+            return nullptr;
+        }
+        const auto &entry = entries[static_cast<size_t>(index)];
+        if (entry.hash == hash && entry.key.size() == length && std::memcmp(entry.key.data(), key, length) == 0) {
+            return &entry;
+        }
+    }
+}
+
+TagFilter::Entry &TagFilter::Table::FindOrInsert(const std::string &key) {
+    if (const auto *entry = Find(key.c_str()); entry != nullptr) {
+        return const_cast<Entry &>(*entry);
+    }
+    size_t length = 0;
+    auto &entry = entries.emplace_back();
+    entry.key = key;
+    entry.hash = Hash(key.c_str(), length);
+    Rehash();
+    return entries.back();
+}
+
+void TagFilter::Table::Rehash() {
+    // Keep the load factor at or below 1/4 so almost every probe hits directly
+    size_t size = 8;
+    while (size < entries.size() * 4) {
+        size *= 2;
+    }
+    slots.assign(size, -1);
+    for (size_t i = 0; i < entries.size(); ++i) {
+        size_t slot = entries[i].hash & (size - 1);
+        while (slots[slot] >= 0) {
+            slot = (slot + 1) & (size - 1);
+        }
+        slots[slot] = static_cast<int32_t>(i);
+    }
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <osmium/osm/item_type.hpp>
+#include <osmium/osm/tag.hpp>
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <vector>
+
+// Decides which objects the loader keeps and which of their tags it copies.
+// Rules are compiled into one open-addressing hash table per object type,
+// keyed by tag key, so testing an object costs one probe per tag and tags
+// that aren't kept are never copied.
+class TagFilter {
+  public:
+    // Relations with type=boundary, building=yes or area=yes and ways with a
+    // highway or area tag; keeps name, type, highway and (on ways) oneway
+    static TagFilter Default();
+
+    // Filter specification, one rule per line:
+    //   # comment
+    //   <way|relation> match <key>[=<value>] ...  keep objects with any of these tags
+    //   <way|relation> keep <key> ...             copy these tags into the loaded data
+    // A match without a value (or with value *) accepts any value. Throws
+    // std::runtime_error naming `sourceName` and the line on errors, and
+    // std::invalid_argument on node rules, which the loader has no use for.
+    static TagFilter Parse(std::istream &input, const std::string &sourceName);
+    static TagFilter FromFile(const std::string &path);
+
+    // An empty value matches any value
+    void AddMatch(osmium::item_type type, const std::string &key, const std::string &value = {});
+    void AddKeep(osmium::item_type type, const std::string &key);
+
+    bool Matches(osmium::item_type type, const osmium::TagList &tags) const;
+
+    // Call `fn(key, value)` for every tag of `tags` that is kept
+    template <typename Fn> void ForEachKeptTag(osmium::item_type type, const osmium::TagList &tags, Fn &&fn) const {
+        const auto *table = GetTable(type);
+        if (table == nullptr || table->keepCount == 0) {
+            return;
+        }
+        for (const auto &tag : tags) {
+            const auto *entry = table->Find(tag.key());
+            if (entry != nullptr && entry->keep) {
+                fn(tag.key(), tag.value());
+            }
+        }
+    }
+
+  private:
+    struct Entry {
+        std::string key;
+        uint32_t hash{0};
+        bool keep{false};
+        bool matchAnyValue{false};
+        std::vector<std::string> values; // sorted; accepted values unless matchAnyValue
+    };
+
+    struct Table {
+        std::vector<Entry> entries;
+        std::vector<int32_t> slots; // entry index or -1, size is a power of two
+        size_t keepCount{0};
+
+        const Entry *Find(const char *key) const;
+        Entry &FindOrInsert(const std::string &key);
+        void Rehash();
+    };
+
+    static uint32_t Hash(const char *key, size_t &length);
+    Table *GetTable(osmium::item_type type);
+    const Table *GetTable(osmium::item_type type) const;
+
+    std::array<Table, 2> tables_; // way, relation
+};
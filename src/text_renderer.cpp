@@ -0,0 +1,397 @@
+#include "text_renderer.h"
+
+#include <shaders.h>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+
+namespace {
+
+// Vertex layout: anchorX, anchorY, offsetX, offsetY, u, v, screenSpace
+constexpr size_t FLOATS_PER_TEXT_VERTEX = 7;
+constexpr size_t VERTICES_PER_GLYPH = 6;
+
+constexpr int ATLAS_WIDTH = 512;
+constexpr int ATLAS_FONT_PIXELS = 32;
+constexpr int GLYPH_PADDING = 6;
+
+// Room reserved after the labels for HUD glyphs so FPS updates never realloc
+constexpr size_t HUD_GLYPH_CAPACITY = 256;
+
+// Labels need this much free path (pixels) on each side
+constexpr double LABEL_MARGIN = 8.0;
+// Maximum bend between neighbouring glyphs before a placement is rejected
+constexpr double MAX_LABEL_BEND = 0.6;
+// Cell size of the label collision grid in pixels
+constexpr double COLLISION_CELL = 128.0;
+
+struct PathPoint {
+    double x;
+    double y;
+};
+
+struct LabelBox {
+    double minX, minY, maxX, maxY;
+
+    bool Overlaps(const LabelBox &other) const {
+        return minX <= other.maxX && other.minX <= maxX && minY <= other.maxY && other.minY <= maxY;
+    }
+};
+
+// Uniform grid of accepted label boxes used to reject overlapping labels
+class LabelCollisionGrid {
+  public:
+    bool TryInsert(const LabelBox &box) {
+        const auto [x0, y0, x1, y1] = CellRange(box);
+        for (int64_t y = y0; y <= y1; ++y) {
+            for (int64_t x = x0; x <= x1; ++x) {
+                if (auto it = cells_.find(Key(x, y)); it != cells_.end()) {
+                    for (auto index : it->second) {
+                        if (boxes_[index].Overlaps(box)) {
+                            return false;
+                        }
+                    }
+                }
+            }
+        }
+
+        const auto index = boxes_.size();
+        boxes_.push_back(box);
+        for (int64_t y = y0; y <= y1; ++y) {
+            for (int64_t x = x0; x <= x1; ++x) {
+                cells_[Key(x, y)].push_back(index);
+            }
+        }
+        return true;
+    }
+
+  private:
+    static int64_t Key(int64_t x, int64_t y) { return (x << 32) ^ (y & 0xFFFFFFFF); }
+
+    static std::array<int64_t, 4> CellRange(const LabelBox &box) {
+        return {static_cast<int64_t>(std::floor(box.minX / COLLISION_CELL)),
+                static_cast<int64_t>(std::floor(box.minY / COLLISION_CELL)),
+                static_cast<int64_t>(std::floor(box.maxX / COLLISION_CELL)),
+                static_cast<int64_t>(std::floor(box.maxY / COLLISION_CELL))};
+    }
+
+    std::vector<LabelBox> boxes_;
+    std::unordered_map<int64_t, std::vector<size_t>> cells_;
+};
+
+} // namespace
+
+void TextRenderer::Initialize() {
+    font_ = std::make_unique<SdfFont>(ATLAS_WIDTH, GLYPH_PADDING);
+
+    wxFont font(wxFontInfo(wxSize(0, ATLAS_FONT_PIXELS)).Family(wxFONTFAMILY_SWISS));
+    wxBitmap measureBitmap(1, 1);
+    wxMemoryDC measureDc(measureBitmap);
+    measureDc.SetFont(font);
+
+    // Printable ASCII and Latin-1, which covers the street names we load
+    auto addGlyphs = [&](uint32_t first, uint32_t last) {
+        for (uint32_t codepoint = first; codepoint <= last; ++codepoint) {
+            const wxString text(wxUniChar(codepoint));
+            wxCoord textWidth = 0;
+            wxCoord textHeight = 0;
+            measureDc.GetTextExtent(text, &textWidth, &textHeight);
+
+            const int width = textWidth + 2 * GLYPH_PADDING;
+            const int height = textHeight + 2 * GLYPH_PADDING;
+            wxBitmap bitmap(width, height, 24);
+            {
+                wxMemoryDC glyphDc(bitmap);
+                glyphDc.SetBackground(*wxBLACK_BRUSH);
+                glyphDc.Clear();
+                glyphDc.SetFont(font);
+                glyphDc.SetTextForeground(*wxWHITE);
+                glyphDc.DrawText(text, GLYPH_PADDING, GLYPH_PADDING);
+            }
+
+            const wxImage image = bitmap.ConvertToImage();
+            const unsigned char *rgb = image.GetData();
+            std::vector<uint8_t> coverage(static_cast<size_t>(width) * height);
+            for (size_t i = 0; i < coverage.size(); ++i) {
+                coverage[i] = rgb[i * 3];
+            }
+            font_->AddGlyph(codepoint, coverage, width, height, static_cast<float>(textWidth));
+        }
+    };
+    addGlyphs(0x20, 0x7E);
+    addGlyphs(0xA0, 0xFF);
+
+    glGenTextures(1, &atlasTexture_);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture_);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, font_->GetAtlasWidth(), font_->GetAtlasHeight(), 0, GL_RED,
+                 GL_UNSIGNED_BYTE, font_->GetAtlasPixels().data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenVertexArrays(1, &VAO_);
+    glBindVertexArray(VAO_);
+    glGenBuffers(1, &VBO_);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_);
+
+    const GLsizei stride = FLOATS_PER_TEXT_VERTEX * sizeof(float);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(0));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(2 * sizeof(float)));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(4 * sizeof(float)));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(3, 1, GL_FLOAT, GL_FALSE, stride, reinterpret_cast<void *>(6 * sizeof(float)));
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+
+    shaderProgram_.vertexShaderSource_ = TextVertexShader;
+    shaderProgram_.fragmentShaderSource_ = TextFragmentShader;
+}
+
+void TextRenderer::Destroy() {
+    glDeleteTextures(1, &atlasTexture_);
+    glDeleteBuffers(1, &VBO_);
+    glDeleteVertexArrays(1, &VAO_);
+    atlasTexture_ = VBO_ = VAO_ = 0;
+}
+
+bool TextRenderer::NeedsLabelUpdate(double pixelsPerLon, double pixelsPerLat) const {
+    return !labelsValid_ || pixelsPerLon != labelPixelsPerLon_ || pixelsPerLat != labelPixelsPerLat_;
+}
+
+void TextRenderer::UpdateLabels(const OSMLoader::Id2Route &routes, Projection projection, double pixelsPerLon,
+                                double pixelsPerLat, float fontSize) {
+    labelVertices_.clear();
+    labelsValid_ = true;
+    labelsUploaded_ = false;
+    labelPixelsPerLon_ = pixelsPerLon;
+    labelPixelsPerLat_ = pixelsPerLat;
+
+    if (!font_ || pixelsPerLon <= 0.0 || pixelsPerLat <= 0.0) {
+        return;
+    }
+
+    const float scale = fontSize / static_cast<float>(font_->GetLineHeight());
+    const float halfHeight = 0.5f * fontSize;
+
+    // Project every named route into pixel space (at the current zoom, no
+    // translation) and label the longest ones first.
+    struct Candidate {
+        const OSMLoader::Route_t *route;
+        std::vector<PathPoint> points;
+        std::vector<double> distances; // cumulative path length at each point
+    };
+    std::vector<Candidate> candidates;
+    for (const auto &[id, route] : routes) {
+        auto it = route.tags.find(NAME_TAG);
+        if (it == route.tags.end() || it->second.empty() || route.nodes.size() < 2) {
+            continue;
+        }
+
+        Candidate candidate{&route, {}, {}};
+        candidate.points.reserve(route.nodes.size());
+        for (const auto &loc : route.nodes) {
+            candidate.points.push_back({loc.lon() * pixelsPerLon, ProjectLat(projection, loc.lat()) * pixelsPerLat});
+        }
+        // Keep text upright by always running left to right
+        if (candidate.points.back().x < candidate.points.front().x) {
+            std::reverse(candidate.points.begin(), candidate.points.end());
+        }
+        candidate.distances.resize(candidate.points.size(), 0.0);
+        for (size_t i = 1; i < candidate.points.size(); ++i) {
+            const double dx = candidate.points[i].x - candidate.points[i - 1].x;
+            const double dy = candidate.points[i].y - candidate.points[i - 1].y;
+            candidate.distances[i] = candidate.distances[i - 1] + std::hypot(dx, dy);
+        }
+        candidates.push_back(std::move(candidate));
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b) {
+        if (a.distances.back() != b.distances.back()) {
+            return a.distances.back() > b.distances.back();
+        }
+        return a.route->id < b.route->id;
+    });
+
+    struct PlacedGlyph {
+        const SdfFont::Glyph *glyph;
+        PathPoint center;
+        double angle;
+    };
+    std::vector<PlacedGlyph> placed;
+    LabelCollisionGrid collisionGrid;
+
+    for (const auto &candidate : candidates) {
+        const auto &name = candidate.route->tags.at(NAME_TAG);
+        const double pathLength = candidate.distances.back();
+        const double textWidth = font_->MeasureText(name) * scale;
+        if (textWidth + 2.0 * LABEL_MARGIN > pathLength) {
+            continue;
+        }
+
+        // Walk the glyphs along the path, centred on its midpoint
+        placed.clear();
+        bool rejected = false;
+        double pen = 0.5 * (pathLength - textWidth);
+        size_t segment = 1;
+        LabelBox box{std::numeric_limits<double>::max(), std::numeric_limits<double>::max(),
+                     std::numeric_limits<double>::lowest(), std::numeric_limits<double>::lowest()};
+
+        for (size_t pos = 0; pos < name.size() && !rejected;) {
+            const auto *glyph = font_->FindGlyph(SdfFont::NextCodepoint(name, pos));
+            if (!glyph) {
+                continue;
+            }
+            const double advance = glyph->advance * scale;
+            const double at = pen + 0.5 * advance;
+            pen += advance;
+
+            while (segment + 1 < candidate.distances.size() && candidate.distances[segment] < at) {
+                ++segment;
+            }
+            const auto &p0 = candidate.points[segment - 1];
+            const auto &p1 = candidate.points[segment];
+            const double segmentLength = candidate.distances[segment] - candidate.distances[segment - 1];
+            const double t = segmentLength > 0.0 ? (at - candidate.distances[segment - 1]) / segmentLength : 0.0;
+            const PathPoint center{p0.x + t * (p1.x - p0.x), p0.y + t * (p1.y - p0.y)};
+            const double angle = std::atan2(p1.y - p0.y, p1.x - p0.x);
+
+            if (!placed.empty()) {
+                const double bend = angle - placed.back().angle;
+                if (std::abs(std::atan2(std::sin(bend), std::cos(bend))) > MAX_LABEL_BEND) {
+                    rejected = true;
+                }
+            }
+            placed.push_back({glyph, center, angle});
+
+            const double extent = std::max(advance, static_cast<double>(fontSize));
+            box.minX = std::min(box.minX, center.x - extent);
+            box.minY = std::min(box.minY, center.y - extent);
+            box.maxX = std::max(box.maxX, center.x + extent);
+            box.maxY = std::max(box.maxY, center.y + extent);
+        }
+
+        if (rejected || placed.empty() || !collisionGrid.TryInsert(box)) {
+            continue;
+        }
+
+        for (const auto &glyph : placed) {
+            const float left = -0.5f * glyph.glyph->advance * scale - GLYPH_PADDING * scale;
+            const float top = -halfHeight - GLYPH_PADDING * scale;
+            AppendGlyphQuad(labelVertices_, *glyph.glyph, static_cast<float>(glyph.center.x / pixelsPerLon),
+                            static_cast<float>(glyph.center.y / pixelsPerLat), left, top, scale,
+                            static_cast<float>(std::cos(glyph.angle)), static_cast<float>(std::sin(glyph.angle)),
+                            false);
+        }
+    }
+}
+
+void TextRenderer::AddHudText(const char *text, float x, float y, float fontSize, const wxSize &viewportSize) {
+    if (!font_) {
+        return;
+    }
+
+    const float scale = fontSize / static_cast<float>(font_->GetLineHeight());
+    const std::string utf8(text);
+    float pen = x;
+    for (size_t pos = 0; pos < utf8.size();) {
+        const auto *glyph = font_->FindGlyph(SdfFont::NextCodepoint(utf8, pos));
+        if (!glyph) {
+            continue;
+        }
+        // HUD anchors are in y-up viewport pixels
+        AppendGlyphQuad(hudVertices_, *glyph, pen, static_cast<float>(viewportSize.y) - y, -GLYPH_PADDING * scale,
+                        -GLYPH_PADDING * scale, scale, 1.0f, 0.0f, true);
+        pen += glyph->advance * scale;
+    }
+}
+
+void TextRenderer::AppendGlyphQuad(std::vector<float> &vertices, const SdfFont::Glyph &glyph, float anchorX,
+                                   float anchorY, float left, float top, float scale, float cosAngle, float sinAngle,
+                                   bool screenSpace) const {
+    const float width = glyph.width * scale;
+    const float height = glyph.height * scale;
+    const float atlasWidth = static_cast<float>(font_->GetAtlasWidth());
+    const float atlasHeight = static_cast<float>(font_->GetAtlasHeight());
+    const float u0 = glyph.atlasX / atlasWidth;
+    const float v0 = glyph.atlasY / atlasHeight;
+    const float u1 = (glyph.atlasX + glyph.width) / atlasWidth;
+    const float v1 = (glyph.atlasY + glyph.height) / atlasHeight;
+
+    // Corner offsets are given y-down (text layout) and emitted y-up, rotated
+    auto emit = [&](float x, float yDown, float u, float v) {
+        const float y = -yDown;
+        vertices.push_back(anchorX);
+        vertices.push_back(anchorY);
+        vertices.push_back(x * cosAngle - y * sinAngle);
+        vertices.push_back(x * sinAngle + y * cosAngle);
+        vertices.push_back(u);
+        vertices.push_back(v);
+        vertices.push_back(screenSpace ? 1.0f : 0.0f);
+    };
+
+    emit(left, top, u0, v0);
+    emit(left + width, top, u1, v0);
+    emit(left, top + height, u0, v1);
+    emit(left + width, top, u1, v0);
+    emit(left + width, top + height, u1, v1);
+    emit(left, top + height, u0, v1);
+}
+
+void TextRenderer::Draw(const float bounds[4], const wxSize &viewportSize) {
+    if (!shaderProgram_.IsReady() || VAO_ == 0) {
+        return;
+    }
+
+    const size_t totalFloats = labelVertices_.size() + hudVertices_.size();
+    if (totalFloats == 0) {
+        return;
+    }
+
+    glBindVertexArray(VAO_);
+    glBindBuffer(GL_ARRAY_BUFFER, VBO_);
+    if (totalFloats > bufferCapacity_) {
+        bufferCapacity_ =
+            labelVertices_.size() + HUD_GLYPH_CAPACITY * VERTICES_PER_GLYPH * FLOATS_PER_TEXT_VERTEX + totalFloats;
+        glBufferData(GL_ARRAY_BUFFER, bufferCapacity_ * sizeof(float), nullptr, GL_DYNAMIC_DRAW);
+        labelsUploaded_ = false;
+    }
+    if (!labelsUploaded_ && !labelVertices_.empty()) {
+        glBufferSubData(GL_ARRAY_BUFFER, 0, labelVertices_.size() * sizeof(float), labelVertices_.data());
+    }
+    labelsUploaded_ = true;
+    if (!hudVertices_.empty()) {
+        glBufferSubData(GL_ARRAY_BUFFER, labelVertices_.size() * sizeof(float), hudVertices_.size() * sizeof(float),
+                        hudVertices_.data());
+    }
+
+    const auto program = shaderProgram_.shaderProgram_.value();
+    glUseProgram(program);
+    if (GLint loc = glGetUniformLocation(program, "uBounds"); loc >= 0) {
+        glUniform4f(loc, bounds[0], bounds[1], bounds[2], bounds[3]);
+    }
+    if (GLint loc = glGetUniformLocation(program, "uViewportSize"); loc >= 0) {
+        glUniform2f(loc, static_cast<float>(viewportSize.x), static_cast<float>(viewportSize.y));
+    }
+    if (GLint loc = glGetUniformLocation(program, "uAtlas"); loc >= 0) {
+        glUniform1i(loc, 0);
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, atlasTexture_);
+
+    glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(totalFloats / FLOATS_PER_TEXT_VERTEX));
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+}
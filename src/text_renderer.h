@@ -0,0 +1,63 @@
+#pragma once
+
+#include <GL/glew.h>
+#include <wx/wx.h>
+
+#include "osm_loader.h"
+#include "projection.h"
+#include "sdf_font.h"
+#include "shaderprogram.h"
+
+#include <memory>
+#include <vector>
+
+// Batched signed-distance-field text for map labels and the HUD. All label
+// and HUD glyphs live in one vertex buffer and are drawn with one call.
+class TextRenderer {
+  public:
+    TextRenderer() = default;
+
+    // Rasterize the glyph atlas with wxWidgets and upload it. Requires a
+    // current GL context. The caller submits GetShaderProgram() for building.
+    void Initialize();
+    void Destroy();
+
+    ShaderProgram &GetShaderProgram() { return shaderProgram_; }
+
+    // Labels are placed in pixel space so they only need recomputing when the
+    // zoom (pixels per projected degree) changes; panning reuses the cached
+    // placement. Anchors are in `projection`, like the line vertices.
+    bool NeedsLabelUpdate(double pixelsPerLon, double pixelsPerLat) const;
+    void UpdateLabels(const OSMLoader::Id2Route &routes, Projection projection, double pixelsPerLon,
+                      double pixelsPerLat, float fontSize);
+    void InvalidateLabels() { labelsValid_ = false; }
+
+    // HUD text is positioned in pixels from the top-left corner of the viewport
+    void ClearHud() { hudVertices_.clear(); }
+    void AddHudText(const char *text, float x, float y, float fontSize, const wxSize &viewportSize);
+
+    // `bounds` is the same projected (minLon, minLat, lonRange, latRange) as the
+    // line shader
+    void Draw(const float bounds[4], const wxSize &viewportSize);
+
+  private:
+    void AppendGlyphQuad(std::vector<float> &vertices, const SdfFont::Glyph &glyph, float anchorX, float anchorY,
+                         float left, float top, float scale, float cosAngle, float sinAngle, bool screenSpace) const;
+
+    std::unique_ptr<SdfFont> font_{};
+    ShaderProgram shaderProgram_{};
+
+    GLuint atlasTexture_{0};
+    GLuint VAO_{0};
+    GLuint VBO_{0};
+    size_t bufferCapacity_{0}; // in floats
+
+    // Label vertices are uploaded once per placement; HUD vertices follow
+    // them in the same buffer and are rewritten every frame.
+    std::vector<float> labelVertices_{};
+    std::vector<float> hudVertices_{};
+    bool labelsValid_{false};
+    bool labelsUploaded_{false};
+    double labelPixelsPerLon_{0.0};
+    double labelPixelsPerLat_{0.0};
+};
@@ -0,0 +1,597 @@
+#include "tile_pyramid.h"
+
+#include "osm_xml_scanner.h"
+#include "parallel.h"
+#include "web_mercator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+namespace {
+
+// File layout, all integers little-endian:
+//   header:  magic[8] version:u32 extent:u32 minZoom:u32 maxZoom:u32
+//            left,bottom,right,top:f64 tileCount:u64 indexOffset:u64
+//   tiles:   encoded tiles, back to back
+//   index:   tileCount x (key:u64 offset:u64 size:u64), sorted by key
+// An encoded tile is a string table (varint count, then varint length and
+// bytes per string) followed by a varint feature count and the features:
+//   zigzag(id - previous id), area:u8, varint tag count, (key, value) string
+//   indices, varint point count, zigzag x/y deltas in grid units
+constexpr char MAGIC[8] = {'O', 'S', 'M', 'T', 'I', 'L', 'E', 'S'};
+constexpr uint32_t VERSION = 1;
+constexpr size_t HEADER_SIZE = 72;
+constexpr size_t INDEX_ENTRY_SIZE = 24;
+// Columns and rows have 28 bits in TileId::Key
+constexpr uint32_t MAX_ZOOM = 24;
+
+void PutFixed(std::string &out, uint64_t value, size_t bytes) {
+    for (size_t i = 0; i < bytes; ++i) {
+        out.push_back(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+uint64_t GetFixed(const uint8_t *p, size_t bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < bytes; ++i) {
+        value |= uint64_t{p[i]} << (8 * i);
+    }
+    return value;
+}
+
+void PutDouble(std::string &out, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    PutFixed(out, bits, sizeof(bits));
+}
+
+double GetDouble(const uint8_t *p) {
+    const uint64_t bits = GetFixed(p, sizeof(uint64_t));
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+void PutVarint(std::string &out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<char>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+uint64_t ZigZag(int64_t value) { return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63); }
+
+int64_t UnZigZag(uint64_t value) { return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1); }
+
+// Bounds-checked reads from one encoded tile
+class TileDecoder {
+  public:
+    TileDecoder(const uint8_t *data, size_t size) : p_(data), end_(data + size) {}
+
+    uint64_t Varint() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            const uint8_t byte = Byte();
+            value |= uint64_t{byte & 0x7Fu} << shift;
+            if ((byte & 0x80) == 0) {
+                return value;
+            }
+        }
+        throw std::runtime_error("corrupt tile: varint too long");
+    }
+
+    uint8_t Byte() {
+        if (p_ == end_) {
+            throw std::runtime_error("corrupt tile: truncated");
+        }
+        return *p_++;
+    }
+
+    std::string String() {
+        const uint64_t length = Varint();
+        if (length > static_cast<uint64_t>(end_ - p_)) {
+            throw std::runtime_error("corrupt tile: truncated string");
+        }
+        std::string value(reinterpret_cast<const char *>(p_), static_cast<size_t>(length));
+        p_ += length;
+        return value;
+    }
+
+  private:
+    const uint8_t *p_;
+    const uint8_t *end_;
+};
+
+struct Point {
+    double x;
+    double y;
+};
+
+// A route or area ring in normalised Web Mercator coordinates
+struct SourceFeature {
+    osmium::object_id_type id{0};
+    bool area{false};
+    std::vector<std::pair<std::string, std::string>> tags;
+    std::vector<Point> points;
+};
+
+// One clipped, simplified and quantized piece of a feature in a tile
+struct Piece {
+    uint64_t tileKey;
+    size_t feature;
+    std::vector<int64_t> coords; // x, y pairs in grid units
+};
+
+SourceFeature MakeSourceFeature(osmium::object_id_type id, bool area, const OSMLoader::Coordinates &nodes,
+                                const OSMLoader::Tags &tags, const std::vector<std::string> &keepTags) {
+    SourceFeature feature;
+    feature.id = id;
+    feature.area = area;
+    for (const auto &key : keepTags) {
+        if (auto it = tags.find(key); it != tags.end()) {
+            feature.tags.emplace_back(it->first, it->second);
+        }
+    }
+    feature.points.reserve(nodes.size());
+    for (const auto &node : nodes) {
+        feature.points.push_back({web_mercator::LonToX(node.lon()), web_mercator::LatToY(node.lat())});
+    }
+    return feature;
+}
+
+// Pieces of the polyline inside the square [lo, hi]^2 (Liang-Barsky per
+// segment). A piece continues as long as consecutive segments stay inside.
+void ClipPolyline(const std::vector<Point> &points, double lo, double hi, std::vector<std::vector<Point>> &pieces) {
+    std::vector<Point> current;
+    auto flush = [&]() {
+        if (current.size() >= 2) {
+            pieces.push_back(std::move(current));
+        }
+        current.clear();
+    };
+
+    for (size_t i = 1; i < points.size(); ++i) {
+        const Point a = points[i - 1];
+        const Point b = points[i];
+        const double dx = b.x - a.x;
+        const double dy = b.y - a.y;
+        double t0 = 0.0;
+        double t1 = 1.0;
+        auto clipEdge = [&](double p, double q) {
+            if (p == 0.0) {
+                return q >= 0.0;
+            }
+            const double r = q / p;
+            if (p < 0.0) {
+                if (r > t1) {
+                    return false;
+                }
+                t0 = std::max(t0, r);
+            } else {
+                if (r < t0) {
+                    return false;
+                }
+                t1 = std::min(t1, r);
+            }
+            return true;
+        };
+        if (!clipEdge(-dx, a.x - lo) || !clipEdge(dx, hi - a.x) || !clipEdge(-dy, a.y - lo) ||
+            !clipEdge(dy, hi - a.y)) {
+            flush();
+            continue;
+        }
+        if (current.empty() || t0 > 0.0) {
+            flush();
+            current.push_back({a.x + t0 * dx, a.y + t0 * dy});
+        }
+        current.push_back({a.x + t1 * dx, a.y + t1 * dy});
+        if (t1 < 1.0) {
+            flush();
+        }
+    }
+    flush();
+}
+
+double SquaredSegmentDistance(const Point &p, const Point &a, const Point &b) {
+    const double dx = b.x - a.x;
+    const double dy = b.y - a.y;
+    const double lengthSquared = dx * dx + dy * dy;
+    double t = lengthSquared > 0.0 ? ((p.x - a.x) * dx + (p.y - a.y) * dy) / lengthSquared : 0.0;
+    t = std::clamp(t, 0.0, 1.0);
+    const double ex = a.x + t * dx - p.x;
+    const double ey = a.y + t * dy - p.y;
+    return ex * ex + ey * ey;
+}
+
+// Douglas-Peucker with an explicit stack
+std::vector<Point> Simplify(const std::vector<Point> &points, double tolerance) {
+    if (points.size() <= 2 || tolerance <= 0.0) {
+        return points;
+    }
+    std::vector<bool> keep(points.size(), false);
+    keep.front() = keep.back() = true;
+    std::vector<std::pair<size_t, size_t>> stack{{0, points.size() - 1}};
+    const double toleranceSquared = tolerance * tolerance;
+    while (!stack.empty()) {
+        const auto [first, last] = stack.back();
+        stack.pop_back();
+        double farthest = toleranceSquared;
+        size_t split = 0;
+        for (size_t i = first + 1; i < last; ++i) {
+            const double distance = SquaredSegmentDistance(points[i], points[first], points[last]);
+            if (distance > farthest) {
+                farthest = distance;
+                split = i;
+            }
+        }
+        if (split != 0) {
+            keep[split] = true;
+            stack.emplace_back(first, split);
+            stack.emplace_back(split, last);
+        }
+    }
+
+    std::vector<Point> simplified;
+    for (size_t i = 0; i < points.size(); ++i) {
+        if (keep[i]) {
+            simplified.push_back(points[i]);
+        }
+    }
+    return simplified;
+}
+
+// Every piece of `feature` at zoom `z`, in tile order
+std::vector<Piece> CutFeature(const SourceFeature &feature, size_t featureIndex, uint32_t z,
+                              const TilePyramidOptions &options) {
+    std::vector<Piece> pieces;
+    const double extent = options.extent;
+    const double scale = std::ldexp(extent, static_cast<int>(z));
+    const double buffer = options.buffer;
+    const auto lastTile = static_cast<int64_t>((uint64_t{1} << z) - 1);
+    auto tileOf = [&](double world, double margin) {
+        return std::clamp(static_cast<int64_t>(std::floor((world * scale + margin) / extent)), int64_t{0}, lastTile);
+    };
+
+    // Only the tiles some segment's box touches, not the whole feature box:
+    // long diagonal roads cross a small fraction of the tiles they span
+    std::vector<std::pair<int64_t, int64_t>> candidates; // (y, x)
+    for (size_t i = 1; i < feature.points.size(); ++i) {
+        const auto &a = feature.points[i - 1];
+        const auto &b = feature.points[i];
+        const int64_t lastY = tileOf(std::max(a.y, b.y), buffer);
+        const int64_t lastX = tileOf(std::max(a.x, b.x), buffer);
+        for (int64_t y = tileOf(std::min(a.y, b.y), -buffer); y <= lastY; ++y) {
+            for (int64_t x = tileOf(std::min(a.x, b.x), -buffer); x <= lastX; ++x) {
+                candidates.emplace_back(y, x);
+            }
+        }
+    }
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+    std::vector<Point> local(feature.points.size());
+    std::vector<std::vector<Point>> clipped;
+    for (const auto &[y, x] : candidates) {
+        for (size_t i = 0; i < local.size(); ++i) {
+            local[i] = {feature.points[i].x * scale - static_cast<double>(x) * extent,
+                        feature.points[i].y * scale - static_cast<double>(y) * extent};
+        }
+        clipped.clear();
+        ClipPolyline(local, -buffer, extent + buffer, clipped);
+
+        const TileId tile{z, static_cast<uint32_t>(x), static_cast<uint32_t>(y)};
+        for (const auto &part : clipped) {
+            Piece piece{tile.Key(), featureIndex, {}};
+            for (const auto &point : Simplify(part, options.tolerance)) {
+                const auto qx = static_cast<int64_t>(std::llround(point.x));
+                const auto qy = static_cast<int64_t>(std::llround(point.y));
+                const size_t n = piece.coords.size();
+                if (n >= 2 && piece.coords[n - 2] == qx && piece.coords[n - 1] == qy) {
+                    continue;
+                }
+                piece.coords.push_back(qx);
+                piece.coords.push_back(qy);
+            }
+            // Features smaller than a grid unit at this zoom disappear
+            if (piece.coords.size() >= 4) {
+                pieces.push_back(std::move(piece));
+            }
+        }
+    }
+    return pieces;
+}
+
+std::string EncodeTile(const std::vector<const Piece *> &pieces, const std::vector<SourceFeature> &features) {
+    std::vector<const std::string *> strings;
+    std::unordered_map<std::string, uint64_t> stringIndex;
+    auto indexOf = [&](const std::string &value) {
+        auto [it, inserted] = stringIndex.emplace(value, strings.size());
+        if (inserted) {
+            strings.push_back(&it->first);
+        }
+        return it->second;
+    };
+
+    std::string body;
+    PutVarint(body, pieces.size());
+    osmium::object_id_type previousId = 0;
+    for (const auto *piece : pieces) {
+        const auto &feature = features[piece->feature];
+        PutVarint(body, ZigZag(feature.id - previousId));
+        previousId = feature.id;
+        body.push_back(feature.area ? 1 : 0);
+        PutVarint(body, feature.tags.size());
+        for (const auto &[key, value] : feature.tags) {
+            PutVarint(body, indexOf(key));
+            PutVarint(body, indexOf(value));
+        }
+        PutVarint(body, piece->coords.size() / 2);
+        int64_t x = 0;
+        int64_t y = 0;
+        for (size_t i = 0; i < piece->coords.size(); i += 2) {
+            PutVarint(body, ZigZag(piece->coords[i] - x));
+            PutVarint(body, ZigZag(piece->coords[i + 1] - y));
+            x = piece->coords[i];
+            y = piece->coords[i + 1];
+        }
+    }
+
+    std::string tile;
+    PutVarint(tile, strings.size());
+    for (const auto *value : strings) {
+        PutVarint(tile, value->size());
+        tile += *value;
+    }
+    return tile + body;
+}
+
+} // namespace
+
+TileRange TilesCovering(const osmium::Box &bounds, uint32_t zoom) {
+    TileRange range;
+    range.z = zoom;
+    if (!bounds.valid() || zoom > MAX_ZOOM) {
+        return range;
+    }
+    const double tiles = std::ldexp(1.0, static_cast<int>(zoom));
+    auto toTile = [tiles](double world) {
+        return static_cast<uint32_t>(std::clamp(std::floor(world * tiles), 0.0, tiles - 1.0));
+    };
+    range.minX = toTile(web_mercator::LonToX(bounds.left()));
+    range.maxX = toTile(web_mercator::LonToX(bounds.right()));
+    // Rows grow southwards
+    range.minY = toTile(web_mercator::LatToY(bounds.top()));
+    range.maxY = toTile(web_mercator::LatToY(bounds.bottom()));
+    return range;
+}
+
+osmium::Box TileBounds(const TileId &tile) {
+    const double tiles = std::ldexp(1.0, static_cast<int>(tile.z));
+    return osmium::Box{web_mercator::XToLon(tile.x / tiles), web_mercator::YToLat((tile.y + 1) / tiles),
+                       web_mercator::XToLon((tile.x + 1) / tiles), web_mercator::YToLat(tile.y / tiles)};
+}
+
+TilePyramidStats WriteTilePyramid(const OSMLoader::OSMData &data, const TilePyramidOptions &options,
+                                  const std::string &path) {
+    if (options.minZoom > options.maxZoom || options.maxZoom > MAX_ZOOM) {
+        throw std::runtime_error("tile pyramid zoom levels must satisfy min <= max <= " + std::to_string(MAX_ZOOM));
+    }
+    if (options.extent == 0) {
+        throw std::runtime_error("tile extent must be positive");
+    }
+
+    // Features in id order, routes first, so tiles come out the same every run
+    std::vector<const OSMLoader::Route_t *> routes;
+    for (const auto &entry : data.first) {
+        routes.push_back(&entry.second);
+    }
+    std::sort(routes.begin(), routes.end(), [](const auto *a, const auto *b) { return a->id < b->id; });
+    std::vector<const OSMLoader::Area_t *> areas;
+    for (const auto &entry : data.second) {
+        areas.push_back(&entry.second);
+    }
+    std::sort(areas.begin(), areas.end(), [](const auto *a, const auto *b) { return a->id < b->id; });
+
+    std::vector<SourceFeature> features;
+    osmium::Box bounds;
+    auto addFeature = [&](osmium::object_id_type id, bool area, const OSMLoader::Coordinates &nodes,
+                          const OSMLoader::Tags &tags) {
+        if (nodes.size() < 2) {
+            return;
+        }
+        for (const auto &node : nodes) {
+            bounds.extend(node);
+        }
+        features.push_back(MakeSourceFeature(id, area, nodes, tags, options.keepTags));
+    };
+    for (const auto *route : routes) {
+        addFeature(route->id, false, route->nodes, route->tags);
+    }
+    for (const auto *area : areas) {
+        for (const auto &ring : area->outerRings) {
+            addFeature(area->id, true, ring, area->tags);
+        }
+    }
+    if (features.empty()) {
+        throw std::runtime_error("no routes or areas to write into " + path);
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) {
+        throw std::runtime_error("cannot write " + path);
+    }
+    out.write(std::string(HEADER_SIZE, '\0').data(), HEADER_SIZE);
+
+    TilePyramidStats stats;
+    std::string index;
+    uint64_t offset = HEADER_SIZE;
+    std::vector<std::vector<Piece>> featurePieces(features.size());
+    for (uint32_t z = options.minZoom; z <= options.maxZoom; ++z) {
+        ParallelFor(features.size(), options.threadCount,
+                    [&](size_t i) { featurePieces[i] = CutFeature(features[i], i, z, options); });
+
+        // Group by tile, keeping feature order within each tile
+        std::map<uint64_t, std::vector<const Piece *>> tiles;
+        for (const auto &pieces : featurePieces) {
+            for (const auto &piece : pieces) {
+                tiles[piece.tileKey].push_back(&piece);
+                stats.vertices += piece.coords.size() / 2;
+            }
+        }
+        std::vector<std::pair<uint64_t, const std::vector<const Piece *> *>> ordered;
+        ordered.reserve(tiles.size());
+        for (const auto &[key, pieces] : tiles) {
+            ordered.emplace_back(key, &pieces);
+            stats.features += pieces.size();
+        }
+
+        std::vector<std::string> encoded(ordered.size());
+        ParallelFor(ordered.size(), options.threadCount,
+                    [&](size_t i) { encoded[i] = EncodeTile(*ordered[i].second, features); });
+        for (size_t i = 0; i < ordered.size(); ++i) {
+            out.write(encoded[i].data(), static_cast<std::streamsize>(encoded[i].size()));
+            PutFixed(index, ordered[i].first, 8);
+            PutFixed(index, offset, 8);
+            PutFixed(index, encoded[i].size(), 8);
+            offset += encoded[i].size();
+        }
+        stats.tiles += ordered.size();
+    }
+    out.write(index.data(), static_cast<std::streamsize>(index.size()));
+
+    std::string header(MAGIC, sizeof(MAGIC));
+    PutFixed(header, VERSION, 4);
+    PutFixed(header, options.extent, 4);
+    PutFixed(header, options.minZoom, 4);
+    PutFixed(header, options.maxZoom, 4);
+    PutDouble(header, bounds.left());
+    PutDouble(header, bounds.bottom());
+    PutDouble(header, bounds.right());
+    PutDouble(header, bounds.top());
+    PutFixed(header, stats.tiles, 8);
+    PutFixed(header, offset, 8);
+    out.seekp(0);
+    out.write(header.data(), static_cast<std::streamsize>(header.size()));
+    out.close();
+    if (!out) {
+        throw std::runtime_error("error writing " + path);
+    }
+    stats.bytes = offset + index.size();
+    return stats;
+}
+
+TilePyramid::TilePyramid(const std::string &path) : file_(std::make_unique<MappedFile>(path)) {
+    const auto *data = reinterpret_cast<const uint8_t *>(file_->data());
+    const size_t size = file_->size();
+    if (size < HEADER_SIZE || std::memcmp(data, MAGIC, sizeof(MAGIC)) != 0) {
+        throw std::runtime_error(path + " is not a tile pyramid");
+    }
+    if (GetFixed(data + 8, 4) != VERSION) {
+        throw std::runtime_error(path + " has an unsupported tile pyramid version");
+    }
+    extent_ = static_cast<uint32_t>(GetFixed(data + 12, 4));
+    minZoom_ = static_cast<uint32_t>(GetFixed(data + 16, 4));
+    maxZoom_ = static_cast<uint32_t>(GetFixed(data + 20, 4));
+    bounds_ = osmium::Box{GetDouble(data + 24), GetDouble(data + 32), GetDouble(data + 40), GetDouble(data + 48)};
+    const uint64_t tileCount = GetFixed(data + 56, 8);
+    const uint64_t indexOffset = GetFixed(data + 64, 8);
+    if (indexOffset > size || tileCount > (size - indexOffset) / INDEX_ENTRY_SIZE || maxZoom_ > MAX_ZOOM) {
+        throw std::runtime_error(path + " is truncated or corrupt");
+    }
+    tileCount_ = static_cast<size_t>(tileCount);
+    index_ = data + indexOffset;
+}
+
+TilePyramid::~TilePyramid() = default;
+
+const uint8_t *TilePyramid::FindTile(const TileId &tile, size_t &size) const {
+    const uint64_t key = tile.Key();
+    size_t lo = 0;
+    size_t hi = tileCount_;
+    while (lo < hi) {
+        const size_t mid = lo + (hi - lo) / 2;
+        if (GetFixed(index_ + mid * INDEX_ENTRY_SIZE, 8) < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == tileCount_ || GetFixed(index_ + lo * INDEX_ENTRY_SIZE, 8) != key) {
+        return nullptr;
+    }
+    const uint64_t offset = GetFixed(index_ + lo * INDEX_ENTRY_SIZE + 8, 8);
+    const uint64_t length = GetFixed(index_ + lo * INDEX_ENTRY_SIZE + 16, 8);
+    if (offset > file_->size() || length > file_->size() - offset) {
+        throw std::runtime_error("corrupt tile pyramid index");
+    }
+    size = static_cast<size_t>(length);
+    return reinterpret_cast<const uint8_t *>(file_->data()) + offset;
+}
+
+bool TilePyramid::HasTile(const TileId &tile) const {
+    size_t size = 0;
+    return FindTile(tile, size) != nullptr;
+}
+
+std::vector<TileFeature> TilePyramid::ReadTile(const TileId &tile) const {
+    std::vector<TileFeature> features;
+    size_t size = 0;
+    const uint8_t *encoded = FindTile(tile, size);
+    if (encoded == nullptr) {
+        return features;
+    }
+
+    TileDecoder decoder(encoded, size);
+    const uint64_t stringCount = decoder.Varint();
+    if (stringCount > size) {
+        throw std::runtime_error("corrupt tile: bad string count");
+    }
+    std::vector<std::string> strings(static_cast<size_t>(stringCount));
+    for (auto &value : strings) {
+        value = decoder.String();
+    }
+    auto string = [&strings](uint64_t i) -> const std::string & {
+        if (i >= strings.size()) {
+            throw std::runtime_error("corrupt tile: bad string index");
+        }
+        return strings[i];
+    };
+
+    const double extent = extent_;
+    const double scale = std::ldexp(extent, static_cast<int>(tile.z));
+    const double originX = static_cast<double>(tile.x) * extent;
+    const double originY = static_cast<double>(tile.y) * extent;
+    const uint64_t featureCount = decoder.Varint();
+    osmium::object_id_type id = 0;
+    for (uint64_t f = 0; f < featureCount; ++f) {
+        auto &feature = features.emplace_back();
+        id += UnZigZag(decoder.Varint());
+        feature.id = id;
+        feature.area = decoder.Byte() != 0;
+        for (uint64_t tagCount = decoder.Varint(); tagCount > 0; --tagCount) {
+            const auto &key = string(decoder.Varint());
+            feature.tags[key] = string(decoder.Varint());
+        }
+        const uint64_t pointCount = decoder.Varint();
+        if (pointCount > size) {
+            throw std::runtime_error("corrupt tile: bad point count");
+        }
+        feature.nodes.reserve(static_cast<size_t>(pointCount));
+        int64_t x = 0;
+        int64_t y = 0;
+        for (uint64_t i = 0; i < pointCount; ++i) {
+            x += UnZigZag(decoder.Varint());
+            y += UnZigZag(decoder.Varint());
+            feature.nodes.emplace_back(web_mercator::XToLon((originX + static_cast<double>(x)) / scale),
+                                       web_mercator::YToLat((originY + static_cast<double>(y)) / scale));
+        }
+    }
+    return features;
+}
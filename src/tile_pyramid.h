@@ -0,0 +1,118 @@
+#pragma once
+
+#include "osm_loader.h"
+
+#include <osmium/osm/box.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+class MappedFile;
+
+// Offline z/x/y tile pyramid of the loader's routes and area outlines. Each
+// tile holds its features clipped to the tile (plus a small buffer),
+// simplified for the zoom level and quantized to an integer grid in Web
+// Mercator tile coordinates, like Mapbox vector tiles. All tiles live in one
+// file: a header, the encoded tiles, and an index sorted by tile so readers
+// can memory-map the file and binary search for the tiles they need.
+
+constexpr auto TILE_PYRAMID_EXTENSION = ".osmtiles";
+
+struct TileId {
+    uint32_t z{0};
+    uint32_t x{0};
+    uint32_t y{0};
+
+    // Sorts by zoom, then column, then row
+    uint64_t Key() const { return (uint64_t{z} << 56) | (uint64_t{x} << 28) | y; }
+};
+
+// Inclusive block of tiles of one zoom level; empty by default
+struct TileRange {
+    uint32_t z{0};
+    uint32_t minX{1};
+    uint32_t minY{1};
+    uint32_t maxX{0};
+    uint32_t maxY{0};
+
+    size_t Count() const {
+        return minX > maxX || minY > maxY ? 0 : size_t{maxX - minX + 1} * size_t{maxY - minY + 1};
+    }
+    bool operator==(const TileRange &other) const {
+        return z == other.z && minX == other.minX && minY == other.minY && maxX == other.maxX && maxY == other.maxY;
+    }
+    bool operator!=(const TileRange &other) const { return !(*this == other); }
+};
+
+// Tiles of `zoom` that intersect `bounds` (clamped to the Mercator world)
+TileRange TilesCovering(const osmium::Box &bounds, uint32_t zoom);
+
+// Lon/lat extent of `tile`
+osmium::Box TileBounds(const TileId &tile);
+
+// A route, or a piece of an area's outer ring, as stored in one tile
+struct TileFeature {
+    osmium::object_id_type id{0};
+    bool area{false};
+    OSMLoader::Coordinates nodes;
+    OSMLoader::Tags tags;
+};
+
+struct TilePyramidOptions {
+    uint32_t minZoom{10};
+    uint32_t maxZoom{16};
+    // Grid resolution of a tile and the margin kept around it, in grid units
+    uint32_t extent{4096};
+    uint32_t buffer{64};
+    // Douglas-Peucker tolerance in grid units
+    double tolerance{2.0};
+    // Tags copied into the tiles; the viewer only needs these to style and label features
+    std::vector<std::string> keepTags{HIGHWAY_TAG, NAME_TAG};
+    size_t threadCount{0};
+};
+
+struct TilePyramidStats {
+    size_t tiles{0};
+    size_t features{0}; // summed over all tiles
+    size_t vertices{0};
+    size_t bytes{0};
+};
+
+// Cut `data` into tiles for every zoom level of `options` and write them to
+// `path`. Throws std::runtime_error if the file cannot be written.
+TilePyramidStats WriteTilePyramid(const OSMLoader::OSMData &data, const TilePyramidOptions &options,
+                                  const std::string &path);
+
+// Read-only view of a tile pyramid file. ReadTile may be called from several
+// threads at once.
+class TilePyramid {
+  public:
+    // Throws std::runtime_error if `path` cannot be mapped or is not a pyramid
+    explicit TilePyramid(const std::string &path);
+    ~TilePyramid();
+
+    uint32_t MinZoom() const { return minZoom_; }
+    uint32_t MaxZoom() const { return maxZoom_; }
+    // Extent of the data the pyramid was built from
+    const osmium::Box &Bounds() const { return bounds_; }
+    size_t TileCount() const { return tileCount_; }
+
+    bool HasTile(const TileId &tile) const;
+    // Decoded features of `tile`; empty if the pyramid has no such tile
+    std::vector<TileFeature> ReadTile(const TileId &tile) const;
+
+  private:
+    // Encoded tile, or nullptr
+    const uint8_t *FindTile(const TileId &tile, size_t &size) const;
+
+    std::unique_ptr<MappedFile> file_;
+    uint32_t extent_{0};
+    uint32_t minZoom_{0};
+    uint32_t maxZoom_{0};
+    osmium::Box bounds_{};
+    size_t tileCount_{0};
+    const uint8_t *index_{nullptr};
+};
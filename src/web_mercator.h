@@ -0,0 +1,25 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// Spherical Web Mercator (EPSG:3857) in normalised world coordinates: x and
+// y in [0, 1], y growing southwards like slippy map tile rows.
+namespace web_mercator {
+
+constexpr double PI = 3.14159265358979323846;
+// Latitude where the projected world becomes square
+constexpr double MAX_LATITUDE = 85.0511287798066;
+
+inline double LonToX(double lon) { return (lon + 180.0) / 360.0; }
+
+inline double LatToY(double lat) {
+    const double sinLat = std::sin(std::clamp(lat, -MAX_LATITUDE, MAX_LATITUDE) * PI / 180.0);
+    return 0.5 - std::log((1.0 + sinLat) / (1.0 - sinLat)) / (4.0 * PI);
+}
+
+inline double XToLon(double x) { return x * 360.0 - 180.0; }
+
+inline double YToLat(double y) { return 90.0 - 360.0 * std::atan(std::exp((y - 0.5) * 2.0 * PI)) / PI; }
+
+} // namespace web_mercator